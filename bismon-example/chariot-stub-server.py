@@ -0,0 +1,65 @@
+#!/usr/bin/python3
+## A local stub of the Bismon REST service, to test the HTTP publication
+## of the gcc8plugin_chariotdemo plugin without Bismon:
+##     ./chariot-stub-server.py --port 8087 --log stub.log &
+##     make chariotdemo-stub-hello
+## It answers every POST with a small JSON object, and prints (and
+## optionally logs) one line per request or per event of a batch.
+## Copyright © 2019 CEA (Commissariat à l'énergie atomique et aux énergies alternatives)
+## GPLv3+ like the plugin, see gcc8plugin-demo-chariot-2019Q2.cc
+
+import sys
+import json
+import argparse
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+class StubHandler(BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+
+    def do_POST(self):
+        length = int(self.headers.get('Content-Length', 0))
+        body = self.rfile.read(length)
+        try:
+            request = json.loads(body.decode('utf-8'))
+        except ValueError as error:
+            self.reply(400, {'error': str(error)})
+            return
+        if self.path.endswith('/chariotbatch'):
+            events = request.get('events', [])
+            lines = ['%s %s %s %s' % (self.path, request.get('translunit'), event.get('rest'),
+                     json.dumps(event.get('data'), sort_keys=True)) for event in events]
+        else:
+            events = [request]
+            lines = ['%s %s' % (self.path, json.dumps(request, sort_keys=True))]
+        for line in lines:
+            print(line)
+        if self.server.log_file is not None:
+            with open(self.server.log_file, 'a') as log:
+                log.write('\n'.join(lines) + '\n')
+        self.reply(200, {'chariotstub': True, 'events': len(events)})
+
+    def reply(self, code, answer):
+        content = (json.dumps(answer) + '\n').encode('utf-8')
+        self.send_response(code)
+        self.send_header('Content-Type', 'application/json')
+        self.send_header('Content-Length', str(len(content)))
+        self.end_headers()
+        self.wfile.write(content)
+
+    def log_message(self, format, *args):
+        if self.server.verbose:
+            sys.stderr.write(format % args + '\n')
+
+parser = argparse.ArgumentParser(description='stub of the Bismon REST service for the CHARIOT plugin')
+parser.add_argument('--port', '-p', type=int, default=8087, help='listened port (default 8087)')
+parser.add_argument('--log', '-l', help='append the received events to this file')
+parser.add_argument('--verbose', '-v', action='store_true', help='print every HTTP request')
+args = parser.parse_args()
+
+server = ThreadingHTTPServer(('localhost', args.port), StubHandler)
+server.log_file = args.log
+server.verbose = args.verbose
+try:
+    server.serve_forever()
+except KeyboardInterrupt:
+    pass
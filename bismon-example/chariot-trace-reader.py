@@ -0,0 +1,114 @@
+#!/usr/bin/python3
+## Reader of the binary traces written by the gcc8plugin_chariotdemo
+## plugin with -fplugin-arg-gcc8plugin_chariotdemo-trace=<file>. It
+## renders one line per function, or aggregates several traces with
+## --summary. The format is described before Chariot_tracer in
+## gcc8plugin-demo-chariot-2019Q2.cc.
+## Copyright © 2019 CEA (Commissariat à l'énergie atomique et aux énergies alternatives)
+## GPLv3+ like the plugin, see gcc8plugin-demo-chariot-2019Q2.cc
+
+import sys
+import struct
+import argparse
+
+TRACE_MAGIC = b'CHARIOTTRACE\0\0\0\0'
+TRACE_HEADER_SIZE = 64
+TRACE_VERSION = 1
+KIND_FUNCTION, KIND_CALLEES, KIND_FRAME = 1, 2, 3
+NO_ID = 0xffffffff
+
+class Function:
+    def __init__(self, name):
+        self.name = name
+        self.bbcount = self.stmtcount = self.nbcalls = self.nbindirect = 0
+        self.callees = []
+        self.static_stack = None
+        self.dynamic_stack = 0
+        self.unbounded = False
+
+def read_trace(file_name):
+    """returns the translation unit and its functions by name"""
+    with open(file_name, 'rb') as trace_file:
+        content = trace_file.read()
+    if len(content) < TRACE_HEADER_SIZE or content[:16] != TRACE_MAGIC:
+        raise ValueError('%s is not a CHARIOT trace' % file_name)
+    order = '<'
+    if struct.unpack_from('<I', content, 16)[0] != TRACE_VERSION:
+        order = '>'
+    (version, record_size, records_number, names_number) = struct.unpack_from(order + '4I', content, 16)
+    (names_offset,) = struct.unpack_from(order + 'Q', content, 32)
+    if version != TRACE_VERSION or record_size != 32 \
+            or TRACE_HEADER_SIZE + records_number*record_size > names_offset or names_offset > len(content):
+        raise ValueError('%s is an unsupported or truncated CHARIOT trace' % file_name)
+    names = content[names_offset:].split(b'\0')[:names_number]
+    if len(names) != names_number:
+        raise ValueError('%s has truncated names' % file_name)
+    names = [name.decode('utf-8', 'replace') for name in names]
+    functions = {}
+    def function_of(funid):
+        name = names[funid] if funid < len(names) else '#%d' % funid
+        if name not in functions:
+            functions[name] = Function(name)
+        return functions[name]
+    for (kind, funid, *data) in struct.iter_unpack(order + '8I',
+            content[TRACE_HEADER_SIZE:TRACE_HEADER_SIZE + records_number*record_size]):
+        function = function_of(funid)
+        if kind == KIND_FUNCTION:
+            (function.bbcount, function.stmtcount, function.nbcalls, function.nbindirect) = data[:4]
+            function.callees = []
+        elif kind == KIND_CALLEES:
+            function.callees += [names[callee] for callee in data if callee != NO_ID and callee < len(names)]
+        elif kind == KIND_FRAME:
+            function.static_stack = None if data[0] == NO_ID else data[0]
+            function.dynamic_stack = data[1]
+            function.unbounded = data[2] != 0
+    return (names[0] if names else '?', functions)
+
+def render(translation_unit, functions, out):
+    out.write('# translation unit %s\n' % translation_unit)
+    for function in functions.values():
+        frame = '?' if function.static_stack is None else '%d+%d%s' % (
+                function.static_stack, function.dynamic_stack, '(unbounded)' if function.unbounded else '')
+        out.write('%s: %d basic blocks, %d statements, %d calls (%d indirect), frame %s%s\n' % (
+                function.name, function.bbcount, function.stmtcount, function.nbcalls,
+                function.nbindirect, frame,
+                ' -> ' + ' '.join(function.callees) if function.callees else ''))
+
+def summarize(traces, top, out):
+    all_functions = [function for (_, functions) in traces for function in functions.values()]
+    called = {}
+    for function in all_functions:
+        for callee in function.callees:
+            called[callee] = called.get(callee, 0) + 1
+    out.write('%d translation units, %d functions, %d basic blocks, %d statements, %d calls (%d indirect)\n' % (
+            len(traces), len(all_functions), sum(f.bbcount for f in all_functions),
+            sum(f.stmtcount for f in all_functions), sum(f.nbcalls for f in all_functions),
+            sum(f.nbindirect for f in all_functions)))
+    out.write('largest functions:\n')
+    for function in sorted(all_functions, key=lambda f: -f.stmtcount)[:top]:
+        out.write('  %8d statements  %s\n' % (function.stmtcount, function.name))
+    out.write('largest frames:\n')
+    for function in sorted(all_functions, key=lambda f: -(f.static_stack or 0) - f.dynamic_stack)[:top]:
+        if function.static_stack is not None:
+            out.write('  %8d bytes  %s%s\n' % (function.static_stack + function.dynamic_stack,
+                    function.name, ' (unbounded)' if function.unbounded else ''))
+    out.write('most called:\n')
+    for (callee, count) in sorted(called.items(), key=lambda item: -item[1])[:top]:
+        out.write('  %8d callers  %s\n' % (count, callee))
+
+parser = argparse.ArgumentParser(description='Render or aggregate the binary traces of the CHARIOT gcc plugin')
+parser.add_argument('traces', nargs='+', help='trace files written with the trace=<file> plugin argument')
+parser.add_argument('--summary', '-s', action='store_true', help='aggregate the traces instead of rendering them')
+parser.add_argument('--top', '-t', type=int, default=10, help='number of entries of each --summary ranking')
+args = parser.parse_args()
+
+try:
+    traces = [read_trace(trace) for trace in args.traces]
+except (OSError, ValueError) as error:
+    sys.stderr.write('%s\n' % error)
+    sys.exit(1)
+if args.summary:
+    summarize(traces, args.top, sys.stdout)
+else:
+    for (translation_unit, functions) in traces:
+        render(translation_unit, functions, sys.stdout)
@@ -24,15 +24,20 @@
 #endif
 
 #include <iostream>
-#include <unordered_map>
-#include <unordered_set>
 #include <map>
 #include <set>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include <cstdio>
 #include <cassert>
 
 #include <unistd.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <math.h>
 
@@ -71,6 +76,14 @@
 #include "plugin-version.h"
 #include "diagnostic.h"
 #include "context.h"
+#include "cgraph.h"
+#include "dumpfile.h"
+#include "tree-cfg.h"
+#include "opts.h"
+#include "md5.h"
+#include "cfgexpand.h"
+#include "lto-streamer.h"
+#include "flags.h"
 
 
 
@@ -84,35 +97,240 @@ const char chariot_plugin_gitid[] = PLUGINGITID;
 ////////////////////////////////////////////////////////////////
 // our global variables
 
-std::unordered_map<tree,function*> chariot_map_decl_to_fun;
+/// The call graph is kept in a compact store: every examined function
+/// gets a dense index into _cgs_funtab, and its callees are a
+/// contiguous row of the single _cgs_edgetab array (compressed sparse
+/// rows).  Both arrays are bump-allocated arenas which only grow, and
+/// _cgs_decltab is an open addressing index from the function
+/// declaration to its dense index.  Nothing here is allocated by the
+/// marking routine, which is a linear walk of the arrays.
 void chariot_ggc_marker_callback(void*,void*);
 
-class Func_chariot_data
+struct Chariot_cgfun
+{
+  tree cgf_decl;
+  function* cgf_func;
+  unsigned cgf_firstedge;	// index of the first callee in _cgs_edgetab
+  unsigned cgf_nbedges;
+  unsigned cgf_nbindirect;	// calls without a known callee
+  long cgf_staticstack;		// -1 until the framesize pass
+  long cgf_dynamicstack;
+  bool cgf_unboundeddynamic;
+};
+
+class Chariot_callgraph_store
 {
   friend void chariot_ggc_marker_callback(void*,void*);
-  int _chfun_rank;
-  function* _chfun_func;
-  std::unordered_set<tree> _chfun_calleeset;
-  static int _chfun_count;
+  Chariot_cgfun* _cgs_funtab;
+  unsigned _cgs_nbfun;
+  unsigned _cgs_funsize;
+  tree* _cgs_edgetab;
+  unsigned _cgs_nbedges;
+  unsigned _cgs_edgesize;
+  unsigned* _cgs_decltab;	// dense index + 1, or 0 for an empty slot
+  unsigned _cgs_declsize;	// a power of two
+  unsigned _cgs_curix;		// the function whose row is being filled
+  static unsigned hash_decl(tree decl)
+  {
+    uintptr_t ad = (uintptr_t) decl;
+    return (unsigned) ((ad >> 4) ^ (ad >> 17));
+  };
+  void grow_decltab(void);
 public:
-  Func_chariot_data(function*curfun):
-    _chfun_rank (++_chfun_count),
-    _chfun_func(curfun),
-    _chfun_calleeset()
+  Chariot_callgraph_store():
+    _cgs_funtab(nullptr), _cgs_nbfun(0), _cgs_funsize(0),
+    _cgs_edgetab(nullptr), _cgs_nbedges(0), _cgs_edgesize(0),
+    _cgs_decltab(nullptr), _cgs_declsize(0), _cgs_curix(0)
+  {
+  };
+  ~Chariot_callgraph_store()
+  {
+    free (_cgs_funtab);
+    free (_cgs_edgetab);
+    free (_cgs_decltab);
+  };
+  Chariot_callgraph_store(const Chariot_callgraph_store&) = delete;
+  Chariot_callgraph_store& operator = (const Chariot_callgraph_store&) = delete;
+  unsigned nb_functions(void) const
+  {
+    return _cgs_nbfun;
+  };
+  const Chariot_cgfun& function_at(unsigned ix) const
   {
-    assert (curfun != nullptr);
+    assert (ix < _cgs_nbfun);
+    return _cgs_funtab[ix];
   };
-  ~Func_chariot_data()
+  tree callee_at(const Chariot_cgfun& cgf, unsigned rk) const
   {
-    _chfun_func=nullptr;
-    _chfun_rank=0;
+    assert (rk < cgf.cgf_nbedges);
+    return _cgs_edgetab[cgf.cgf_firstedge + rk];
   };
-  Func_chariot_data(const Func_chariot_data&) = default;
-  Func_chariot_data(Func_chariot_data&&) = default;
+  const tree* callees_of(const Chariot_cgfun& cgf) const
+  {
+    return _cgs_edgetab + cgf.cgf_firstedge;
+  };
+  /// dense index of a function declaration, or -1 if it was not examined
+  int find_function(tree decl) const;
+  /// start the callee row of a function at the end of the edge arena
+  unsigned start_function(function* fun);
+  /// add a callee to the row of the function started last
+  void add_callee(tree callee);
+  /// sort the row of the function started last and remove its duplicates
+  void finish_function(void);
+  void add_indirect_call(void)
+  {
+    assert (_cgs_nbfun > 0);
+    _cgs_funtab[_cgs_curix].cgf_nbindirect++;
+  };
+  /// record the frame size computed by the prologue of a function
+  void record_frame(function* fun, long staticsize, long dynamicsize, bool unbounded);
+  /// write the per translation unit summary read by chariot_stackdepth.exe
+  bool write_summary(FILE* fil, const char* translunit) const;
 };
 
-int Func_chariot_data::_chfun_count;
-std::unordered_map<function*,Func_chariot_data> chariot_map_func_to_data;
+void
+Chariot_callgraph_store::grow_decltab(void)
+{
+  unsigned newsize = _cgs_declsize ? 2*_cgs_declsize : 256;
+  unsigned* newtab = (unsigned*) xcalloc(newsize, sizeof(unsigned));
+  for (unsigned ix = 0; ix < _cgs_nbfun; ix++)
+    {
+      unsigned h = hash_decl(_cgs_funtab[ix].cgf_decl) & (newsize-1);
+      while (newtab[h] != 0)
+        h = (h+1) & (newsize-1);
+      newtab[h] = ix+1;
+    }
+  free (_cgs_decltab);
+  _cgs_decltab = newtab;
+  _cgs_declsize = newsize;
+} // end Chariot_callgraph_store::grow_decltab
+
+int
+Chariot_callgraph_store::find_function(tree decl) const
+{
+  if (!_cgs_declsize)
+    return -1;
+  for (unsigned h = hash_decl(decl) & (_cgs_declsize-1);
+       _cgs_decltab[h] != 0;
+       h = (h+1) & (_cgs_declsize-1))
+    if (_cgs_funtab[_cgs_decltab[h]-1].cgf_decl == decl)
+      return (int) _cgs_decltab[h]-1;
+  return -1;
+} // end Chariot_callgraph_store::find_function
+
+unsigned
+Chariot_callgraph_store::start_function(function* fun)
+{
+  assert (fun != nullptr);
+  int oldix = find_function(fun->decl);
+  if (oldix >= 0)
+    {
+      // examined again: its new row replaces the old one, left unused
+      Chariot_cgfun& cgf = _cgs_funtab[oldix];
+      cgf.cgf_func = fun;
+      cgf.cgf_firstedge = _cgs_nbedges;
+      cgf.cgf_nbedges = 0;
+      cgf.cgf_nbindirect = 0;
+      _cgs_curix = oldix;
+      return oldix;
+    }
+  if (_cgs_nbfun == _cgs_funsize)
+    {
+      _cgs_funsize = _cgs_funsize ? 2*_cgs_funsize : 64;
+      _cgs_funtab = (Chariot_cgfun*) xrealloc(_cgs_funtab, _cgs_funsize*sizeof(Chariot_cgfun));
+    }
+  if (2*(_cgs_nbfun+1) > _cgs_declsize)
+    grow_decltab();
+  unsigned ix = _cgs_nbfun++;
+  _cgs_funtab[ix] = { fun->decl, fun, _cgs_nbedges, 0, 0, -1, 0, false };
+  _cgs_curix = ix;
+  unsigned h = hash_decl(fun->decl) & (_cgs_declsize-1);
+  while (_cgs_decltab[h] != 0)
+    h = (h+1) & (_cgs_declsize-1);
+  _cgs_decltab[h] = ix+1;
+  return ix;
+} // end Chariot_callgraph_store::start_function
+
+void
+Chariot_callgraph_store::add_callee(tree callee)
+{
+  assert (_cgs_nbfun > 0);
+  if (_cgs_nbedges == _cgs_edgesize)
+    {
+      _cgs_edgesize = _cgs_edgesize ? 2*_cgs_edgesize : 256;
+      _cgs_edgetab = (tree*) xrealloc(_cgs_edgetab, _cgs_edgesize*sizeof(tree));
+    }
+  _cgs_edgetab[_cgs_nbedges++] = callee;
+  _cgs_funtab[_cgs_curix].cgf_nbedges++;
+} // end Chariot_callgraph_store::add_callee
+
+void
+Chariot_callgraph_store::finish_function(void)
+{
+  assert (_cgs_nbfun > 0);
+  Chariot_cgfun& cgf = _cgs_funtab[_cgs_curix];
+  assert (cgf.cgf_firstedge + cgf.cgf_nbedges == _cgs_nbedges);
+  tree* row = _cgs_edgetab + cgf.cgf_firstedge;
+  std::sort(row, row + cgf.cgf_nbedges);
+  unsigned nbedges = std::unique(row, row + cgf.cgf_nbedges) - row;
+  _cgs_nbedges -= cgf.cgf_nbedges - nbedges;
+  cgf.cgf_nbedges = nbedges;
+} // end Chariot_callgraph_store::finish_function
+
+void
+Chariot_callgraph_store::record_frame(function* fun, long staticsize, long dynamicsize,
+                                      bool unbounded)
+{
+  int ix = find_function(fun->decl);
+  if (ix < 0)
+    {
+      // not seen by the callgraph pass: no known callee
+      ix = start_function(fun);
+      finish_function();
+    }
+  Chariot_cgfun& cgf = _cgs_funtab[ix];
+  cgf.cgf_staticstack = staticsize;
+  cgf.cgf_dynamicstack = dynamicsize;
+  cgf.cgf_unboundeddynamic = unbounded;
+} // end Chariot_callgraph_store::record_frame
+
+/// the name of a function in the summary: its assembler name, prefixed
+/// by the translation unit when it is not public
+static void
+chariot_print_summary_name(FILE* fil, tree decl, const char* translunit)
+{
+  if (!TREE_PUBLIC(decl))
+    fprintf(fil, "%s:", translunit);
+  fputs(IDENTIFIER_POINTER(DECL_ASSEMBLER_NAME(decl)), fil);
+} // end chariot_print_summary_name
+
+/// The summary is a text file, one record per line:
+///   F <name> <static stack> <dynamic stack> <unbounded dynamic 0|1> <indirect calls>
+/// followed by one line per callee of this function:
+///   C <name>
+/// a static stack of -1 means that the frame size is unknown (no -fstack-usage)
+bool
+Chariot_callgraph_store::write_summary(FILE* fil, const char* translunit) const
+{
+  fprintf(fil, "# CHARIOT callgraph summary 1 of %s\n", translunit);
+  for (unsigned ix = 0; ix < _cgs_nbfun; ix++)
+    {
+      const Chariot_cgfun& cgf = _cgs_funtab[ix];
+      fputs("F ", fil);
+      chariot_print_summary_name(fil, cgf.cgf_decl, translunit);
+      fprintf(fil, " %ld %ld %d %u\n", cgf.cgf_staticstack, cgf.cgf_dynamicstack,
+              (int) cgf.cgf_unboundeddynamic, cgf.cgf_nbindirect);
+      for (unsigned rk = 0; rk < cgf.cgf_nbedges; rk++)
+        {
+          fputs("C ", fil);
+          chariot_print_summary_name(fil, callee_at(cgf, rk), translunit);
+          fputc('\n', fil);
+        }
+    }
+  return !ferror(fil);
+} // end Chariot_callgraph_store::write_summary
+
+Chariot_callgraph_store chariot_callgraph;
 
 std::string chariot_bismoncookiestr;
 
@@ -122,6 +340,9 @@ std::string chariot_bismonprojectstr;
 
 std::string chariot_translationunitstr;
 
+// the per translation unit call graph summary, by default <translationunit>.chariotcg
+std::string chariot_summarystr;
+
 bool chariot_show_http;
 
 bool chariot_faking;
@@ -130,30 +351,484 @@ CURL* chariot_curl;
 
 int chariot_timeout_millisec = 1600;
 
+// group the REST events in posts to restchariot2q19/chariotbatch, for a Bismon with that handler
+bool chariot_batching;
+
+// when not empty, the REST batches are written there to be published once per build
+std::string chariot_spooldirstr;
+
 ////////////////////////////////////////////////////////////////
-/// the marking routine
-void chariot_ggc_marker_callback(void*,void*)
+/// Asynchronous and batched publication of the REST events, with the
+/// batch or spooldir arguments; otherwise each event is posted at once
+/// to its own URL.  The compiler thread only appends an event to a
+/// bounded queue.  A
+/// sender thread groups the queued events into one POST to
+/// restchariot2q19/chariotbatch and keeps a few of them in flight on a
+/// curl multi handle, which reuses the connection and multiplexes the
+/// requests with HTTP/2.  With a spool directory, the batches of every
+/// translation unit are written there instead, to be published once
+/// per build.  GCC diagnostics are not thread safe, so the sender only
+/// counts its failures; flush reports them at PLUGIN_FINISH_UNIT, or
+/// at PLUGIN_FINISH when GCC skips the former (-fsyntax-only, errors,
+/// LTO whole program analysis).  The destructor still joins the thread
+/// when GCC exits on a fatal error.
+#define CHARIOT_REST_QUEUE_MAX 256
+#define CHARIOT_REST_BATCH_MAX 64
+#define CHARIOT_REST_INFLIGHT 4
+
+class Chariot_rest_sender
 {
-  for (auto it : chariot_map_decl_to_fun)
+  std::mutex _rs_mutex;
+  std::condition_variable _rs_cond;	// new events or stop request
+  std::condition_variable _rs_roomcond;	// room in the queue
+  std::deque<Json::Value> _rs_queue;
+  std::thread _rs_thread;
+  bool _rs_started;
+  bool _rs_stopping;
+  long _rs_nbevents;
+  // only changed by the sender thread, read by flush after the join
+  long _rs_nbbatches;
+  long _rs_nbfailed;
+  long _rs_sequence;		// never reset, names the spooled batches
+  long _rs_nbbytes;		// never reset, size of the batch bodies
+  std::string _rs_lasterror;
+  struct Transfer
+  {
+    CURL* tr_easy;
+    struct curl_slist* tr_headers;
+    std::string tr_body;
+    char tr_errbuf[CURL_ERROR_SIZE];
+  };
+  static size_t discard_response(char*, size_t size, size_t nmemb, void*)
+  {
+    return size*nmemb;
+  };
+  std::string batch_body(std::vector<Json::Value>& events) const;
+  bool spool_batch(const std::string& body);
+  Transfer* start_transfer(CURLM* multi, std::string&& body);
+  void sender_loop(void);
+  void stop(void);
+public:
+  Chariot_rest_sender():
+    _rs_started(false), _rs_stopping(false), _rs_nbevents(0),
+    _rs_nbbatches(0), _rs_nbfailed(0), _rs_sequence(0), _rs_nbbytes(0)
+  {
+  };
+  ~Chariot_rest_sender()
+  {
+    stop();
+  };
+  Chariot_rest_sender(const Chariot_rest_sender&) = delete;
+  Chariot_rest_sender& operator = (const Chariot_rest_sender&) = delete;
+  /// queue an event for restchariot2q19/<urlsuffix>, waits when the queue is full
+  void enqueue(const char* urlsuffix, const Json::Value* jevent);
+  /// publish the queued events, stop the sender and report its failures
+  void flush(void);
+  /// bytes of the published or spooled batches, meaningful after flush
+  long nb_bytes(void) const
+  {
+    return _rs_nbbytes;
+  };
+};
+
+Chariot_rest_sender chariot_rest_sender;
+
+
+////////////////////////////////////////////////////////////////
+/// Binary trace of the plugin, with the trace=<file> argument: fixed
+/// size records written through a large stdio buffer replace the
+/// diagnostics issued for every statement, so that a build only pays
+/// for the data.  chariot-trace-reader.py renders and aggregates it.
+/// The file, in host byte order, is a header of
+/// CHARIOT_TRACE_HEADER_SIZE bytes: "CHARIOTTRACE\0\0\0\0", then the
+/// version, the record size, the number of records and of names as
+/// 32 bits integers and the 64 bits offset of the names; then the
+/// records; then the names, each ended by a null byte.  A function id
+/// is the rank of its name, the name 0 being the translation unit.
+#define CHARIOT_TRACE_VERSION 1
+#define CHARIOT_TRACE_HEADER_SIZE 64
+#define CHARIOT_TRACE_BUFFER_SIZE (1 << 20)
+#define CHARIOT_TRACE_NBDATA 6
+
+enum Chariot_trace_kind
+{
+  CTK_Function = 1,		// bbcount stmtcount nbcalls nbindirect nbcallees
+  CTK_Callees = 2,		// up to CHARIOT_TRACE_NBDATA callee ids, ~0U for none
+  CTK_Frame = 3			// static stack (~0U if unknown), dynamic stack, unbounded
+};
+
+struct Chariot_trace_record
+{
+  uint32_t ctr_kind;
+  uint32_t ctr_funid;
+  uint32_t ctr_data[CHARIOT_TRACE_NBDATA];
+};
+
+class Chariot_tracer
+{
+  FILE* _tr_file;
+  char* _tr_buffer;
+  uint32_t _tr_nbrecords;
+  std::vector<std::string> _tr_names;
+  std::map<tree, uint32_t> _tr_ids;
+  void write_record(const Chariot_trace_record& rec)
+  {
+    if (fwrite(&rec, sizeof(rec), 1, _tr_file) == 1)
+      _tr_nbrecords++;
+  };
+public:
+  Chariot_tracer(): _tr_file(nullptr), _tr_buffer(nullptr), _tr_nbrecords(0) {};
+  Chariot_tracer(const Chariot_tracer&) = delete;
+  Chariot_tracer& operator = (const Chariot_tracer&) = delete;
+  bool active(void) const
+  {
+    return _tr_file != nullptr;
+  };
+  bool open(const char* path, const char* translunit);
+  uint32_t id_of(tree decl);
+  void trace_function(tree decl, int bbcount, int stmtcount, int nbcalls, unsigned nbindirect,
+                      const tree* callees, unsigned nbcallees);
+  void trace_frame(tree decl, long staticsize, long dynamicsize, bool unbounded);
+  /// write the names and the final header, false on a write error
+  bool close(void);
+};
+
+Chariot_tracer chariot_tracer;
+
+// the binary trace file given by the trace=<file> argument
+std::string chariot_tracestr;
+
+// the function cache directory given by the cachedir=<dir> argument
+std::string chariot_cachedirstr;
+
+bool
+Chariot_tracer::open(const char* path, const char* translunit)
+{
+  static_assert(sizeof(Chariot_trace_record) == 32, "Chariot_trace_record should have 32 bytes");
+  _tr_file = fopen(path, "wb");
+  if (!_tr_file)
+    return false;
+  _tr_buffer = (char*) xmalloc(CHARIOT_TRACE_BUFFER_SIZE);
+  setvbuf(_tr_file, _tr_buffer, _IOFBF, CHARIOT_TRACE_BUFFER_SIZE);
+  char header[CHARIOT_TRACE_HEADER_SIZE];
+  memset (header, 0, sizeof(header)); // rewritten by close
+  fwrite(header, sizeof(header), 1, _tr_file);
+  _tr_names.push_back(translunit);
+  return true;
+} // end Chariot_tracer::open
+
+uint32_t
+Chariot_tracer::id_of(tree decl)
+{
+  auto it = _tr_ids.find(decl);
+  if (it != _tr_ids.end())
+    return it->second;
+  uint32_t id = _tr_names.size();
+  tree name = DECL_P(decl) ? DECL_ASSEMBLER_NAME(decl) : NULL_TREE;
+  _tr_names.push_back(name ? IDENTIFIER_POINTER(name) : "?");
+  _tr_ids[decl] = id;
+  return id;
+} // end Chariot_tracer::id_of
+
+void
+Chariot_tracer::trace_function(tree decl, int bbcount, int stmtcount, int nbcalls,
+                               unsigned nbindirect, const tree* callees, unsigned nbcallees)
+{
+  Chariot_trace_record rec;
+  memset (&rec, 0, sizeof(rec));
+  rec.ctr_kind = CTK_Function;
+  rec.ctr_funid = id_of(decl);
+  rec.ctr_data[0] = bbcount;
+  rec.ctr_data[1] = stmtcount;
+  rec.ctr_data[2] = nbcalls;
+  rec.ctr_data[3] = nbindirect;
+  rec.ctr_data[4] = nbcallees;
+  write_record(rec);
+  for (unsigned first = 0; first < nbcallees; first += CHARIOT_TRACE_NBDATA)
     {
-      tree tr = it.first;
-      function* fun = it.second;
-      ggc_mark(tr);
-      ggc_mark(fun);
+      rec.ctr_kind = CTK_Callees;
+      for (unsigned rk = 0; rk < CHARIOT_TRACE_NBDATA; rk++)
+        rec.ctr_data[rk] = first + rk < nbcallees ? id_of(callees[first + rk]) : ~0U;
+      write_record(rec);
     }
-  for (auto itd : chariot_map_func_to_data)
+} // end Chariot_tracer::trace_function
+
+void
+Chariot_tracer::trace_frame(tree decl, long staticsize, long dynamicsize, bool unbounded)
+{
+  Chariot_trace_record rec;
+  memset (&rec, 0, sizeof(rec));
+  rec.ctr_kind = CTK_Frame;
+  rec.ctr_funid = id_of(decl);
+  rec.ctr_data[0] = staticsize < 0 ? ~0U : (uint32_t) staticsize;
+  rec.ctr_data[1] = (uint32_t) dynamicsize;
+  rec.ctr_data[2] = unbounded;
+  write_record(rec);
+} // end Chariot_tracer::trace_frame
+
+bool
+Chariot_tracer::close(void)
+{
+  if (!_tr_file)
+    return true;
+  uint64_t namesoff = CHARIOT_TRACE_HEADER_SIZE + (uint64_t) _tr_nbrecords*sizeof(Chariot_trace_record);
+  for (const std::string& name : _tr_names)
+    fwrite(name.c_str(), name.size() + 1, 1, _tr_file);
+  char header[CHARIOT_TRACE_HEADER_SIZE];
+  memset (header, 0, sizeof(header));
+  memcpy(header, "CHARIOTTRACE", 12);
+  uint32_t fields[4] = { CHARIOT_TRACE_VERSION, (uint32_t) sizeof(Chariot_trace_record),
+                         _tr_nbrecords, (uint32_t) _tr_names.size()
+                       };
+  memcpy(header + 16, fields, sizeof(fields));
+  memcpy(header + 32, &namesoff, sizeof(namesoff));
+  bool ok = fseek(_tr_file, 0, SEEK_SET) == 0
+            && fwrite(header, sizeof(header), 1, _tr_file) == 1;
+  ok = !ferror(_tr_file) && ok;
+  ok = fclose(_tr_file) == 0 && ok;
+  free (_tr_buffer);
+  _tr_file = nullptr;
+  _tr_buffer = nullptr;
+  return ok;
+} // end Chariot_tracer::close
+
+
+////////////////////////////////////////////////////////////////
+/// Incremental analysis, with the cachedir=<dir> argument.  The
+/// callgraph pass runs after the inlining, so the GIMPLE body it sees
+/// and the compilation flags determine its results.  Their MD5
+/// fingerprint names a cache entry, shared by every translation unit
+/// and build which use the same directory: for an unchanged function,
+/// the pass reloads the entry instead of examining its statements,
+/// and its REST event, already published, is not sent again.  The
+/// frame sizes are still recorded by the framesize pass, which costs
+/// nothing since GCC computes them anyway.  An entry is a text file
+/// <dir>/<xx>/<fingerprint>.chariotfn, written then renamed so that
+/// parallel compilations can share it:
+///   # CHARIOT function cache 1
+///   B <basic blocks> <statements> <calls> <indirect calls>
+/// followed by one line per callee, given by its assembler name:
+///   C <name>
+/// An entry whose callees are not all known in the current
+/// translation unit is a miss.
+#define CHARIOT_CACHE_HEADER "# CHARIOT function cache 1"
+
+class Chariot_function_cache
+{
+  std::string _fc_dir;
+  unsigned char _fc_flags[16];	// fingerprint of the compiler and its flags
+  unsigned _fc_nbhits;
+  unsigned _fc_nbmisses;
+  unsigned _fc_nbstored;
+  std::string entry_path(const unsigned char digest[16], bool makedir) const;
+public:
+  Chariot_function_cache(): _fc_nbhits(0), _fc_nbmisses(0), _fc_nbstored(0)
+  {
+    memset(_fc_flags, 0, sizeof(_fc_flags));
+  };
+  Chariot_function_cache(const Chariot_function_cache&) = delete;
+  Chariot_function_cache& operator = (const Chariot_function_cache&) = delete;
+  bool active(void) const
+  {
+    return !_fc_dir.empty();
+  };
+  /// use the cache directory dir, created if needed
+  bool open(const char* dir);
+  /// the fingerprint of the current GIMPLE body of fun, false if unavailable
+  bool fingerprint(unsigned char digest[16], function* fun) const;
+  /// start, fill and finish the row of fun in chariot_callgraph from its
+  /// entry and give its counts, false on a miss
+  bool load(const unsigned char digest[16], function* fun,
+            int* bbcount, int* stmtcount, int* nbcalls);
+  void store(const unsigned char digest[16], const Chariot_cgfun& cgf,
+             int bbcount, int stmtcount, int nbcalls);
+  unsigned nb_hits(void) const
+  {
+    return _fc_nbhits;
+  };
+  unsigned nb_misses(void) const
+  {
+    return _fc_nbmisses;
+  };
+  unsigned nb_stored(void) const
+  {
+    return _fc_nbstored;
+  };
+};
+
+Chariot_function_cache chariot_function_cache;
+
+bool
+Chariot_function_cache::open(const char* dir)
+{
+  if (mkdir(dir, 0777) && errno != EEXIST)
+    return false;
+  _fc_dir = dir;
+  // the output and dump files, the dependencies and the plugin
+  // arguments do not change the generated code
+  struct md5_ctx ctx;
+  md5_init_ctx(&ctx);
+  const char* versions[] =
+  {
+    gcc_version.basever, gcc_version.datestamp, gcc_version.devphase,
+    gcc_version.revision, gcc_version.configuration_arguments
+  };
+  for (const char* vers : versions)
+    md5_process_bytes(vers, strlen(vers)+1, &ctx);
+  for (unsigned ix = 0; ix < save_decoded_options_count; ix++)
     {
-      function* fun = itd.first;
-      Func_chariot_data* cda = &itd.second;
-      ggc_mark(fun);
-      ggc_mark(cda->_chfun_func);
-      assert (fun == cda->_chfun_func);
-      for (auto itc : cda->_chfun_calleeset)
+      const struct cl_decoded_option& opt = save_decoded_options[ix];
+      switch (opt.opt_index)
         {
-          tree tr = itc;
-          ggc_mark(tr);
+        case OPT_SPECIAL_program_name:
+        case OPT_SPECIAL_input_file:
+        case OPT_o:
+        case OPT_dumpbase:
+        case OPT_auxbase:
+        case OPT_auxbase_strip:
+        case OPT_MD:
+        case OPT_MMD:
+        case OPT_MF:
+        case OPT_MQ:
+        case OPT_MT:
+        case OPT_fplugin_:
+        case OPT_fplugin_arg_:
+          continue;
+        default:
+          break;
         }
+      const char* text = opt.orig_option_with_args_text;
+      md5_process_bytes(text, strlen(text)+1, &ctx);
+    }
+  md5_finish_ctx(&ctx, _fc_flags);
+  return true;
+} // end Chariot_function_cache::open
+
+std::string
+Chariot_function_cache::entry_path(const unsigned char digest[16], bool makedir) const
+{
+  char hexbuf[2*16+1];
+  for (int ix = 0; ix < 16; ix++)
+    snprintf(hexbuf + 2*ix, 3, "%02x", digest[ix]);
+  std::string path = _fc_dir + "/" + std::string(hexbuf, 2);
+  if (makedir)
+    mkdir(path.c_str(), 0777);
+  return path + "/" + hexbuf + ".chariotfn";
+} // end Chariot_function_cache::entry_path
+
+bool
+Chariot_function_cache::fingerprint(unsigned char digest[16], function* fun) const
+{
+  // without the uids, the dump does not change with the other
+  // declarations of the translation unit
+  char* dumpbuf = nullptr;
+  size_t dumpsiz = 0;
+  FILE* dumpfil = open_memstream(&dumpbuf, &dumpsiz);
+  if (!dumpfil)
+    return false;
+  dump_function_to_file(fun->decl, dumpfil, TDF_NOUID);
+  if (fclose(dumpfil))
+    {
+      free(dumpbuf);
+      return false;
     }
+  struct md5_ctx ctx;
+  md5_init_ctx(&ctx);
+  md5_process_bytes(_fc_flags, sizeof(_fc_flags), &ctx);
+  const char* asmname = IDENTIFIER_POINTER(DECL_ASSEMBLER_NAME(fun->decl));
+  md5_process_bytes(asmname, strlen(asmname)+1, &ctx);
+  md5_process_bytes(dumpbuf, dumpsiz, &ctx);
+  md5_finish_ctx(&ctx, digest);
+  free(dumpbuf);
+  return true;
+} // end Chariot_function_cache::fingerprint
+
+bool
+Chariot_function_cache::load(const unsigned char digest[16], function* fun,
+                             int* bbcount, int* stmtcount, int* nbcalls)
+{
+  std::string path = entry_path(digest, false);
+  FILE* fil = fopen(path.c_str(), "r");
+  if (!fil)
+    {
+      _fc_nbmisses++;
+      return false;
+    }
+  char linebuf[512];
+  bool ok = fgets(linebuf, sizeof(linebuf), fil)
+            && !strncmp(linebuf, CHARIOT_CACHE_HEADER "\n", sizeof(CHARIOT_CACHE_HEADER));
+  int counts[3] = {0, 0, 0};
+  unsigned nbindirect = 0;
+  ok = ok && fgets(linebuf, sizeof(linebuf), fil)
+       && sscanf(linebuf, "B %d %d %d %u", counts, counts+1, counts+2, &nbindirect) == 4;
+  std::vector<tree> callees;
+  while (ok && fgets(linebuf, sizeof(linebuf), fil))
+    {
+      size_t linelen = strlen(linebuf);
+      if (linelen < 3 || linebuf[0] != 'C' || linebuf[1] != ' ' || linebuf[linelen-1] != '\n')
+        ok = false;
+      else
+        {
+          linebuf[linelen-1] = (char)0;
+          symtab_node* node = symtab_node::get_for_asmname(get_identifier(linebuf + 2));
+          if (node)
+            callees.push_back(node->decl);
+          else
+            ok = false;
+        }
+    }
+  fclose(fil);
+  if (!ok)
+    {
+      _fc_nbmisses++;
+      return false;
+    }
+  chariot_callgraph.start_function(fun);
+  for (tree callee : callees)
+    chariot_callgraph.add_callee(callee);
+  for (unsigned rk = 0; rk < nbindirect; rk++)
+    chariot_callgraph.add_indirect_call();
+  chariot_callgraph.finish_function();
+  *bbcount = counts[0];
+  *stmtcount = counts[1];
+  *nbcalls = counts[2];
+  _fc_nbhits++;
+  return true;
+} // end Chariot_function_cache::load
+
+void
+Chariot_function_cache::store(const unsigned char digest[16], const Chariot_cgfun& cgf,
+                              int bbcount, int stmtcount, int nbcalls)
+{
+  std::string path = entry_path(digest, true);
+  std::string tmppath = path + "." + std::to_string((long) getpid()) + ".tmp";
+  FILE* fil = fopen(tmppath.c_str(), "w");
+  if (!fil)
+    return;
+  fprintf(fil, CHARIOT_CACHE_HEADER "\nB %d %d %d %u\n",
+          bbcount, stmtcount, nbcalls, cgf.cgf_nbindirect);
+  for (unsigned rk = 0; rk < cgf.cgf_nbedges; rk++)
+    fprintf(fil, "C %s\n",
+            IDENTIFIER_POINTER(DECL_ASSEMBLER_NAME(chariot_callgraph.callee_at(cgf, rk))));
+  // a failed entry is only a future miss
+  if (fclose(fil) || rename(tmppath.c_str(), path.c_str()))
+    remove(tmppath.c_str());
+  else
+    _fc_nbstored++;
+} // end Chariot_function_cache::store
+
+////////////////////////////////////////////////////////////////
+/// the marking routine, a linear walk without any allocation
+void chariot_ggc_marker_callback(void*,void*)
+{
+  const Chariot_callgraph_store& cgs = chariot_callgraph;
+  for (unsigned ix = 0; ix < cgs._cgs_nbfun; ix++)
+    {
+      ggc_mark(cgs._cgs_funtab[ix].cgf_decl);
+      ggc_mark(cgs._cgs_funtab[ix].cgf_func);
+    }
+  for (unsigned ie = 0; ie < cgs._cgs_nbedges; ie++)
+    ggc_mark(cgs._cgs_edgetab[ie]);
 } // end chariot_ggc_marker_callback
 
 
@@ -168,6 +843,129 @@ chariot_cputime(void)
 } // end chariot_cputime
 
 
+////////////////////////////////////////////////////////////////
+/// Cost of the plugin.  A plugin cannot add its own timevars to GCC,
+/// so both passes run under TV_PLUGIN_RUN, the "plugin execution"
+/// line of -ftime-report, like the plugin callbacks.  Each pass also
+/// accumulates here its wall and CPU time and the number of functions
+/// it processed; chariot_report_timing gives them at
+/// PLUGIN_FINISH_UNIT with the bytes produced, and appends them as a
+/// JSON line to the timereport=<file> argument to be summed by CI.
+struct Chariot_pass_timing
+{
+  const char* pt_name;
+  double pt_wall;
+  double pt_cpu;
+  unsigned pt_nbfun;
+};
+
+Chariot_pass_timing chariot_callgraph_timing = { "callgraph", 0.0, 0.0, 0 };
+Chariot_pass_timing chariot_framesize_timing = { "framesize", 0.0, 0.0, 0 };
+Chariot_pass_timing chariot_finishing_timing = { "finishing", 0.0, 0.0, 0 };
+
+std::string chariot_timereportstr;
+
+class Chariot_timing_scope
+{
+  Chariot_pass_timing& _ts_timing;
+  double _ts_wall;
+  double _ts_cpu;
+  static double now(clockid_t clk)
+  {
+    struct timespec ts = {0,0};
+    clock_gettime(clk, &ts);
+    return (double) ts.tv_sec + 1.0e-9*ts.tv_nsec;
+  };
+public:
+  // the REST sender has its own thread, so the CPU time is the compiler thread's
+  explicit Chariot_timing_scope(Chariot_pass_timing& timing):
+    _ts_timing(timing), _ts_wall(now(CLOCK_MONOTONIC)), _ts_cpu(now(CLOCK_THREAD_CPUTIME_ID))
+  {
+  };
+  ~Chariot_timing_scope()
+  {
+    _ts_timing.pt_wall += now(CLOCK_MONOTONIC) - _ts_wall;
+    _ts_timing.pt_cpu += now(CLOCK_THREAD_CPUTIME_ID) - _ts_cpu;
+    _ts_timing.pt_nbfun++;
+  };
+  Chariot_timing_scope(const Chariot_timing_scope&) = delete;
+  Chariot_timing_scope& operator = (const Chariot_timing_scope&) = delete;
+};
+
+static long
+chariot_file_size(const std::string& path)
+{
+  struct stat st;
+  if (path.empty() || stat(path.c_str(), &st))
+    return 0;
+  return (long) st.st_size;
+} // end chariot_file_size
+
+void
+chariot_report_timing(void)
+{
+  const Chariot_pass_timing* timings[] =
+  {
+    &chariot_callgraph_timing, &chariot_framesize_timing, &chariot_finishing_timing
+  };
+  long summarybytes = chariot_file_size(chariot_summarystr);
+  long tracebytes = chariot_file_size(chariot_tracestr);
+  long restbytes = chariot_rest_sender.nb_bytes();
+  double cputime = chariot_cputime();
+  double plugincpu = 0.0;
+  Json::Value jreport(Json::objectValue);
+  jreport["translunit"] = chariot_translationunitstr;
+  for (const Chariot_pass_timing* pt : timings)
+    {
+      if (pt == &chariot_finishing_timing)
+        inform(UNKNOWN_LOCATION, "CHARIOTPLUGINDEMO: %s: wall %.3f s, cpu %.3f s",
+               pt->pt_name, pt->pt_wall, pt->pt_cpu);
+      else
+        inform(UNKNOWN_LOCATION, "CHARIOTPLUGINDEMO: %s pass: %u functions, wall %.3f s, cpu %.3f s",
+               pt->pt_name, pt->pt_nbfun, pt->pt_wall, pt->pt_cpu);
+      plugincpu += pt->pt_cpu;
+      Json::Value jpass(Json::objectValue);
+      jpass["functions"] = pt->pt_nbfun;
+      jpass["wall"] = pt->pt_wall;
+      jpass["cpu"] = pt->pt_cpu;
+      jreport[pt->pt_name] = jpass;
+    }
+  if (chariot_function_cache.active())
+    inform(UNKNOWN_LOCATION, "CHARIOTPLUGINDEMO: function cache %s: %u hits, %u misses, %u stored",
+           chariot_cachedirstr.c_str(), chariot_function_cache.nb_hits(),
+           chariot_function_cache.nb_misses(), chariot_function_cache.nb_stored());
+  inform(UNKNOWN_LOCATION,
+         "CHARIOTPLUGINDEMO: produced %ld bytes of summary, %ld of trace, %ld of REST batches;"
+         " plugin cpu %.3f s of %.3f s", summarybytes, tracebytes, restbytes, plugincpu, cputime);
+  if (chariot_timereportstr.empty())
+    return;
+  Json::Value jbytes(Json::objectValue);
+  jbytes["summary"] = (Json::Int64) summarybytes;
+  jbytes["trace"] = (Json::Int64) tracebytes;
+  jbytes["rest"] = (Json::Int64) restbytes;
+  jreport["bytes"] = jbytes;
+  if (chariot_function_cache.active())
+    {
+      Json::Value jcache(Json::objectValue);
+      jcache["hits"] = chariot_function_cache.nb_hits();
+      jcache["misses"] = chariot_function_cache.nb_misses();
+      jcache["stored"] = chariot_function_cache.nb_stored();
+      jreport["cache"] = jcache;
+    }
+  jreport["plugincpu"] = plugincpu;
+  jreport["cputime"] = cputime;
+  Json::FastWriter writer;
+  std::string line = writer.write(jreport);
+  // one fwrite of an appended line, parallel compilations can share the file
+  FILE* repfil = fopen(chariot_timereportstr.c_str(), "a");
+  if (!repfil
+      || fwrite(line.c_str(), line.size(), 1, repfil) != 1
+      || fclose(repfil))
+    warning(UNKNOWN_LOCATION, "CHARIOTPLUGINDEMO: cannot append the timing to %s - %m",
+            chariot_timereportstr.c_str());
+} // end chariot_report_timing
+
+
 
 /// GCC callback which gets called before processing a translation unit
 void
@@ -194,8 +992,44 @@ chariot_finishing(void*gccdata __attribute__((unused)), void*userdata __attribut
          chariot_bismonprojectstr.c_str(),
          chariot_translationunitstr.c_str(),
          cputimbuf, __LINE__);
+  {
+    Chariot_timing_scope timing(chariot_finishing_timing);
+    chariot_rest_sender.flush();
+    if (chariot_tracer.active() && !chariot_tracer.close())
+      warning(UNKNOWN_LOCATION, "CHARIOTPLUGINDEMO: cannot write trace %s - %m",
+              chariot_tracestr.c_str());
+    // with LTO, the whole program summary is written by the chariot_ipa pass
+    if (!in_lto_p)
+      {
+        if (chariot_summarystr.empty())
+          chariot_summarystr = chariot_translationunitstr + ".chariotcg";
+        FILE* sumfil = fopen(chariot_summarystr.c_str(), "w");
+        if (!sumfil)
+          warning(UNKNOWN_LOCATION, "CHARIOTPLUGINDEMO: cannot open callgraph summary %s - %m",
+                  chariot_summarystr.c_str());
+        else
+          {
+            bool ok = chariot_callgraph.write_summary(sumfil, chariot_translationunitstr.c_str());
+            if (fclose(sumfil) || !ok)
+              warning(UNKNOWN_LOCATION, "CHARIOTPLUGINDEMO: cannot write callgraph summary %s",
+                      chariot_summarystr.c_str());
+            else
+              inform(UNKNOWN_LOCATION, "CHARIOTPLUGINDEMO: wrote callgraph summary %s of %u functions",
+                     chariot_summarystr.c_str(), chariot_callgraph.nb_functions());
+          }
+      }
+  }
+  chariot_report_timing();
 } // end chariot_finishing
 
+
+/// GCC callback at exit, which flushes the REST events when PLUGIN_FINISH_UNIT was skipped
+void
+chariot_ending(void*gccdata __attribute__((unused)), void*userdata __attribute((unused)))
+{
+  chariot_rest_sender.flush();
+} // end chariot_ending
+
 ////////////////////////////////////////////////////////////////
 /// low-level routine to make an HTTP REST POST call to Bismon using
 /// libcurl; a bit long, but trivial to understand.
@@ -390,7 +1224,8 @@ void chariot_bismon_post_restcall(const char*urlsuffix,
         respjsonsiz = 0;
         curl_slist_free_all(list);
         list = NULL;
-        curl_easy_cleanup(chariot_curl);
+        // keep the handle, and its connection, for the next request
+        curl_easy_reset(chariot_curl);
       }
     }
 } // end chariot_bismon_post_restcall
@@ -398,6 +1233,244 @@ void chariot_bismon_post_restcall(const char*urlsuffix,
 
 
 
+std::string
+Chariot_rest_sender::batch_body(std::vector<Json::Value>& events) const
+{
+  Json::Value jbatch(Json::objectValue);
+  jbatch["chariotproject"] = chariot_bismonprojectstr;
+  jbatch["translunit"] = chariot_translationunitstr;
+  Json::Value& jevents = jbatch["events"] = Json::Value(Json::arrayValue);
+  for (Json::Value& jev : events)
+    jevents.append(std::move(jev));
+  Json::FastWriter jfwri;
+  return jfwri.write(jbatch);
+} // end Chariot_rest_sender::batch_body
+
+bool
+Chariot_rest_sender::spool_batch(const std::string& body)
+{
+  // written under a temporary name, so that a publisher never sees a partial batch
+  char pathbuf[512];
+  snprintf(pathbuf, sizeof(pathbuf), "%s/%s-%d-%ld.chariotbatch",
+           chariot_spooldirstr.c_str(), chariot_translationunitstr.c_str(),
+           (int) getpid(), ++_rs_sequence);
+  std::string tmppath = std::string(pathbuf) + ".tmp";
+  FILE* fil = fopen(tmppath.c_str(), "w");
+  if (!fil)
+    {
+      _rs_lasterror = std::string("cannot open ") + tmppath + ": " + strerror(errno);
+      return false;
+    }
+  bool ok = fwrite(body.data(), 1, body.size(), fil) == body.size();
+  if (fclose(fil) || !ok || rename(tmppath.c_str(), pathbuf))
+    {
+      _rs_lasterror = std::string("cannot write ") + pathbuf + ": " + strerror(errno);
+      remove(tmppath.c_str());
+      return false;
+    }
+  return true;
+} // end Chariot_rest_sender::spool_batch
+
+Chariot_rest_sender::Transfer*
+Chariot_rest_sender::start_transfer(CURLM* multi, std::string&& body)
+{
+  Transfer* tr = new Transfer;
+  tr->tr_easy = curl_easy_init();
+  tr->tr_headers = curl_slist_append(nullptr, "Content-Type: application/json");
+  tr->tr_body = std::move(body);
+  memset (tr->tr_errbuf, 0, sizeof(tr->tr_errbuf));
+  if (!tr->tr_easy)
+    {
+      curl_slist_free_all(tr->tr_headers);
+      delete tr;
+      return nullptr;
+    }
+  std::string urlstr = chariot_bismonurlprefixstr;
+  urlstr.append(CHARIOTDEMO_URLSUFFIX "/chariotbatch");
+  CURL* easy = tr->tr_easy;
+  curl_easy_setopt(easy, CURLOPT_URL, urlstr.c_str());
+  curl_easy_setopt(easy, CURLOPT_POST, 1L);
+  curl_easy_setopt(easy, CURLOPT_POSTFIELDS, tr->tr_body.c_str());
+  curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE, (long) tr->tr_body.size());
+  curl_easy_setopt(easy, CURLOPT_HTTPHEADER, tr->tr_headers);
+  curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, (long) chariot_timeout_millisec);
+  curl_easy_setopt(easy, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(easy, CURLOPT_USERAGENT, __FILE__);
+  curl_easy_setopt(easy, CURLOPT_ERRORBUFFER, tr->tr_errbuf);
+  curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, discard_response);
+  curl_easy_setopt(easy, CURLOPT_PRIVATE, (void*) tr);
+  if (!chariot_bismoncookiestr.empty())
+    {
+      std::string cookiestr = std::string("BISMONCOOKIE=") + chariot_bismoncookiestr;
+      curl_easy_setopt(easy, CURLOPT_COOKIE, cookiestr.c_str());
+    }
+  curl_multi_add_handle(multi, easy);
+  return tr;
+} // end Chariot_rest_sender::start_transfer
+
+void
+Chariot_rest_sender::sender_loop(void)
+{
+  CURLM* multi = nullptr;
+  if (chariot_spooldirstr.empty())
+    {
+      multi = curl_multi_init();
+      curl_multi_setopt(multi, CURLMOPT_PIPELINING, (long) CURLPIPE_MULTIPLEX);
+    }
+  std::vector<Transfer*> inflight;
+  for (;;)
+    {
+      std::vector<Json::Value> events;
+      bool stopped = false;
+      {
+        std::unique_lock<std::mutex> lock(_rs_mutex);
+        if (inflight.empty())
+          _rs_cond.wait(lock, [this] { return _rs_stopping || !_rs_queue.empty(); });
+        while (!_rs_queue.empty() && events.size() < CHARIOT_REST_BATCH_MAX
+               && inflight.size() < CHARIOT_REST_INFLIGHT)
+          {
+            events.push_back(std::move(_rs_queue.front()));
+            _rs_queue.pop_front();
+          }
+        stopped = _rs_stopping && _rs_queue.empty();
+      }
+      if (!events.empty())
+        {
+          _rs_roomcond.notify_all();
+          std::string body = batch_body(events);
+          _rs_nbbatches++;
+          _rs_nbbytes += body.size();
+          if (!multi)
+            {
+              if (!spool_batch(body))
+                _rs_nbfailed++;
+            }
+          else if (Transfer* tr = start_transfer(multi, std::move(body)))
+            inflight.push_back(tr);
+          else
+            {
+              _rs_nbfailed++;
+              _rs_lasterror = "cannot create a curl handle";
+            }
+        }
+      if (multi && !inflight.empty())
+        {
+          int nbrunning = 0;
+          curl_multi_perform(multi, &nbrunning);
+          int nbmsg = 0;
+          while (CURLMsg* msg = curl_multi_info_read(multi, &nbmsg))
+            {
+              if (msg->msg != CURLMSG_DONE)
+                continue;
+              Transfer* tr = nullptr;
+              curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**) &tr);
+              if (msg->data.result != CURLE_OK)
+                {
+                  _rs_nbfailed++;
+                  _rs_lasterror = tr->tr_errbuf[0] ? tr->tr_errbuf : curl_easy_strerror(msg->data.result);
+                }
+              curl_multi_remove_handle(multi, tr->tr_easy);
+              curl_easy_cleanup(tr->tr_easy);
+              curl_slist_free_all(tr->tr_headers);
+              inflight.erase(std::find(inflight.begin(), inflight.end(), tr));
+              delete tr;
+            }
+          if (!inflight.empty())
+            curl_multi_wait(multi, nullptr, 0, 50, nullptr);
+        }
+      if (stopped && inflight.empty())
+        break;
+    }
+  if (multi)
+    curl_multi_cleanup(multi);
+} // end Chariot_rest_sender::sender_loop
+
+void
+Chariot_rest_sender::enqueue(const char* urlsuffix, const Json::Value* jevent)
+{
+  if (chariot_faking || (!chariot_batching && chariot_spooldirstr.empty()))
+    {
+      Json::Value jinput = jevent ? *jevent : Json::Value(Json::objectValue);
+      Json::Value jres;
+      chariot_bismon_post_restcall(urlsuffix, &jinput, &jres);
+      return;
+    }
+  Json::Value jev(Json::objectValue);
+  jev["rest"] = urlsuffix;
+  if (jevent)
+    jev["data"] = *jevent;
+  {
+    std::unique_lock<std::mutex> lock(_rs_mutex);
+    if (!_rs_started)
+      {
+        _rs_started = true;
+        _rs_stopping = false;
+        _rs_thread = std::thread(&Chariot_rest_sender::sender_loop, this);
+      }
+    _rs_roomcond.wait(lock, [this] { return _rs_queue.size() < CHARIOT_REST_QUEUE_MAX; });
+    _rs_queue.push_back(std::move(jev));
+    _rs_nbevents++;
+  }
+  _rs_cond.notify_one();
+} // end Chariot_rest_sender::enqueue
+
+void
+Chariot_rest_sender::stop(void)
+{
+  if (!_rs_started)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(_rs_mutex);
+    _rs_stopping = true;
+  }
+  _rs_cond.notify_one();
+  _rs_thread.join();
+  _rs_started = false;
+} // end Chariot_rest_sender::stop
+
+void
+Chariot_rest_sender::flush(void)
+{
+  if (!_rs_started)
+    return;
+  stop();
+  if (_rs_nbfailed > 0)
+    warning(UNKNOWN_LOCATION, "CHARIOTPLUGINDEMO: %ld of %ld REST batches failed, last error: %s",
+            _rs_nbfailed, _rs_nbbatches, _rs_lasterror.c_str());
+  else if (chariot_show_http || !chariot_spooldirstr.empty())
+    inform(UNKNOWN_LOCATION, "CHARIOTPLUGINDEMO: %s %ld REST events in %ld batches%s%s",
+           chariot_spooldirstr.empty() ? "published" : "spooled",
+           _rs_nbevents, _rs_nbbatches,
+           chariot_spooldirstr.empty() ? "" : " into ", chariot_spooldirstr.c_str());
+  _rs_nbevents = _rs_nbbatches = _rs_nbfailed = 0;
+} // end Chariot_rest_sender::flush
+
+
+
+
+
+/// queue the chariotfunction REST event of a compiled or cached function
+static void
+chariot_publish_function(function* fun, const Chariot_cgfun& cgf,
+                         int bbcount, int stmtcount, int nbcalls)
+{
+  Json::Value jfun(Json::objectValue);
+  jfun["function"] = function_name(fun);
+  jfun["bbcount"] = bbcount;
+  jfun["stmtcount"] = stmtcount;
+  jfun["nbcalls"] = nbcalls;
+  jfun["nbindirect"] = cgf.cgf_nbindirect;
+  Json::Value& jcallees = jfun["callees"] = Json::Value(Json::arrayValue);
+  for (unsigned rk = 0; rk < cgf.cgf_nbedges; rk++)
+    {
+      tree callee = chariot_callgraph.callee_at(cgf, rk);
+      if (DECL_NAME(callee))
+        jcallees.append(IDENTIFIER_POINTER(DECL_NAME(callee)));
+    }
+  chariot_rest_sender.enqueue("chariotfunction", &jfun);
+} // end chariot_publish_function
+
 
 ////////////////////////////////////////////////////////////////
 //// the call graph related CHARIOT pass
@@ -406,7 +1479,7 @@ const pass_data pass_data_chariot_callgraph =
   GIMPLE_PASS, /* type */
   "chariot_callgraph", /* name */
   OPTGROUP_NONE, /* optinfo_flags */
-  TV_NONE, /* tv_id */
+  TV_PLUGIN_RUN, /* tv_id */
   PROP_ssa, /* properties_required */
   0, /* properties_provided */
   0, /* properties_destroyed */
@@ -440,12 +1513,32 @@ pass_chariot_callgraph::execute (function *fun)
   auto funendloc = (fun && fun->function_end_locus)
                    ?  fun->function_end_locus
                    : UNKNOWN_LOCATION;
-  inform (funstartloc,
-          "CHARIOTPLUGINDEMO: callgraph start examining %qD @@ %s:%d",
-          fun->decl, __FILE__, __LINE__);
-  Func_chariot_data chdafun(fun);
-  chariot_map_decl_to_fun.insert({fun->decl,fun});
-  chariot_map_func_to_data.insert({fun,chdafun});
+  Chariot_timing_scope timing(chariot_callgraph_timing);
+  // with a binary trace, no diagnostic for every statement
+  bool verbose = !chariot_tracer.active();
+  if (verbose)
+    inform (funstartloc,
+            "CHARIOTPLUGINDEMO: callgraph start examining %qD @@ %s:%d",
+            fun->decl, __FILE__, __LINE__);
+  unsigned char digest[16];
+  bool fingerprinted = chariot_function_cache.active()
+                       && chariot_function_cache.fingerprint(digest, fun);
+  if (fingerprinted
+      && chariot_function_cache.load(digest, fun, &bbcount, &stmtcount, &nbcalls))
+    {
+      // Bismon gets the same event as for a compiled function
+      const Chariot_cgfun& cgf
+        = chariot_callgraph.function_at(chariot_callgraph.find_function(fun->decl));
+      chariot_publish_function(fun, cgf, bbcount, stmtcount, nbcalls);
+      if (verbose)
+        inform (funstartloc,
+                "CHARIOTPLUGINDEMO: callgraph %qD unchanged, with its cached summary", fun->decl);
+      else
+        chariot_tracer.trace_function(fun->decl, bbcount, stmtcount, nbcalls, cgf.cgf_nbindirect,
+                                      chariot_callgraph.callees_of(cgf), cgf.cgf_nbedges);
+      return 0;
+    }
+  unsigned cgix = chariot_callgraph.start_function(fun);
   usleep (1); // we could set a breakpoint here
   FOR_EACH_BB_FN (bb, fun)
   {
@@ -459,13 +1552,34 @@ pass_chariot_callgraph::execute (function *fun)
             nbcalls++;
             tree callee = gimple_call_fndecl(curstmt);
             if (callee)
-              inform(gimple_location(curstmt), "CHARIOTPLUGINDEMO: callgraph in %qD call to %qD",
-                     fun->decl, callee);
+              {
+                if (verbose)
+                  inform(gimple_location(curstmt), "CHARIOTPLUGINDEMO: callgraph in %qD call to %qD",
+                         fun->decl, callee);
+                chariot_callgraph.add_callee(callee);
+              }
             else
-              warning(gimple_location(curstmt), "CHARIOTPLUGINDEMO: callgraph no callee in %qD", fun->decl);
+              {
+                if (verbose)
+                  warning(gimple_location(curstmt), "CHARIOTPLUGINDEMO: callgraph no callee in %qD", fun->decl);
+                chariot_callgraph.add_indirect_call();
+              }
           }
       };
   }
+  chariot_callgraph.finish_function();
+  {
+    const Chariot_cgfun& cgf = chariot_callgraph.function_at(cgix);
+    if (fingerprinted)
+      chariot_function_cache.store(digest, cgf, bbcount, stmtcount, nbcalls);
+    chariot_publish_function(fun, cgf, bbcount, stmtcount, nbcalls);
+    if (!verbose)
+      {
+        chariot_tracer.trace_function(fun->decl, bbcount, stmtcount, nbcalls, cgf.cgf_nbindirect,
+                                      chariot_callgraph.callees_of(cgf), cgf.cgf_nbedges);
+        return 0;
+      }
+  }
   inform(funstartloc,
          "CHARIOTPLUGINDEMO: callgraph function %qD has %d basic-blocks and %d statements",
          fun->decl, bbcount, stmtcount);
@@ -516,7 +1630,7 @@ const pass_data pass_data_chariot_framesize =
   RTL_PASS, /* type */
   "chariot_framesize", /* name */
   OPTGROUP_NONE, /* optinfo_flags */
-  TV_NONE, /* tv_id */
+  TV_PLUGIN_RUN, /* tv_id */
   PROP_ssa, /* properties_required */
   0, /* properties_provided */
   0, /* properties_destroyed */
@@ -545,20 +1659,35 @@ pass_chariot_framesize::execute (function *fun)
   auto funendloc = (fun && fun->function_end_locus)
                    ?  fun->function_end_locus
                    : UNKNOWN_LOCATION;
-  inform (funstartloc,
-          "CHARIOTPLUGINDEMO: framesize start examining %qD @@ %s:%d", fun->decl,
-          __FILE__, __LINE__);
+  Chariot_timing_scope timing(chariot_framesize_timing);
+  bool verbose = !chariot_tracer.active();
+  if (verbose)
+    {
+      inform (funstartloc,
+              "CHARIOTPLUGINDEMO: framesize start examining %qD @@ %s:%d", fun->decl,
+              __FILE__, __LINE__);
+      inform(funendloc, "CHARIOTPLUGINDEMO: framesize current_function_decl %qD (@%p, fun.decl@%p)",
+             current_function_decl, (void*)current_function_decl, (void*)fun->decl);
+    }
   usleep (1); // we could set a breakpoint here
-  inform(funendloc, "CHARIOTPLUGINDEMO: framesize current_function_decl %qD (@%p, fun.decl@%p)",
-         current_function_decl, (void*)current_function_decl, (void*)fun->decl);
   if (fun && fun->su)
     {
       auto fsu = fun->su;
-      inform(funendloc, "CHARIOTPLUGINDEMO: framesize function %qD (@%p) size: static stack %ld, dynamic stack %ld",
-             fun->decl, (void*)fun, (long) fsu->static_stack_size, (long) fsu->dynamic_stack_size);
+      if (verbose)
+        inform(funendloc, "CHARIOTPLUGINDEMO: framesize function %qD (@%p) size: static stack %ld, dynamic stack %ld",
+               fun->decl, (void*)fun, (long) fsu->static_stack_size, (long) fsu->dynamic_stack_size);
+      else
+        chariot_tracer.trace_frame(fun->decl, (long) fsu->static_stack_size,
+                                   (long) fsu->dynamic_stack_size,
+                                   fsu->has_unbounded_dynamic_stack_size);
+      chariot_callgraph.record_frame(fun, (long) fsu->static_stack_size,
+                                     (long) fsu->dynamic_stack_size,
+                                     fsu->has_unbounded_dynamic_stack_size);
     }
-  else
+  else if (verbose)
     warning(funendloc, "CHARIOTPLUGINDEMO: framesize function %qD has no stack usage", fun->decl);
+  else
+    chariot_tracer.trace_frame(fun->decl, -1, 0, false);
 
   return 0;
 
@@ -572,6 +1701,251 @@ make_pass_chariot_framesize (gcc::context *ctxt)
 }
 ////////////////////////////////////////////////////////////////
 
+//// the whole program CHARIOT pass, under -flto.  The per translation
+//// unit passes above only see the calls inside their unit, so with
+//// LTO this regular IPA pass, inserted after the "inline" pass,
+//// computes the call graph once over the merged program:
+////  * at compile time, its summary gives the estimated frame size of
+////    every function (the one used by the inliner, since the RTL
+////    frames only exist later in the LTRANS units) and whether it
+////    calls alloca, streamed into the object file in a
+////    .gnu.lto_chariot-callgraph-summary section;
+////  * at WPA time, the call edges of the symbol table, where the
+////    inlined callees are counted into the frame of their caller,
+////    and these summaries give the whole program callgraph summary,
+////    in the format of the per unit ones, for chariot_stackdepth.exe.
+//// Without -flto it does nothing.
+
+#define CHARIOT_LTO_SECTION "chariot-callgraph-summary"
+#define CHARIOT_LTO_VERSION 1
+#define CHARIOT_LTO_UNBOUNDED 1
+
+// the section, in host byte order, is the version and the number of
+// records, as 32 bits integers, then the records
+struct Chariot_lto_record
+{
+  uint32_t clr_node;		// index in the symbol table encoder of the unit
+  uint32_t clr_flags;		// CHARIOT_LTO_UNBOUNDED
+  int64_t clr_frame;
+};
+
+// the summaries, by DECL_UID of the functions
+std::map<unsigned, Chariot_lto_record> chariot_lto_summaries;
+
+static void
+chariot_ipa_generate_summary (void)
+{
+  cgraph_node* node;
+  FOR_EACH_FUNCTION_WITH_GIMPLE_BODY (node)
+  {
+    function* fn = DECL_STRUCT_FUNCTION(node->decl);
+    Chariot_lto_record rec;
+    rec.clr_node = 0;
+    rec.clr_flags = (fn && fn->calls_alloca) ? CHARIOT_LTO_UNBOUNDED : 0;
+    rec.clr_frame = (int64_t) estimated_stack_frame_size(node);
+    chariot_lto_summaries[DECL_UID(node->decl)] = rec;
+  }
+} // end chariot_ipa_generate_summary
+
+static void
+chariot_ipa_write_summary (void)
+{
+  lto_symtab_encoder_t encoder = lto_get_out_decl_state ()->symtab_node_encoder;
+  std::vector<Chariot_lto_record> records;
+  for (int ix = 0; ix < lto_symtab_encoder_size (encoder); ix++)
+    {
+      cgraph_node* node = dyn_cast <cgraph_node *> (lto_symtab_encoder_deref (encoder, ix));
+      if (!node)
+        continue;
+      auto it = chariot_lto_summaries.find(DECL_UID(node->decl));
+      if (it == chariot_lto_summaries.end())
+        continue;
+      records.push_back(it->second);
+      records.back().clr_node = ix;
+    }
+  uint32_t header[2] = { CHARIOT_LTO_VERSION, (uint32_t) records.size() };
+  char* secname = lto_get_section_name (LTO_section_function_body, CHARIOT_LTO_SECTION, NULL);
+  // compressed like every section read at WPA time
+  lto_begin_section (secname, true);
+  free (secname);
+  lto_write_data (header, sizeof(header));
+  if (!records.empty())
+    lto_write_data (records.data(), records.size() * sizeof(Chariot_lto_record));
+  lto_end_section ();
+} // end chariot_ipa_write_summary
+
+static void
+chariot_ipa_read_summary (void)
+{
+  lto_file_decl_data** filedatavec = lto_get_file_decl_data ();
+  lto_file_decl_data* filedata;
+  for (int fix = 0; (filedata = filedatavec[fix]) != NULL; fix++)
+    {
+      size_t len = 0;
+      const char* data = lto_get_section_data (filedata, LTO_section_function_body,
+                         CHARIOT_LTO_SECTION, &len);
+      if (!data)		// compiled without the plugin
+        continue;
+      uint32_t header[2] = { 0, 0 };
+      if (len >= sizeof(header))
+        memcpy(header, data, sizeof(header));
+      if (header[0] != CHARIOT_LTO_VERSION
+          || len != sizeof(header) + (size_t) header[1] * sizeof(Chariot_lto_record))
+        warning(UNKNOWN_LOCATION, "CHARIOTPLUGINDEMO: bad callgraph summary section in %s",
+                filedata->file_name);
+      else
+        for (uint32_t rk = 0; rk < header[1]; rk++)
+          {
+            Chariot_lto_record rec;
+            memcpy(&rec, data + sizeof(header) + rk * sizeof(rec), sizeof(rec));
+            cgraph_node* node
+              = dyn_cast <cgraph_node *> (lto_symtab_encoder_deref (filedata->symtab_node_encoder,
+                                          rec.clr_node));
+            if (node)
+              chariot_lto_summaries[DECL_UID(node->decl)] = rec;
+          }
+      lto_free_section_data (filedata, LTO_section_function_body, CHARIOT_LTO_SECTION, data, len);
+    }
+} // end chariot_ipa_read_summary
+
+/// the name of a function in the whole program summary, prefixed by
+/// the basename of its object file when it is not public, like the
+/// translation unit in the per unit summaries
+static std::string
+chariot_lto_summary_name (cgraph_node* node)
+{
+  std::string name = IDENTIFIER_POINTER(DECL_ASSEMBLER_NAME(node->decl));
+  if (TREE_PUBLIC(node->decl))
+    return name;
+  std::string unit = "?";
+  if (node->lto_file_data && node->lto_file_data->file_name)
+    {
+      const char* base = lbasename(node->lto_file_data->file_name);
+      const char* dot = strrchr(base, '.');
+      unit.assign(base, dot ? (size_t) (dot - base) : strlen(base));
+    }
+  return unit + ":" + name;
+} // end chariot_lto_summary_name
+
+/// collect the callees and indirect calls of node and of the callees
+/// inlined into it, and give its frame with theirs, -1 if unknown
+static long
+chariot_lto_collect (cgraph_node* node, std::vector<cgraph_node*>& callees,
+                     unsigned* nbindirect, bool* unbounded)
+{
+  long frame = -1;
+  auto it = chariot_lto_summaries.find(DECL_UID(node->decl));
+  if (it != chariot_lto_summaries.end())
+    {
+      frame = (long) it->second.clr_frame;
+      if (it->second.clr_flags & CHARIOT_LTO_UNBOUNDED)
+        *unbounded = true;
+    }
+  long inlinedframe = 0;
+  for (cgraph_edge* edge = node->callees; edge; edge = edge->next_callee)
+    if (!edge->inline_failed)
+      {
+        long calleeframe = chariot_lto_collect(edge->callee, callees, nbindirect, unbounded);
+        if (calleeframe < 0 || frame < 0)
+          frame = -1;
+        else if (calleeframe > inlinedframe)
+          inlinedframe = calleeframe;
+      }
+    else
+      callees.push_back(edge->callee->ultimate_alias_target());
+  for (cgraph_edge* edge = node->indirect_calls; edge; edge = edge->next_callee)
+    (*nbindirect)++;
+  return frame < 0 ? -1 : frame + inlinedframe;
+} // end chariot_lto_collect
+
+const pass_data pass_data_chariot_ipa =
+{
+  IPA_PASS, /* type */
+  "chariot_ipa", /* name */
+  OPTGROUP_NONE, /* optinfo_flags */
+  TV_PLUGIN_RUN, /* tv_id */
+  0, /* properties_required */
+  0, /* properties_provided */
+  0, /* properties_destroyed */
+  0, /* todo_flags_start */
+  0, /* todo_flags_finish */
+};
+
+class pass_chariot_ipa : public ipa_opt_pass_d
+{
+public:
+  pass_chariot_ipa(gcc::context *ctxt)
+    : ipa_opt_pass_d(pass_data_chariot_ipa, ctxt,
+                     chariot_ipa_generate_summary, /* generate_summary */
+                     chariot_ipa_write_summary, /* write_summary */
+                     chariot_ipa_read_summary, /* read_summary */
+                     NULL, /* write_optimization_summary */
+                     NULL, /* read_optimization_summary */
+                     NULL, /* stmt_fixup */
+                     0, /* function_transform_todo_flags_start */
+                     NULL, /* function_transform */
+                     NULL) /* variable_transform */
+  {}
+
+  /* opt_pass methods: */
+  virtual bool gate (function *)
+  {
+    return flag_generate_lto || in_lto_p;
+  }
+  virtual unsigned int execute (function *);
+
+}; // class pass_chariot_ipa
+
+unsigned int
+pass_chariot_ipa::execute (function *)
+{
+  // with -ffat-lto-objects, the per unit passes will still run
+  if (!in_lto_p)
+    return 0;
+  std::string path = chariot_summarystr.empty()
+                     ? std::string("wholeprogram.chariotcg") : chariot_summarystr;
+  FILE* sumfil = fopen(path.c_str(), "w");
+  if (!sumfil)
+    {
+      warning(UNKNOWN_LOCATION, "CHARIOTPLUGINDEMO: cannot open whole program callgraph summary %s - %m",
+              path.c_str());
+      return 0;
+    }
+  fputs("# CHARIOT callgraph summary 1 of wholeprogram\n", sumfil);
+  unsigned nbfun = 0;
+  cgraph_node* node;
+  FOR_EACH_DEFINED_FUNCTION (node)
+  {
+    if (node->global.inlined_to || node->alias || node->thunk.thunk_p)
+      continue;
+    std::vector<cgraph_node*> callees;
+    unsigned nbindirect = 0;
+    bool unbounded = false;
+    long frame = chariot_lto_collect(node, callees, &nbindirect, &unbounded);
+    std::sort(callees.begin(), callees.end());
+    callees.erase(std::unique(callees.begin(), callees.end()), callees.end());
+    fprintf(sumfil, "F %s %ld 0 %d %u\n", chariot_lto_summary_name(node).c_str(),
+            frame, (int) unbounded, nbindirect);
+    for (cgraph_node* callee : callees)
+      fprintf(sumfil, "C %s\n", chariot_lto_summary_name(callee).c_str());
+    nbfun++;
+  }
+  if (fclose(sumfil))
+    warning(UNKNOWN_LOCATION, "CHARIOTPLUGINDEMO: cannot write whole program callgraph summary %s",
+            path.c_str());
+  else
+    inform(UNKNOWN_LOCATION, "CHARIOTPLUGINDEMO: wrote whole program callgraph summary %s of %u functions",
+           path.c_str(), nbfun);
+  return 0;
+} // end pass_chariot_ipa::execute
+
+ipa_opt_pass_d *
+make_pass_chariot_ipa (gcc::context *ctxt)
+{
+  return new pass_chariot_ipa (ctxt);
+}
+////////////////////////////////////////////////////////////////
+
 
 void parse_plugin_arguments (const char*plugin_name, struct plugin_name_args* plargs)
 {
@@ -642,6 +2016,34 @@ void parse_plugin_arguments (const char*plugin_name, struct plugin_name_args* pl
         {
           chariot_translationunitstr = std::string(curval);
         }
+      else if (!strcmp(curkey, "summary") && curval)
+        {
+          chariot_summarystr = std::string(curval);
+        }
+      else if (!strcmp(curkey, "spooldir") && curval)
+        {
+          chariot_spooldirstr = std::string(curval);
+        }
+      else if (!strcmp(curkey, "batch"))
+        {
+          chariot_batching = true;
+        }
+      else if (!strcmp(curkey, "synchronous"))
+        {
+          chariot_batching = false;
+        }
+      else if (!strcmp(curkey, "trace") && curval)
+        {
+          chariot_tracestr = std::string(curval);
+        }
+      else if (!strcmp(curkey, "timereport") && curval)
+        {
+          chariot_timereportstr = std::string(curval);
+        }
+      else if (!strcmp(curkey, "cachedir") && curval)
+        {
+          chariot_cachedirstr = std::string(curval);
+        }
       else if (!strcmp(curkey, "show-http"))
         {
           inform (UNKNOWN_LOCATION, "CHARIOTPLUGINDEMO plugin %s will show HTTP REST requests", plugin_name);
@@ -665,6 +2067,13 @@ void parse_plugin_arguments (const char*plugin_name, struct plugin_name_args* pl
           printf("\t -fplugin-arg-%s-timeoutmilli=<basename>\n", plugin_name);
           printf("\t -fplugin-arg-%s-help #this help\n", plugin_name);
           printf("\t -fplugin-arg-%s-show-http # show HTTP REST requests\n", plugin_name);
+          printf("\t -fplugin-arg-%s-summary=<file> #callgraph summary, default <translationunit>.chariotcg\n", plugin_name);
+          printf("\t -fplugin-arg-%s-spooldir=<dir> #write the REST batches into <dir> instead of posting them\n", plugin_name);
+          printf("\t -fplugin-arg-%s-batch #post the REST events in batches to restchariot2q19/chariotbatch\n", plugin_name);
+          printf("\t -fplugin-arg-%s-synchronous #post each REST event at once to its own URL (default)\n", plugin_name);
+          printf("\t -fplugin-arg-%s-trace=<file> #binary trace instead of per statement diagnostics\n", plugin_name);
+          printf("\t -fplugin-arg-%s-timereport=<file> #append the timing of the plugin as a JSON line\n", plugin_name);
+          printf("\t -fplugin-arg-%s-cachedir=<dir> #reuse the summaries of the unchanged functions\n", plugin_name);
           printf("\t -fplugin-arg-%s-translationunit=<basename>\n", plugin_name);
         }
       else
@@ -756,6 +2165,14 @@ plugin_init (struct plugin_name_args *plugin_info,
   inform(UNKNOWN_LOCATION,
          "CHARIOTPLUGINDEMO: translation unit %s for main file %s",
          chariot_translationunitstr.c_str(), main_input_filename);
+  if (!chariot_tracestr.empty()
+      && !chariot_tracer.open(chariot_tracestr.c_str(), chariot_translationunitstr.c_str()))
+    warning(UNKNOWN_LOCATION, "CHARIOTPLUGINDEMO: cannot open trace %s - %m",
+            chariot_tracestr.c_str());
+  if (!chariot_cachedirstr.empty()
+      && !chariot_function_cache.open(chariot_cachedirstr.c_str()))
+    warning(UNKNOWN_LOCATION, "CHARIOTPLUGINDEMO: cannot use cache directory %s - %m",
+            chariot_cachedirstr.c_str());
 
   // initialize CURL HTTP client library
   {
@@ -773,9 +2190,8 @@ plugin_init (struct plugin_name_args *plugin_info,
     Json::Value jtop(Json::objectValue);
     jtop["chariotproject"] = chariot_bismonprojectstr;
     jtop["translunit"] = chariot_translationunitstr;
-    Json::Value jres;
-    chariot_bismon_post_restcall("startchariot", &jtop, &jres);
-#warning should handle result of startchariot
+    // its result is unused, so with batching it is queued like the other events
+    chariot_rest_sender.enqueue("startchariot", &jtop);
   }
   //
   struct register_pass_info my_callgraph_pass_info;
@@ -794,9 +2210,18 @@ plugin_init (struct plugin_name_args *plugin_info,
   my_framesize_pass_info.pos_op = PASS_POS_INSERT_AFTER;
   register_callback (plugin_name, PLUGIN_PASS_MANAGER_SETUP, NULL,
                      &my_framesize_pass_info);
+  //
+  struct register_pass_info my_ipa_pass_info;
+  my_ipa_pass_info.pass = make_pass_chariot_ipa (g);
+  my_ipa_pass_info.reference_pass_name = "inline";
+  my_ipa_pass_info.ref_pass_instance_number = 1;
+  my_ipa_pass_info.pos_op = PASS_POS_INSERT_AFTER;
+  register_callback (plugin_name, PLUGIN_PASS_MANAGER_SETUP, NULL,
+                     &my_ipa_pass_info);
   ///
   register_callback (plugin_name, PLUGIN_START_UNIT, chariot_starting, NULL);
   register_callback (plugin_name, PLUGIN_FINISH_UNIT, chariot_finishing, NULL);
+  register_callback (plugin_name, PLUGIN_FINISH, chariot_ending, NULL);
   ///
   inform(UNKNOWN_LOCATION, "CHARIOTPLUGINDEMO: built " __DATE__ " on " __TIME__ " process %d"
 #ifdef PLUGINGITID
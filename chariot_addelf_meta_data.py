@@ -4,6 +4,8 @@ import sys
 import argparse
 import subprocess
 import tempfile
+import struct
+import hashlib
 
 __author__ = "Franck Vedrine"
 __copyright__ = "Copyright (c) 2019-2020, Commissariat a l'Energie Atomique CEA. All rights reserved."
@@ -46,8 +48,9 @@ __status__ = "Prototype"
 
 # CHARIOT: Add meta-data into firmware
 # requires size, objcopy supporting add-section option
-#          gcc (at least gnu-as)
+#          gcc (at least gnu-as) unless chariot_writeobj_meta_data.exe is built
 #          sha256sum, git, hexdump
+#          b3sum with --blake3, unless chariot_digest_meta_data.exe is built
 
 def close_fd_and_file(*args, **kwargs):
     is_fd = True
@@ -58,32 +61,115 @@ def close_fd_and_file(*args, **kwargs):
             os.remove(ar)
         is_fd = not is_fd
 
-def compute_sha_256(in_file_name, verbose):
-    sha_256_proc = subprocess.Popen(['sha256sum', in_file_name], stdout=subprocess.PIPE)
+def compute_sha_256(in_file_name, verbose, tool='sha256sum', options=[]):
+    sha_256_proc = subprocess.Popen([tool] + options + [in_file_name], stdout=subprocess.PIPE)
     sha_result = sha_256_proc.stdout.read().decode().partition(' ')[0]
     returncode = sha_256_proc.wait()
     if verbose or returncode:
-        command = "sha256sum " + in_file_name
+        command = " ".join([tool] + options + [in_file_name])
         if returncode:
             print ("[error] the command " + command + " has failed with return code " + str(returncode))
             raise OSError(returncode)
         print (command)
     return sha_result
 
-def compute_sha_256_content(elf_name, mainboot, verbose):
+# hashes with the native hashers (sha256, blake3, crc32c) of the library when it is built
+native_digest = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+        'chariot_digest_meta_data.exe')
+
+def compute_blake3(in_file_name, verbose):
+    if os.path.isfile(native_digest):
+        return compute_sha_256(in_file_name, verbose, native_digest, ['--blake3'])
+    return compute_sha_256(in_file_name, verbose, 'b3sum')
+
+def load_segments(elf_name):
+    # (file offset, file size) of every PT_LOAD segment of an elf32 file
+    result = []
+    with open(elf_name, 'rb') as elf_file:
+        header = elf_file.read(52)
+        if len(header) < 52 or header[0:4] != b'\x7fELF':
+            print ("[error] " + elf_name + " is not an elf file")
+            raise OSError(1)
+        endian = '>' if header[5] == 2 else '<'
+        (phoff,) = struct.unpack(endian + 'I', header[28:32])
+        (phentsize, phnum) = struct.unpack(endian + 'HH', header[42:46])
+        for index in range(phnum):
+            elf_file.seek(phoff + index*phentsize)
+            (p_type, p_offset, p_vaddr, p_paddr, p_filesz) = struct.unpack(endian + 'IIIII', elf_file.read(20))
+            if p_type == 1 and p_filesz > 0: # PT_LOAD
+                result.append((p_offset, p_filesz))
+    return result
+
+def compute_crc32c(in_file_name, verbose):
+    if os.path.isfile(native_digest):
+        return compute_sha_256(in_file_name, verbose, native_digest, ['--crc32c'])
+    # slow fallback, one byte at a time
+    table = []
+    for value in range(256):
+        crc = value
+        for bit in range(8):
+            crc = (crc >> 1) ^ 0x82f63b78 if crc & 1 else crc >> 1
+        table.append(crc)
+    crc = 0xffffffff
+    with open(in_file_name, 'rb') as in_file:
+        for byte in in_file.read():
+            crc = table[(crc ^ byte) & 0xff] ^ (crc >> 8)
+    return '{0:08x}'.format(crc ^ 0xffffffff)
+
+def compute_chunks(in_file_name, chunk_size):
+    # Merkle table "ssssssss:root:leaves" of the content cut into chunk_size bytes
+    leaves = []
+    with open(in_file_name, 'rb') as in_file:
+        while True:
+            chunk = in_file.read(chunk_size)
+            if len(chunk) == 0:
+                break
+            leaves.append(hashlib.sha256(b'\x00' + chunk).digest())
+    if len(leaves) == 0:
+        print ("[error] the main boot is empty, no chunk to hash")
+        raise OSError(1)
+    def compute_node(first, number):
+        if number == 1:
+            return leaves[first]
+        left_number = 1
+        while left_number*2 < number:
+            left_number *= 2
+        return hashlib.sha256(b'\x01' + compute_node(first, left_number)
+                + compute_node(first + left_number, number - left_number)).digest()
+    return ('{0:08x}'.format(chunk_size) + ':' + compute_node(0, len(leaves)).hex() + ':'
+            + ''.join([leaf.hex() for leaf in leaves]))
+
+def compute_sha_256_content(elf_name, mainboot, verbose, with_blake3=False, with_crc32c=False,
+        chunk_size=None):
+    # returns the sha256 and, on demand, the blake3, the crc32c and the chunk table
+    # of the mainboot content
     fd_content_s, content_s_path = tempfile.mkstemp()
+    fd_part_s, part_s_path = tempfile.mkstemp()
     try:
-        returncode = os.system('objcopy --dump-section .%s=%s %s' % (mainboot, content_s_path, elf_name))
-        if args.verbose or returncode:
-            command = "objcopy --dump-section ." + mainboot + "=" + content_s_path + " " + elf_name
-            if returncode:
-                print ("[error] the command " + command + " has failed with return code " + str(returncode))
-                raise OSError(returncode)
-            print (command)
+        with open(content_s_path, 'wb') as content_file:
+            if mainboot is None:
+                with open(elf_name, 'rb') as elf_file:
+                    for (offset, size) in load_segments(elf_name):
+                        elf_file.seek(offset)
+                        content_file.write(elf_file.read(size))
+            else:
+                for section in mainboot:
+                    returncode = os.system('objcopy --dump-section .%s=%s %s' % (section, part_s_path, elf_name))
+                    if args.verbose or returncode:
+                        command = "objcopy --dump-section ." + section + "=" + part_s_path + " " + elf_name
+                        if returncode:
+                            print ("[error] the command " + command + " has failed with return code " + str(returncode))
+                            raise OSError(returncode)
+                        print (command)
+                    with open(part_s_path, 'rb') as part_file:
+                        content_file.write(part_file.read())
         sha_result = compute_sha_256(content_s_path, verbose);
+        blake3_result = compute_blake3(content_s_path, verbose) if with_blake3 else None
+        crc32c_result = compute_crc32c(content_s_path, verbose) if with_crc32c else None
+        chunks_result = compute_chunks(content_s_path, chunk_size) if chunk_size else None
     finally:
-        close_fd_and_file(fd_content_s, content_s_path)
-    return sha_result
+        close_fd_and_file(fd_content_s, content_s_path, fd_part_s, part_s_path)
+    return (sha_result, blake3_result, crc32c_result, chunks_result)
 
 def compute_git_version(in_file_name, verbose):
     git_log_proc = subprocess.Popen(
@@ -100,123 +186,195 @@ def compute_git_version(in_file_name, verbose):
             print (command)
     return git_version_result
 
-def generate_metadata_as_assembly(out_as_file, elf_file_name, mainboot,
+def encode_field_v2(symbol, value):
+    # raw bytes of a 'field' in the format version 2, None when it stays a string
+    if symbol in ("chariotmeta_mainboot_sha256", "chariotmeta_mainboot_blake3"):
+        return bytes.fromhex(value[0:64])
+    if symbol in ("chariotmeta_mainboot_offsetnum", "chariotmeta_mainboot_sizenum",
+            "chariotmeta_mainboot_crc32c", "chariotmeta_extraboot_offsetnum",
+            "chariotmeta_extraboot_sizenum"):
+        return struct.pack('<I', int(value, 16))
+    if symbol == "chariotmeta_mainboot_regions" and value != "PT_LOAD":
+        return b''.join([struct.pack('<II', int(offset, 16), int(size, 16))
+                for (offset, _, size) in [region.partition(':') for region in value.split(',')]])
+    if symbol == "chariotmeta_mainboot_chunks":
+        (chunk_size, root, leaves) = value.split(':')
+        return struct.pack('<I', int(chunk_size, 16)) + bytes.fromhex(root) + bytes.fromhex(leaves)
+    return None
+
+def collect_metadata_fields(elf_file_name, mainboot,
         in_additional_file_name, in_additional_mime,
         in_static_code_analysis_file, in_static_code_analysis_mime,
         in_block_chain_path, in_license, verbose, mainboot_size=0, mainboot_offset=0,
-        additional_size=0, additional_offset=0):
+        additional_size=0, additional_offset=0, mainboot_regions=None, with_blake3=False,
+        with_crc32c=False, chunk_size=None, in_codanalys_binary=None, format_v2=False,
+        mainboot_file_name=None):
+    # list of (symbol, kind, value) in the order of the .chariotmeta.rodata section:
+    # a 'field' string has the size of its characters, a 'text' string includes its
+    # final '\0' in its size, a 'binary' value is the name of a raw file and a
+    # 'bytes' value is raw bytes of the format version 2
+    # the mainboot is hashed in mainboot_file_name, the file with the metadata, since
+    # objcopy rewrites the elf header that the first loadable segment often contains
+    (mainboot_sha256, mainboot_blake3, mainboot_crc32c, mainboot_chunks) = compute_sha_256_content(
+            mainboot_file_name if mainboot_file_name is not None else elf_file_name,
+            mainboot, verbose, with_blake3, with_crc32c, chunk_size)
     content = [
-               ".section .chariotmeta.rodata,\"a\"",
-               " .align 16",
-               " .globl chariotmeta_mainboot_sha256",
-               "chariotmeta_mainboot_sha256:",
-               " .string \"" + compute_sha_256_content(elf_file_name, mainboot, verbose) + " mainboot\"",
-               " .type  chariotmeta_mainboot_sha256, @object",
-               " .size  chariotmeta_mainboot_sha256, 73",
-               # " .align 16",
-               " .globl chariotmeta_format_typeinfo",
-               "chariotmeta_format_typeinfo:",
-               " .string \"!CHARIOTMETAFORMAT_2019a\"",
-               " .type  chariotmeta_format_typeinfo, @object",
-               " .size  chariotmeta_format_typeinfo, 24",
-               # " .align 16",
-               " .globl chariotmeta_mainboot_offsetnum",
-               "chariotmeta_mainboot_offsetnum:",
-               " .string \"" + '{0:08x}'.format(int(mainboot_offset)) + "\" /*@mainboot_offsetnum*/",
-               " .type  chariotmeta_mainboot_offsetnum, @object",
-               " .size  chariotmeta_mainboot_offsetnum, 8",
-               # " .align 16",
-               " .globl chariotmeta_mainboot_sizenum",
-               "chariotmeta_mainboot_sizenum:",
-               " .string \"" + '{0:08x}'.format(int(mainboot_size)) + "\" /*@mainboot_sizenum*/",
-               " .type  chariotmeta_mainboot_sizenum, @object",
-               " .size  chariotmeta_mainboot_sizenum, 8"
-               # " .align 16"
+               ("chariotmeta_mainboot_sha256", 'field', mainboot_sha256 + " mainboot"),
+               ("chariotmeta_format_typeinfo", 'field', "!CHARIOTMETAFORMAT_2019a"),
+               ("chariotmeta_mainboot_offsetnum", 'field', '{0:08x}'.format(int(mainboot_offset))),
+               ("chariotmeta_mainboot_sizenum", 'field', '{0:08x}'.format(int(mainboot_size)))
               ]
+    if mainboot_regions is not None:
+        content.append(("chariotmeta_mainboot_regions", 'field', mainboot_regions))
+    if mainboot_blake3 is not None:
+        content.append(("chariotmeta_mainboot_blake3", 'field', mainboot_blake3 + " mainboot"))
+    if mainboot_crc32c is not None:
+        content.append(("chariotmeta_mainboot_crc32c", 'field', mainboot_crc32c))
+    if mainboot_chunks is not None:
+        content.append(("chariotmeta_mainboot_chunks", 'field', mainboot_chunks))
     if in_additional_file_name is not None:
         content+= [
-                   " .globl chariotmeta_extraboot_sha256",
-                   "chariotmeta_extraboot_sha256:",
-                   " .string \""
-                       + compute_sha_256(in_additional_file_name, verbose)
-                       + ' ' + in_additional_file_name + "\"",
-                   " .type  chariotmeta_extraboot_sha256, @object",
-                   " .size chariotmeta_extraboot_sha256,     . - chariotmeta_extraboot_sha256",
-                   # " .align 16",
-                   " .globl chariotmeta_extraboot_offsetnum",
-                   "chariotmeta_extraboot_offsetnum:",
-                   " .string \"" + '{:08x}'.format(int(additional_offset)) + "\" /*@extraboot_offsetnum*/",
-                   " .type  chariotmeta_extraboot_offsetnum, @object",
-                   " .size  chariotmeta_extraboot_offsetnum, 8",
-                   # " .align 16",
-                   " .globl chariotmeta_extraboot_sizenum",
-                   "chariotmeta_extraboot_sizenum:",
-                   " .string \"" + '{:08x}'.format(int(additional_size)) + "\" /*@extraboot_sizenum*/",
-                   " .type  chariotmeta_extraboot_sizenum, @object",
-                   " .size  chariotmeta_extraboot_sizenum, 8",
-                   # " .align 16",
-                   " .globl chariotmeta_extraboot_typeinfo",
-                   "chariotmeta_extraboot_typeinfo:",
-                   " .string \"" + in_additional_mime + "\"",
-                   " .type  chariotmeta_extraboot_typeinfo, @object",
-                   " .size  chariotmeta_extraboot_typeinfo, " + str(len(in_additional_mime))
-                   # " .align 16"
+                   ("chariotmeta_extraboot_sha256", 'text',
+                       compute_sha_256(in_additional_file_name, verbose) + ' ' + in_additional_file_name),
+                   ("chariotmeta_extraboot_offsetnum", 'field', '{:08x}'.format(int(additional_offset))),
+                   ("chariotmeta_extraboot_sizenum", 'field', '{:08x}'.format(int(additional_size))),
+                   ("chariotmeta_extraboot_typeinfo", 'field', in_additional_mime)
                   ]
     if in_static_code_analysis_file is not None:
-        content+= [
-                   " .globl chariotmeta_codanalys_typeinfo",
-                   "chariotmeta_codanalys_typeinfo:",
-                   " .string \"" + in_static_code_analysis_mime + "\"",
-                   " .type  chariotmeta_codanalys_typeinfo, @object",
-                   " .size  chariotmeta_codanalys_typeinfo, " + str(len(in_static_code_analysis_mime))
-                   # " .align 16"
-                  ]
-    content+= [
-               " .globl chariotmeta_version_data",
-               "chariotmeta_version_data:",
-               " .string \"" + compute_git_version(elf_file_name, verbose) + "\"",
-               " .type  chariotmeta_version_data, @object",
-               " .size chariotmeta_version_data,     . - chariotmeta_version_data"
-               # " .align 16"
-              ]
+        content.append(("chariotmeta_codanalys_typeinfo", 'field', in_static_code_analysis_mime))
+    content.append(("chariotmeta_version_data", 'text', compute_git_version(elf_file_name, verbose)))
     if in_block_chain_path is not None:
-        content+= [
-                   " .globl chariotmeta_firmware_path",
-                   "chariotmeta_firmware_path:",
-                   " .string \"CHARIOTMETA_FIRMWARE_PATH=" + in_block_chain_path + "\"",
-                   " .type chariotmeta_firmware_path,  @object",
-                   " .size chariotmeta_firmware_path,     . - chariotmeta_firmware_path"
-                   # " .align 16"
-                  ]
+        content.append(("chariotmeta_firmware_path", 'text',
+                "CHARIOTMETA_FIRMWARE_PATH=" + in_block_chain_path))
     if in_license is not None:
-        content+= [
-                   " .globl chariotmeta_firmware_license",
-                   "chariotmeta_firmware_license:",
-                   " .string \"CHARIOTMETA_FIRMWARE_LICENSE=" + in_license + "\"",
-                   " .type chariotmeta_firmware_license,  @object",
-                   " .size chariotmeta_firmware_license,     . - chariotmeta_firmware_license"
-                   # " .align 16"
-                  ]
+        content.append(("chariotmeta_firmware_license", 'text',
+                "CHARIOTMETA_FIRMWARE_LICENSE=" + in_license))
     if in_static_code_analysis_file is not None:
         with open(in_static_code_analysis_file, 'r') as ana_file:
-            static_code_analysis = ana_file.read()
-            static_code_analysis = static_code_analysis.replace(
-                    '\\', '\\\\').replace('\n', '\\n').replace('\t', '\\t').replace('"', '\\"')
+            content.append(("chariotmeta_codanalys_data", 'text',
+                    "CHARIOTMETA_CODANALYS_DATA= " + ana_file.read() + " "))
+    if in_codanalys_binary is not None:
+        # raw bytes read in place by chariot_codanalys_open
+        content.append(("chariotmeta_codanalys_binary", 'binary', os.path.abspath(in_codanalys_binary)))
+    if format_v2:
+        # the digests and the numbers become raw little-endian bytes
+        content = [("chariotmeta_format_version", 'bytes', struct.pack('<I', 2))] + [
+                (symbol, kind, value) if kind != 'field' or encode_field_v2(symbol, value) is None
+                else (symbol, 'bytes', encode_field_v2(symbol, value))
+                for (symbol, kind, value) in content]
+    return content
+
+def generate_metadata_as_assembly(out_as_file, fields):
+    content = [".section .chariotmeta.rodata,\"a\"", " .align 16"]
+    for (symbol, kind, value) in fields:
+        if kind == 'binary':
+            content+= [
+                       " .balign 4",
+                       " .globl " + symbol,
+                       symbol + ":",
+                       " .incbin \"" + value + "\""
+                      ]
+        elif kind == 'bytes':
+            content+= [
+                       " .balign 4",
+                       " .globl " + symbol,
+                       symbol + ":",
+                       " .byte " + ",".join([str(byte) for byte in value])
+                      ]
+        else:
+            size = len(value.encode())
+            value = value.replace('\\', '\\\\').replace('\n', '\\n').replace('\t', '\\t').replace('"', '\\"')
             content+= [
-                       " .globl chariotmeta_codanalys_data",
-                       "chariotmeta_codanalys_data:",
-                       " .string \"CHARIOTMETA_CODANALYS_DATA= " + static_code_analysis + " \"",
-                       " .type chariotmeta_codanalys_data,  @object",
-                       " .size chariotmeta_codanalys_data,     . - chariotmeta_codanalys_data"
+                       " .globl " + symbol,
+                       symbol + ":",
+                       " .string \"" + value + "\""
                       ]
+        content.append(" .type " + symbol + ", @object")
+        if kind == 'field':
+            content.append(" .size " + symbol + ", " + str(size))
+        else:
+            content.append(" .size " + symbol + ", . - " + symbol)
     for line in content:
         out_as_file.write(line);
         out_as_file.write('\n');
 
+def load_elf_target(elf_name):
+    # (e_machine, e_flags, is_big_endian) of an elf32 file
+    with open(elf_name, 'rb') as elf_file:
+        header = elf_file.read(52)
+    if len(header) < 52 or header[0:4] != b'\x7fELF':
+        print ("[error] " + elf_name + " is not an elf file")
+        raise OSError(1)
+    endian = '>' if header[5] == 2 else '<'
+    (machine,) = struct.unpack(endian + 'H', header[18:20])
+    (flags,) = struct.unpack(endian + 'I', header[36:40])
+    return (machine, flags, header[5] == 2)
+
+# writes the relocatable object without any assembler when it is built
+native_object_writer = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+        'chariot_writeobj_meta_data.exe')
+
+def build_metadata_object(fields, elf_file_name, metadata_s_path, metadata_o_path, verbose,
+        is_compressed=False):
+    if os.path.isfile(native_object_writer):
+        (machine, flags, is_big_endian) = load_elf_target(elf_file_name)
+        command = [native_object_writer, '--machine', str(machine), '--flags', str(flags)]
+        if is_big_endian:
+            command.append('--big-endian')
+        text_paths = []
+        try:
+            for (symbol, kind, value) in fields:
+                if kind == 'binary':
+                    command+= ['--binary-file', symbol, value]
+                elif kind == 'bytes':
+                    fd_bytes, bytes_path = tempfile.mkstemp()
+                    text_paths+= [fd_bytes, bytes_path]
+                    with open(bytes_path, 'wb') as bytes_file:
+                        bytes_file.write(value)
+                    command+= ['--binary-file', symbol, bytes_path]
+                elif kind == 'text' and len(value) > 4096:
+                    # too long for a command line argument
+                    fd_text, text_path = tempfile.mkstemp()
+                    text_paths+= [fd_text, text_path]
+                    with open(text_path, 'w') as text_file:
+                        text_file.write(value)
+                    command+= ['--text-file', symbol, text_path]
+                else:
+                    command+= ['--' + kind, symbol, value]
+                if is_compressed and symbol == 'chariotmeta_codanalys_data':
+                    # zlib SHF_COMPRESSED section, streamed by the readers
+                    command+= ['--compress', symbol]
+            command+= ['--output', metadata_o_path]
+            returncode = subprocess.call(command)
+        finally:
+            close_fd_and_file(*text_paths)
+        if verbose or returncode:
+            command = native_object_writer + " ... --output " + metadata_o_path
+            if returncode:
+                print ("[error] the command " + command + " has failed with return code " + str(returncode))
+                raise OSError(returncode)
+            print (command)
+        return
+    if is_compressed and verbose:
+        print ("the metadata are not compressed without " + native_object_writer)
+    with open(metadata_s_path, 'w') as assembly_file:
+        generate_metadata_as_assembly(assembly_file, fields)
+    # could use as instead of gcc: as --32
+    gcc_option = "-m32" # -m32
+    # as_option = "" # --32
+    returncode = os.system('gcc -ffreestanding %s -c -O %s -Wall -o %s' % (gcc_option, metadata_s_path, metadata_o_path))
+    # os.system('as %s %s -o %s' % (as_option, metadata_s_path, metadata_o_path))
+    if verbose or returncode:
+        command = "gcc -ffreestanding " + gcc_option + " -c -O " + metadata_s_path + " -Wall -o " + metadata_o_path + " \""
+        if returncode:
+            print ("[error] the command " + command + " has failed with return code " + str(returncode))
+            raise OSError(returncode)
+        print (command)
+
 def generate_additional_as_c_file(c_file_with_additional, additional_data_file, additional_data_mime, verbose):
     c_file_with_additional.write('const char boot_supplementary_data[] __attribute__((section(".suppldata"))) = {\n')
     hexdump_proc = subprocess.Popen(['hexdump', '-v', '-e', '/1 \" %#x,\"', additional_data_file], stdout=subprocess.PIPE)
-    hex_result = hexdump_proc.stdout.read()
+    hex_result = hexdump_proc.stdout.read().decode()
     returncode = hexdump_proc.wait()
     if verbose or returncode:
         command = "hexdump -v -e '/1 \" %#x,\"' " + additional_data_file
@@ -227,6 +385,38 @@ def generate_additional_as_c_file(c_file_with_additional, additional_data_file,
     c_file_with_additional.write(hex_result)
     c_file_with_additional.write("};\n")
 
+def build_additional_object(additional_data_file, elf_file_name, additional_o_path, verbose):
+    if os.path.isfile(native_object_writer):
+        # the payload bytes are copied as is, without any C encoding
+        (machine, flags, is_big_endian) = load_elf_target(elf_file_name)
+        command = [native_object_writer, '--suppldata', '--machine', str(machine), '--flags', str(flags)]
+        if is_big_endian:
+            command.append('--big-endian')
+        command+= ['--binary-file', 'boot_supplementary_data', additional_data_file,
+                '--output', additional_o_path]
+        returncode = subprocess.call(command)
+        if verbose or returncode:
+            command = " ".join(command)
+            if returncode:
+                print ("[error] the command " + command + " has failed with return code " + str(returncode))
+                raise OSError(returncode)
+            print (command)
+        return
+    fd_additional_c, additional_c_path = tempfile.mkstemp(suffix = ".c")
+    try:
+        with open(additional_c_path, 'w') as c_file_with_additional:
+            generate_additional_as_c_file(c_file_with_additional, additional_data_file, None, verbose)
+        gcc_option = "-m32" # -m32
+        returncode = os.system('gcc -ffreestanding %s -O -c %s -Wall -o %s' % (gcc_option, additional_c_path, additional_o_path))
+        if verbose or returncode:
+            command = "gcc -ffreestanding " + gcc_option + " -O -c " + additional_c_path + " -Wall -o " + additional_o_path + " \""
+            if returncode:
+                print ("[error] the command " + command + " has failed with return code " + str(returncode))
+                raise OSError(returncode)
+            print (command)
+    finally:
+        close_fd_and_file(fd_additional_c, additional_c_path)
+
 def extract_info(output_file, section):
     size_proc = subprocess.Popen(['size', '-A', '-d', output_file], stdout=subprocess.PIPE)
     partition = None
@@ -248,6 +438,40 @@ def extract_info(output_file, section):
         print (command)
     return (partition[1], partition[2])
 
+def extract_file_region(output_file, section):
+    # (size, file offset) of the section, the library hashes the file content
+    objdump_proc = subprocess.Popen(['objdump', '-h', '-w', output_file], stdout=subprocess.PIPE)
+    partition = None
+    while True:
+        line = objdump_proc.stdout.readline().decode()
+        if len(line) == 0:
+            break
+        fields = line.split()
+        if len(fields) >= 6 and fields[1] == '.' + section:
+            partition = fields
+    returncode = objdump_proc.wait()
+    if args.verbose or returncode or partition is None:
+        command = "objdump -h -w " + output_file
+        if returncode or partition is None:
+            print ("[error] the command " + command + " has failed with return code " + str(returncode))
+            if partition is None:
+                print ("section ." + section + " not found")
+            raise OSError(returncode)
+        print (command)
+    return (int(partition[2], 16), int(partition[5], 16))
+
+def extract_mainboot_regions(output_file, mainboot):
+    # None when the legacy offsetnum/sizenum pair is enough,
+    # placeholders of the same size without output_file
+    if mainboot is None:
+        return "PT_LOAD"
+    if len(mainboot) == 1:
+        return None
+    if output_file is None:
+        return ",".join(["00000000:00000000"]*len(mainboot))
+    return ",".join(['{0:08x}:{1:08x}'.format(offset, size)
+            for (size, offset) in [extract_file_region(output_file, section) for section in mainboot]])
+
 def extract_sub_info(output_file, section):
     fd_content_s, content_s_path = tempfile.mkstemp()
     try:
@@ -284,8 +508,18 @@ parser = argparse.ArgumentParser(description='Add Chariot meta-data into an elf
 parser.add_argument('exe_name', help='the name of the executable elf file')
 # parser.add_argument('--march', '-march', nargs=2, required=True,
 #                    help='option passed to gcc')
-parser.add_argument('--boot', '-boot', nargs=1, required=True,
-                   help='name of the main boot section of the elf file')
+parser.add_argument('--boot', '-boot', action='append',
+                   help='name of a main boot section of the elf file (can be repeated)')
+parser.add_argument('--boot-segments', '-boot-segments', action='store_true',
+                   help='the main boot is made of all the loadable segments of the elf file')
+parser.add_argument('--blake3', '-blake3', action='store_true',
+                   help='also store the blake3 digest of the main boot (requires chariot_digest_meta_data.exe or b3sum)')
+parser.add_argument('--crc32c', '-crc32c', action='store_true',
+                   help='also store the crc32c of the main boot for a quick check')
+parser.add_argument('--chunks', '-chunks', action='store_true',
+                   help='also store the Merkle table of the main boot chunks')
+parser.add_argument('--chunk-size', '-chunk-size', type=int, default=4096,
+                   help='size of the main boot chunks for --chunks (default 4096)')
 parser.add_argument('--add', '-add', nargs=2,
                    help='additional file/mime to encode in the Chariot supplementary section')
 parser.add_argument('--verbose', '-v', action='store_true',
@@ -296,9 +530,19 @@ parser.add_argument('--license', '-lic', nargs=1,
                    help='the license of the firmware in the Chariot format')
 parser.add_argument('--static-analysis', '-sa', nargs=2,
                    help='result of the static analysis as file/format')
+parser.add_argument('--codanalys-binary', '-cab', nargs=1,
+                   help='compact binary code analysis data written by chariot_stackdepth.exe --binary')
 parser.add_argument('--output', '-o', nargs=1,
                    help='output file if different from the original file')
+parser.add_argument('--format-v2', '-format-v2', action='store_true',
+                   help='store the digests and the numbers as raw little-endian bytes')
+parser.add_argument('--compress', '-compress', action='store_true',
+                   help='store the static analysis in a zlib SHF_COMPRESSED section')
 args = parser.parse_args()
+if (args.boot is None) == (not args.boot_segments):
+    parser.error('exactly one of the arguments --boot --boot-segments is required')
+if args.chunk_size <= 0:
+    parser.error('the argument --chunk-size should be positive')
 
 # produces additional temporary files
 if args.add is not None:
@@ -315,6 +559,8 @@ else:
     static_code_analysis_file = None
     static_code_analysis_mime = None
 
+codanalys_binary = args.codanalys_binary[0] if args.codanalys_binary is not None else None
+
 if args.blockchain_path is not None:
     blockchain_path = args.blockchain_path[0]
 else:
@@ -325,69 +571,40 @@ if args.license is not None:
 else:
     license = None
 
-mainboot = args.boot[0]
+mainboot = args.boot # None for all the loadable segments
 
-print ("generate section containing metadata as an assembly file")
+print ("generate section containing metadata as an elf object file")
 fd_metadata_s, metadata_s_path = tempfile.mkstemp(suffix=".s")
+fd_metadata_o, metadata_o_path = tempfile.mkstemp()
 try:
-    assembly_file_without_data = open(metadata_s_path, 'w')
-    generate_metadata_as_assembly(assembly_file_without_data, args.exe_name, args.boot[0],
+    build_metadata_object(collect_metadata_fields(args.exe_name, mainboot,
             additional_data_file, additional_data_mime,
             static_code_analysis_file, static_code_analysis_mime,
-            blockchain_path, license, args.verbose)
-    assembly_file_without_data.close()
+            blockchain_path, license, args.verbose, with_blake3=args.blake3,
+            with_crc32c=args.crc32c, chunk_size=args.chunk_size if args.chunks else None,
+            in_codanalys_binary=codanalys_binary, format_v2=args.format_v2,
+            mainboot_regions=extract_mainboot_regions(None, mainboot)),
+            args.exe_name, metadata_s_path, metadata_o_path, args.verbose, args.compress)
 except OSError as err:
-    os.close(fd_metadata_s)
-    os.remove(metadata_s_path)
+    close_fd_and_file(fd_metadata_s, metadata_s_path, fd_metadata_o, metadata_o_path)
     sys.exit(err.errno)
 
-print ("compile metadata assembly file into an elf object file")
-fd_metadata_o, metadata_o_path = tempfile.mkstemp()
-# could use as instead of gcc: as --32
-gcc_option = "-m32" # -m32
-# as_option = "" # --32
-returncode = os.system('gcc -ffreestanding %s -c -O %s -Wall -o %s' % (gcc_option, metadata_s_path, metadata_o_path))
-# os.system('as %s %s -o %s' % (as_option, metadata_s_path, metadata_o_path))
-if args.verbose or returncode:
-    command = "gcc -ffreestanding " + gcc_option + " -c -O " + metadata_s_path + " -Wall -o " + metadata_o_path + " \""
-    if returncode:
-        print ("[error] the command " + command + " has failed with return code " + str(returncode))
-        close_fd_and_file(fd_metadata_s, metadata_s_path)
-        os.close(fd_metadata_o)
-        sys.exit(returncode)
-    print (command)
-
 if args.output is not None:
     output_file = args.output[0]
 else:
     fd_output, output_file = tempfile.mkstemp()
 
 if additional_data_file is not None:
-    print ("compile extra-data file into an elf object file")
-    fd_additional_c, additional_c_path = tempfile.mkstemp(suffix = ".c")
-    c_file_with_additional = open(additional_c_path, 'w')
+    print ("wrap extra-data file into an elf object file")
+    fd_additional_o, additional_o_path = tempfile.mkstemp()
     try:
-        generate_additional_as_c_file(c_file_with_additional, additional_data_file, additional_data_mime, args.verbose)
+        build_additional_object(additional_data_file, args.exe_name, additional_o_path, args.verbose)
     except OSError as err:
-        c_file_with_additional.close()
-        close_fd_and_file(fd_metadata_s, metadata_s_path, fd_metadata_o, metadata_o_path)
+        close_fd_and_file(fd_metadata_s, metadata_s_path, fd_additional_o, additional_o_path,
+                fd_metadata_o, metadata_o_path)
         if args.output is None:
             os.close(fd_output)
         sys.exit(err.errno)
-    c_file_with_additional.close()
-    fd_additional_o, additional_o_path = tempfile.mkstemp()
-    returncode = os.system('gcc -ffreestanding %s -O -c %s -Wall -o %s' % (gcc_option, additional_c_path, additional_o_path))
-    if args.verbose or returncode:
-        command = "gcc -ffreestanding " + gcc_option + " -O -c " + additional_c_path + " -Wall -o " + additional_o_path + " \""
-        if returncode:
-            print ("[error] the command " + command + " has failed with return code " + str(returncode))
-            close_fd_and_file(fd_metadata_s, metadata_s_path, fd_additional_c, additional_c_path,
-                    fd_additional_o, additional_o_path, fd_metadata_o, metadata_o_path)
-            if args.output is None:
-                os.close(fd_output)
-            sys.exit(returncode)
-        print (command)
-    close_fd_and_file(fd_additional_c, additional_c_path)
 
     print ("add meta-data and extra-data into the elf executable file")
     fstAction = "add-section" if not has_section(args.exe_name, "chariotmeta.rodata") else "update-section"
@@ -423,32 +640,26 @@ else:
             sys.exit(returncode)
         print (command)
 
-print ("update meta-data assembly file")
+print ("update meta-data elf object file")
 try:
-    (mainboot_size, mainboot_offset) = extract_info(output_file, mainboot)
+    if mainboot is not None:
+        (mainboot_size, mainboot_offset) = extract_file_region(output_file, mainboot[0])
+    else:
+        (mainboot_offset, mainboot_size) = load_segments(output_file)[0]
+    mainboot_regions = extract_mainboot_regions(output_file, mainboot)
     (additional_size, additional_offset) = (0, 0)
     if additional_data_file is not None:
         additional_size, additional_offset = extract_sub_info(output_file, "suppldata")
-    assembly_file_without_data = open(metadata_s_path, 'w')
-    generate_metadata_as_assembly(assembly_file_without_data, args.exe_name, mainboot,
+    print ("regenerate metadata elf object file after update")
+    fields = collect_metadata_fields(args.exe_name, mainboot,
             additional_data_file, additional_data_mime,
             static_code_analysis_file, static_code_analysis_mime,
             blockchain_path, license, args.verbose, mainboot_size, mainboot_offset,
-            additional_size, additional_offset)
-    assembly_file_without_data.close()
-    print ("recompile metadata assembly file after update")
-    returncode = os.system('gcc -ffreestanding %s -c -O %s -Wall -o %s' % (gcc_option, metadata_s_path, metadata_o_path))
-    if args.verbose or returncode:
-        command = "gcc -ffreestanding " + gcc_option + " -c -O " + metadata_s_path + " -Wall -o " + metadata_o_path + " \""
-        if returncode:
-            print ("[error] the command " + command + " has failed with return code " + str(returncode))
-            close_fd_and_file(fd_metadata_s, metadata_s_path, fd_metadata_o, metadata_o_path)
-            if additional_data_file is not None:
-                close_fd_and_file(fd_additional_o, additional_o_path)
-            if args.output is None:
-                close_fd_and_file(fd_output, output_file)
-            sys.exit(returncode)
-        print (command)
+            additional_size, additional_offset, mainboot_regions, args.blake3, args.crc32c,
+            args.chunk_size if args.chunks else None, codanalys_binary, args.format_v2,
+            output_file)
+    build_metadata_object(fields, args.exe_name, metadata_s_path, metadata_o_path,
+            args.verbose, args.compress)
     if additional_data_file is not None:
         print ("add again meta-data and extra-data into the elf executable file")
         fstAction = "add-section" if not has_section(args.exe_name, "chariotmeta.rodata") else "update-section"
@@ -485,6 +696,16 @@ try:
                 sys.exit(returncode)
             print (command)
 
+    # the metadata of the same size should leave the elf header unchanged: check it
+    (mainboot_sha256, _, _, _) = compute_sha_256_content(output_file, mainboot, args.verbose)
+    expected_sha256 = [value for (symbol, kind, value) in fields
+            if symbol == "chariotmeta_mainboot_sha256"][0]
+    if isinstance(expected_sha256, bytes):
+        expected_sha256 = expected_sha256.hex()
+    if mainboot_sha256 != expected_sha256[0:64]:
+        print ("[error] the mainboot of " + output_file + " does not match its mainboot_sha256")
+        raise OSError(1)
+
 except OSError as err:
     close_fd_and_file(fd_metadata_s, metadata_s_path, fd_metadata_o, metadata_o_path)
     if args.output is None:
@@ -0,0 +1,513 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "chariot_archive.h"
+#include "chariot_sha256.h"
+
+#define ARCHIVE_HEADER_SIZE (8 + 5*4 + 2*32)
+#define ARCHIVE_CHUNK_ENTRY_SIZE (32 + 4)
+#define ARCHIVE_PATH_SIZE 4096
+
+static const char archive_magic[8] = { 'C', 'H', 'A', 'R', 'I', 'O', 'T', 'A' };
+
+static void
+store_u32(unsigned char* target, uint32_t value) {
+   target[0] = (unsigned char) value;
+   target[1] = (unsigned char) (value >> 8);
+   target[2] = (unsigned char) (value >> 16);
+   target[3] = (unsigned char) (value >> 24);
+}
+
+static uint32_t
+load_u32(const unsigned char* source) {
+   return (uint32_t) source[0] | ((uint32_t) source[1] << 8)
+      | ((uint32_t) source[2] << 16) | ((uint32_t) source[3] << 24);
+}
+
+/* digests follow the convention of retrieve_mainboot_sha256: digest[7] is the first word */
+static void
+store_digest(unsigned char* target, const uint32_t digest[8]) {
+   for (int index = 0; index < 8; ++index) {
+      uint32_t word = digest[7-index];
+      target[4*index] = (unsigned char) (word >> 24);
+      target[4*index+1] = (unsigned char) (word >> 16);
+      target[4*index+2] = (unsigned char) (word >> 8);
+      target[4*index+3] = (unsigned char) word;
+   }
+}
+
+static void
+load_digest(uint32_t digest[8], const unsigned char* source) {
+   for (int index = 0; index < 8; ++index)
+      digest[7-index] = ((uint32_t) source[4*index] << 24) | ((uint32_t) source[4*index+1] << 16)
+         | ((uint32_t) source[4*index+2] << 8) | (uint32_t) source[4*index+3];
+}
+
+void chariot_archive_chunker_init(Chariot_Archive_chunker* chunker) {
+   // splitmix64 sequence, the boundaries only depend on this fixed table
+   uint64_t state = 0x43484152494f5441ULL;
+   for (int index = 0; index < 256; ++index) {
+      uint64_t value = (state += 0x9e3779b97f4a7c15ULL);
+      value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+      chunker->gear[index] = value ^ (value >> 31);
+   }
+}
+
+size_t chariot_archive_next_chunk(const Chariot_Archive_chunker* chunker, const unsigned char* data,
+      size_t len) {
+   if (len <= CHARIOT_ARCHIVE_MIN_CHUNK)
+      return len;
+   size_t end = len < CHARIOT_ARCHIVE_MAX_CHUNK ? len : CHARIOT_ARCHIVE_MAX_CHUNK;
+   // the hash forgets a byte after 64 shifts, a boundary only depends on the 64 last bytes
+   uint64_t hash = 0;
+   for (size_t index = CHARIOT_ARCHIVE_MIN_CHUNK; index < end; ++index) {
+      hash = (hash << 1) + chunker->gear[data[index]];
+      if ((hash >> (64 - CHARIOT_ARCHIVE_AVERAGE_CHUNK_BITS)) == 0)
+         return index + 1;
+   }
+   return end;
+}
+
+static bool
+is_valid_image_name(const char* image_name) {
+   return image_name[0] != '\0' && strchr(image_name, '/') == NULL
+      && strcmp(image_name, ".") != 0 && strcmp(image_name, "..") != 0;
+}
+
+static bool
+make_directory(const char* path) {
+   return mkdir(path, 0777) == 0 || errno == EEXIST;
+}
+
+static void
+write_hex_digest(char* target, const unsigned char digest[32]) {
+   static const char hex_digits[] = "0123456789abcdef";
+   for (int index = 0; index < 32; ++index) {
+      target[2*index] = hex_digits[digest[index] >> 4];
+      target[2*index+1] = hex_digits[digest[index] & 0xf];
+   }
+   target[64] = '\0';
+}
+
+/* path of a chunk from the 32 bytes of its sha256 */
+static bool
+chunk_path(char path[ARCHIVE_PATH_SIZE], const char* directory, const unsigned char digest[32]) {
+   char hex[65];
+   write_hex_digest(hex, digest);
+   int len = snprintf(path, ARCHIVE_PATH_SIZE, "%s/chunks/%.2s/%s", directory, hex, hex);
+   return len > 0 && len < ARCHIVE_PATH_SIZE;
+}
+
+static bool
+record_path(char path[ARCHIVE_PATH_SIZE], const char* directory, const char* image_name) {
+   int len = snprintf(path, ARCHIVE_PATH_SIZE, "%s/images/%s", directory, image_name);
+   return len > 0 && len < ARCHIVE_PATH_SIZE;
+}
+
+/* writes content into path through a temporary file, so that a reader never sees a partial file */
+static bool
+write_file(const char* path, const void* content, size_t len, const void* tail, size_t tail_len) {
+   char temporary_path[ARCHIVE_PATH_SIZE + 32];
+   snprintf(temporary_path, sizeof(temporary_path), "%s.tmp%ld", path, (long) getpid());
+   FILE* file = fopen(temporary_path, "wb");
+   if (!file)
+      return false;
+   bool result = fwrite(content, 1, len, file) == len
+      && (tail_len == 0 || fwrite(tail, 1, tail_len, file) == tail_len);
+   if (fclose(file) != 0)
+      result = false;
+   if (result && rename(temporary_path, path) != 0)
+      result = false;
+   if (!result)
+      remove(temporary_path);
+   return result;
+}
+
+int chariot_archive_store(const char* directory, const char* image_name, const char* buffer_exe,
+      size_t buffer_len, Chariot_Archive_statistics* statistics, const char** error_message) {
+   if (!is_valid_image_name(image_name)) {
+      *error_message = "invalid image name for the archive";
+      return false;
+   }
+   if (buffer_len > UINT32_MAX) {
+      *error_message = "the firmware is too large for the archive";
+      return false;
+   }
+
+   // the metadata are extracted and the mainboot is checked before anything is stored
+   Elf32_Ehdr elf_header, metadata_elf_header;
+   Elf32_Shdr metadata_section;
+   if (!fill_exe_header(&elf_header, buffer_exe, buffer_len, error_message)
+         || !retrieve_section_header(&metadata_section, &elf_header, buffer_exe, buffer_len, CS_Meta,
+            error_message))
+      return false;
+   if (metadata_section.sh_offset > buffer_len
+         || metadata_section.sh_size > buffer_len - metadata_section.sh_offset) {
+      *error_message = "unable to read the metadata section: buffer is too small";
+      return false;
+   }
+   if (!fill_exe_header(&metadata_elf_header, buffer_exe + metadata_section.sh_offset,
+         metadata_section.sh_size, error_message))
+      return false;
+   Chariot_Metadata_localizations metadata_dict;
+   metadata_dict.valid_entries = 0;
+   metadata_dict.metadata_header = &metadata_elf_header;
+   metadata_dict.metadata_section = &metadata_section;
+   metadata_dict.metadata_buffer_exe = buffer_exe + metadata_section.sh_offset;
+   metadata_dict.metadata_buffer_len = metadata_section.sh_size;
+   Chariot_Mainboot_region regions[CHARIOT_MAINBOOT_REGIONS_MAX];
+   size_t regions_number = 0;
+   uint32_t mainboot_sha256[8], image_sha256[8];
+   if (!fill_metadata_dict(&metadata_dict, error_message)
+         || !verify_mainboot_sha256(&elf_header, buffer_exe, buffer_len, &metadata_dict, error_message)
+         || !retrieve_mainboot_sha256(mainboot_sha256, &metadata_dict, error_message)
+         || !retrieve_mainboot_regions(regions, &regions_number, CHARIOT_MAINBOOT_REGIONS_MAX,
+            &elf_header, buffer_exe, buffer_len, &metadata_dict, error_message))
+      return false;
+
+   char path[ARCHIVE_PATH_SIZE];
+   int path_len = snprintf(path, sizeof(path), "%s/chunks", directory);
+   if (path_len <= 0 || path_len + 4 >= ARCHIVE_PATH_SIZE) {
+      *error_message = "the path of the archive is too long";
+      return false;
+   }
+   if (!make_directory(directory) || !make_directory(path)
+         || (snprintf(path, sizeof(path), "%s/images", directory), !make_directory(path))) {
+      *error_message = "unable to create the archive directories";
+      return false;
+   }
+
+   size_t regions_size = regions_number*8;
+   size_t chunks_capacity = buffer_len/CHARIOT_ARCHIVE_MIN_CHUNK + 1;
+   size_t record_len = ARCHIVE_HEADER_SIZE + regions_size + metadata_section.sh_size;
+   unsigned char* record = (unsigned char*) malloc(record_len);
+   unsigned char* chunks = (unsigned char*) malloc(chunks_capacity*ARCHIVE_CHUNK_ENTRY_SIZE);
+   Chariot_Archive_chunker* chunker = (Chariot_Archive_chunker*) malloc(sizeof(Chariot_Archive_chunker));
+   bool result = false;
+   if (!record || !chunks || !chunker) {
+      *error_message = "not enough memory";
+      goto end;
+   }
+   chariot_archive_chunker_init(chunker);
+
+   // one pass over the firmware computes the boundaries, the chunk digests and the image digest
+   Chariot_Sha256_context image_context;
+   chariot_sha256_init(&image_context);
+   statistics->chunks_number = statistics->new_chunks_number = statistics->new_bytes = 0;
+   const unsigned char* data = (const unsigned char*) buffer_exe;
+   for (size_t position = 0; position < buffer_len; ) {
+      size_t len = chariot_archive_next_chunk(chunker, data + position, buffer_len - position);
+      Chariot_Sha256_context context;
+      uint32_t sha256[8];
+      chariot_sha256_init(&context);
+      chariot_sha256_update(&context, data + position, len);
+      chariot_sha256_final(&context, sha256);
+      chariot_sha256_update(&image_context, data + position, len);
+      unsigned char* entry = chunks + statistics->chunks_number*ARCHIVE_CHUNK_ENTRY_SIZE;
+      store_digest(entry, sha256);
+      store_u32(entry + 32, (uint32_t) len);
+
+      if (!chunk_path(path, directory, entry)) {
+         *error_message = "the path of the archive is too long";
+         goto end;
+      }
+      if (access(path, F_OK) != 0) {
+         // the parent chunks/xx directory ends 65 characters before the file name
+         path[strlen(path) - 65] = '\0';
+         bool is_written = make_directory(path);
+         path[strlen(path)] = '/';
+         if (!is_written || !write_file(path, data + position, len, NULL, 0)) {
+            *error_message = "unable to write a chunk in the archive";
+            goto end;
+         }
+         ++statistics->new_chunks_number;
+         statistics->new_bytes += len;
+      }
+      ++statistics->chunks_number;
+      position += len;
+   }
+   chariot_sha256_final(&image_context, image_sha256);
+
+   memcpy(record, archive_magic, 8);
+   store_u32(record + 8, CHARIOT_ARCHIVE_VERSION);
+   store_u32(record + 12, (uint32_t) buffer_len);
+   store_u32(record + 16, (uint32_t) statistics->chunks_number);
+   store_u32(record + 20, metadata_section.sh_size);
+   store_u32(record + 24, (uint32_t) regions_number);
+   store_digest(record + 28, image_sha256);
+   store_digest(record + 60, mainboot_sha256);
+   for (size_t region_index = 0; region_index < regions_number; ++region_index) {
+      store_u32(record + ARCHIVE_HEADER_SIZE + 8*region_index, regions[region_index].offset);
+      store_u32(record + ARCHIVE_HEADER_SIZE + 8*region_index + 4, regions[region_index].size);
+   }
+   memcpy(record + ARCHIVE_HEADER_SIZE + regions_size, buffer_exe + metadata_section.sh_offset,
+         metadata_section.sh_size);
+   if (!record_path(path, directory, image_name)
+         || !write_file(path, record, record_len, chunks,
+            statistics->chunks_number*ARCHIVE_CHUNK_ENTRY_SIZE)) {
+      *error_message = "unable to write the record of the image in the archive";
+      goto end;
+   }
+   result = true;
+
+end:
+   free(record);
+   free(chunks);
+   free(chunker);
+   return result;
+}
+
+/* reads the record up to its chunk list */
+static bool
+load_record(Chariot_Archive_record* record, FILE* file, const char** error_message) {
+   unsigned char header[ARCHIVE_HEADER_SIZE];
+   memset(record, 0, sizeof(Chariot_Archive_record));
+   if (fread(header, 1, ARCHIVE_HEADER_SIZE, file) != ARCHIVE_HEADER_SIZE
+         || memcmp(header, archive_magic, 8) != 0) {
+      *error_message = "the record has not the chariot archive format";
+      return false;
+   }
+   if (load_u32(header + 8) != CHARIOT_ARCHIVE_VERSION) {
+      *error_message = "unsupported version of chariot archive";
+      return false;
+   }
+   record->image_size = load_u32(header + 12);
+   record->chunks_number = load_u32(header + 16);
+   record->metadata_size = load_u32(header + 20);
+   record->regions_number = load_u32(header + 24);
+   load_digest(record->image_sha256, header + 28);
+   load_digest(record->mainboot_sha256, header + 60);
+   if (record->regions_number > CHARIOT_MAINBOOT_REGIONS_MAX) {
+      *error_message = "too many mainboot regions in the record";
+      return false;
+   }
+   for (size_t region_index = 0; region_index < record->regions_number; ++region_index) {
+      unsigned char region[8];
+      if (fread(region, 1, 8, file) != 8) {
+         *error_message = "the record is truncated";
+         return false;
+      }
+      record->regions[region_index].offset = load_u32(region);
+      record->regions[region_index].size = load_u32(region + 4);
+      if (record->regions[region_index].offset > record->image_size
+            || record->regions[region_index].size > record->image_size - record->regions[region_index].offset) {
+         *error_message = "a mainboot region is out of the archived firmware";
+         return false;
+      }
+   }
+   record->metadata = (char*) malloc(record->metadata_size + 1);
+   if (!record->metadata) {
+      *error_message = "not enough memory";
+      return false;
+   }
+   if (fread(record->metadata, 1, record->metadata_size, file) != record->metadata_size) {
+      *error_message = "the record is truncated";
+      return false;
+   }
+   return true;
+}
+
+int chariot_archive_read_record(Chariot_Archive_record* record, const char* directory,
+      const char* image_name, const char** error_message) {
+   char path[ARCHIVE_PATH_SIZE];
+   memset(record, 0, sizeof(Chariot_Archive_record));
+   FILE* file = NULL;
+   if (!is_valid_image_name(image_name) || !record_path(path, directory, image_name)
+         || !(file = fopen(path, "rb"))) {
+      *error_message = "unable to find the image in the archive";
+      return false;
+   }
+   bool result = load_record(record, file, error_message);
+   fclose(file);
+   return result;
+}
+
+void chariot_archive_record_free(Chariot_Archive_record* record) {
+   free(record->metadata);
+   record->metadata = NULL;
+}
+
+typedef struct {
+   FILE* target;
+   const Chariot_Archive_record* record;
+   Chariot_Sha256_context image_context;
+   Chariot_Sha256_context mainboot_context;
+   size_t written;
+   bool are_regions_in_order;
+   size_t region_index; // next region to hash when they are in order
+   unsigned char* gathered; // concatenation of the regions otherwise
+   size_t region_starts[CHARIOT_MAINBOOT_REGIONS_MAX]; // in gathered
+} Archive_output;
+
+/* hashes the part of the mainboot regions in [written, written+len) */
+static void
+hash_mainboot(Archive_output* output, const unsigned char* buffer, size_t len) {
+   const Chariot_Archive_record* record = output->record;
+   size_t start = output->written, end = start + len;
+   if (output->are_regions_in_order) {
+      for (; output->region_index < record->regions_number; ++output->region_index) {
+         const Chariot_Mainboot_region* region = &record->regions[output->region_index];
+         size_t region_end = (size_t) region->offset + region->size;
+         size_t first = region->offset > start ? region->offset : start;
+         size_t last = region_end < end ? region_end : end;
+         if (first < last)
+            chariot_sha256_update(&output->mainboot_context, buffer + (first - start), last - first);
+         if (region_end > end)
+            break;
+      }
+      return;
+   }
+   for (size_t region_index = 0; region_index < record->regions_number; ++region_index) {
+      const Chariot_Mainboot_region* region = &record->regions[region_index];
+      size_t region_end = (size_t) region->offset + region->size;
+      size_t first = region->offset > start ? region->offset : start;
+      size_t last = region_end < end ? region_end : end;
+      if (first < last)
+         memcpy(output->gathered + output->region_starts[region_index] + (first - region->offset),
+               buffer + (first - start), last - first);
+   }
+}
+
+static bool
+write_output(Archive_output* output, const unsigned char* buffer, size_t len, const char** error_message) {
+   if (len > output->record->image_size - output->written) {
+      *error_message = "the chunks produce more bytes than the image size";
+      return false;
+   }
+   if (fwrite(buffer, 1, len, output->target) != len) {
+      *error_message = "unable to write the restored firmware";
+      return false;
+   }
+   chariot_sha256_update(&output->image_context, buffer, len);
+   hash_mainboot(output, buffer, len);
+   output->written += len;
+   return true;
+}
+
+int chariot_archive_restore(FILE* target, const char* directory, const char* image_name,
+      const char** error_message) {
+   char path[ARCHIVE_PATH_SIZE];
+   FILE* file = NULL;
+   if (!is_valid_image_name(image_name) || !record_path(path, directory, image_name)
+         || !(file = fopen(path, "rb"))) {
+      *error_message = "unable to find the image in the archive";
+      return false;
+   }
+   Chariot_Archive_record record;
+   Archive_output output;
+   unsigned char* buffer = NULL;
+   bool result = false;
+   output.gathered = NULL;
+   if (!load_record(&record, file, error_message))
+      goto end;
+
+   output.target = target;
+   output.record = &record;
+   output.written = 0;
+   output.region_index = 0;
+   output.are_regions_in_order = true;
+   size_t gathered_len = 0;
+   for (size_t region_index = 0; region_index < record.regions_number; ++region_index) {
+      if (region_index > 0 && record.regions[region_index].offset
+            < (size_t) record.regions[region_index-1].offset + record.regions[region_index-1].size)
+         output.are_regions_in_order = false;
+      output.region_starts[region_index] = gathered_len;
+      gathered_len += record.regions[region_index].size;
+   }
+   chariot_sha256_init(&output.image_context);
+   chariot_sha256_init(&output.mainboot_context);
+   buffer = (unsigned char*) malloc(CHARIOT_ARCHIVE_MAX_CHUNK);
+   if (!output.are_regions_in_order)
+      output.gathered = (unsigned char*) malloc(gathered_len + 1);
+   if (!buffer || (!output.are_regions_in_order && !output.gathered)) {
+      *error_message = "not enough memory";
+      goto end;
+   }
+
+   for (size_t chunk_index = 0; chunk_index < record.chunks_number; ++chunk_index) {
+      unsigned char entry[ARCHIVE_CHUNK_ENTRY_SIZE];
+      if (fread(entry, 1, ARCHIVE_CHUNK_ENTRY_SIZE, file) != ARCHIVE_CHUNK_ENTRY_SIZE) {
+         *error_message = "the record is truncated";
+         goto end;
+      }
+      size_t len = load_u32(entry + 32);
+      FILE* chunk = NULL;
+      if (len > CHARIOT_ARCHIVE_MAX_CHUNK || !chunk_path(path, directory, entry)
+            || !(chunk = fopen(path, "rb"))) {
+         *error_message = "a chunk of the image is missing in the archive";
+         goto end;
+      }
+      bool is_read = fread(buffer, 1, len, chunk) == len && fgetc(chunk) == EOF;
+      fclose(chunk);
+      if (!is_read) {
+         *error_message = "a chunk of the image has not its recorded size";
+         goto end;
+      }
+      if (!write_output(&output, buffer, len, error_message))
+         goto end;
+   }
+
+   uint32_t sha256[8];
+   chariot_sha256_final(&output.image_context, sha256);
+   if (output.written != record.image_size || memcmp(sha256, record.image_sha256, sizeof(sha256)) != 0) {
+      *error_message = "the restored firmware does not match the image sha256";
+      goto end;
+   }
+   if (!output.are_regions_in_order)
+      chariot_sha256_update(&output.mainboot_context, output.gathered, gathered_len);
+   chariot_sha256_final(&output.mainboot_context, sha256);
+   if (memcmp(sha256, record.mainboot_sha256, sizeof(sha256)) != 0) {
+      *error_message = "the restored firmware does not match its mainboot_sha256";
+      goto end;
+   }
+   result = true;
+
+end:
+   fclose(file);
+   chariot_archive_record_free(&record);
+   free(buffer);
+   free(output.gathered);
+   return result;
+}
@@ -0,0 +1,121 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+/*
+ * Deduplicating archive of CHARIOT firmwares. The images are cut into chunks at
+ * content-defined boundaries (a gear rolling hash), so that an insertion only
+ * changes the chunks around it, and every distinct chunk is stored once under its
+ * sha256. The record of an image keeps its chunk list next to its extracted
+ * metadata object, and its reconstruction streams the chunks back while checking
+ * the image sha256 and chariotmeta_mainboot_sha256 on the fly.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include "chariot_extractelf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Archive directory:
+ *   chunks/xx/<64 hexadecimal digits of the sha256>, xx being the first two digits
+ *   images/<image name>, the record of an image
+ * Record format, every number is a 32 bits little endian integer:
+ *   "CHARIOTA" version image_size chunks_number metadata_size regions_number
+ *   image_sha256[32] mainboot_sha256[32]
+ *   regions_number (offset size) of the mainboot
+ *   metadata[metadata_size], the content of the .chariotmeta.rodata section
+ *   chunks_number (sha256[32] size)
+ */
+#define CHARIOT_ARCHIVE_VERSION 1
+#define CHARIOT_ARCHIVE_MIN_CHUNK 2048
+#define CHARIOT_ARCHIVE_AVERAGE_CHUNK_BITS 13
+#define CHARIOT_ARCHIVE_MAX_CHUNK 65536
+
+typedef struct {
+   uint64_t gear[256];
+} Chariot_Archive_chunker;
+
+void chariot_archive_chunker_init(Chariot_Archive_chunker* chunker);
+/* length of the chunk starting at data, in [MIN_CHUNK, MAX_CHUNK] unless len is smaller */
+size_t chariot_archive_next_chunk(const Chariot_Archive_chunker* chunker, const unsigned char* data,
+      size_t len);
+
+typedef struct {
+   size_t chunks_number;
+   size_t new_chunks_number; // chunks that were not yet in the archive
+   size_t new_bytes;
+} Chariot_Archive_statistics;
+
+/*
+ * Verifies the mainboot_sha256 of the elf firmware in buffer_exe, then stores its
+ * new chunks and its record under image_name, which replaces any previous record.
+ * The image name should not contain '/'.
+ */
+int chariot_archive_store(const char* directory, const char* image_name, const char* buffer_exe,
+      size_t buffer_len, Chariot_Archive_statistics* statistics, const char** error_message);
+
+typedef struct {
+   size_t image_size;
+   size_t chunks_number;
+   uint32_t image_sha256[8];
+   uint32_t mainboot_sha256[8];
+   Chariot_Mainboot_region regions[CHARIOT_MAINBOOT_REGIONS_MAX];
+   size_t regions_number;
+   char* metadata; // the nested elf object of the .chariotmeta.rodata section
+   size_t metadata_size;
+} Chariot_Archive_record;
+
+/* reads the record of image_name without its chunk list */
+int chariot_archive_read_record(Chariot_Archive_record* record, const char* directory,
+      const char* image_name, const char** error_message);
+void chariot_archive_record_free(Chariot_Archive_record* record);
+
+/*
+ * Writes into target the image_name firmware by streaming its chunks in a single
+ * pass. The chunks only go through a bounded buffer; the mainboot regions are
+ * hashed as they go by, or gathered when they are not in increasing order.
+ */
+int chariot_archive_restore(FILE* target, const char* directory, const char* image_name,
+      const char** error_message);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,294 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+
+/*
+ * Deduplicating archive of CHARIOT firmwares, see chariot_archive.h:
+ *   --store FIRMWARE [--name NAME]   adds a firmware (its name defaults to its file name)
+ *   --restore NAME --output FILE     rebuilds a firmware and checks its digests
+ *   --info NAME                      prints the record and the metadata of a firmware
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "chariot_archive.h"
+
+typedef struct _InputParser {
+  const char* archive_directory;
+  const char* firmware_name;
+  const char* image_name;
+  const char* restore_name;
+  const char* info_name;
+  const char* output_file;
+  bool requires_help : 1;
+  bool requires_verbose : 1;
+} InputParser;
+
+void
+input_parser_usage()
+{
+  printf("usage: chariot_archive_meta_data.exe [-h] [--verbose] ARCHIVE\n"
+         "                                     (--store FIRMWARE [--name NAME]\n"
+         "                                     | --restore NAME --output OUTPUT | --info NAME)\n"
+         "\n"
+         "stores the CHARIOT firmwares in the deduplicating archive directory ARCHIVE,\n"
+         "cut into content-defined chunks, and restores them with a check of their digests\n"
+         "\n");
+}
+
+bool
+fill_input_parser_fields(InputParser* parser, int argc, const char** argv)
+{
+  memset(parser, 0, sizeof(InputParser));
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+      parser->requires_help = true;
+    else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0)
+      parser->requires_verbose = true;
+    else if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--store") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      parser->firmware_name = argv[i];
+    }
+    else if (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--name") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      parser->image_name = argv[i];
+    }
+    else if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--restore") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      parser->restore_name = argv[i];
+    }
+    else if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--info") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      parser->info_name = argv[i];
+    }
+    else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      parser->output_file = argv[i];
+    }
+    else if (argv[i][0] == '-' || parser->archive_directory)
+      return false;
+    else
+      parser->archive_directory = argv[i];
+  }
+  if (parser->requires_help)
+    return true;
+  if (parser->firmware_name && !parser->image_name)
+  {
+    const char* separator = strrchr(parser->firmware_name, '/');
+    parser->image_name = separator ? separator+1 : parser->firmware_name;
+  }
+  int commands_number = (parser->firmware_name != NULL) + (parser->restore_name != NULL)
+    + (parser->info_name != NULL);
+  return parser->archive_directory && commands_number == 1
+    && (!parser->restore_name || parser->output_file);
+}
+
+int
+store_firmware(const InputParser* parser)
+{
+  int fd = open(parser->firmware_name, O_RDONLY);
+  struct stat status;
+  if (fd < 0 || fstat(fd, &status) != 0 || status.st_size <= 0)
+  {
+    fprintf(stderr, "Cannot open file %s\n", parser->firmware_name);
+    if (fd >= 0)
+      close(fd);
+    return 1;
+  }
+  size_t buffer_len = status.st_size;
+  const char* buffer = (const char*) mmap(NULL, buffer_len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (buffer == MAP_FAILED)
+  {
+    fprintf(stderr, "Cannot map file %s\n", parser->firmware_name);
+    return 1;
+  }
+
+  const char* error_message = NULL;
+  Chariot_Archive_statistics statistics;
+  int result = 0;
+  if (!chariot_archive_store(parser->archive_directory, parser->image_name, buffer, buffer_len,
+        &statistics, &error_message))
+  {
+    fprintf(stderr, "Cannot archive the firmware %s\n", parser->firmware_name);
+    fprintf(stderr, "  %s\n", error_message);
+    result = 1;
+  }
+  else if (parser->requires_verbose)
+    printf("%s: %u chunks, %u new chunks of %u bytes\n", parser->image_name,
+        (unsigned) statistics.chunks_number, (unsigned) statistics.new_chunks_number,
+        (unsigned) statistics.new_bytes);
+  munmap((void*) buffer, buffer_len);
+  return result;
+}
+
+int
+restore_firmware(const InputParser* parser)
+{
+  FILE* output = fopen(parser->output_file, "wb");
+  if (!output)
+  {
+    fprintf(stderr, "Cannot write file %s\n", parser->output_file);
+    return 1;
+  }
+  const char* error_message = NULL;
+  if (!chariot_archive_restore(output, parser->archive_directory, parser->restore_name, &error_message))
+  {
+    fprintf(stderr, "Cannot restore the firmware %s\n", parser->restore_name);
+    fprintf(stderr, "  %s\n", error_message);
+    fclose(output);
+    remove(parser->output_file);
+    return 1;
+  }
+  if (fclose(output) != 0)
+  {
+    fprintf(stderr, "Cannot write file %s\n", parser->output_file);
+    remove(parser->output_file);
+    return 1;
+  }
+  if (parser->requires_verbose)
+    printf("%s: restored and verified in %s\n", parser->restore_name, parser->output_file);
+  return 0;
+}
+
+void
+print_text_field(const char* name, const Chariot_Metadata_localizations* metadata_dict,
+    Chariot_Metadata_Symbols field) {
+  const char* value;
+  size_t value_len;
+  const char* error_message = NULL;
+  if (!(metadata_dict->valid_entries & (1U << field)))
+    return;
+  bool result = field == CMS_Firmware_path
+    ? retrieve_firmware_path(&value, &value_len, metadata_dict, &error_message)
+    : (field == CMS_Firmware_license
+      ? retrieve_firmware_license(&value, &value_len, metadata_dict, &error_message)
+      : retrieve_metadata_field(&value, &value_len, field, metadata_dict, &error_message));
+  if (!result)
+    return;
+  while (value_len > 0 && value[value_len-1] == '\0')
+    --value_len;
+  printf("%s: ", name);
+  fwrite(value, 1, value_len, stdout);
+  printf("\n");
+}
+
+int
+print_info(const InputParser* parser)
+{
+  Chariot_Archive_record record;
+  const char* error_message = NULL;
+  if (!chariot_archive_read_record(&record, parser->archive_directory, parser->info_name,
+        &error_message))
+  {
+    fprintf(stderr, "Cannot read the record of %s\n", parser->info_name);
+    fprintf(stderr, "  %s\n", error_message);
+    chariot_archive_record_free(&record);
+    return 1;
+  }
+  printf("size: %u\n", (unsigned) record.image_size);
+  printf("chunks: %u\n", (unsigned) record.chunks_number);
+  printf("mainboot_sha256: ");
+  for (int i = 8; --i >= 0; )
+    printf("%08x", record.mainboot_sha256[i]);
+  printf("\nmainboot_regions:");
+  for (size_t index = 0; index < record.regions_number; ++index)
+    printf(" %08x:%08x", record.regions[index].offset, record.regions[index].size);
+  printf("\n");
+
+  // the extracted metadata object is read without the firmware
+  Elf32_Ehdr metadata_elf_header;
+  Elf32_Shdr metadata_section;
+  Chariot_Metadata_localizations metadata_dict;
+  memset(&metadata_section, 0, sizeof(Elf32_Shdr));
+  metadata_section.sh_size = record.metadata_size;
+  metadata_dict.valid_entries = 0;
+  metadata_dict.metadata_header = &metadata_elf_header;
+  metadata_dict.metadata_section = &metadata_section;
+  metadata_dict.metadata_buffer_exe = record.metadata;
+  metadata_dict.metadata_buffer_len = record.metadata_size;
+  if (fill_exe_header(&metadata_elf_header, record.metadata, record.metadata_size, &error_message)
+      && fill_metadata_dict(&metadata_dict, &error_message))
+  {
+    print_text_field("version_data", &metadata_dict, CMS_Version_data);
+    print_text_field("firmware_path", &metadata_dict, CMS_Firmware_path);
+    print_text_field("firmware_license", &metadata_dict, CMS_Firmware_license);
+  }
+  chariot_archive_record_free(&record);
+  return 0;
+}
+
+int
+main(int argc, const char** argv)
+{
+  InputParser parser;
+  if (!fill_input_parser_fields(&parser, argc, argv))
+  {
+    input_parser_usage();
+    return 1;
+  }
+  if (parser.requires_help)
+  {
+    input_parser_usage();
+    return 0;
+  }
+  if (parser.firmware_name)
+    return store_firmware(&parser);
+  if (parser.restore_name)
+    return restore_firmware(&parser);
+  return print_info(&parser);
+}
@@ -0,0 +1,1418 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+/*
+ * Batch insertion of the CHARIOT metadata into many variants of a firmware.
+ * The manifest has one line per firmware:
+ *   INPUT OUTPUT [version=VERSION] [blockchain_path=PATH] [license=LICENSE]
+ * where the optional fields override the ones of the command line; the empty lines
+ * and the lines starting with '#' are ignored. The fields shared by every firmware
+ * (license, blockchain path, code analysis, digest of the additional data) are built
+ * once and the .suppldata object once per target. Then a pool of threads takes the
+ * firmwares one by one: each one hashes its mainboot regions and writes its output
+ * through a temporary file renamed at the end. Two lines may not write the same
+ * output, nor the input of another line.
+ * Unlike objcopy, the CHARIOT sections, the section names and the section headers
+ * are appended after the original content, which keeps its file offsets, so that
+ * the metadata are computed in a single pass without a second insertion.
+ * With --compress, codanalys_data goes into the SHF_COMPRESSED section of the metadata
+ * object and the .suppldata section is SHF_COMPRESSED, both deflated once and only
+ * if they shrink. codanalys_binary stays uncompressed since it is read in place.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "chariot_extractelf.h"
+#include "chariot_metaobj.h"
+#include "chariot_sha256.h"
+#include "chariot_blake3.h"
+#include "chariot_crc32c.h"
+
+// defined in chariot_extractelf.c
+extern const char* Chariot_Section_names[];
+
+#define BATCH_THREADS_MAX 64
+#define BATCH_TARGETS_MAX 16
+#define BATCH_FIELDS_MAX 20
+#define BATCH_SECTION_ALIGN 16
+
+typedef struct _InputParser {
+  const char* manifest_name;
+  const char** boot_sections;
+  size_t boot_sections_number;
+  const char* additional_file;
+  const char* additional_mime;
+  const char* blockchain_path;
+  const char* license;
+  const char* static_analysis_file;
+  const char* static_analysis_format;
+  const char* codanalys_binary_file;
+  Elf32_Word chunk_size;
+  int threads_number;
+  bool requires_help : 1;
+  bool requires_verbose : 1;
+  bool requires_boot_segments : 1;
+  bool requires_blake3 : 1;
+  bool requires_crc32c : 1;
+  bool requires_chunks : 1;
+  bool requires_format_v2 : 1;
+  bool requires_compress : 1;
+} InputParser;
+
+void
+input_parser_usage()
+{
+  printf("usage: chariot_batchelf_meta_data.exe [-h] [--verbose] (--boot SECTION | --boot-segments)\n"
+         "                                      [--blake3] [--crc32c] [--chunks] [--chunk-size SIZE]\n"
+         "                                      [--add FILE MIME] [--blockchain_path PATH]\n"
+         "                                      [--license LICENSE] [--static-analysis FILE FORMAT]\n"
+         "                                      [--codanalys-binary FILE] [--threads THREADS]\n"
+         "                                      [--format-v2] [--compress] manifest\n"
+         "\n"
+         "inserts the CHARIOT metadata into every firmware of the manifest, one line\n"
+         "\"INPUT OUTPUT [version=VERSION] [blockchain_path=PATH] [license=LICENSE]\" per firmware,\n"
+         "on THREADS threads (default one per online processor). With --format-v2, the digests\n"
+         "and the numbers are stored as raw little-endian bytes instead of hexadecimal digits.\n"
+         "With --compress, the static analysis and the .suppldata section are compressed by zlib\n"
+         "\n");
+}
+
+bool
+fill_input_parser_fields(InputParser* parser, int argc, const char** argv)
+{
+  memset(parser, 0, sizeof(InputParser));
+  parser->chunk_size = 4096;
+  parser->boot_sections = (const char**) calloc(argc, sizeof(const char*));
+  if (!parser->boot_sections)
+    return false;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+      parser->requires_help = true;
+    else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0)
+      parser->requires_verbose = true;
+    else if (strcmp(argv[i], "-boot-segments") == 0 || strcmp(argv[i], "--boot-segments") == 0)
+      parser->requires_boot_segments = true;
+    else if (strcmp(argv[i], "-blake3") == 0 || strcmp(argv[i], "--blake3") == 0)
+      parser->requires_blake3 = true;
+    else if (strcmp(argv[i], "-crc32c") == 0 || strcmp(argv[i], "--crc32c") == 0)
+      parser->requires_crc32c = true;
+    else if (strcmp(argv[i], "-chunks") == 0 || strcmp(argv[i], "--chunks") == 0)
+      parser->requires_chunks = true;
+    else if (strcmp(argv[i], "-format-v2") == 0 || strcmp(argv[i], "--format-v2") == 0)
+      parser->requires_format_v2 = true;
+    else if (strcmp(argv[i], "-compress") == 0 || strcmp(argv[i], "--compress") == 0)
+      parser->requires_compress = true;
+    else if (strcmp(argv[i], "-boot") == 0 || strcmp(argv[i], "--boot") == 0)
+    {
+      if (++i >= argc || parser->boot_sections_number >= CHARIOT_MAINBOOT_REGIONS_MAX)
+        return false;
+      parser->boot_sections[parser->boot_sections_number++] = argv[i];
+    }
+    else if (strcmp(argv[i], "-chunk-size") == 0 || strcmp(argv[i], "--chunk-size") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      long chunk_size = atol(argv[i]);
+      if (chunk_size <= 0 || chunk_size > 0x7fffffffL)
+        return false;
+      parser->chunk_size = (Elf32_Word) chunk_size;
+    }
+    else if (strcmp(argv[i], "-add") == 0 || strcmp(argv[i], "--add") == 0)
+    {
+      if (i+2 >= argc)
+        return false;
+      parser->additional_file = argv[++i];
+      parser->additional_mime = argv[++i];
+    }
+    else if (strcmp(argv[i], "-sa") == 0 || strcmp(argv[i], "--static-analysis") == 0)
+    {
+      if (i+2 >= argc)
+        return false;
+      parser->static_analysis_file = argv[++i];
+      parser->static_analysis_format = argv[++i];
+    }
+    else if (strcmp(argv[i], "-bp") == 0 || strcmp(argv[i], "--blockchain_path") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      parser->blockchain_path = argv[i];
+    }
+    else if (strcmp(argv[i], "-lic") == 0 || strcmp(argv[i], "--license") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      parser->license = argv[i];
+    }
+    else if (strcmp(argv[i], "-cab") == 0 || strcmp(argv[i], "--codanalys-binary") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      parser->codanalys_binary_file = argv[i];
+    }
+    else if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--threads") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      parser->threads_number = atoi(argv[i]);
+      if (parser->threads_number < 0)
+        return false;
+    }
+    else if (argv[i][0] == '-' || parser->manifest_name)
+      return false;
+    else
+      parser->manifest_name = argv[i];
+  }
+  if (parser->requires_help)
+    return true;
+  // exactly one of --boot and --boot-segments
+  return parser->manifest_name
+    && (parser->boot_sections_number > 0) != parser->requires_boot_segments;
+}
+
+char*
+load_file(const char* file_name, size_t* buffer_size)
+{
+  FILE* file = fopen(file_name, "rb");
+  if (!file)
+    return NULL;
+  fseek(file, 0, SEEK_END);
+  long int len = ftell(file);
+  if (len < 0 || len > 0x7fffffffL)
+  {
+    fclose(file);
+    return NULL;
+  }
+  // one more byte for the final '\0' of the texts
+  char* buffer = malloc(len+1);
+  if (!buffer)
+  {
+    fclose(file);
+    return NULL;
+  }
+  fseek(file, 0, SEEK_SET);
+  *buffer_size = fread(buffer, 1, len, file);
+  buffer[*buffer_size] = '\0';
+  fclose(file);
+  if (*buffer_size != (size_t) len)
+  {
+    free(buffer);
+    return NULL;
+  }
+  return buffer;
+}
+
+static char*
+concatenate(const char* first, const char* second, const char* third)
+{
+  size_t first_len = strlen(first), second_len = strlen(second);
+  char* result = (char*) malloc(first_len + second_len + strlen(third) + 1);
+  if (result)
+  {
+    memcpy(result, first, first_len);
+    memcpy(result + first_len, second, second_len);
+    strcpy(result + first_len + second_len, third);
+  }
+  return result;
+}
+
+/* a firmware of the manifest and the result of its insertion */
+typedef struct {
+  const char* input_name;
+  const char* output_name;
+  const char* version;
+  const char* blockchain_path;
+  const char* license;
+  bool is_inserted;
+  const char* error_message;
+  uint64_t mainboot_len;
+  size_t output_len;
+} Image;
+
+typedef struct {
+  Elf32_Half machine;
+  Elf32_Word flags;
+  bool is_big_endian;
+  bool is_compressed; // object is the content of a SHF_COMPRESSED section, if smaller
+  char* object;
+  size_t object_len;
+} Suppldata_object;
+
+typedef struct {
+  const InputParser* parser;
+  Image* images;
+  size_t images_number;
+  char* manifest;
+
+  // fields shared by every firmware
+  char* firmware_path;
+  char* firmware_license;
+  char* codanalys_data;
+  char* codanalys_sections[2]; // compressed section of codanalys_data, indexed by is_big_endian
+  size_t codanalys_sections_len[2];
+  char* codanalys_binary;
+  size_t codanalys_binary_len;
+  FILE* additional_file;
+  Elf32_Word additional_len;
+  char* extraboot_sha256;
+
+  // the .suppldata object of every target, built on demand under the mutex
+  pthread_mutex_t mutex;
+  Suppldata_object suppldata_objects[BATCH_TARGETS_MAX];
+  size_t suppldata_objects_number;
+  size_t next_image;
+} Batch;
+
+static const char*
+sha256_digits(char result[65], const uint32_t digest[8])
+{
+  // digest[7] is the first word
+  for (int index = 0; index < 8; ++index)
+    sprintf(result + 8*index, "%08x", digest[7-index]);
+  return result;
+}
+
+static const char*
+hex_digits(char* result, const unsigned char* bytes, size_t len)
+{
+  for (size_t index = 0; index < len; ++index)
+    sprintf(result + 2*index, "%02x", bytes[index]);
+  return result;
+}
+
+/* a path of the manifest, by its canonical name, to find the conflicting lines */
+typedef struct {
+  char* canonical_name;
+  size_t image_index;
+  bool is_output;
+} Manifest_path;
+
+/* the real path of the file or, for an output to create, of its directory */
+static char*
+canonical_name(const char* name)
+{
+  char* result = realpath(name, NULL);
+  if (result)
+    return result;
+  const char* base = strrchr(name, '/');
+  char* directory = base ? strndup(name, base == name ? 1 : (size_t) (base - name)) : strdup(".");
+  char* real_directory = directory ? realpath(directory, NULL) : NULL;
+  free(directory);
+  if (!real_directory)
+    return strdup(name);
+  result = concatenate(real_directory, "/", base ? base + 1 : name);
+  free(real_directory);
+  return result;
+}
+
+static int
+compare_manifest_paths(const void* first, const void* second)
+{
+  const Manifest_path* first_path = (const Manifest_path*) first;
+  const Manifest_path* second_path = (const Manifest_path*) second;
+  int result = strcmp(first_path->canonical_name, second_path->canonical_name);
+  if (result != 0)
+    return result;
+  return (int) second_path->is_output - (int) first_path->is_output;
+}
+
+/* the workers would overwrite each other: an output written twice or read by another line */
+static int
+check_manifest_paths(const Batch* batch, const char** error_message)
+{
+  size_t paths_number = 2*batch->images_number;
+  Manifest_path* paths = (Manifest_path*) calloc(paths_number, sizeof(Manifest_path));
+  int result = paths != NULL;
+  if (!result)
+    *error_message = "unable to allocate the paths of the manifest";
+  for (size_t index = 0; result && index < paths_number; ++index) {
+    const Image* image = &batch->images[index/2];
+    paths[index].is_output = index % 2;
+    paths[index].image_index = index/2;
+    paths[index].canonical_name = canonical_name(paths[index].is_output ? image->output_name
+        : image->input_name);
+    if (!paths[index].canonical_name) {
+      *error_message = "unable to allocate the paths of the manifest";
+      result = false;
+    }
+  }
+  if (result)
+    qsort(paths, paths_number, sizeof(Manifest_path), compare_manifest_paths);
+  // in a run of the same name, the outputs come first
+  size_t end = 0;
+  for (size_t start = 0; result && start < paths_number; start = end) {
+    const Manifest_path* output = &paths[start];
+    for (end = start+1; end < paths_number
+        && strcmp(paths[end].canonical_name, output->canonical_name) == 0; ++end) {
+      if (!result || !output->is_output)
+        continue;
+      if (paths[end].is_output) {
+        *error_message = "two lines of the manifest write the same output";
+        result = false;
+      }
+      else if (paths[end].image_index != output->image_index) {
+        *error_message = "an output of the manifest is the input of another line";
+        result = false;
+      }
+    }
+  }
+  for (size_t index = 0; paths && index < paths_number; ++index)
+    free(paths[index].canonical_name);
+  free(paths);
+  return result;
+}
+
+/* reads the manifest in place: the images point into batch->manifest */
+int
+read_manifest(Batch* batch, const char** error_message)
+{
+  size_t manifest_len = 0;
+  batch->manifest = load_file(batch->parser->manifest_name, &manifest_len);
+  if (!batch->manifest) {
+    *error_message = "unable to read the manifest";
+    return false;
+  }
+  size_t lines_number = 1;
+  for (size_t index = 0; index < manifest_len; ++index)
+    if (batch->manifest[index] == '\n')
+      ++lines_number;
+  batch->images = (Image*) calloc(lines_number, sizeof(Image));
+  if (!batch->images) {
+    *error_message = "unable to allocate the images of the manifest";
+    return false;
+  }
+
+  char* line = batch->manifest;
+  while (line) {
+    char* next_line = strchr(line, '\n');
+    if (next_line)
+      *next_line++ = '\0';
+    const char* tokens[5];
+    size_t tokens_number = 0;
+    char* position = line;
+    while (true) {
+      while (*position == ' ' || *position == '\t' || *position == '\r')
+        *position++ = '\0';
+      if (!*position || (tokens_number == 0 && *position == '#'))
+        break;
+      if (tokens_number >= 5) {
+        *error_message = "too many fields on a line of the manifest";
+        return false;
+      }
+      tokens[tokens_number++] = position;
+      while (*position && *position != ' ' && *position != '\t' && *position != '\r')
+        ++position;
+    }
+    line = next_line;
+    if (tokens_number == 0)
+      continue;
+    if (tokens_number < 2) {
+      *error_message = "a line of the manifest has no output";
+      return false;
+    }
+    Image* image = &batch->images[batch->images_number++];
+    image->input_name = tokens[0];
+    image->output_name = tokens[1];
+    for (size_t token_index = 2; token_index < tokens_number; ++token_index) {
+      const char* token = tokens[token_index];
+      if (strncmp(token, "version=", strlen("version=")) == 0)
+        image->version = token + strlen("version=");
+      else if (strncmp(token, "blockchain_path=", strlen("blockchain_path=")) == 0)
+        image->blockchain_path = token + strlen("blockchain_path=");
+      else if (strncmp(token, "license=", strlen("license=")) == 0)
+        image->license = token + strlen("license=");
+      else {
+        *error_message = "unknown field on a line of the manifest";
+        return false;
+      }
+    }
+  }
+  if (batch->images_number == 0) {
+    *error_message = "no firmware in the manifest";
+    return false;
+  }
+  return check_manifest_paths(batch, error_message);
+}
+
+/* builds once the fields that do not depend on the firmware */
+int
+build_shared_fields(Batch* batch, const char** error_message)
+{
+  const InputParser* parser = batch->parser;
+  if (parser->blockchain_path
+      && !(batch->firmware_path = concatenate(Chariot_Metadata_schema[CMS_Firmware_path].prefix,
+            parser->blockchain_path, ""))) {
+    *error_message = "unable to allocate the shared fields";
+    return false;
+  }
+  if (parser->license
+      && !(batch->firmware_license = concatenate(Chariot_Metadata_schema[CMS_Firmware_license].prefix,
+            parser->license, ""))) {
+    *error_message = "unable to allocate the shared fields";
+    return false;
+  }
+  if (parser->static_analysis_file) {
+    size_t len = 0;
+    char* content = load_file(parser->static_analysis_file, &len);
+    if (!content) {
+      *error_message = "unable to read the static analysis file";
+      return false;
+    }
+    batch->codanalys_data = concatenate(Chariot_Metadata_schema[CMS_Codanalys_data].prefix, content, " ");
+    free(content);
+    if (!batch->codanalys_data) {
+      *error_message = "unable to allocate the shared fields";
+      return false;
+    }
+  }
+  if (parser->requires_compress && batch->codanalys_data) {
+    // codanalys_data is the only compressed field of the metadata objects
+    Chariot_Metaobj_field field;
+    memset(&field, 0, sizeof(field));
+    field.name = Chariot_Metadata_schema[CMS_Codanalys_data].symbol;
+    field.content = batch->codanalys_data;
+    field.content_len = field.size = strlen(batch->codanalys_data)+1;
+    field.is_compressed = true;
+    Chariot_Metaobj_description description;
+    memset(&description, 0, sizeof(description));
+    description.section = CS_Meta;
+    description.fields = &field;
+    description.fields_number = 1;
+    for (int is_big_endian = 0; is_big_endian <= 1; ++is_big_endian) {
+      description.is_big_endian = is_big_endian;
+      if (!chariot_metaobj_compress(&batch->codanalys_sections[is_big_endian],
+            &batch->codanalys_sections_len[is_big_endian], &description, error_message))
+        return false;
+    }
+    // like objcopy, a section is only compressed if it becomes smaller
+    if (batch->codanalys_sections_len[0] >= field.content_len) {
+      free(batch->codanalys_sections[0]);
+      free(batch->codanalys_sections[1]);
+      batch->codanalys_sections[0] = batch->codanalys_sections[1] = NULL;
+    }
+  }
+  if (parser->codanalys_binary_file) {
+    batch->codanalys_binary = load_file(parser->codanalys_binary_file, &batch->codanalys_binary_len);
+    if (!batch->codanalys_binary) {
+      *error_message = "unable to read the code analysis binary file";
+      return false;
+    }
+  }
+  if (parser->additional_file) {
+    // the additional data is hashed here by blocks and copied into each .suppldata object
+    batch->additional_file = fopen(parser->additional_file, "rb");
+    if (!batch->additional_file) {
+      *error_message = "unable to open the additional data file";
+      return false;
+    }
+    Chariot_Sha256_context context;
+    char block[65536], digits[65];
+    uint32_t digest[8];
+    uint64_t len = 0;
+    size_t block_len;
+    chariot_sha256_init(&context);
+    while ((block_len = fread(block, 1, sizeof(block), batch->additional_file)) > 0) {
+      chariot_sha256_update(&context, block, block_len);
+      len += block_len;
+    }
+    chariot_sha256_final(&context, digest);
+    if (ferror(batch->additional_file) || len > 0x7fffffff) {
+      *error_message = "unable to read the additional data file";
+      return false;
+    }
+    batch->additional_len = (Elf32_Word) len;
+    batch->extraboot_sha256 = concatenate(sha256_digits(digits, digest), " ", parser->additional_file);
+    if (!batch->extraboot_sha256) {
+      *error_message = "unable to allocate the shared fields";
+      return false;
+    }
+  }
+  return true;
+}
+
+void
+free_batch(Batch* batch)
+{
+  for (size_t index = 0; index < batch->suppldata_objects_number; ++index)
+    free(batch->suppldata_objects[index].object);
+  if (batch->additional_file)
+    fclose(batch->additional_file);
+  free(batch->extraboot_sha256);
+  free(batch->codanalys_binary);
+  free(batch->codanalys_sections[0]);
+  free(batch->codanalys_sections[1]);
+  free(batch->codanalys_data);
+  free(batch->firmware_license);
+  free(batch->firmware_path);
+  free(batch->images);
+  free(batch->manifest);
+}
+
+/* the .suppldata object for the target of a firmware, shared by the firmwares of this target */
+static bool
+retrieve_suppldata_object(const Suppldata_object** result, Batch* batch,
+      const Elf32_Ehdr* header, bool is_big_endian, const char** error_message)
+{
+  bool is_found = false;
+  pthread_mutex_lock(&batch->mutex);
+  for (size_t index = 0; !is_found && index < batch->suppldata_objects_number; ++index) {
+    const Suppldata_object* object = &batch->suppldata_objects[index];
+    if (object->machine == header->e_machine && object->flags == header->e_flags
+        && object->is_big_endian == is_big_endian) {
+      *result = object;
+      is_found = true;
+    }
+  }
+  if (!is_found && batch->suppldata_objects_number >= BATCH_TARGETS_MAX)
+    *error_message = "too many different targets in the manifest";
+  else if (!is_found) {
+    Chariot_Metaobj_field field;
+    memset(&field, 0, sizeof(field));
+    field.name = "boot_supplementary_data";
+    field.content_file = batch->additional_file;
+    field.content_len = field.size = batch->additional_len;
+    field.align = 4;
+    Chariot_Metaobj_description description;
+    description.section = CS_Extra;
+    description.machine = header->e_machine;
+    description.flags = header->e_flags;
+    description.is_big_endian = is_big_endian;
+    description.fields = &field;
+    description.fields_number = 1;
+    description.compressed_section = NULL;
+    description.compressed_section_len = 0;
+    Suppldata_object* object = &batch->suppldata_objects[batch->suppldata_objects_number];
+    object->machine = header->e_machine;
+    object->flags = header->e_flags;
+    object->is_big_endian = is_big_endian;
+    object->object_len = chariot_metaobj_size(&description);
+    object->object = object->object_len ? (char*) malloc(object->object_len) : NULL;
+    if (!object->object)
+      *error_message = "unable to allocate the supplementary data object";
+    else if (fseek(batch->additional_file, 0, SEEK_SET) != 0
+        || !chariot_metaobj_write(object->object, object->object_len, &description, error_message)) {
+      free(object->object);
+      object->object = NULL;
+    }
+    else if (batch->parser->requires_compress) {
+      // the whole object becomes the content of the SHF_COMPRESSED .suppldata section
+      char* compressed = NULL;
+      size_t compressed_len = 0;
+      if (chariot_metaobj_compress_section(&compressed, &compressed_len, object->object,
+            object->object_len, BATCH_SECTION_ALIGN, is_big_endian, error_message)) {
+        if (compressed_len < object->object_len) {
+          free(object->object);
+          object->object = compressed;
+          object->object_len = compressed_len;
+          object->is_compressed = true;
+        }
+        else
+          free(compressed);
+        ++batch->suppldata_objects_number;
+        *result = object;
+        is_found = true;
+      }
+      else {
+        free(object->object);
+        object->object = NULL;
+      }
+    }
+    else {
+      ++batch->suppldata_objects_number;
+      *result = object;
+      is_found = true;
+    }
+  }
+  pthread_mutex_unlock(&batch->mutex);
+  return is_found;
+}
+
+typedef struct {
+  unsigned char* buffer;
+  size_t buffer_len;
+  Elf32_Ehdr header;
+  bool is_little_endian;
+  Elf32_Shdr* sections; // e_shnum section headers in the host byte order
+  const char* section_names;
+  Elf32_Word section_names_size;
+} Firmware;
+
+static uint32_t
+read_elf_word(const unsigned char* source, bool is_little_endian)
+{
+  return is_little_endian
+    ? (uint32_t) source[0] | ((uint32_t) source[1] << 8) | ((uint32_t) source[2] << 16) | ((uint32_t) source[3] << 24)
+    : (uint32_t) source[3] | ((uint32_t) source[2] << 8) | ((uint32_t) source[1] << 16) | ((uint32_t) source[0] << 24);
+}
+
+static void
+write_elf_word(unsigned char* target, uint32_t value, bool is_little_endian)
+{
+  for (int index = 0; index < 4; ++index)
+    target[is_little_endian ? index : 3-index] = (unsigned char) (value >> (8*index));
+}
+
+static void
+write_elf_half(unsigned char* target, uint16_t value, bool is_little_endian)
+{
+  target[is_little_endian ? 0 : 1] = (unsigned char) value;
+  target[is_little_endian ? 1 : 0] = (unsigned char) (value >> 8);
+}
+
+int
+open_firmware(Firmware* firmware, const char** error_message)
+{
+  if (!fill_exe_header(&firmware->header, (const char*) firmware->buffer, firmware->buffer_len,
+        error_message))
+    return false;
+  if (memcmp(firmware->header.e_ident, "\177ELF", 4) != 0
+      || firmware->header.e_ident[4] != 1 /* ELFCLASS32 */) {
+    *error_message = "not an elf32 file";
+    return false;
+  }
+  firmware->is_little_endian = firmware->header.e_ident[5] == 1 /* ELFDATA2LSB */;
+  if (firmware->header.e_shentsize != 40 || firmware->header.e_shnum == 0
+      || firmware->header.e_shoff + (uint64_t) firmware->header.e_shnum*40 > firmware->buffer_len
+      || firmware->header.e_shstrndx >= firmware->header.e_shnum) {
+    *error_message = "unable to read the section headers: buffer is too small";
+    return false;
+  }
+  firmware->sections = (Elf32_Shdr*) calloc(firmware->header.e_shnum + CS_Extra + 1, sizeof(Elf32_Shdr));
+  if (!firmware->sections) {
+    *error_message = "unable to allocate the section headers";
+    return false;
+  }
+  for (unsigned section_index = 0; section_index < firmware->header.e_shnum; ++section_index) {
+    const unsigned char* source = firmware->buffer + firmware->header.e_shoff + section_index*40;
+    Elf32_Shdr* section = &firmware->sections[section_index];
+    section->sh_name = read_elf_word(source, firmware->is_little_endian);
+    section->sh_type = read_elf_word(source + 4, firmware->is_little_endian);
+    section->sh_flags = read_elf_word(source + 8, firmware->is_little_endian);
+    section->sh_addr = read_elf_word(source + 12, firmware->is_little_endian);
+    section->sh_offset = read_elf_word(source + 16, firmware->is_little_endian);
+    section->sh_size = read_elf_word(source + 20, firmware->is_little_endian);
+    section->sh_link = read_elf_word(source + 24, firmware->is_little_endian);
+    section->sh_info = read_elf_word(source + 28, firmware->is_little_endian);
+    section->sh_addralign = read_elf_word(source + 32, firmware->is_little_endian);
+    section->sh_entsize = read_elf_word(source + 36, firmware->is_little_endian);
+  }
+  const Elf32_Shdr* names_section = &firmware->sections[firmware->header.e_shstrndx];
+  if (names_section->sh_size == 0
+      || names_section->sh_offset + (uint64_t) names_section->sh_size > firmware->buffer_len
+      || firmware->buffer[names_section->sh_offset + names_section->sh_size - 1] != '\0') {
+    *error_message = "unable to read the section names";
+    return false;
+  }
+  firmware->section_names = (const char*) firmware->buffer + names_section->sh_offset;
+  firmware->section_names_size = names_section->sh_size;
+  return true;
+}
+
+/* index of the section name, 0 (the null section) if it is absent */
+static unsigned
+find_section(const Firmware* firmware, const char* name)
+{
+  for (unsigned section_index = 1; section_index < firmware->header.e_shnum; ++section_index) {
+    Elf32_Word name_offset = firmware->sections[section_index].sh_name;
+    if (name_offset < firmware->section_names_size
+        && strcmp(firmware->section_names + name_offset, name) == 0)
+      return section_index;
+  }
+  return 0;
+}
+
+/* file regions of the --boot sections or of the loadable segments */
+int
+retrieve_regions(Chariot_Mainboot_region* regions, size_t* regions_number,
+      const Firmware* firmware, const InputParser* parser, const char** error_message)
+{
+  *regions_number = 0;
+  if (parser->requires_boot_segments) {
+    if (firmware->header.e_phentsize != 32
+        || firmware->header.e_phoff + (uint64_t) firmware->header.e_phnum*32 > firmware->buffer_len) {
+      *error_message = "unable to read the program headers: buffer is too small";
+      return false;
+    }
+    for (unsigned segment_index = 0; segment_index < firmware->header.e_phnum; ++segment_index) {
+      const unsigned char* segment = firmware->buffer + firmware->header.e_phoff + segment_index*32;
+      Elf32_Word file_size = read_elf_word(segment + 16, firmware->is_little_endian);
+      if (read_elf_word(segment, firmware->is_little_endian) != 1 /* PT_LOAD */ || file_size == 0)
+        continue;
+      if (*regions_number >= CHARIOT_MAINBOOT_REGIONS_MAX) {
+        *error_message = "too many loadable segments for mainboot regions";
+        return false;
+      }
+      regions[*regions_number].offset = read_elf_word(segment + 4, firmware->is_little_endian);
+      regions[*regions_number].size = file_size;
+      ++*regions_number;
+    }
+  }
+  else {
+    for (size_t boot_index = 0; boot_index < parser->boot_sections_number; ++boot_index) {
+      char name[256];
+      snprintf(name, sizeof(name), ".%s", parser->boot_sections[boot_index]);
+      unsigned section_index = find_section(firmware, name);
+      if (section_index == 0 || firmware->sections[section_index].sh_type == 8 /* SHT_NOBITS */) {
+        *error_message = "a mainboot section is not in the file content of the firmware";
+        return false;
+      }
+      regions[*regions_number].offset = firmware->sections[section_index].sh_offset;
+      regions[*regions_number].size = firmware->sections[section_index].sh_size;
+      ++*regions_number;
+    }
+  }
+  if (*regions_number == 0) {
+    *error_message = "no loadable segment for mainboot regions";
+    return false;
+  }
+  for (size_t region_index = 0; region_index < *regions_number; ++region_index)
+    if (regions[region_index].offset + (uint64_t) regions[region_index].size > firmware->buffer_len) {
+      *error_message = "a mainboot region is out of the firmware";
+      return false;
+    }
+  return true;
+}
+
+static void
+digest_bytes(unsigned char result[32], const uint32_t digest[8])
+{
+  for (int index = 0; index < 8; ++index)
+    write_elf_word(result + 4*index, digest[7-index], false);
+}
+
+/* node of the Merkle tree for the leaves [first, first+number), as in chariot_extractelf.c */
+static void
+compute_chunks_node(unsigned char result[32], const unsigned char* leaves, size_t first, size_t number)
+{
+  if (number == 1) {
+    memcpy(result, leaves + first*32, 32);
+    return;
+  }
+  size_t left_number = 1;
+  while (left_number*2 < number)
+    left_number *= 2;
+  unsigned char prefix = 1, nodes[64];
+  compute_chunks_node(nodes, leaves, first, left_number);
+  compute_chunks_node(nodes + 32, leaves, first + left_number, number - left_number);
+  Chariot_Sha256_context context;
+  uint32_t digest[8];
+  chariot_sha256_init(&context);
+  chariot_sha256_update(&context, &prefix, 1);
+  chariot_sha256_update(&context, nodes, 64);
+  chariot_sha256_final(&context, digest);
+  digest_bytes(result, digest);
+}
+
+/*
+ * Fills the placeholders of the digests with the ones of the regions:
+ * sha256 (64 digits), blake3 (64 digits) and crc32c (8 digits) when they are not NULL
+ * and the Merkle table "ssssssss:root:leaves" in chunks. In the format version 2
+ * (is_raw), the digests have 32 bytes, crc32c 4 bytes little-endian and the Merkle
+ * table is the chunk size on 4 bytes, the root and then the leaves.
+ */
+static bool
+hash_regions(char* sha256, char* blake3, char* crc32c, char* chunks, Elf32_Word chunk_size,
+      const Chariot_Mainboot_region* regions, size_t regions_number, const unsigned char* buffer,
+      bool is_raw)
+{
+  Chariot_Sha256_context context;
+  uint32_t digest[8];
+  char digits[65];
+  chariot_sha256_init(&context);
+  for (size_t region_index = 0; region_index < regions_number; ++region_index)
+    chariot_sha256_update(&context, buffer + regions[region_index].offset, regions[region_index].size);
+  chariot_sha256_final(&context, digest);
+  if (is_raw)
+    digest_bytes((unsigned char*) sha256, digest);
+  else
+    memcpy(sha256, sha256_digits(digits, digest), 64);
+
+  if (blake3) {
+    Chariot_Blake3_slice slices[CHARIOT_BLAKE3_SLICES_MAX];
+    unsigned char blake3_digest[32];
+    for (size_t region_index = 0; region_index < regions_number; ++region_index) {
+      slices[region_index].start = buffer + regions[region_index].offset;
+      slices[region_index].len = regions[region_index].size;
+    }
+    // the firmwares are already spread over the threads
+    if (!chariot_blake3_hash_slices(slices, regions_number, blake3_digest, 1))
+      return false;
+    if (is_raw)
+      memcpy(blake3, blake3_digest, 32);
+    else
+      memcpy(blake3, hex_digits(digits, blake3_digest, 32), 64);
+  }
+  if (crc32c) {
+    uint32_t crc = 0;
+    for (size_t region_index = 0; region_index < regions_number; ++region_index)
+      crc = chariot_crc32c(crc, buffer + regions[region_index].offset, regions[region_index].size);
+    if (is_raw)
+      write_elf_word((unsigned char*) crc32c, crc, true);
+    else {
+      sprintf(digits, "%08x", crc);
+      memcpy(crc32c, digits, 8);
+    }
+  }
+  if (chunks) {
+    // a leaf is sha256(0x00 || chunk) of the concatenation of the regions
+    uint64_t content_len = 0;
+    for (size_t region_index = 0; region_index < regions_number; ++region_index)
+      content_len += regions[region_index].size;
+    size_t chunks_number = (content_len + chunk_size - 1) / chunk_size;
+    unsigned char* leaves = (unsigned char*) malloc(chunks_number*32);
+    if (!leaves)
+      return false;
+    unsigned char prefix = 0;
+    size_t chunk_index = 0;
+    Elf32_Word chunk_len = 0;
+    for (size_t region_index = 0; region_index < regions_number; ++region_index) {
+      const unsigned char* start = buffer + regions[region_index].offset;
+      Elf32_Word left = regions[region_index].size;
+      while (left > 0) {
+        if (chunk_len == 0) {
+          chariot_sha256_init(&context);
+          chariot_sha256_update(&context, &prefix, 1);
+        }
+        Elf32_Word piece_len = chunk_size - chunk_len < left ? chunk_size - chunk_len : left;
+        chariot_sha256_update(&context, start, piece_len);
+        start += piece_len;
+        left -= piece_len;
+        chunk_len += piece_len;
+        if (chunk_len == chunk_size) {
+          chariot_sha256_final(&context, digest);
+          digest_bytes(leaves + 32*chunk_index++, digest);
+          chunk_len = 0;
+        }
+      }
+    }
+    if (chunk_len > 0) {
+      chariot_sha256_final(&context, digest);
+      digest_bytes(leaves + 32*chunk_index++, digest);
+    }
+    unsigned char root[32];
+    compute_chunks_node(root, leaves, 0, chunks_number);
+    if (is_raw) {
+      memcpy(chunks + 4, root, 32);
+      memcpy(chunks + 4+32, leaves, 32*chunks_number);
+    }
+    else {
+      hex_digits(chunks + 9, root, 32);
+      chunks[9+64] = ':';
+      for (chunk_index = 0; chunk_index < chunks_number; ++chunk_index)
+        hex_digits(chunks + 9+64+1 + 64*chunk_index, leaves + 32*chunk_index, 32);
+    }
+    free(leaves);
+  }
+  return true;
+}
+
+/* the symbol of the field and its encoding come from Chariot_Metadata_schema */
+static void
+add_field(Chariot_Metaobj_field* fields, size_t* fields_number, Chariot_Metadata_Symbols symbol,
+      const char* content)
+{
+  Chariot_Metaobj_field* field = &fields[(*fields_number)++];
+  memset(field, 0, sizeof(Chariot_Metaobj_field));
+  field->name = Chariot_Metadata_schema[symbol].symbol;
+  field->content = content;
+  field->content_len = strlen(content)+1;
+  // a text includes its final '\0' in its size, unlike the fixed-size fields
+  field->size = Chariot_Metadata_schema[symbol].encoding == CFE_Text
+      ? field->content_len : field->content_len-1;
+}
+
+/* a field of the format version 2 with len raw bytes */
+static void
+add_raw_field(Chariot_Metaobj_field* fields, size_t* fields_number, Chariot_Metadata_Symbols symbol,
+      const char* content, size_t len)
+{
+  Chariot_Metaobj_field* field = &fields[(*fields_number)++];
+  memset(field, 0, sizeof(Chariot_Metaobj_field));
+  field->name = Chariot_Metadata_schema[symbol].symbol;
+  field->content = content;
+  field->content_len = field->size = (Elf32_Word) len;
+  field->align = 4;
+}
+
+/* 8 hexadecimal digits or, in the format version 2, 4 bytes little-endian */
+static void
+add_number_field(Chariot_Metaobj_field* fields, size_t* fields_number, Chariot_Metadata_Symbols symbol,
+      char digits[9], uint32_t value, bool is_raw)
+{
+  if (is_raw) {
+    write_elf_word((unsigned char*) digits, value, true);
+    add_raw_field(fields, fields_number, symbol, digits, 4);
+  }
+  else {
+    sprintf(digits, "%08x", (unsigned) value);
+    add_field(fields, fields_number, symbol, digits);
+  }
+}
+
+static void
+write_section_header(unsigned char* target, const Elf32_Shdr* section, bool is_little_endian)
+{
+  write_elf_word(target, section->sh_name, is_little_endian);
+  write_elf_word(target + 4, section->sh_type, is_little_endian);
+  write_elf_word(target + 8, section->sh_flags, is_little_endian);
+  write_elf_word(target + 12, section->sh_addr, is_little_endian);
+  write_elf_word(target + 16, section->sh_offset, is_little_endian);
+  write_elf_word(target + 20, section->sh_size, is_little_endian);
+  write_elf_word(target + 24, section->sh_link, is_little_endian);
+  write_elf_word(target + 28, section->sh_info, is_little_endian);
+  write_elf_word(target + 32, section->sh_addralign, is_little_endian);
+  write_elf_word(target + 36, section->sh_entsize, is_little_endian);
+}
+
+static bool
+write_padding(FILE* file, size_t* position, size_t align)
+{
+  static const char zeros[BATCH_SECTION_ALIGN] = { 0 };
+  size_t len = (align - *position % align) % align;
+  *position += len;
+  return fwrite(zeros, 1, len, file) == len;
+}
+
+static inline size_t
+align_up(size_t value, size_t align)
+{  return (value + align - 1) & ~(align - 1); }
+
+/* a CHARIOT section appended at offset with size bytes, existing or new */
+static void
+set_chariot_section(Elf32_Shdr* section, Elf32_Word name, Elf32_Off offset, Elf32_Word size,
+    bool is_compressed)
+{
+  memset(section, 0, sizeof(Elf32_Shdr));
+  section->sh_name = name;
+  section->sh_type = 1; // SHT_PROGBITS, not loaded and read-only
+  section->sh_flags = is_compressed ? SHF_COMPRESSED : 0;
+  section->sh_offset = offset;
+  section->sh_size = size;
+  section->sh_addralign = BATCH_SECTION_ALIGN;
+}
+
+/* inserts the metadata into a firmware of the manifest, from any thread of the pool */
+int
+insert_metadata(Batch* batch, Image* image, const char** error_message)
+{
+  const InputParser* parser = batch->parser;
+  Firmware firmware;
+  memset(&firmware, 0, sizeof(Firmware));
+  firmware.buffer = (unsigned char*) load_file(image->input_name, &firmware.buffer_len);
+  if (!firmware.buffer) {
+    *error_message = "unable to read the firmware";
+    return false;
+  }
+
+  bool result = false;
+  Chariot_Mainboot_region regions[CHARIOT_MAINBOOT_REGIONS_MAX];
+  size_t regions_number = 0;
+  char *regions_field = NULL, *chunks_field = NULL, *firmware_path = NULL, *firmware_license = NULL;
+  char* metadata_object = NULL;
+  unsigned char* section_headers = NULL;
+  FILE* output = NULL;
+  char* temporary_name = NULL;
+  if (!open_firmware(&firmware, error_message)
+      || !retrieve_regions(regions, &regions_number, &firmware, parser, error_message))
+    goto end;
+  uint64_t content_len = 0;
+  for (size_t region_index = 0; region_index < regions_number; ++region_index)
+    content_len += regions[region_index].size;
+  image->mainboot_len = content_len;
+
+  // the fields in the order of chariot_addelf_meta_data.py, the digits are placeholders until hash_regions
+  bool is_raw = parser->requires_format_v2;
+  char sha256[64+sizeof(" mainboot")], blake3[64+sizeof(" mainboot")], crc32c[9];
+  char offsetnum[9], sizenum[9], extra_offsetnum[9], extra_sizenum[9], format_version[9];
+  Chariot_Metaobj_field fields[BATCH_FIELDS_MAX];
+  size_t fields_number = 0;
+  if (is_raw) {
+    memset(sha256, 0, 32);
+    memset(blake3, 0, 32);
+    add_number_field(fields, &fields_number, CMS_Format_version, format_version, 2, true);
+    add_raw_field(fields, &fields_number, CMS_Mainboot_sha256, sha256, 32);
+  }
+  else {
+    sprintf(sha256, "%064x mainboot", 0);
+    sprintf(blake3, "%064x mainboot", 0);
+    add_field(fields, &fields_number, CMS_Mainboot_sha256, sha256);
+  }
+  add_field(fields, &fields_number, CMS_Format_typeinfo, "!CHARIOTMETAFORMAT_2019a");
+  add_number_field(fields, &fields_number, CMS_Mainboot_offsetnum, offsetnum, regions[0].offset, is_raw);
+  add_number_field(fields, &fields_number, CMS_Mainboot_sizesnum, sizenum, regions[0].size, is_raw);
+  if (parser->requires_boot_segments || regions_number > 1) {
+    regions_field = (char*) malloc(regions_number*18 + sizeof("PT_LOAD"));
+    if (!regions_field) {
+      *error_message = "unable to allocate the mainboot regions";
+      goto end;
+    }
+    if (parser->requires_boot_segments)
+      strcpy(regions_field, "PT_LOAD");
+    else if (is_raw) {
+      for (size_t region_index = 0; region_index < regions_number; ++region_index) {
+        write_elf_word((unsigned char*) regions_field + 8*region_index, regions[region_index].offset, true);
+        write_elf_word((unsigned char*) regions_field + 8*region_index + 4, regions[region_index].size, true);
+      }
+    }
+    else {
+      char* position = regions_field;
+      for (size_t region_index = 0; region_index < regions_number; ++region_index)
+        position += sprintf(position, region_index ? ",%08x:%08x" : "%08x:%08x",
+            (unsigned) regions[region_index].offset, (unsigned) regions[region_index].size);
+    }
+    if (is_raw && !parser->requires_boot_segments)
+      add_raw_field(fields, &fields_number, CMS_Mainboot_regions, regions_field, 8*regions_number);
+    else
+      add_field(fields, &fields_number, CMS_Mainboot_regions, regions_field);
+  }
+  if (parser->requires_blake3) {
+    if (is_raw)
+      add_raw_field(fields, &fields_number, CMS_Mainboot_blake3, blake3, 32);
+    else
+      add_field(fields, &fields_number, CMS_Mainboot_blake3, blake3);
+  }
+  if (parser->requires_crc32c)
+    add_number_field(fields, &fields_number, CMS_Mainboot_crc32c, crc32c, 0, is_raw);
+  if (parser->requires_chunks) {
+    size_t chunks_number = (content_len + parser->chunk_size - 1) / parser->chunk_size;
+    if (chunks_number == 0 || chunks_number > (0x7fffffff - (8+1+64+1)) / 64) {
+      *error_message = chunks_number ? "too many mainboot chunks" : "the mainboot is empty, no chunk to hash";
+      goto end;
+    }
+    chunks_field = (char*) malloc(8+1+64+1 + 64*chunks_number + 1);
+    if (!chunks_field) {
+      *error_message = "unable to allocate the mainboot chunks";
+      goto end;
+    }
+    if (is_raw) {
+      write_elf_word((unsigned char*) chunks_field, parser->chunk_size, true);
+      memset(chunks_field + 4, 0, 32 + 32*chunks_number);
+      add_raw_field(fields, &fields_number, CMS_Mainboot_chunks, chunks_field, 4+32 + 32*chunks_number);
+    }
+    else {
+      sprintf(chunks_field, "%08x:", (unsigned) parser->chunk_size);
+      memset(chunks_field + 9, '0', 64+1 + 64*chunks_number);
+      chunks_field[9+64+1 + 64*chunks_number] = '\0';
+      add_field(fields, &fields_number, CMS_Mainboot_chunks, chunks_field);
+    }
+  }
+  if (parser->additional_file) {
+    // the sha256 of the additional data is followed by its file name, it stays a text
+    add_field(fields, &fields_number, CMS_Extraboot_sha256, batch->extraboot_sha256);
+    // boot_supplementary_data starts the .suppldata section of its object
+    add_number_field(fields, &fields_number, CMS_Extraboot_offsetnum, extra_offsetnum, 0, is_raw);
+    add_number_field(fields, &fields_number, CMS_Extraboot_sizenum, extra_sizenum,
+        batch->additional_len, is_raw);
+    add_field(fields, &fields_number, CMS_Extraboot_typeinfo, parser->additional_mime);
+  }
+  if (parser->static_analysis_file)
+    add_field(fields, &fields_number, CMS_Codanalys_typeinfo, parser->static_analysis_format);
+  add_field(fields, &fields_number, CMS_Version_data, image->version ? image->version
+      : "0000000000000000000000000000000000000000000000000000000000000000");
+  if (image->blockchain_path
+      && !(firmware_path = concatenate(Chariot_Metadata_schema[CMS_Firmware_path].prefix,
+            image->blockchain_path, ""))) {
+    *error_message = "unable to allocate the fields of the firmware";
+    goto end;
+  }
+  if (image->license
+      && !(firmware_license = concatenate(Chariot_Metadata_schema[CMS_Firmware_license].prefix,
+            image->license, ""))) {
+    *error_message = "unable to allocate the fields of the firmware";
+    goto end;
+  }
+  if (firmware_path || batch->firmware_path)
+    add_field(fields, &fields_number, CMS_Firmware_path,
+        firmware_path ? firmware_path : batch->firmware_path);
+  if (firmware_license || batch->firmware_license)
+    add_field(fields, &fields_number, CMS_Firmware_license,
+        firmware_license ? firmware_license : batch->firmware_license);
+  if (batch->codanalys_data) {
+    add_field(fields, &fields_number, CMS_Codanalys_data, batch->codanalys_data);
+    fields[fields_number-1].is_compressed = batch->codanalys_sections[0] != NULL;
+  }
+  if (batch->codanalys_binary) {
+    Chariot_Metaobj_field* field = &fields[fields_number++];
+    memset(field, 0, sizeof(Chariot_Metaobj_field));
+    field->name = Chariot_Metadata_schema[CMS_Codanalys_binary].symbol;
+    field->content = batch->codanalys_binary;
+    field->content_len = field->size = (Elf32_Word) batch->codanalys_binary_len;
+    field->align = 4;
+  }
+
+  Chariot_Metaobj_description description;
+  description.section = CS_Meta;
+  description.machine = firmware.header.e_machine;
+  description.flags = firmware.header.e_flags;
+  description.is_big_endian = !firmware.is_little_endian;
+  description.fields = fields;
+  description.fields_number = fields_number;
+  description.compressed_section = batch->codanalys_sections[description.is_big_endian];
+  description.compressed_section_len = batch->codanalys_sections_len[description.is_big_endian];
+  size_t metadata_len = chariot_metaobj_size(&description);
+  const Suppldata_object* suppldata = NULL;
+  if (metadata_len == 0) {
+    *error_message = "invalid description of the metadata object";
+    goto end;
+  }
+  if (parser->additional_file
+      && !retrieve_suppldata_object(&suppldata, batch, &firmware.header, description.is_big_endian,
+          error_message))
+    goto end;
+
+  // layout of the output: the original content, the new section names, .suppldata,
+  // .chariotmeta.rodata and then the section headers
+  unsigned chariot_indexes[CS_Extra+1];
+  Elf32_Word chariot_names[CS_Extra+1];
+  Elf32_Word names_len = firmware.section_names_size;
+  unsigned sections_number = firmware.header.e_shnum;
+  for (int section = CS_Meta; section <= CS_Extra; ++section) {
+    chariot_indexes[section] = find_section(&firmware, Chariot_Section_names[section]);
+    if (chariot_indexes[section])
+      chariot_names[section] = firmware.sections[chariot_indexes[section]].sh_name;
+    else if (section == CS_Meta || suppldata) {
+      chariot_indexes[section] = sections_number++;
+      chariot_names[section] = names_len;
+      names_len += strlen(Chariot_Section_names[section]) + 1;
+    }
+  }
+  if (sections_number >= 0xff00 /* SHN_LORESERVE */) {
+    *error_message = "too many sections in the firmware";
+    goto end;
+  }
+  size_t names_offset = firmware.buffer_len;
+  size_t output_len = names_len > firmware.section_names_size ? names_offset + names_len : names_offset;
+  size_t suppldata_offset = align_up(output_len, BATCH_SECTION_ALIGN);
+  if (suppldata)
+    output_len = suppldata_offset + suppldata->object_len;
+  size_t metadata_offset = align_up(output_len, BATCH_SECTION_ALIGN);
+  size_t headers_offset = align_up(metadata_offset + metadata_len, 4);
+  output_len = headers_offset + sections_number*40;
+  if (output_len > 0xffffffffU) {
+    *error_message = "the firmware with its metadata is too large for elf32";
+    goto end;
+  }
+
+  // the new elf header is part of the first loadable segment, so it is set before hashing
+  write_elf_word(firmware.buffer + 32, (uint32_t) headers_offset, firmware.is_little_endian);
+  write_elf_half(firmware.buffer + 48, (uint16_t) sections_number, firmware.is_little_endian);
+  if (!hash_regions(sha256, parser->requires_blake3 ? blake3 : NULL,
+        parser->requires_crc32c ? crc32c : NULL, chunks_field, parser->chunk_size,
+        regions, regions_number, firmware.buffer, parser->requires_format_v2)) {
+    *error_message = "unable to hash the mainboot regions";
+    goto end;
+  }
+  metadata_object = (char*) malloc(metadata_len);
+  section_headers = (unsigned char*) malloc(sections_number*40);
+  if (!metadata_object || !section_headers) {
+    *error_message = "unable to allocate the metadata object";
+    goto end;
+  }
+  if (!chariot_metaobj_write(metadata_object, metadata_len, &description, error_message))
+    goto end;
+
+  if (names_len > firmware.section_names_size) {
+    firmware.sections[firmware.header.e_shstrndx].sh_offset = (Elf32_Off) names_offset;
+    firmware.sections[firmware.header.e_shstrndx].sh_size = names_len;
+  }
+  set_chariot_section(&firmware.sections[chariot_indexes[CS_Meta]], chariot_names[CS_Meta],
+      (Elf32_Off) metadata_offset, (Elf32_Word) metadata_len, false);
+  if (suppldata)
+    set_chariot_section(&firmware.sections[chariot_indexes[CS_Extra]], chariot_names[CS_Extra],
+        (Elf32_Off) suppldata_offset, (Elf32_Word) suppldata->object_len, suppldata->is_compressed);
+  for (unsigned section_index = 0; section_index < sections_number; ++section_index)
+    write_section_header(section_headers + section_index*40, &firmware.sections[section_index],
+        firmware.is_little_endian);
+
+  // a failed or interrupted write never leaves a truncated firmware under the output name
+  char process[24];
+  snprintf(process, sizeof(process), "%ld", (long) getpid());
+  temporary_name = concatenate(image->output_name, ".tmp", process);
+  output = temporary_name ? fopen(temporary_name, "wb") : NULL;
+  size_t position = firmware.buffer_len;
+  bool is_written = output
+    && fwrite(firmware.buffer, 1, firmware.buffer_len, output) == firmware.buffer_len;
+  if (is_written && names_len > firmware.section_names_size) {
+    is_written = fwrite(firmware.section_names, 1, firmware.section_names_size, output)
+        == firmware.section_names_size;
+    for (int section = CS_Meta; is_written && section <= CS_Extra; ++section)
+      if ((section == CS_Meta || suppldata)
+          && chariot_names[section] >= firmware.section_names_size)
+        is_written = fwrite(Chariot_Section_names[section], 1,
+            strlen(Chariot_Section_names[section]) + 1, output)
+          == strlen(Chariot_Section_names[section]) + 1;
+    position += names_len;
+  }
+  if (is_written && suppldata) {
+    is_written = write_padding(output, &position, BATCH_SECTION_ALIGN)
+      && fwrite(suppldata->object, 1, suppldata->object_len, output) == suppldata->object_len;
+    position += suppldata->object_len;
+  }
+  is_written = is_written && write_padding(output, &position, BATCH_SECTION_ALIGN)
+    && fwrite(metadata_object, 1, metadata_len, output) == metadata_len;
+  position += metadata_len;
+  is_written = is_written && write_padding(output, &position, 4)
+    && fwrite(section_headers, 1, sections_number*40, output) == sections_number*40;
+  if (output && fclose(output) != 0)
+    is_written = false;
+  output = NULL;
+  if (is_written && rename(temporary_name, image->output_name) != 0)
+    is_written = false;
+  if (!is_written) {
+    if (temporary_name)
+      remove(temporary_name);
+    *error_message = "unable to write the output firmware";
+    goto end;
+  }
+  image->output_len = output_len;
+  result = true;
+
+end:
+  free(temporary_name);
+  free(section_headers);
+  free(metadata_object);
+  free(firmware_license);
+  free(firmware_path);
+  free(chunks_field);
+  free(regions_field);
+  free(firmware.sections);
+  free(firmware.buffer);
+  return result;
+}
+
+static void*
+insert_images(void* argument)
+{
+  Batch* batch = (Batch*) argument;
+  while (true) {
+    pthread_mutex_lock(&batch->mutex);
+    size_t image_index = batch->next_image++;
+    pthread_mutex_unlock(&batch->mutex);
+    if (image_index >= batch->images_number)
+      return NULL;
+    Image* image = &batch->images[image_index];
+    image->is_inserted = insert_metadata(batch, image, &image->error_message);
+  }
+}
+
+int
+main(int argc, const char** argv)
+{
+  InputParser parser;
+  if (!fill_input_parser_fields(&parser, argc, argv))
+  {
+    input_parser_usage();
+    free(parser.boot_sections);
+    return 1;
+  }
+  if (parser.requires_help)
+  {
+    input_parser_usage();
+    free(parser.boot_sections);
+    return 0;
+  }
+
+  Batch batch;
+  memset(&batch, 0, sizeof(Batch));
+  batch.parser = &parser;
+  pthread_mutex_init(&batch.mutex, NULL);
+  const char* error_message = NULL;
+  if (!read_manifest(&batch, &error_message))
+  {
+    fprintf(stderr, "Cannot read the manifest %s\n", parser.manifest_name);
+    fprintf(stderr, "  %s\n", error_message);
+    free_batch(&batch);
+    free(parser.boot_sections);
+    return 1;
+  }
+  if (!build_shared_fields(&batch, &error_message))
+  {
+    fprintf(stderr, "Cannot build the shared metadata fields\n");
+    fprintf(stderr, "  %s\n", error_message);
+    free_batch(&batch);
+    free(parser.boot_sections);
+    return 1;
+  }
+
+  int threads_number = parser.threads_number;
+  if (threads_number <= 0)
+  {
+    long processors_number = sysconf(_SC_NPROCESSORS_ONLN);
+    threads_number = processors_number > 0 ? (int) processors_number : 1;
+  }
+  if (threads_number > BATCH_THREADS_MAX)
+    threads_number = BATCH_THREADS_MAX;
+  if ((size_t) threads_number > batch.images_number)
+    threads_number = (int) batch.images_number;
+  // the calling thread is the first worker of the pool, a failed creation only shrinks it
+  pthread_t threads[BATCH_THREADS_MAX];
+  bool is_thread_created[BATCH_THREADS_MAX];
+  for (int thread_index = 1; thread_index < threads_number; ++thread_index)
+    is_thread_created[thread_index]
+      = pthread_create(&threads[thread_index], NULL, insert_images, &batch) == 0;
+  insert_images(&batch);
+  for (int thread_index = 1; thread_index < threads_number; ++thread_index)
+    if (is_thread_created[thread_index])
+      pthread_join(threads[thread_index], NULL);
+
+  int result = 0;
+  for (size_t image_index = 0; image_index < batch.images_number; ++image_index)
+  {
+    const Image* image = &batch.images[image_index];
+    if (!image->is_inserted)
+    {
+      fprintf(stderr, "Cannot insert the metadata into %s\n", image->input_name);
+      fprintf(stderr, "  %s\n", image->error_message);
+      result = 1;
+    }
+    else if (parser.requires_verbose)
+      printf("%s -> %s: mainboot of %llu bytes, %u bytes\n", image->input_name, image->output_name,
+          (unsigned long long) image->mainboot_len, (unsigned) image->output_len);
+  }
+  if (parser.requires_verbose)
+    printf("%u firmwares on %d threads\n", (unsigned) batch.images_number, threads_number);
+  pthread_mutex_destroy(&batch.mutex);
+  free_batch(&batch);
+  free(parser.boot_sections);
+  return result;
+}
@@ -0,0 +1,586 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "chariot_batchread.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+// IORING_OP_OPENAT and IORING_OP_READ come with this feature in linux 5.6
+#if defined(IORING_FEAT_RW_CUR_POS) && defined(__NR_io_uring_setup)
+#define BATCH_HAS_IO_URING
+#endif
+#endif
+#endif
+
+#define BATCH_EHDR_SIZE 52
+#define BATCH_SHDR_SIZE 40
+// the first read gets the elf header and usually the program headers
+#define BATCH_HEAD_SIZE 4096
+#define BATCH_NAMES_MAX 0x100000
+#define BATCH_QUEUE_DEPTH 256
+#define BATCH_THREADS_MAX 64
+
+extern const char* Chariot_Section_names[];
+
+typedef enum {
+   BS_Open, BS_Head, BS_Table, BS_Names, BS_Metadata, BS_Done
+} Batch_step;
+
+/* one firmware, from its opening to its parsing */
+typedef struct _Batch_image {
+   size_t index;
+   const char* file_name;
+   int fd;
+   Batch_step step;
+   const char* error_message;
+   // current read
+   uint64_t read_offset;
+   char* read_target;
+   size_t read_len, read_done;
+   // results of the reads
+   char* head;
+   size_t head_len;
+   Elf32_Ehdr elf_header;
+   char* section_table;
+   char* names;
+   size_t names_len;
+   Elf32_Shdr metadata_section;
+   char* metadata_buffer;
+   struct _Batch_image* next; // in the queue of the parser workers
+} Batch_image;
+
+static void
+free_image(Batch_image* image) {
+   free(image->head);
+   free(image->section_table);
+   free(image->names);
+   free(image->metadata_buffer);
+   free(image);
+}
+
+static bool
+prepare_read(Batch_image* image, Batch_step step, uint64_t offset, char** target, size_t len) {
+   *target = (char*) malloc(len + 1);
+   if (!*target) {
+      image->error_message = "not enough memory";
+      return false;
+   }
+   image->step = step;
+   image->read_offset = offset;
+   image->read_target = *target;
+   image->read_len = len;
+   image->read_done = 0;
+   return true;
+}
+
+/*
+ * Checks the result of the read of the current step and prepares the next one.
+ * Returns false when the image is complete (BS_Done) or has failed (error_message).
+ */
+static bool
+next_read(Batch_image* image) {
+   switch (image->step) {
+      case BS_Open:
+         return prepare_read(image, BS_Head, 0, &image->head, BATCH_HEAD_SIZE);
+      case BS_Head: {
+         image->head_len = image->read_done;
+         if (!fill_exe_header(&image->elf_header, image->head, image->head_len, &image->error_message))
+            return false;
+         if (image->elf_header.e_shentsize != BATCH_SHDR_SIZE) {
+            image->error_message = "size of section header is not as expected";
+            return false;
+         }
+         if (image->elf_header.e_shstrndx == 0 || image->elf_header.e_shstrndx >= image->elf_header.e_shnum) {
+            image->error_message = "no string table to find CHARIOT sections";
+            return false;
+         }
+         return prepare_read(image, BS_Table, image->elf_header.e_shoff, &image->section_table,
+               (size_t) image->elf_header.e_shnum*BATCH_SHDR_SIZE);
+      }
+      case BS_Table: {
+         if (image->read_done != image->read_len) {
+            image->error_message = "unable to read a section header: buffer is too small";
+            return false;
+         }
+         Elf32_Shdr section_string_table;
+         fill_section_header(&section_string_table, &image->elf_header,
+               image->section_table + image->elf_header.e_shstrndx*BATCH_SHDR_SIZE);
+         if (section_string_table.sh_size > BATCH_NAMES_MAX) {
+            image->error_message = "unable to read section string table";
+            return false;
+         }
+         return prepare_read(image, BS_Names, section_string_table.sh_offset, &image->names,
+               section_string_table.sh_size);
+      }
+      case BS_Names: {
+         image->names_len = image->read_done;
+         const char* section_name = Chariot_Section_names[CS_Meta];
+         size_t name_len = strlen(section_name) + 1;
+         for (int section_index = 0; section_index < image->elf_header.e_shnum; ++section_index) {
+            Elf32_Shdr section_header;
+            fill_section_header(&section_header, &image->elf_header,
+                  image->section_table + section_index*BATCH_SHDR_SIZE);
+            if (section_header.sh_name < image->names_len
+                  && name_len <= image->names_len - section_header.sh_name
+                  && memcmp(image->names + section_header.sh_name, section_name, name_len) == 0) {
+               image->metadata_section = section_header;
+               return prepare_read(image, BS_Metadata, section_header.sh_offset, &image->metadata_buffer,
+                     section_header.sh_size);
+            }
+         }
+         image->error_message = "unable to find CHARIOT metadata section in elf buffer";
+         return false;
+      }
+      case BS_Metadata:
+         if (image->read_done != image->read_len) {
+            image->error_message = "unable to read the metadata section: buffer is too small";
+            return false;
+         }
+         image->step = BS_Done;
+         return false;
+      default:
+         return false;
+   }
+}
+
+/* builds the Chariot_Reader_metadata of a complete image and gives it to the callback */
+static void
+parse_image(Batch_image* image, Chariot_Batch_callback callback, void* context) {
+   if (image->step != BS_Done) {
+      callback(context, image->index, NULL, image->error_message);
+      return;
+   }
+   Chariot_Reader_metadata metadata;
+   const char* error_message = NULL;
+   memset(&metadata, 0, sizeof(Chariot_Reader_metadata));
+   metadata.elf_header = image->elf_header;
+   // like chariot_reader_load_metadata, head has the program headers if it holds them
+   metadata.head = image->head;
+   metadata.head_len = BATCH_EHDR_SIZE;
+   uint64_t program_headers_end = image->elf_header.e_phoff
+      + (uint64_t) image->elf_header.e_phnum*image->elf_header.e_phentsize;
+   if (image->elf_header.e_phnum > 0 && program_headers_end <= image->head_len
+         && program_headers_end > BATCH_EHDR_SIZE)
+      metadata.head_len = (size_t) program_headers_end;
+   metadata.metadata_section = image->metadata_section;
+   metadata.metadata_buffer = image->metadata_buffer;
+   metadata.metadata_dict.valid_entries = 0;
+   metadata.metadata_dict.metadata_header = &metadata.metadata_header;
+   metadata.metadata_dict.metadata_section = &metadata.metadata_section;
+   metadata.metadata_dict.metadata_buffer_exe = image->metadata_buffer;
+   metadata.metadata_dict.metadata_buffer_len = image->metadata_section.sh_size;
+   if (!fill_exe_header(&metadata.metadata_header, image->metadata_buffer, image->metadata_section.sh_size,
+            &error_message)
+         || !fill_metadata_dict(&metadata.metadata_dict, &error_message))
+      callback(context, image->index, NULL, error_message);
+   else
+      callback(context, image->index, &metadata, NULL);
+}
+
+typedef struct {
+   const char* const* file_names;
+   size_t files_number;
+   size_t next_file;
+   Chariot_Batch_callback callback;
+   void* context;
+   pthread_mutex_t mutex;
+   pthread_cond_t condition;
+   Batch_image* first_image; // queue of the images to parse
+   Batch_image* last_image;
+   bool is_reading_finished;
+   bool has_failed;
+} Batch_state;
+
+static Batch_image*
+new_image(Batch_state* state, size_t index) {
+   Batch_image* image = (Batch_image*) calloc(1, sizeof(Batch_image));
+   if (!image)
+      return NULL;
+   image->index = index;
+   image->file_name = state->file_names[index];
+   image->fd = -1;
+   image->step = BS_Open;
+   return image;
+}
+
+/* the thread pool backend: every thread reads and parses its images with blocking reads */
+static void*
+read_with_thread(void* argument) {
+   Batch_state* state = (Batch_state*) argument;
+   while (true) {
+      pthread_mutex_lock(&state->mutex);
+      size_t index = state->has_failed ? state->files_number : state->next_file;
+      if (index < state->files_number)
+         ++state->next_file;
+      pthread_mutex_unlock(&state->mutex);
+      if (index >= state->files_number)
+         return NULL;
+
+      Batch_image* image = new_image(state, index);
+      if (!image) {
+         pthread_mutex_lock(&state->mutex);
+         state->has_failed = true;
+         pthread_mutex_unlock(&state->mutex);
+         return NULL;
+      }
+      image->fd = open(image->file_name, O_RDONLY | O_CLOEXEC);
+      if (image->fd < 0)
+         image->error_message = "unable to open the firmware";
+      else {
+         while (next_read(image)) {
+            while (image->read_done < image->read_len) {
+               ssize_t read_len = pread(image->fd, image->read_target + image->read_done,
+                     image->read_len - image->read_done, (off_t) (image->read_offset + image->read_done));
+               if (read_len < 0 && errno == EINTR)
+                  continue;
+               if (read_len < 0) {
+                  image->error_message = "unable to read the firmware";
+                  break;
+               }
+               if (read_len == 0)
+                  break;
+               image->read_done += read_len;
+            }
+            if (image->error_message)
+               break;
+         }
+         close(image->fd);
+      }
+      parse_image(image, state->callback, state->context);
+      free_image(image);
+   }
+}
+
+/* parser worker of the io_uring backend */
+static void*
+parse_with_thread(void* argument) {
+   Batch_state* state = (Batch_state*) argument;
+   while (true) {
+      pthread_mutex_lock(&state->mutex);
+      while (!state->first_image && !state->is_reading_finished)
+         pthread_cond_wait(&state->condition, &state->mutex);
+      Batch_image* image = state->first_image;
+      if (image) {
+         state->first_image = image->next;
+         if (!state->first_image)
+            state->last_image = NULL;
+      }
+      pthread_mutex_unlock(&state->mutex);
+      if (!image)
+         return NULL;
+      parse_image(image, state->callback, state->context);
+      free_image(image);
+   }
+}
+
+static void
+push_image(Batch_state* state, Batch_image* image) {
+   image->next = NULL;
+   pthread_mutex_lock(&state->mutex);
+   if (state->last_image)
+      state->last_image->next = image;
+   else
+      state->first_image = image;
+   state->last_image = image;
+   pthread_cond_signal(&state->condition);
+   pthread_mutex_unlock(&state->mutex);
+}
+
+#ifdef BATCH_HAS_IO_URING
+
+typedef struct {
+   int fd;
+   unsigned* sq_head;
+   unsigned* sq_tail;
+   unsigned* sq_mask;
+   unsigned* sq_array;
+   struct io_uring_sqe* sqes;
+   unsigned* cq_head;
+   unsigned* cq_tail;
+   unsigned* cq_mask;
+   struct io_uring_cqe* cqes;
+   void* sq_ring;
+   size_t sq_ring_size;
+   void* cq_ring;
+   size_t cq_ring_size;
+   size_t sqes_size;
+   unsigned to_submit;
+} Batch_ring;
+
+static void
+close_ring(Batch_ring* ring) {
+   if (ring->sqes)
+      munmap(ring->sqes, ring->sqes_size);
+   if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+      munmap(ring->cq_ring, ring->cq_ring_size);
+   if (ring->sq_ring)
+      munmap(ring->sq_ring, ring->sq_ring_size);
+   close(ring->fd);
+}
+
+/* io_uring without liburing: the rings are mapped from the file descriptor of io_uring_setup */
+static bool
+open_ring(Batch_ring* ring, unsigned entries) {
+   struct io_uring_params params;
+   memset(ring, 0, sizeof(Batch_ring));
+   memset(&params, 0, sizeof(params));
+   ring->fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+   if (ring->fd < 0)
+      return false;
+   if (!(params.features & IORING_FEAT_RW_CUR_POS)) { // IORING_OP_READ and IORING_OP_OPENAT
+      close(ring->fd);
+      return false;
+   }
+   ring->sq_ring_size = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+   ring->cq_ring_size = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+   if ((params.features & IORING_FEAT_SINGLE_MMAP) && ring->cq_ring_size > ring->sq_ring_size)
+      ring->sq_ring_size = ring->cq_ring_size;
+   ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+         ring->fd, IORING_OFF_SQ_RING);
+   if (ring->sq_ring == MAP_FAILED) {
+      ring->sq_ring = NULL;
+      close_ring(ring);
+      return false;
+   }
+   if (params.features & IORING_FEAT_SINGLE_MMAP)
+      ring->cq_ring = ring->sq_ring;
+   else {
+      ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            ring->fd, IORING_OFF_CQ_RING);
+      if (ring->cq_ring == MAP_FAILED) {
+         ring->cq_ring = NULL;
+         close_ring(ring);
+         return false;
+      }
+   }
+   ring->sqes_size = params.sq_entries*sizeof(struct io_uring_sqe);
+   ring->sqes = (struct io_uring_sqe*) mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+         MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+   if (ring->sqes == MAP_FAILED) {
+      ring->sqes = NULL;
+      close_ring(ring);
+      return false;
+   }
+   char* sq_ring = (char*) ring->sq_ring;
+   char* cq_ring = (char*) ring->cq_ring;
+   ring->sq_head = (unsigned*) (sq_ring + params.sq_off.head);
+   ring->sq_tail = (unsigned*) (sq_ring + params.sq_off.tail);
+   ring->sq_mask = (unsigned*) (sq_ring + params.sq_off.ring_mask);
+   ring->sq_array = (unsigned*) (sq_ring + params.sq_off.array);
+   ring->cq_head = (unsigned*) (cq_ring + params.cq_off.head);
+   ring->cq_tail = (unsigned*) (cq_ring + params.cq_off.tail);
+   ring->cq_mask = (unsigned*) (cq_ring + params.cq_off.ring_mask);
+   ring->cqes = (struct io_uring_cqe*) (cq_ring + params.cq_off.cqes);
+   return true;
+}
+
+/* the submission queue has room since every image has at most one request in flight */
+static void
+submit_request(Batch_ring* ring, Batch_image* image) {
+   unsigned tail = *ring->sq_tail;
+   unsigned position = tail & *ring->sq_mask;
+   struct io_uring_sqe* sqe = &ring->sqes[position];
+   memset(sqe, 0, sizeof(struct io_uring_sqe));
+   if (image->step == BS_Open) {
+      sqe->opcode = IORING_OP_OPENAT;
+      sqe->fd = AT_FDCWD;
+      sqe->addr = (uint64_t) (uintptr_t) image->file_name;
+      sqe->open_flags = O_RDONLY | O_CLOEXEC;
+   }
+   else {
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = image->fd;
+      sqe->addr = (uint64_t) (uintptr_t) (image->read_target + image->read_done);
+      sqe->len = (uint32_t) (image->read_len - image->read_done);
+      sqe->off = image->read_offset + image->read_done;
+   }
+   sqe->user_data = (uint64_t) (uintptr_t) image;
+   ring->sq_array[position] = position;
+   __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+   ++ring->to_submit;
+}
+
+/* a read of the image has completed with res, returns true if the image needs another request */
+static bool
+complete_request(Batch_image* image, int res) {
+   if (image->step == BS_Open) {
+      if (res < 0) {
+         image->error_message = "unable to open the firmware";
+         return false;
+      }
+      image->fd = res;
+   }
+   else if (res < 0) {
+      image->error_message = "unable to read the firmware";
+      return false;
+   }
+   else {
+      image->read_done += res;
+      if (res > 0 && image->read_done < image->read_len)
+         return true; // short read, the rest is requested
+   }
+   return next_read(image) && (image->read_len > 0 || complete_request(image, 0));
+}
+
+static bool
+read_with_ring(Batch_state* state, Batch_ring* ring, unsigned queue_depth) {
+   unsigned in_flight = 0;
+   while (state->next_file < state->files_number || in_flight > 0) {
+      while (in_flight < queue_depth && state->next_file < state->files_number) {
+         Batch_image* image = new_image(state, state->next_file);
+         if (!image)
+            return false;
+         ++state->next_file;
+         submit_request(ring, image);
+         ++in_flight;
+      }
+      int result = (int) syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, 1,
+            IORING_ENTER_GETEVENTS, NULL, 0);
+      if (result < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+         return false;
+      if (result > 0)
+         ring->to_submit -= result < (int) ring->to_submit ? (unsigned) result : ring->to_submit;
+
+      unsigned head = *ring->cq_head;
+      while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+         struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+         Batch_image* image = (Batch_image*) (uintptr_t) cqe->user_data;
+         int res = cqe->res;
+         ++head;
+         __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+         if (complete_request(image, res))
+            submit_request(ring, image);
+         else {
+            // the image is complete or has failed, a parser worker takes it
+            if (image->fd >= 0)
+               close(image->fd);
+            --in_flight;
+            push_image(state, image);
+         }
+      }
+   }
+   return true;
+}
+
+#endif // BATCH_HAS_IO_URING
+
+static int
+workers_number(const Chariot_Batch_options* options) {
+   int result = options->workers_number;
+   if (result <= 0) {
+      long processors_number = sysconf(_SC_NPROCESSORS_ONLN);
+      result = processors_number > 0 ? (int) processors_number : 1;
+   }
+   return result < BATCH_THREADS_MAX ? result : BATCH_THREADS_MAX;
+}
+
+int chariot_batch_read_metadata(const char* const* file_names, size_t files_number,
+      const Chariot_Batch_options* options, Chariot_Batch_callback callback, void* context,
+      Chariot_Batch_backend* backend, const char** error_message) {
+   Batch_state state;
+   memset(&state, 0, sizeof(Batch_state));
+   state.file_names = file_names;
+   state.files_number = files_number;
+   state.callback = callback;
+   state.context = context;
+   pthread_mutex_init(&state.mutex, NULL);
+   pthread_cond_init(&state.condition, NULL);
+   unsigned queue_depth = options->queue_depth > 0 ? (unsigned) options->queue_depth : BATCH_QUEUE_DEPTH;
+   pthread_t threads[BATCH_THREADS_MAX];
+   int threads_number = 0;
+   bool result = true;
+   *backend = CBB_Threads;
+
+#ifdef BATCH_HAS_IO_URING
+   Batch_ring ring;
+   if (!options->requires_threads && open_ring(&ring, queue_depth)) {
+      // the calling thread drives the ring, the workers parse the complete images
+      *backend = CBB_Io_uring;
+      int parsers_number = workers_number(options);
+      for (; threads_number < parsers_number; ++threads_number)
+         if (pthread_create(&threads[threads_number], NULL, parse_with_thread, &state) != 0)
+            break;
+      if (threads_number == 0) {
+         *error_message = "unable to create the parser threads";
+         result = false;
+      }
+      else if (!read_with_ring(&state, &ring, queue_depth)) {
+         *error_message = "unable to read the firmwares with io_uring";
+         result = false;
+      }
+      pthread_mutex_lock(&state.mutex);
+      state.is_reading_finished = true;
+      pthread_cond_broadcast(&state.condition);
+      pthread_mutex_unlock(&state.mutex);
+      for (int index = 0; index < threads_number; ++index)
+         pthread_join(threads[index], NULL);
+      // the images still in the ring after a failure are lost with it
+      close_ring(&ring);
+      pthread_mutex_destroy(&state.mutex);
+      pthread_cond_destroy(&state.condition);
+      return result;
+   }
+#endif
+
+   // every thread has one blocking read in flight
+   int readers_number = queue_depth < BATCH_THREADS_MAX ? (int) queue_depth : BATCH_THREADS_MAX;
+   if ((size_t) readers_number > files_number)
+      readers_number = files_number > 0 ? (int) files_number : 1;
+   for (; threads_number < readers_number - 1; ++threads_number)
+      if (pthread_create(&threads[threads_number], NULL, read_with_thread, &state) != 0)
+         break;
+   read_with_thread(&state);
+   for (int index = 0; index < threads_number; ++index)
+      pthread_join(threads[index], NULL);
+   if (state.has_failed) {
+      *error_message = "not enough memory";
+      result = false;
+   }
+   pthread_mutex_destroy(&state.mutex);
+   pthread_cond_destroy(&state.condition);
+   return result;
+}
@@ -0,0 +1,84 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+/*
+ * Batch extraction of the CHARIOT metadata of many firmwares, for the fleet audits
+ * on network file systems. Hundreds of files are read at the same time: the
+ * dependent reads of a firmware (elf header, section table, section names and
+ * .chariotmeta.rodata) are chained as soon as the previous one completes, and the
+ * complete images go to parser workers. The reads go through io_uring when the
+ * kernel provides it and otherwise through a pool of threads doing blocking reads.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include "chariot_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+   CBB_Io_uring, CBB_Threads
+} Chariot_Batch_backend;
+
+typedef struct {
+   int queue_depth; // images read at the same time, 0 for 256
+   int workers_number; // parser workers, 0 = one per online processor
+   bool requires_threads; // uses the thread pool even when io_uring is available
+} Chariot_Batch_options;
+
+/*
+ * Called by a parser worker once per file, metadata is NULL when error_message is
+ * not. The calls are concurrent and follow the order of completion of the reads,
+ * not the one of file_names.
+ */
+typedef void (*Chariot_Batch_callback)(void* context, size_t index, const Chariot_Reader_metadata* metadata,
+      const char* error_message);
+
+/*
+ * Reads the metadata of the files_number firmwares of file_names. It only fails on a
+ * memory or thread error, the errors of the firmwares go to the callback.
+ */
+int chariot_batch_read_metadata(const char* const* file_names, size_t files_number,
+      const Chariot_Batch_options* options, Chariot_Batch_callback callback, void* context,
+      Chariot_Batch_backend* backend, const char** error_message);
+
+#ifdef __cplusplus
+}
+#endif
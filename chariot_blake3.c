@@ -0,0 +1,374 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "chariot_blake3.h"
+
+#define BLAKE3_BLOCK_LEN 64
+#define BLAKE3_CHUNK_LEN 1024
+#define BLAKE3_LANES 8
+// a subtree smaller than this is not worth a new thread
+#define BLAKE3_THREAD_MIN_LEN (256*1024)
+
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#define BLAKE3_TARGET_CLONES __attribute__((target_clones("avx2","default")))
+#else
+#define BLAKE3_TARGET_CLONES
+#endif
+
+enum { Blake3_Chunk_start = 1, Blake3_Chunk_end = 2, Blake3_Parent = 4, Blake3_Root = 8 };
+
+static const uint32_t blake3_iv[8] = {
+   0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const uint8_t blake3_schedule[7][16] = {
+   { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+   { 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 },
+   { 3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1 },
+   { 10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6 },
+   { 12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4 },
+   { 9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7 },
+   { 11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13 }
+};
+
+typedef struct {
+   const Chariot_Blake3_slice* slices;
+   size_t slices_number;
+   uint64_t slice_starts[CHARIOT_BLAKE3_SLICES_MAX+1];
+} Blake3_input;
+
+static inline uint32_t
+load_word(const unsigned char* source)
+{  return (uint32_t) source[0] | ((uint32_t) source[1] << 8) | ((uint32_t) source[2] << 16)
+      | ((uint32_t) source[3] << 24);
+}
+
+static inline void
+store_word(unsigned char* target, uint32_t word)
+{  target[0] = (unsigned char) word; target[1] = (unsigned char) (word >> 8);
+   target[2] = (unsigned char) (word >> 16); target[3] = (unsigned char) (word >> 24);
+}
+
+static inline uint32_t
+rotate_right(uint32_t word, int shift)
+{  return (word >> shift) | (word << (32-shift)); }
+
+// returns a pointer to the input range [start, start+len[, gathered in scratch if it crosses slices
+static const unsigned char*
+input_range(const Blake3_input* input, uint64_t start, size_t len, unsigned char* scratch) {
+   size_t low = 0, high = input->slices_number;
+   if (high == 0)
+      return scratch;
+   while (high - low > 1) {
+      size_t middle = (low + high) / 2;
+      if (input->slice_starts[middle] <= start)
+         low = middle;
+      else
+         high = middle;
+   }
+   while (low + 1 < input->slices_number && input->slice_starts[low+1] <= start)
+      ++low;
+   if (start + len <= input->slice_starts[low+1])
+      return (const unsigned char*) input->slices[low].start + (start - input->slice_starts[low]);
+   size_t copied = 0;
+   while (copied < len && low < input->slices_number) {
+      size_t offset = start + copied - input->slice_starts[low];
+      size_t part = input->slices[low].len - offset;
+      if (part > len - copied)
+         part = len - copied;
+      memcpy(scratch + copied, (const unsigned char*) input->slices[low].start + offset, part);
+      copied += part;
+      ++low;
+   }
+   return scratch;
+}
+
+static void
+compress_in_place(uint32_t cv[8], const unsigned char block[BLAKE3_BLOCK_LEN], uint32_t block_len,
+      uint64_t counter, uint32_t flags) {
+   uint32_t message[16], state[16];
+   for (int index = 0; index < 16; ++index)
+      message[index] = load_word(block + 4*index);
+   memcpy(state, cv, 8*sizeof(uint32_t));
+   memcpy(state + 8, blake3_iv, 4*sizeof(uint32_t));
+   state[12] = (uint32_t) counter;
+   state[13] = (uint32_t) (counter >> 32);
+   state[14] = block_len;
+   state[15] = flags;
+#define BLAKE3_G(a, b, c, d, x, y)                                               \
+   state[a] += state[b] + (x); state[d] = rotate_right(state[d] ^ state[a], 16);  \
+   state[c] += state[d]; state[b] = rotate_right(state[b] ^ state[c], 12);        \
+   state[a] += state[b] + (y); state[d] = rotate_right(state[d] ^ state[a], 8);   \
+   state[c] += state[d]; state[b] = rotate_right(state[b] ^ state[c], 7);
+   for (int round = 0; round < 7; ++round) {
+      const uint8_t* schedule = blake3_schedule[round];
+      BLAKE3_G(0, 4, 8, 12, message[schedule[0]], message[schedule[1]])
+      BLAKE3_G(1, 5, 9, 13, message[schedule[2]], message[schedule[3]])
+      BLAKE3_G(2, 6, 10, 14, message[schedule[4]], message[schedule[5]])
+      BLAKE3_G(3, 7, 11, 15, message[schedule[6]], message[schedule[7]])
+      BLAKE3_G(0, 5, 10, 15, message[schedule[8]], message[schedule[9]])
+      BLAKE3_G(1, 6, 11, 12, message[schedule[10]], message[schedule[11]])
+      BLAKE3_G(2, 7, 8, 13, message[schedule[12]], message[schedule[13]])
+      BLAKE3_G(3, 4, 9, 14, message[schedule[14]], message[schedule[15]])
+   }
+   for (int index = 0; index < 8; ++index)
+      cv[index] = state[index] ^ state[index+8];
+}
+
+typedef uint32_t blake3_lanes __attribute__((vector_size(4*BLAKE3_LANES)));
+
+static inline void
+broadcast_lanes(blake3_lanes* result, uint32_t word) {
+   for (int lane = 0; lane < BLAKE3_LANES; ++lane)
+      (*result)[lane] = word;
+}
+
+// hashes BLAKE3_LANES full consecutive chunks, one chunk per vector lane
+BLAKE3_TARGET_CLONES static void
+hash_chunks_many(const unsigned char* const chunks[BLAKE3_LANES], uint64_t counter,
+      uint32_t cvs[BLAKE3_LANES][8]) {
+   blake3_lanes cv[8], counter_low, counter_high;
+   for (int index = 0; index < 8; ++index)
+      broadcast_lanes(&cv[index], blake3_iv[index]);
+   for (int lane = 0; lane < BLAKE3_LANES; ++lane) {
+      counter_low[lane] = (uint32_t) (counter + lane);
+      counter_high[lane] = (uint32_t) ((counter + lane) >> 32);
+   }
+   for (int block = 0; block < BLAKE3_CHUNK_LEN/BLAKE3_BLOCK_LEN; ++block) {
+      blake3_lanes message[16], state[16];
+      for (int index = 0; index < 16; ++index)
+         for (int lane = 0; lane < BLAKE3_LANES; ++lane)
+            message[index][lane] = load_word(chunks[lane] + block*BLAKE3_BLOCK_LEN + 4*index);
+      uint32_t flags = (block == 0 ? Blake3_Chunk_start : 0)
+         | (block == BLAKE3_CHUNK_LEN/BLAKE3_BLOCK_LEN-1 ? Blake3_Chunk_end : 0);
+      for (int index = 0; index < 8; ++index)
+         state[index] = cv[index];
+      for (int index = 0; index < 4; ++index)
+         broadcast_lanes(&state[8+index], blake3_iv[index]);
+      state[12] = counter_low;
+      state[13] = counter_high;
+      broadcast_lanes(&state[14], BLAKE3_BLOCK_LEN);
+      broadcast_lanes(&state[15], flags);
+#define BLAKE3_VG(a, b, c, d, x, y)                                                             \
+      state[a] += state[b] + (x); state[d] = (state[d] ^ state[a]) >> 16 | (state[d] ^ state[a]) << 16; \
+      state[c] += state[d]; state[b] = (state[b] ^ state[c]) >> 12 | (state[b] ^ state[c]) << 20; \
+      state[a] += state[b] + (y); state[d] = (state[d] ^ state[a]) >> 8 | (state[d] ^ state[a]) << 24; \
+      state[c] += state[d]; state[b] = (state[b] ^ state[c]) >> 7 | (state[b] ^ state[c]) << 25;
+      for (int round = 0; round < 7; ++round) {
+         const uint8_t* schedule = blake3_schedule[round];
+         BLAKE3_VG(0, 4, 8, 12, message[schedule[0]], message[schedule[1]])
+         BLAKE3_VG(1, 5, 9, 13, message[schedule[2]], message[schedule[3]])
+         BLAKE3_VG(2, 6, 10, 14, message[schedule[4]], message[schedule[5]])
+         BLAKE3_VG(3, 7, 11, 15, message[schedule[6]], message[schedule[7]])
+         BLAKE3_VG(0, 5, 10, 15, message[schedule[8]], message[schedule[9]])
+         BLAKE3_VG(1, 6, 11, 12, message[schedule[10]], message[schedule[11]])
+         BLAKE3_VG(2, 7, 8, 13, message[schedule[12]], message[schedule[13]])
+         BLAKE3_VG(3, 4, 9, 14, message[schedule[14]], message[schedule[15]])
+      }
+      for (int index = 0; index < 8; ++index)
+         cv[index] = state[index] ^ state[index+8];
+   }
+   for (int lane = 0; lane < BLAKE3_LANES; ++lane)
+      for (int index = 0; index < 8; ++index)
+         cvs[lane][index] = cv[index][lane];
+}
+
+static void
+chunk_cv(const unsigned char* chunk, size_t len, uint64_t counter, uint32_t root_flag, uint32_t cv[8]) {
+   size_t blocks_number = len == 0 ? 1 : (len + BLAKE3_BLOCK_LEN - 1) / BLAKE3_BLOCK_LEN;
+   memcpy(cv, blake3_iv, sizeof(blake3_iv));
+   for (size_t block = 0; block < blocks_number; ++block) {
+      size_t block_len = len - block*BLAKE3_BLOCK_LEN;
+      bool is_last = block + 1 == blocks_number;
+      unsigned char padded_block[BLAKE3_BLOCK_LEN];
+      const unsigned char* block_start = chunk + block*BLAKE3_BLOCK_LEN;
+      if (block_len > BLAKE3_BLOCK_LEN)
+         block_len = BLAKE3_BLOCK_LEN;
+      else if (block_len < BLAKE3_BLOCK_LEN) {
+         memset(padded_block, 0, BLAKE3_BLOCK_LEN);
+         if (block_len > 0)
+            memcpy(padded_block, block_start, block_len);
+         block_start = padded_block;
+      }
+      compress_in_place(cv, block_start, (uint32_t) block_len, counter,
+            (block == 0 ? Blake3_Chunk_start : 0) | (is_last ? Blake3_Chunk_end | root_flag : 0));
+   }
+}
+
+static void
+parent_cv(const uint32_t left[8], const uint32_t right[8], uint32_t flags, uint32_t cv[8]) {
+   unsigned char block[BLAKE3_BLOCK_LEN];
+   for (int index = 0; index < 8; ++index) {
+      store_word(block + 4*index, left[index]);
+      store_word(block + 32 + 4*index, right[index]);
+   }
+   memcpy(cv, blake3_iv, sizeof(blake3_iv));
+   compress_in_place(cv, block, BLAKE3_BLOCK_LEN, 0, Blake3_Parent | flags);
+}
+
+static inline uint64_t
+largest_power_of_two_below(uint64_t number) { /* number >= 2 */
+   uint64_t result = 1;
+   while (2*result < number)
+      result *= 2;
+   return result;
+}
+
+static void
+reduce_cvs(uint32_t (*cvs)[8], size_t number, uint32_t cv[8]) {
+   if (number == 1) {
+      memcpy(cv, cvs[0], 8*sizeof(uint32_t));
+      return;
+   }
+   size_t left_number = largest_power_of_two_below(number);
+   uint32_t left[8], right[8];
+   reduce_cvs(cvs, left_number, left);
+   reduce_cvs(cvs + left_number, number - left_number, right);
+   parent_cv(left, right, 0, cv);
+}
+
+typedef struct {
+   const Blake3_input* input;
+   uint64_t start;
+   uint64_t len;
+   int threads_number;
+   uint32_t cv[8];
+} Blake3_subtree;
+
+static void subtree_cv(Blake3_subtree* subtree);
+
+static void*
+subtree_thread(void* subtree) {
+   subtree_cv((Blake3_subtree*) subtree);
+   return NULL;
+}
+
+// the left subtree has the largest power of two chunks that leaves at least one byte on the right
+static void
+split_subtrees(const Blake3_input* input, uint64_t start, uint64_t len, int threads_number,
+      uint32_t left_cv[8], uint32_t right_cv[8]) {
+   uint64_t left_len = largest_power_of_two_below((len + BLAKE3_CHUNK_LEN - 1) / BLAKE3_CHUNK_LEN)
+      * BLAKE3_CHUNK_LEN;
+   Blake3_subtree left = { input, start, left_len, threads_number / 2 };
+   Blake3_subtree right = { input, start + left_len, len - left_len, threads_number - threads_number / 2 };
+   pthread_t thread;
+   bool is_threaded = threads_number >= 2 && len >= BLAKE3_THREAD_MIN_LEN
+      && pthread_create(&thread, NULL, subtree_thread, &left) == 0;
+   if (!is_threaded) {
+      left.threads_number = right.threads_number = 1;
+      subtree_cv(&left);
+   }
+   subtree_cv(&right);
+   if (is_threaded)
+      pthread_join(thread, NULL);
+   memcpy(left_cv, left.cv, sizeof(left.cv));
+   memcpy(right_cv, right.cv, sizeof(right.cv));
+}
+
+static void
+subtree_cv(Blake3_subtree* subtree) {
+   uint64_t counter = subtree->start / BLAKE3_CHUNK_LEN;
+   if (subtree->len <= BLAKE3_LANES*BLAKE3_CHUNK_LEN) {
+      uint32_t cvs[BLAKE3_LANES][8];
+      unsigned char scratch[BLAKE3_LANES][BLAKE3_CHUNK_LEN];
+      size_t chunks_number = (subtree->len + BLAKE3_CHUNK_LEN - 1) / BLAKE3_CHUNK_LEN;
+      if (subtree->len == BLAKE3_LANES*BLAKE3_CHUNK_LEN) {
+         const unsigned char* chunks[BLAKE3_LANES];
+         for (int lane = 0; lane < BLAKE3_LANES; ++lane)
+            chunks[lane] = input_range(subtree->input, subtree->start + lane*BLAKE3_CHUNK_LEN,
+                  BLAKE3_CHUNK_LEN, scratch[lane]);
+         hash_chunks_many(chunks, counter, cvs);
+      }
+      else {
+         for (size_t chunk = 0; chunk < chunks_number; ++chunk) {
+            uint64_t chunk_start = chunk*BLAKE3_CHUNK_LEN;
+            size_t chunk_len = subtree->len - chunk_start < BLAKE3_CHUNK_LEN
+               ? subtree->len - chunk_start : BLAKE3_CHUNK_LEN;
+            chunk_cv(input_range(subtree->input, subtree->start + chunk_start, chunk_len, scratch[0]),
+                  chunk_len, counter + chunk, 0, cvs[chunk]);
+         }
+      }
+      reduce_cvs(cvs, chunks_number, subtree->cv);
+      return;
+   }
+   uint32_t left[8], right[8];
+   split_subtrees(subtree->input, subtree->start, subtree->len, subtree->threads_number, left, right);
+   parent_cv(left, right, 0, subtree->cv);
+}
+
+int
+chariot_blake3_hash_slices(const Chariot_Blake3_slice* slices, size_t slices_number,
+      unsigned char result[32], int threads_number) {
+   if (slices_number > CHARIOT_BLAKE3_SLICES_MAX)
+      return false;
+   Blake3_input input;
+   input.slices = slices;
+   input.slices_number = slices_number;
+   input.slice_starts[0] = 0;
+   for (size_t index = 0; index < slices_number; ++index)
+      input.slice_starts[index+1] = input.slice_starts[index] + slices[index].len;
+   uint64_t len = input.slice_starts[slices_number];
+   if (threads_number <= 0) {
+      long processors_number = sysconf(_SC_NPROCESSORS_ONLN);
+      threads_number = processors_number > 0 ? (int) processors_number : 1;
+   }
+
+   uint32_t cv[8];
+   if (len <= BLAKE3_CHUNK_LEN) {
+      unsigned char scratch[BLAKE3_CHUNK_LEN];
+      chunk_cv(input_range(&input, 0, (size_t) len, scratch), (size_t) len, 0, Blake3_Root, cv);
+   }
+   else {
+      uint32_t left[8], right[8];
+      split_subtrees(&input, 0, len, threads_number, left, right);
+      parent_cv(left, right, Blake3_Root, cv);
+   }
+   for (int index = 0; index < 8; ++index)
+      store_word(result + 4*index, cv[index]);
+   return true;
+}
+
+void
+chariot_blake3_hash(const void* input, size_t len, unsigned char result[32], int threads_number) {
+   Chariot_Blake3_slice slice = { input, len };
+   chariot_blake3_hash_slices(&slice, 1, result, threads_number);
+}
@@ -0,0 +1,366 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+
+/*
+ * Builds the fleet index of the CHARIOT metadata of many firmwares, see chariot_index.h.
+ * The firmwares are given on the command line or, one per line, in a --list file.
+ * Their name in the index is the path given there. A firmware without CHARIOT metadata
+ * is reported and skipped. Only the few reads that reach the metadata of a firmware
+ * are done, many firmwares at the same time, by chariot_batchread.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <pthread.h>
+
+#include "chariot_index.h"
+#include "chariot_batchread.h"
+
+typedef struct _InputParser {
+  const char** firmware_names;
+  size_t firmwares_number;
+  const char* list_file;
+  const char* output_file;
+  Chariot_Batch_options batch_options;
+  bool requires_help : 1;
+  bool requires_verbose : 1;
+} InputParser;
+
+void
+input_parser_usage()
+{
+  printf("usage: chariot_buildindex_meta_data.exe [-h] [--verbose] [--list FILE] --output INDEX\n"
+         "                                        [--queue-depth DEPTH] [--threads THREADS]\n"
+         "                                        [--no-io-uring] [firmware ...]\n"
+         "\n"
+         "builds the columnar index INDEX of the CHARIOT metadata of the firmwares, given\n"
+         "as arguments or one per line in FILE, to be queried by chariot_queryindex_meta_data.exe.\n"
+         "DEPTH firmwares are read at the same time (default 256) through io_uring, or through\n"
+         "a pool of threads with --no-io-uring or without io_uring, and THREADS workers\n"
+         "parse them (default one per online processor)\n"
+         "\n");
+}
+
+bool
+fill_input_parser_fields(InputParser* parser, int argc, const char** argv)
+{
+  memset(parser, 0, sizeof(InputParser));
+  parser->firmware_names = (const char**) calloc(argc, sizeof(const char*));
+  if (!parser->firmware_names)
+    return false;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+      parser->requires_help = true;
+    else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0)
+      parser->requires_verbose = true;
+    else if (strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "--list") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      parser->list_file = argv[i];
+    }
+    else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      parser->output_file = argv[i];
+    }
+    else if (strcmp(argv[i], "-q") == 0 || strcmp(argv[i], "--queue-depth") == 0
+        || strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--threads") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      char* end = NULL;
+      long value = strtol(argv[i], &end, 10);
+      if (!end || *end || end == argv[i] || value <= 0 || value > 65536)
+        return false;
+      if (argv[i-1][1] == 'q' || argv[i-1][2] == 'q')
+        parser->batch_options.queue_depth = (int) value;
+      else
+        parser->batch_options.workers_number = (int) value;
+    }
+    else if (strcmp(argv[i], "--no-io-uring") == 0)
+      parser->batch_options.requires_threads = true;
+    else if (argv[i][0] == '-')
+      return false;
+    else
+      parser->firmware_names[parser->firmwares_number++] = argv[i];
+  }
+  if (parser->requires_help)
+    return true;
+  return parser->output_file && strlen(parser->output_file) > 0
+    && (parser->firmwares_number > 0 || parser->list_file);
+}
+
+/* a firmware read by a worker, added to the index once the previous ones are */
+typedef struct {
+  Chariot_Index_entry* entry; // NULL for a firmware without metadata
+  const char* error_message;
+  bool is_read;
+} Index_slot;
+
+typedef struct {
+  Chariot_Index_builder builder;
+  const char** firmware_names;
+  Index_slot* slots; // one per firmware, in the order of the list
+  size_t next_index; // first slot not yet added to the index
+  size_t firmwares_number;
+  pthread_mutex_t mutex;
+  size_t skipped_number;
+  bool requires_verbose;
+  bool has_failed; // memory error of the builder
+} Index_state;
+
+/* adds the read slots which follow the last added one: the index does not depend on the
+   order in which the workers complete; a firmware without metadata is reported and skipped */
+void
+add_read_slots(Index_state* state) {
+  for (; state->next_index < state->firmwares_number && state->slots[state->next_index].is_read;
+      ++state->next_index)
+  {
+    Index_slot* slot = &state->slots[state->next_index];
+    const char* firmware_name = state->firmware_names[state->next_index];
+    const char* error_message = slot->error_message;
+    uint32_t images_number = state->builder.images_number;
+    bool is_indexed = slot->entry && !state->has_failed
+      && chariot_index_add_entry(&state->builder, slot->entry, &error_message);
+    if (slot->entry && !state->has_failed && !is_indexed)
+      state->has_failed = true;
+    if (slot->entry)
+    {
+      chariot_index_entry_free(slot->entry);
+      free(slot->entry);
+      slot->entry = NULL;
+    }
+    if (is_indexed)
+    {
+      if (state->requires_verbose)
+        printf("%s: indexed as image %u\n", firmware_name, (unsigned) images_number);
+    }
+    else if (error_message)
+    {
+      fprintf(stderr, "Cannot index the metadata of %s\n", firmware_name);
+      fprintf(stderr, "  %s\n", error_message);
+      ++state->skipped_number;
+    }
+  }
+}
+
+/* the values are copied by the worker, outside of the lock */
+void
+add_metadata(void* context, size_t index, const Chariot_Reader_metadata* metadata,
+    const char* error_message) {
+  Index_state* state = (Index_state*) context;
+  Chariot_Index_entry* entry = NULL;
+  if (metadata)
+  {
+    entry = (Chariot_Index_entry*) malloc(sizeof(Chariot_Index_entry));
+    if (!entry)
+      error_message = "not enough memory";
+    else if (!chariot_index_read_entry(entry, state->firmware_names[index], &metadata->metadata_dict,
+          &error_message))
+    {
+      free(entry);
+      entry = NULL;
+    }
+  }
+  pthread_mutex_lock(&state->mutex);
+  if (!entry && strcmp(error_message, "not enough memory") == 0)
+    state->has_failed = true;
+  state->slots[index].entry = entry;
+  state->slots[index].error_message = entry ? NULL : error_message;
+  state->slots[index].is_read = true;
+  add_read_slots(state);
+  pthread_mutex_unlock(&state->mutex);
+}
+
+/* the firmwares of the command line then those of the --list file */
+bool
+collect_firmware_names(const InputParser* parser, const char*** names, size_t* names_number,
+    char*** list_names, size_t* list_names_number) {
+  size_t capacity = parser->firmwares_number + 1024;
+  *names = (const char**) malloc(capacity*sizeof(const char*));
+  *list_names = (char**) malloc(capacity*sizeof(char*));
+  *names_number = *list_names_number = 0;
+  if (!*names || !*list_names)
+    return false;
+  for (size_t index = 0; index < parser->firmwares_number; ++index)
+    (*names)[(*names_number)++] = parser->firmware_names[index];
+  if (!parser->list_file)
+    return true;
+  FILE* list = fopen(parser->list_file, "r");
+  if (!list)
+  {
+    fprintf(stderr, "Cannot open file %s\n", parser->list_file);
+    return false;
+  }
+  char line[4096];
+  bool result = true;
+  while (result && fgets(line, sizeof(line), list))
+  {
+    size_t len = strlen(line);
+    while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+      line[--len] = '\0';
+    if (len == 0 || line[0] == '#')
+      continue;
+    if (*names_number == capacity)
+    {
+      capacity *= 2;
+      const char** new_names = (const char**) realloc(*names, capacity*sizeof(const char*));
+      char** new_list_names = (char**) realloc(*list_names, capacity*sizeof(char*));
+      if (new_names)
+        *names = new_names;
+      if (new_list_names)
+        *list_names = new_list_names;
+      if (!new_names || !new_list_names)
+      {
+        result = false;
+        break;
+      }
+    }
+    char* name = strdup(line);
+    if (!name)
+      result = false;
+    else
+      (*names)[(*names_number)++] = (*list_names)[(*list_names_number)++] = name;
+  }
+  fclose(list);
+  return result;
+}
+
+int
+main(int argc, const char** argv)
+{
+  InputParser parser;
+  if (!fill_input_parser_fields(&parser, argc, argv))
+  {
+    input_parser_usage();
+    free(parser.firmware_names);
+    return 1;
+  }
+  if (parser.requires_help)
+  {
+    input_parser_usage();
+    free(parser.firmware_names);
+    return 0;
+  }
+
+  Index_state state;
+  memset(&state, 0, sizeof(Index_state));
+  chariot_index_builder_init(&state.builder);
+  pthread_mutex_init(&state.mutex, NULL);
+  state.requires_verbose = parser.requires_verbose;
+  char** list_names = NULL;
+  size_t list_names_number = 0, names_number = 0;
+  const char* error_message = NULL;
+  Chariot_Batch_backend backend;
+  bool result = collect_firmware_names(&parser, &state.firmware_names, &names_number, &list_names,
+      &list_names_number);
+  state.firmwares_number = names_number;
+  if (result)
+  {
+    state.slots = (Index_slot*) calloc(names_number + 1, sizeof(Index_slot));
+    if (!state.slots)
+    {
+      fprintf(stderr, "Cannot read the firmwares\n");
+      fprintf(stderr, "  not enough memory\n");
+      result = false;
+    }
+  }
+  if (result && !chariot_batch_read_metadata(state.firmware_names, names_number, &parser.batch_options,
+        add_metadata, &state, &backend, &error_message))
+  {
+    fprintf(stderr, "Cannot read the firmwares\n");
+    fprintf(stderr, "  %s\n", error_message);
+    result = false;
+  }
+  else if (result && parser.requires_verbose)
+    printf("firmwares read through %s\n", backend == CBB_Io_uring ? "io_uring" : "a thread pool");
+  // the slots left behind a firmware that was never read
+  for (size_t index = state.next_index; state.slots && index < names_number; ++index)
+    if (state.slots[index].entry)
+    {
+      chariot_index_entry_free(state.slots[index].entry);
+      free(state.slots[index].entry);
+    }
+  free(state.slots);
+  for (size_t index = 0; index < list_names_number; ++index)
+    free(list_names[index]);
+  free(list_names);
+  free(state.firmware_names);
+  pthread_mutex_destroy(&state.mutex);
+  if (!result || state.has_failed)
+  {
+    fprintf(stderr, "Cannot build the index %s\n", parser.output_file);
+    chariot_index_builder_free(&state.builder);
+    free(parser.firmware_names);
+    return 1;
+  }
+
+  int exit_code = 0;
+  FILE* output = fopen(parser.output_file, "wb");
+  if (!output)
+  {
+    fprintf(stderr, "Cannot write file %s\n", parser.output_file);
+    exit_code = 1;
+  }
+  else if (!chariot_index_write(output, &state.builder, &error_message))
+  {
+    fprintf(stderr, "Cannot write the index %s\n", parser.output_file);
+    fprintf(stderr, "  %s\n", error_message);
+    fclose(output);
+    exit_code = 1;
+  }
+  else if (fclose(output) != 0)
+  {
+    fprintf(stderr, "Cannot write file %s\n", parser.output_file);
+    exit_code = 1;
+  }
+  else if (parser.requires_verbose || state.skipped_number > 0)
+    printf("%s: %u firmwares indexed, %u skipped\n", parser.output_file,
+        (unsigned) state.builder.images_number, (unsigned) state.skipped_number);
+  chariot_index_builder_free(&state.builder);
+  free(parser.firmware_names);
+  return exit_code;
+}
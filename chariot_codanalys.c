@@ -0,0 +1,321 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chariot_codanalys.h"
+
+static const char codanalys_magic[4] = { 'C', 'H', 'C', 'A' };
+
+static void
+store_u32(unsigned char* target, uint32_t value) {
+   target[0] = (unsigned char) value;
+   target[1] = (unsigned char) (value >> 8);
+   target[2] = (unsigned char) (value >> 16);
+   target[3] = (unsigned char) (value >> 24);
+}
+
+static uint32_t
+load_u32(const unsigned char* source) {
+   return (uint32_t) source[0] | ((uint32_t) source[1] << 8)
+      | ((uint32_t) source[2] << 16) | ((uint32_t) source[3] << 24);
+}
+
+typedef struct {
+   unsigned char* content;
+   size_t size, capacity;
+} Byte_buffer;
+
+static bool
+reserve_bytes(Byte_buffer* buffer, size_t size) {
+   if (buffer->size + size <= buffer->capacity)
+      return true;
+   size_t new_capacity = buffer->capacity ? 2*buffer->capacity : 4096;
+   while (new_capacity < buffer->size + size)
+      new_capacity *= 2;
+   unsigned char* new_content = (unsigned char*) realloc(buffer->content, new_capacity);
+   if (!new_content)
+      return false;
+   buffer->content = new_content;
+   buffer->capacity = new_capacity;
+   return true;
+}
+
+static bool
+append_varint(Byte_buffer* buffer, uint32_t value) {
+   if (!reserve_bytes(buffer, 5))
+      return false;
+   while (value >= 0x80) {
+      buffer->content[buffer->size++] = (unsigned char) (value | 0x80);
+      value >>= 7;
+   }
+   buffer->content[buffer->size++] = (unsigned char) value;
+   return true;
+}
+
+/* decodes a varint in [*cursor, end), false if it is truncated or too long */
+static bool
+read_varint(uint32_t* result, const unsigned char** cursor, const unsigned char* end) {
+   uint32_t value = 0;
+   for (int shift = 0; shift < 35 && *cursor < end; shift += 7) {
+      unsigned char byte = *(*cursor)++;
+      value |= (uint32_t) (byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+         *result = value;
+         return true;
+      }
+   }
+   return false;
+}
+
+typedef struct {
+   const char* name;
+   uint32_t original;
+} Sorted_function;
+
+static int
+compare_sorted_functions(const void* first, const void* second) {
+   return strcmp(((const Sorted_function*) first)->name, ((const Sorted_function*) second)->name);
+}
+
+static int
+compare_indices(const void* first, const void* second) {
+   uint32_t first_index = *(const uint32_t*) first, second_index = *(const uint32_t*) second;
+   return first_index < second_index ? -1 : (first_index > second_index ? 1 : 0);
+}
+
+int chariot_codanalys_write(FILE* file, const Chariot_Codanalys_entry* functions,
+      uint32_t functions_number, const char** error_message) {
+   Sorted_function* sorted = (Sorted_function*) malloc((functions_number+1)*sizeof(Sorted_function));
+   uint32_t* ranks = (uint32_t*) malloc((functions_number+1)*sizeof(uint32_t));
+   unsigned char* index = (unsigned char*) malloc(4*(size_t) functions_number + 1);
+   uint32_t* callees = NULL;
+   uint32_t callees_capacity = 0, calls_number = 0;
+   Byte_buffer strings = { NULL, 0, 0 }, records = { NULL, 0, 0 };
+   bool result = false;
+   *error_message = "not enough memory";
+   if (!sorted || !ranks || !index)
+      goto end;
+
+   for (uint32_t function = 0; function < functions_number; ++function) {
+      sorted[function].name = functions[function].name;
+      sorted[function].original = function;
+   }
+   qsort(sorted, functions_number, sizeof(Sorted_function), compare_sorted_functions);
+   for (uint32_t rank = 0; rank < functions_number; ++rank) {
+      if (rank > 0 && strcmp(sorted[rank-1].name, sorted[rank].name) == 0) {
+         *error_message = "two functions have the same name";
+         goto end;
+      }
+      ranks[sorted[rank].original] = rank;
+   }
+
+   for (uint32_t rank = 0; rank < functions_number; ++rank) {
+      const Chariot_Codanalys_entry* function = &functions[sorted[rank].original];
+      size_t name_len = strlen(function->name) + 1;
+      if (strings.size > UINT32_MAX - name_len || records.size > UINT32_MAX - 64) {
+         *error_message = "too large code analysis data";
+         goto end;
+      }
+      store_u32(index + 4*(size_t) rank, (uint32_t) records.size);
+      if (!append_varint(&records, (uint32_t) strings.size) || !reserve_bytes(&strings, name_len))
+         goto end;
+      memcpy(strings.content + strings.size, function->name, name_len);
+      strings.size += name_len;
+
+      if (function->callees_number > callees_capacity) {
+         uint32_t* new_callees = (uint32_t*) realloc(callees, function->callees_number*sizeof(uint32_t));
+         if (!new_callees)
+            goto end;
+         callees = new_callees;
+         callees_capacity = function->callees_number;
+      }
+      uint32_t callees_number = 0;
+      for (uint32_t callee = 0; callee < function->callees_number; ++callee) {
+         if (function->callees[callee] >= functions_number) {
+            *error_message = "invalid callee index";
+            goto end;
+         }
+         callees[callee] = ranks[function->callees[callee]];
+      }
+      qsort(callees, function->callees_number, sizeof(uint32_t), compare_indices);
+      for (uint32_t callee = 0; callee < function->callees_number; ++callee)
+         if (callees_number == 0 || callees[callee] != callees[callees_number-1])
+            callees[callees_number++] = callees[callee];
+      calls_number += callees_number;
+
+      if (!append_varint(&records, function->frame) || !append_varint(&records, function->depth)
+            || !append_varint(&records, function->flags) || !append_varint(&records, function->code_size)
+            || !append_varint(&records, callees_number))
+         goto end;
+      for (uint32_t callee = 0; callee < callees_number; ++callee)
+         if (!append_varint(&records, callee > 0 ? callees[callee] - callees[callee-1] : callees[0]))
+            goto end;
+   }
+
+   unsigned char header[CHARIOT_CODANALYS_HEADER_SIZE];
+   uint32_t strings_offset = CHARIOT_CODANALYS_HEADER_SIZE + 4*functions_number;
+   memcpy(header, codanalys_magic, 4);
+   header[4] = CHARIOT_CODANALYS_VERSION; header[5] = 0;
+   header[6] = CHARIOT_CODANALYS_HEADER_SIZE; header[7] = 0;
+   store_u32(header + 8, functions_number);
+   store_u32(header + 12, calls_number);
+   store_u32(header + 16, strings_offset);
+   store_u32(header + 20, (uint32_t) strings.size);
+   store_u32(header + 24, strings_offset + (uint32_t) strings.size);
+   store_u32(header + 28, (uint32_t) records.size);
+   if (fwrite(header, 1, CHARIOT_CODANALYS_HEADER_SIZE, file) != CHARIOT_CODANALYS_HEADER_SIZE
+         || fwrite(index, 4, functions_number, file) != functions_number
+         || fwrite(strings.content, 1, strings.size, file) != strings.size
+         || fwrite(records.content, 1, records.size, file) != records.size) {
+      *error_message = "unable to write the code analysis data";
+      goto end;
+   }
+   result = true;
+
+end:
+   free(sorted);
+   free(ranks);
+   free(index);
+   free(callees);
+   free(strings.content);
+   free(records.content);
+   return result;
+}
+
+int chariot_codanalys_open(Chariot_Codanalys_binary* result, const char* buffer, size_t len,
+      const char** error_message) {
+   const unsigned char* start = (const unsigned char*) buffer;
+   if (len < CHARIOT_CODANALYS_HEADER_SIZE || memcmp(start, codanalys_magic, 4) != 0) {
+      *error_message = "invalid code analysis binary data";
+      return false;
+   }
+   uint32_t version = start[4] | (start[5] << 8), header_size = start[6] | (start[7] << 8);
+   if (version != CHARIOT_CODANALYS_VERSION) {
+      *error_message = "unsupported version of code analysis binary data";
+      return false;
+   }
+   result->start = start;
+   result->len = len;
+   result->functions_number = load_u32(start + 8);
+   result->calls_number = load_u32(start + 12);
+   uint32_t strings_offset = load_u32(start + 16);
+   result->strings_size = load_u32(start + 20);
+   uint32_t records_offset = load_u32(start + 24);
+   result->records_size = load_u32(start + 28);
+   if (header_size < CHARIOT_CODANALYS_HEADER_SIZE
+         || header_size + 4*(uint64_t) result->functions_number > len
+         || strings_offset + (uint64_t) result->strings_size > len
+         || records_offset + (uint64_t) result->records_size > len
+         || (result->strings_size > 0 && start[strings_offset + result->strings_size - 1] != '\0')) {
+      *error_message = "code analysis binary data is truncated";
+      return false;
+   }
+   result->index = start + header_size;
+   result->strings = (const char*) start + strings_offset;
+   result->records = start + records_offset;
+   return true;
+}
+
+static inline const unsigned char*
+index_entry(const Chariot_Codanalys_binary* codanalys, uint32_t index) {
+   return codanalys->index + 4*(size_t) index;
+}
+
+int chariot_codanalys_function(Chariot_Codanalys_function* result,
+      const Chariot_Codanalys_binary* codanalys, uint32_t index, const char** error_message) {
+   if (index >= codanalys->functions_number) {
+      *error_message = "invalid function index";
+      return false;
+   }
+   uint32_t offset = load_u32(index_entry(codanalys, index));
+   const unsigned char* end = codanalys->records + codanalys->records_size;
+   const unsigned char* cursor = codanalys->records + offset;
+   uint32_t name_offset;
+   if (offset >= codanalys->records_size
+         || !read_varint(&name_offset, &cursor, end) || name_offset >= codanalys->strings_size
+         || !read_varint(&result->frame, &cursor, end) || !read_varint(&result->depth, &cursor, end)
+         || !read_varint(&result->flags, &cursor, end) || !read_varint(&result->code_size, &cursor, end)
+         || !read_varint(&result->callees_number, &cursor, end)) {
+      *error_message = "corrupted code analysis record";
+      return false;
+   }
+   result->name = codanalys->strings + name_offset;
+   result->callees = cursor;
+   result->callees_end = end;
+   result->callees_left = result->callees_number;
+   result->last_callee = 0;
+   return true;
+}
+
+int chariot_codanalys_find(uint32_t* index, const Chariot_Codanalys_binary* codanalys,
+      const char* name) {
+   uint32_t low = 0, high = codanalys->functions_number;
+   const unsigned char* end = codanalys->records + codanalys->records_size;
+   while (low < high) {
+      uint32_t middle = low + (high - low)/2, offset = load_u32(index_entry(codanalys, middle));
+      const unsigned char* cursor = codanalys->records + offset;
+      uint32_t name_offset;
+      if (offset >= codanalys->records_size || !read_varint(&name_offset, &cursor, end)
+            || name_offset >= codanalys->strings_size)
+         return false;
+      int comparison = strcmp(name, codanalys->strings + name_offset);
+      if (comparison == 0) {
+         *index = middle;
+         return true;
+      }
+      if (comparison < 0)
+         high = middle;
+      else
+         low = middle + 1;
+   }
+   return false;
+}
+
+int chariot_codanalys_next_callee(uint32_t* callee, Chariot_Codanalys_function* function) {
+   uint32_t delta;
+   if (function->callees_left == 0
+         || !read_varint(&delta, &function->callees, function->callees_end))
+      return false;
+   function->last_callee = function->callees_left == function->callees_number
+      ? delta : function->last_callee + delta;
+   --function->callees_left;
+   *callee = function->last_callee;
+   return true;
+}
@@ -0,0 +1,131 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+/*
+ * Compact binary encoding of the code analysis results (call graph, stack usage
+ * and function sizes) stored as chariotmeta_codanalys_binary. The reader works in
+ * place on the firmware buffer or on a mapped file: it needs no allocation, no
+ * pointer fix-up and only decodes the records it is asked for.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Format, every fixed size number is a little endian integer:
+ *   "CHCA" version:16 header_size:16 functions_number:32 calls_number:32
+ *   strings_offset:32 strings_size:32 records_offset:32 records_size:32
+ *   index: functions_number record offsets of 32 bits, the functions sorted by name
+ *   strings: the names ended by '\0'
+ *   records: for each function, unsigned LEB128 varints
+ *      name_offset frame depth flags code_size callees_number
+ *      then the callee indices in increasing order, each one as the difference
+ *      with the previous callee (the first one as is)
+ * Offsets are relative to the start of the encoding, frame and depth are in bytes.
+ */
+#define CHARIOT_CODANALYS_VERSION 1
+#define CHARIOT_CODANALYS_HEADER_SIZE 32
+
+// flags of a function: the depth is a proven bound only without them
+enum {
+   CCA_Recursion = 1, CCA_Indirect = 2, CCA_Unknown = 4, CCA_Unbounded = 8, CCA_No_frame = 16
+};
+
+typedef struct {
+   const char* name;
+   uint32_t frame;
+   uint32_t depth;
+   uint32_t flags;
+   uint32_t code_size;
+   const uint32_t* callees; // indices in the array given to chariot_codanalys_write
+   uint32_t callees_number;
+} Chariot_Codanalys_entry;
+
+/* the entries need not be sorted, their callees may have duplicates */
+int chariot_codanalys_write(FILE* file, const Chariot_Codanalys_entry* functions,
+      uint32_t functions_number, const char** error_message);
+
+typedef struct {
+   const unsigned char* start;
+   size_t len;
+   uint32_t functions_number;
+   uint32_t calls_number;
+   const unsigned char* index; // record offsets of 32 bits
+   const char* strings;
+   uint32_t strings_size;
+   const unsigned char* records;
+   uint32_t records_size;
+} Chariot_Codanalys_binary;
+
+typedef struct {
+   const char* name; // points into the encoding
+   uint32_t frame;
+   uint32_t depth;
+   uint32_t flags;
+   uint32_t code_size;
+   uint32_t callees_number;
+   // iteration state of chariot_codanalys_next_callee
+   const unsigned char* callees;
+   const unsigned char* callees_end;
+   uint32_t callees_left;
+   uint32_t last_callee;
+} Chariot_Codanalys_function;
+
+/* checks the header and the table bounds of the len bytes at buffer */
+int chariot_codanalys_open(Chariot_Codanalys_binary* result, const char* buffer, size_t len,
+      const char** error_message);
+/* decodes the record of the function of rank index in the name order */
+int chariot_codanalys_function(Chariot_Codanalys_function* result,
+      const Chariot_Codanalys_binary* codanalys, uint32_t index, const char** error_message);
+/* binary search of a function by name, returns false if it is absent */
+int chariot_codanalys_find(uint32_t* index, const Chariot_Codanalys_binary* codanalys,
+      const char* name);
+/* next callee index of function, returns false at the end of the callees or on a corrupted record */
+int chariot_codanalys_next_callee(uint32_t* callee, Chariot_Codanalys_function* function);
+
+#ifdef __cplusplus
+}
+#endif
+
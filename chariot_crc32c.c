@@ -0,0 +1,203 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "chariot_crc32c.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CRC32C_HARDWARE
+#include <nmmintrin.h>
+#endif
+
+#define CRC32C_POLY 0x82f63b78
+// the hardware path hashes three interleaved streams to hide the latency of crc32
+#define CRC32C_LONG 8192
+#define CRC32C_SHORT 256
+
+static uint32_t crc32c_table[8][256];
+static uint32_t crc32c_long[4][256];
+static uint32_t crc32c_short[4][256];
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+/* product of a and b modulo the (reflected) polynomial, a != 0 */
+static uint32_t
+gf2_multiply(uint32_t a, uint32_t b) {
+   uint32_t mask = (uint32_t) 1 << 31, result = 0;
+   while (true) {
+      if (a & mask) {
+         result ^= b;
+         if ((a & (mask - 1)) == 0)
+            break;
+      }
+      mask >>= 1;
+      b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+   }
+   return result;
+}
+
+/* x^(8*len) modulo the polynomial: the operator that appends len zero bytes */
+static uint32_t
+zeros_operator(size_t len) {
+   uint32_t result = (uint32_t) 1 << 31, power = (uint32_t) 1 << 30; // x^0 and x^1
+   for (uint64_t exponent = (uint64_t) len * 8; exponent; exponent >>= 1) {
+      if (exponent & 1)
+         result = gf2_multiply(power, result);
+      power = gf2_multiply(power, power);
+   }
+   return result;
+}
+
+static void
+fill_zeros_table(uint32_t table[4][256], size_t len) {
+   uint32_t op = zeros_operator(len);
+   for (uint32_t value = 0; value < 256; ++value)
+      for (int byte_index = 0; byte_index < 4; ++byte_index)
+         table[byte_index][value] = gf2_multiply(op, value << (8*byte_index));
+}
+
+static void
+init_tables(void) {
+   for (uint32_t value = 0; value < 256; ++value) {
+      uint32_t crc = value;
+      for (int bit = 0; bit < 8; ++bit)
+         crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+      crc32c_table[0][value] = crc;
+   }
+   for (uint32_t value = 0; value < 256; ++value) {
+      uint32_t crc = crc32c_table[0][value];
+      for (int slice = 1; slice < 8; ++slice) {
+         crc = crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+         crc32c_table[slice][value] = crc;
+      }
+   }
+   fill_zeros_table(crc32c_long, CRC32C_LONG);
+   fill_zeros_table(crc32c_short, CRC32C_SHORT);
+}
+
+static inline uint32_t
+apply_zeros(uint32_t table[4][256], uint32_t crc) {
+   return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff]
+      ^ table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+}
+
+static inline uint64_t
+load_word64(const unsigned char* source) {
+   uint64_t result;
+   memcpy(&result, source, sizeof(result));
+   return result;
+}
+
+/* slicing-by-8 on the inverted crc register */
+static uint32_t
+crc32c_software(uint32_t crc, const unsigned char* next, size_t len) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+   while (len >= 8) {
+      uint64_t word = load_word64(next) ^ crc;
+      crc = crc32c_table[7][word & 0xff] ^ crc32c_table[6][(word >> 8) & 0xff]
+         ^ crc32c_table[5][(word >> 16) & 0xff] ^ crc32c_table[4][(word >> 24) & 0xff]
+         ^ crc32c_table[3][(word >> 32) & 0xff] ^ crc32c_table[2][(word >> 40) & 0xff]
+         ^ crc32c_table[1][(word >> 48) & 0xff] ^ crc32c_table[0][word >> 56];
+      next += 8;
+      len -= 8;
+   }
+#endif
+   while (len--)
+      crc = crc32c_table[0][(crc ^ *next++) & 0xff] ^ (crc >> 8);
+   return crc;
+}
+
+#ifdef CRC32C_HARDWARE
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_hardware(uint32_t crc, const unsigned char* next, size_t len) {
+   uint64_t crc0 = crc;
+   while (len > 0 && ((uintptr_t) next & 7) != 0) {
+      crc0 = _mm_crc32_u8((uint32_t) crc0, *next++);
+      --len;
+   }
+   while (len >= 3*CRC32C_LONG) {
+      uint64_t crc1 = 0, crc2 = 0;
+      const unsigned char* end = next + CRC32C_LONG;
+      do {
+         crc0 = _mm_crc32_u64(crc0, load_word64(next));
+         crc1 = _mm_crc32_u64(crc1, load_word64(next + CRC32C_LONG));
+         crc2 = _mm_crc32_u64(crc2, load_word64(next + 2*CRC32C_LONG));
+         next += 8;
+      } while (next < end);
+      crc0 = apply_zeros(crc32c_long, (uint32_t) crc0) ^ crc1;
+      crc0 = apply_zeros(crc32c_long, (uint32_t) crc0) ^ crc2;
+      next += 2*CRC32C_LONG;
+      len -= 3*CRC32C_LONG;
+   }
+   while (len >= 3*CRC32C_SHORT) {
+      uint64_t crc1 = 0, crc2 = 0;
+      const unsigned char* end = next + CRC32C_SHORT;
+      do {
+         crc0 = _mm_crc32_u64(crc0, load_word64(next));
+         crc1 = _mm_crc32_u64(crc1, load_word64(next + CRC32C_SHORT));
+         crc2 = _mm_crc32_u64(crc2, load_word64(next + 2*CRC32C_SHORT));
+         next += 8;
+      } while (next < end);
+      crc0 = apply_zeros(crc32c_short, (uint32_t) crc0) ^ crc1;
+      crc0 = apply_zeros(crc32c_short, (uint32_t) crc0) ^ crc2;
+      next += 2*CRC32C_SHORT;
+      len -= 3*CRC32C_SHORT;
+   }
+   while (len >= 8) {
+      crc0 = _mm_crc32_u64(crc0, load_word64(next));
+      next += 8;
+      len -= 8;
+   }
+   while (len--)
+      crc0 = _mm_crc32_u8((uint32_t) crc0, *next++);
+   return (uint32_t) crc0;
+}
+#endif
+
+uint32_t
+chariot_crc32c(uint32_t crc, const void* buffer, size_t len) {
+   pthread_once(&crc32c_once, init_tables);
+   crc = ~crc;
+#ifdef CRC32C_HARDWARE
+   if (__builtin_cpu_supports("sse4.2"))
+      return ~crc32c_hardware(crc, (const unsigned char*) buffer, len);
+#endif
+   return ~crc32c_software(crc, (const unsigned char*) buffer, len);
+}
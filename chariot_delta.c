@@ -0,0 +1,458 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chariot_delta.h"
+#include "chariot_sha256.h"
+#include "chariot_crc32c.h"
+
+// an equal run shorter than this is cheaper as data than as a copy operation
+#define DELTA_MIN_COPY 16
+#define DELTA_BUFFER_SIZE 16384
+#define DELTA_HEADER_SIZE (8 + 4*4 + 3*32 + 4)
+
+static const char delta_magic[8] = { 'C', 'H', 'A', 'R', 'I', 'O', 'T', 'D' };
+
+static void
+store_u32(unsigned char* target, uint32_t value) {
+   target[0] = (unsigned char) value;
+   target[1] = (unsigned char) (value >> 8);
+   target[2] = (unsigned char) (value >> 16);
+   target[3] = (unsigned char) (value >> 24);
+}
+
+static uint32_t
+load_u32(const unsigned char* source) {
+   return (uint32_t) source[0] | ((uint32_t) source[1] << 8)
+      | ((uint32_t) source[2] << 16) | ((uint32_t) source[3] << 24);
+}
+
+/* digests follow the convention of retrieve_mainboot_sha256: digest[7] is the first word */
+static void
+store_digest(unsigned char* target, const uint32_t digest[8]) {
+   for (int index = 0; index < 8; ++index) {
+      uint32_t word = digest[7-index];
+      target[4*index] = (unsigned char) (word >> 24);
+      target[4*index+1] = (unsigned char) (word >> 16);
+      target[4*index+2] = (unsigned char) (word >> 8);
+      target[4*index+3] = (unsigned char) word;
+   }
+}
+
+static void
+load_digest(uint32_t digest[8], const unsigned char* source) {
+   for (int index = 0; index < 8; ++index)
+      digest[7-index] = ((uint32_t) source[4*index] << 24) | ((uint32_t) source[4*index+1] << 16)
+         | ((uint32_t) source[4*index+2] << 8) | (uint32_t) source[4*index+3];
+}
+
+static void
+compute_sha256(uint32_t result[8], const char* buffer, size_t len) {
+   Chariot_Sha256_context context;
+   chariot_sha256_init(&context);
+   chariot_sha256_update(&context, buffer, len);
+   chariot_sha256_final(&context, result);
+}
+
+/* operations are merged with the previous one when they are contiguous */
+typedef struct {
+   FILE* patch;
+   const char* target;
+   char pending_kind; // '\0', 'C' or 'D'
+   size_t pending_offset; // in the source for 'C', in the target for 'D'
+   size_t pending_len;
+   bool has_failed;
+} Delta_writer;
+
+static void
+flush_operation(Delta_writer* writer) {
+   unsigned char operation[9];
+   if (writer->pending_kind == 'C') {
+      operation[0] = 'C';
+      store_u32(operation+1, (uint32_t) writer->pending_offset);
+      store_u32(operation+5, (uint32_t) writer->pending_len);
+      if (fwrite(operation, 1, 9, writer->patch) != 9)
+         writer->has_failed = true;
+   }
+   else if (writer->pending_kind == 'D') {
+      operation[0] = 'D';
+      store_u32(operation+1, (uint32_t) writer->pending_len);
+      if (fwrite(operation, 1, 5, writer->patch) != 5
+            || fwrite(writer->target + writer->pending_offset, 1, writer->pending_len, writer->patch)
+               != writer->pending_len)
+         writer->has_failed = true;
+   }
+   writer->pending_kind = '\0';
+   writer->pending_len = 0;
+}
+
+static void
+emit_operation(Delta_writer* writer, char kind, size_t offset, size_t len) {
+   if (len == 0)
+      return;
+   if (writer->pending_kind == kind && writer->pending_offset + writer->pending_len == offset) {
+      writer->pending_len += len;
+      return;
+   }
+   flush_operation(writer);
+   writer->pending_kind = kind;
+   writer->pending_offset = offset;
+   writer->pending_len = len;
+}
+
+/* open addressing table of the aligned source blocks, indexed by their crc32c */
+typedef struct {
+   uint32_t* slots; // block index + 1, 0 for an empty slot
+   uint32_t* block_crcs;
+   size_t mask;
+   const char* source;
+   size_t block_size;
+} Delta_index;
+
+static bool
+fill_delta_index(Delta_index* index, const char* source, size_t source_len, size_t block_size) {
+   size_t blocks_number = source_len / block_size;
+   size_t capacity = 16;
+   while (capacity < 2*blocks_number)
+      capacity *= 2;
+   index->slots = (uint32_t*) calloc(capacity, sizeof(uint32_t));
+   index->block_crcs = (uint32_t*) malloc((blocks_number ? blocks_number : 1) * sizeof(uint32_t));
+   if (!index->slots || !index->block_crcs) {
+      free(index->slots);
+      free(index->block_crcs);
+      return false;
+   }
+   index->mask = capacity - 1;
+   index->source = source;
+   index->block_size = block_size;
+   for (size_t block_index = 0; block_index < blocks_number; ++block_index) {
+      uint32_t crc = chariot_crc32c(0, source + block_index*block_size, block_size);
+      index->block_crcs[block_index] = crc;
+      size_t slot = crc & index->mask;
+      while (index->slots[slot] != 0)
+         slot = (slot + 1) & index->mask;
+      index->slots[slot] = (uint32_t) (block_index + 1);
+   }
+   return true;
+}
+
+static bool
+find_source_block(const Delta_index* index, const char* block, size_t* source_offset) {
+   uint32_t crc = chariot_crc32c(0, block, index->block_size);
+   for (size_t slot = crc & index->mask; index->slots[slot] != 0; slot = (slot + 1) & index->mask) {
+      size_t block_index = index->slots[slot] - 1;
+      if (index->block_crcs[block_index] == crc
+            && memcmp(index->source + block_index*index->block_size, block, index->block_size) == 0) {
+         *source_offset = block_index*index->block_size;
+         return true;
+      }
+   }
+   return false;
+}
+
+/* the target block [offset, offset+len) against the source bytes at the same offset */
+static void
+emit_block_difference(Delta_writer* writer, const char* source, size_t source_len,
+      const char* target, size_t offset, size_t len) {
+   size_t compared = offset < source_len ? source_len - offset : 0;
+   if (compared > len)
+      compared = len;
+   size_t position = 0;
+   while (position < compared) {
+      size_t run = 0;
+      while (position + run < compared && source[offset+position+run] == target[offset+position+run])
+         ++run;
+      emit_operation(writer, run >= DELTA_MIN_COPY ? 'C' : 'D', offset+position, run);
+      position += run;
+      size_t different_start = position;
+      while (position < compared && source[offset+position] != target[offset+position])
+         ++position;
+      emit_operation(writer, 'D', offset+different_start, position-different_start);
+   }
+   emit_operation(writer, 'D', offset+compared, len-compared);
+}
+
+static int
+compare_offsets(const void* first, const void* second) {
+   size_t first_offset = *(const size_t*) first, second_offset = *(const size_t*) second;
+   return first_offset < second_offset ? -1 : (first_offset > second_offset ? 1 : 0);
+}
+
+int chariot_delta_create(FILE* patch, const char* source, size_t source_len,
+      const char* target, size_t target_len, Elf32_Word block_size,
+      const Chariot_Mainboot_region* regions, size_t regions_number,
+      const uint32_t mainboot_sha256[8], const char** error_message) {
+   if (block_size == 0) {
+      *error_message = "the block size of the delta should be positive";
+      return false;
+   }
+   if (source_len > UINT32_MAX || target_len > UINT32_MAX || regions_number > CHARIOT_MAINBOOT_REGIONS_MAX) {
+      *error_message = "the firmwares are too large for a delta";
+      return false;
+   }
+   unsigned char header[DELTA_HEADER_SIZE];
+   uint32_t digest[8];
+   memcpy(header, delta_magic, 8);
+   store_u32(header+8, CHARIOT_DELTA_VERSION);
+   store_u32(header+12, block_size);
+   store_u32(header+16, (uint32_t) source_len);
+   store_u32(header+20, (uint32_t) target_len);
+   compute_sha256(digest, source, source_len);
+   store_digest(header+24, digest);
+   compute_sha256(digest, target, target_len);
+   store_digest(header+56, digest);
+   store_digest(header+88, mainboot_sha256);
+   store_u32(header+120, (uint32_t) regions_number);
+   if (fwrite(header, 1, DELTA_HEADER_SIZE, patch) != DELTA_HEADER_SIZE) {
+      *error_message = "unable to write the patch header";
+      return false;
+   }
+   for (size_t region_index = 0; region_index < regions_number; ++region_index) {
+      unsigned char region[8];
+      store_u32(region, regions[region_index].offset);
+      store_u32(region+4, regions[region_index].size);
+      if (fwrite(region, 1, 8, patch) != 8) {
+         *error_message = "unable to write the patch header";
+         return false;
+      }
+   }
+
+   // the blocks restart at every boundary of the mainboot regions
+   size_t boundaries[2*CHARIOT_MAINBOOT_REGIONS_MAX+2];
+   size_t boundaries_number = 0;
+   boundaries[boundaries_number++] = 0;
+   boundaries[boundaries_number++] = target_len;
+   for (size_t region_index = 0; region_index < regions_number; ++region_index) {
+      size_t start = regions[region_index].offset, end = start + regions[region_index].size;
+      boundaries[boundaries_number++] = start < target_len ? start : target_len;
+      boundaries[boundaries_number++] = end < target_len ? end : target_len;
+   }
+   qsort(boundaries, boundaries_number, sizeof(size_t), compare_offsets);
+
+   Delta_index index;
+   if (!fill_delta_index(&index, source, source_len, block_size)) {
+      *error_message = "not enough memory for the delta index";
+      return false;
+   }
+   Delta_writer writer = { patch, target, '\0', 0, 0, false };
+   for (size_t boundary_index = 0; boundary_index+1 < boundaries_number; ++boundary_index) {
+      size_t segment_end = boundaries[boundary_index+1];
+      for (size_t offset = boundaries[boundary_index]; offset < segment_end; offset += block_size) {
+         size_t len = segment_end - offset < block_size ? segment_end - offset : block_size;
+         size_t source_offset;
+         if (offset + len <= source_len && memcmp(source + offset, target + offset, len) == 0)
+            emit_operation(&writer, 'C', offset, len);
+         else if (len == block_size && find_source_block(&index, target + offset, &source_offset))
+            emit_operation(&writer, 'C', source_offset, len);
+         else
+            emit_block_difference(&writer, source, source_len, target, offset, len);
+      }
+   }
+   flush_operation(&writer);
+   free(index.slots);
+   free(index.block_crcs);
+   if (writer.has_failed || fputc('E', patch) == EOF) {
+      *error_message = "unable to write the patch operations";
+      return false;
+   }
+   return true;
+}
+
+typedef struct {
+   FILE* target;
+   Chariot_Sha256_context context;
+   size_t written;
+   size_t target_len;
+} Delta_output;
+
+static bool
+write_output(Delta_output* output, const char* buffer, size_t len, const char** error_message) {
+   if (len > output->target_len - output->written) {
+      *error_message = "the patch produces more bytes than the target size";
+      return false;
+   }
+   if (fwrite(buffer, 1, len, output->target) != len) {
+      *error_message = "unable to write the target firmware";
+      return false;
+   }
+   chariot_sha256_update(&output->context, buffer, len);
+   output->written += len;
+   return true;
+}
+
+int chariot_delta_apply(FILE* target, FILE* source, FILE* patch, const char** error_message) {
+   unsigned char header[DELTA_HEADER_SIZE];
+   char buffer[DELTA_BUFFER_SIZE];
+   if (fread(header, 1, DELTA_HEADER_SIZE, patch) != DELTA_HEADER_SIZE
+         || memcmp(header, delta_magic, 8) != 0) {
+      *error_message = "the patch has not the chariot delta format";
+      return false;
+   }
+   if (load_u32(header+8) != CHARIOT_DELTA_VERSION) {
+      *error_message = "unsupported version of chariot delta";
+      return false;
+   }
+   size_t source_len = load_u32(header+16);
+   uint32_t source_sha256[8], target_sha256[8], mainboot_sha256[8], sha256[8];
+   load_digest(source_sha256, header+24);
+   load_digest(target_sha256, header+56);
+   load_digest(mainboot_sha256, header+88);
+   size_t regions_number = load_u32(header+120);
+   if (regions_number > CHARIOT_MAINBOOT_REGIONS_MAX) {
+      *error_message = "too many mainboot regions in the patch";
+      return false;
+   }
+   Chariot_Mainboot_region regions[CHARIOT_MAINBOOT_REGIONS_MAX];
+   for (size_t region_index = 0; region_index < regions_number; ++region_index) {
+      unsigned char region[8];
+      if (fread(region, 1, 8, patch) != 8) {
+         *error_message = "the patch is truncated";
+         return false;
+      }
+      regions[region_index].offset = load_u32(region);
+      regions[region_index].size = load_u32(region+4);
+   }
+
+   // the patch only applies on the source it has been created from
+   Chariot_Sha256_context context;
+   size_t read_len = 0, len;
+   chariot_sha256_init(&context);
+   if (fseek(source, 0, SEEK_SET) != 0) {
+      *error_message = "unable to read the source firmware";
+      return false;
+   }
+   while ((len = fread(buffer, 1, DELTA_BUFFER_SIZE, source)) > 0) {
+      chariot_sha256_update(&context, buffer, len);
+      read_len += len;
+   }
+   chariot_sha256_final(&context, sha256);
+   if (read_len != source_len || memcmp(sha256, source_sha256, sizeof(sha256)) != 0) {
+      *error_message = "the source firmware does not match the patch";
+      return false;
+   }
+
+   Delta_output output;
+   output.target = target;
+   output.written = 0;
+   output.target_len = load_u32(header+20);
+   chariot_sha256_init(&output.context);
+   int operation;
+   while ((operation = fgetc(patch)) != 'E') {
+      unsigned char arguments[8];
+      if (operation == 'C') {
+         if (fread(arguments, 1, 8, patch) != 8) {
+            *error_message = "the patch is truncated";
+            return false;
+         }
+         size_t offset = load_u32(arguments), size = load_u32(arguments+4);
+         if (offset > source_len || size > source_len - offset || fseek(source, (long) offset, SEEK_SET) != 0) {
+            *error_message = "the patch copies bytes out of the source firmware";
+            return false;
+         }
+         while (size > 0) {
+            len = size < DELTA_BUFFER_SIZE ? size : DELTA_BUFFER_SIZE;
+            if (fread(buffer, 1, len, source) != len) {
+               *error_message = "unable to read the source firmware";
+               return false;
+            }
+            if (!write_output(&output, buffer, len, error_message))
+               return false;
+            size -= len;
+         }
+      }
+      else if (operation == 'D') {
+         if (fread(arguments, 1, 4, patch) != 4) {
+            *error_message = "the patch is truncated";
+            return false;
+         }
+         size_t size = load_u32(arguments);
+         while (size > 0) {
+            len = size < DELTA_BUFFER_SIZE ? size : DELTA_BUFFER_SIZE;
+            if (fread(buffer, 1, len, patch) != len) {
+               *error_message = "the patch is truncated";
+               return false;
+            }
+            if (!write_output(&output, buffer, len, error_message))
+               return false;
+            size -= len;
+         }
+      }
+      else {
+         *error_message = operation == EOF ? "the patch is truncated" : "unknown operation in the patch";
+         return false;
+      }
+   }
+   chariot_sha256_final(&output.context, sha256);
+   if (output.written != output.target_len || memcmp(sha256, target_sha256, sizeof(sha256)) != 0) {
+      *error_message = "the patched firmware does not match the target sha256";
+      return false;
+   }
+
+   // reads back the mainboot regions of the result with the same bounded buffer
+   if (fflush(target) != 0) {
+      *error_message = "unable to write the target firmware";
+      return false;
+   }
+   chariot_sha256_init(&context);
+   for (size_t region_index = 0; region_index < regions_number; ++region_index) {
+      size_t offset = regions[region_index].offset, size = regions[region_index].size;
+      if (offset > output.target_len || size > output.target_len - offset
+            || fseek(target, (long) offset, SEEK_SET) != 0) {
+         *error_message = "a mainboot region is out of the patched firmware";
+         return false;
+      }
+      while (size > 0) {
+         len = size < DELTA_BUFFER_SIZE ? size : DELTA_BUFFER_SIZE;
+         if (fread(buffer, 1, len, target) != len) {
+            *error_message = "unable to read the patched firmware";
+            return false;
+         }
+         chariot_sha256_update(&context, buffer, len);
+         size -= len;
+      }
+   }
+   chariot_sha256_final(&context, sha256);
+   if (memcmp(sha256, mainboot_sha256, sizeof(sha256)) != 0) {
+      *error_message = "the patched firmware does not match its mainboot_sha256";
+      return false;
+   }
+   return true;
+}
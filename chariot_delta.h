@@ -0,0 +1,87 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+/*
+ * Block-level delta between two CHARIOT firmwares. The patch rebuilds the target
+ * from the source with copies of source ranges and literal data. Its application
+ * streams the patch and the target with a bounded memory and checks the result
+ * against the target sha256 and against its chariotmeta_mainboot_sha256.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include "chariot_extractelf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Patch format, every number is a 32 bits little endian integer:
+ *   "CHARIOTD" version block_size source_size target_size
+ *   source_sha256[32] target_sha256[32] mainboot_sha256[32]
+ *   regions_number (offset size)*
+ *   then the operations: 'C' source_offset size | 'D' size data[size] | 'E'
+ */
+#define CHARIOT_DELTA_VERSION 1
+#define CHARIOT_DELTA_BLOCK_SIZE 4096
+
+/*
+ * Writes in patch the operations to rebuild target from source.
+ * The target is cut into blocks of block_size bytes starting at each boundary
+ * of the mainboot regions, so that a block never straddles a region boundary.
+ * A block is copied from the same offset or from any aligned block of the source
+ * with the same content, otherwise only its modified bytes are stored.
+ */
+int chariot_delta_create(FILE* patch, const char* source, size_t source_len,
+      const char* target, size_t target_len, Elf32_Word block_size,
+      const Chariot_Mainboot_region* regions, size_t regions_number,
+      const uint32_t mainboot_sha256[8], const char** error_message);
+
+/*
+ * Rebuilds into target the firmware described by patch from source.
+ * source should be seekable and target should be opened for update ("w+b")
+ * since its mainboot regions are read again to check chariotmeta_mainboot_sha256.
+ */
+int chariot_delta_apply(FILE* target, FILE* source, FILE* patch, const char** error_message);
+
+#ifdef __cplusplus
+}
+#endif
+
@@ -0,0 +1,306 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "chariot_delta.h"
+
+typedef struct _InputParser {
+  const char* source_name;
+  const char* second_name; // target for --diff, patch for --apply
+  bool requires_help : 1;
+  bool requires_verbose : 1;
+  bool requires_diff : 1;
+  bool requires_apply : 1;
+  Elf32_Word block_size;
+  const char* output_file;
+} InputParser;
+
+void
+input_parser_usage()
+{
+  printf("usage: chariot_delta_meta_data.exe [-h] [--verbose] [--block-size SIZE]\n"
+         "                                   (--diff SOURCE TARGET | --apply SOURCE PATCH)\n"
+         "                                   --output OUTPUT\n"
+         "\n");
+}
+
+bool
+fill_input_parser_fields(InputParser* parser, int argc, const char** argv)
+{
+  memset(parser, 0, sizeof(InputParser));
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+      parser->requires_help = true;
+    else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0)
+      parser->requires_verbose = true;
+    else if (strcmp(argv[i], "-diff") == 0 || strcmp(argv[i], "--diff") == 0
+        || strcmp(argv[i], "-apply") == 0 || strcmp(argv[i], "--apply") == 0)
+    {
+      if (i+2 >= argc)
+        return false;
+      if (argv[i][strlen(argv[i])-1] == 'f')
+        parser->requires_diff = true;
+      else
+        parser->requires_apply = true;
+      parser->source_name = argv[++i];
+      parser->second_name = argv[++i];
+    }
+    else if (strcmp(argv[i], "-bs") == 0 || strcmp(argv[i], "--block-size") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      int block_size = atoi(argv[i]);
+      if (block_size <= 0)
+        return false;
+      parser->block_size = (Elf32_Word) block_size;
+    }
+    else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      parser->output_file = argv[i];
+    }
+    else
+      return false;
+  }
+  if (parser->requires_help)
+    return true;
+  return parser->requires_diff != parser->requires_apply && parser->output_file
+    && strlen(parser->output_file) > 0;
+}
+
+/* read-only mapping of the whole file, without any size limit */
+char*
+load_file(const char* file_name, size_t* buffer_size)
+{
+  int fd = open(file_name, O_RDONLY);
+  struct stat status;
+  if (fd < 0 || fstat(fd, &status) != 0 || status.st_size <= 0)
+  {
+    fprintf(stderr, "Cannot open file %s\n", file_name);
+    if (fd >= 0)
+      close(fd);
+    return NULL;
+  }
+  *buffer_size = status.st_size;
+  char* buffer = (char*) mmap(NULL, *buffer_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (buffer == MAP_FAILED)
+  {
+    fprintf(stderr, "Cannot map file %s\n", file_name);
+    return NULL;
+  }
+  return buffer;
+}
+
+/* reads the mainboot description of the target and writes the patch */
+int
+create_delta(InputParser* parser, const char* source, size_t source_size,
+    const char* target, size_t target_size, FILE* patch)
+{
+  const char* error_message = NULL;
+  Elf32_Ehdr elf_header, metadata_elf_header;
+  Elf32_Shdr metadata_section;
+  Chariot_Metadata_localizations metadata_dict;
+  if (!fill_exe_header(&elf_header, target, target_size, &error_message)
+      || !retrieve_section_header(&metadata_section, &elf_header, target, target_size,
+          CS_Meta, &error_message)
+      || !fill_exe_header(&metadata_elf_header, target + metadata_section.sh_offset,
+          metadata_section.sh_size, &error_message))
+  {
+    fprintf(stderr, "Cannot find CHARIOT metadata inside %s\n", parser->second_name);
+    fprintf(stderr, "  %s\n", error_message);
+    return 1;
+  }
+  metadata_dict.valid_entries = 0;
+  metadata_dict.metadata_header = &metadata_elf_header;
+  metadata_dict.metadata_section = &metadata_section;
+  metadata_dict.metadata_buffer_exe = target + metadata_section.sh_offset;
+  metadata_dict.metadata_buffer_len = metadata_section.sh_size;
+  if (parser->requires_verbose)
+    printf("call fill_metadata_dict -> CHARIOT symbols\n");
+  if (!fill_metadata_dict(&metadata_dict, &error_message))
+  {
+    fprintf(stderr, "Cannot find CHARIOT symbols inside %s\n", parser->second_name);
+    fprintf(stderr, "  %s\n", error_message);
+    return 1;
+  }
+
+  uint32_t mainboot_sha256[8];
+  Chariot_Mainboot_region regions[CHARIOT_MAINBOOT_REGIONS_MAX];
+  size_t regions_number = 0;
+  if (!retrieve_mainboot_sha256(mainboot_sha256, &metadata_dict, &error_message)
+      || !retrieve_mainboot_regions(regions, &regions_number, CHARIOT_MAINBOOT_REGIONS_MAX,
+          &elf_header, target, target_size, &metadata_dict, &error_message))
+  {
+    fprintf(stderr, "Cannot find the mainboot of %s\n", parser->second_name);
+    fprintf(stderr, "  %s\n", error_message);
+    return 1;
+  }
+
+  // the blocks follow the chunks of the target when it has a chunk table
+  Elf32_Word block_size = parser->block_size;
+  Chariot_Mainboot_chunks chunks;
+  if (block_size == 0)
+    block_size = ((metadata_dict.valid_entries & (1U << CMS_Mainboot_chunks))
+        && retrieve_mainboot_chunks(&chunks, &metadata_dict, &error_message))
+      ? chunks.chunk_size : CHARIOT_DELTA_BLOCK_SIZE;
+  if (parser->requires_verbose)
+    printf("call chariot_delta_create -> patch with blocks of %u bytes\n", (unsigned) block_size);
+  if (!chariot_delta_create(patch, source, source_size, target, target_size, block_size,
+        regions, regions_number, mainboot_sha256, &error_message))
+  {
+    fprintf(stderr, "Cannot create the patch from %s to %s\n", parser->source_name, parser->second_name);
+    fprintf(stderr, "  %s\n", error_message);
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, const char** argv) {
+  InputParser parser;
+  if (!fill_input_parser_fields(&parser, argc, argv))
+  {
+    input_parser_usage();
+    return 1;
+  }
+
+  if (parser.requires_help)
+  {
+    input_parser_usage();
+    printf("\n"
+           "Create or apply a block-level patch between two CHARIOT elf firmwares\n"
+           "\n"
+           "optional arguments:\n"
+           "  -h, --help            show this help message and exit\n"
+           "  --verbose, -v         verbose mode: echo every command on terminal\n"
+           "  --diff SOURCE TARGET, -diff SOURCE TARGET\n"
+           "                        write into OUTPUT the patch from SOURCE to TARGET\n"
+           "  --apply SOURCE PATCH, -apply SOURCE PATCH\n"
+           "                        write into OUTPUT the firmware rebuilt from SOURCE\n"
+           "                        and PATCH, then check its sha256 and its mainboot\n"
+           "  --block-size SIZE, -bs SIZE\n"
+           "                        size of the compared blocks (default: chunk size\n"
+           "                        of the target or 4096)\n"
+           "  --output OUTPUT, -o OUTPUT\n"
+           "                        the patch or the rebuilt firmware\n"
+           "\n");
+    return 0;
+  }
+
+  if (parser.requires_diff)
+  {
+    size_t source_size = 0, target_size = 0;
+    char* source = load_file(parser.source_name, &source_size);
+    if (!source)
+      return 1;
+    char* target = load_file(parser.second_name, &target_size);
+    if (!target)
+    {
+      munmap(source, source_size);
+      return 1;
+    }
+    FILE* patch = fopen(parser.output_file, "wb");
+    if (!patch)
+    {
+      fprintf(stderr, "Cannot create file %s\n", parser.output_file);
+      munmap(target, target_size);
+      munmap(source, source_size);
+      return 1;
+    }
+    int return_code = create_delta(&parser, source, source_size, target, target_size, patch);
+    if (fclose(patch) != 0 && return_code == 0)
+    {
+      fprintf(stderr, "Cannot write file %s\n", parser.output_file);
+      return_code = 1;
+    }
+    if (return_code == 0 && parser.requires_verbose)
+      printf("patch %s created\n", parser.output_file);
+    munmap(target, target_size);
+    munmap(source, source_size);
+    return return_code;
+  }
+
+  FILE* source = fopen(parser.source_name, "rb");
+  if (!source)
+  {
+    fprintf(stderr, "Cannot open file %s\n", parser.source_name);
+    return 1;
+  }
+  FILE* patch = fopen(parser.second_name, "rb");
+  if (!patch)
+  {
+    fprintf(stderr, "Cannot open file %s\n", parser.second_name);
+    fclose(source);
+    return 1;
+  }
+  FILE* target = fopen(parser.output_file, "w+b");
+  if (!target)
+  {
+    fprintf(stderr, "Cannot create file %s\n", parser.output_file);
+    fclose(patch);
+    fclose(source);
+    return 1;
+  }
+  const char* error_message = NULL;
+  if (parser.requires_verbose)
+    printf("call chariot_delta_apply -> %s\n", parser.output_file);
+  bool is_applied = chariot_delta_apply(target, source, patch, &error_message);
+  fclose(target);
+  fclose(patch);
+  fclose(source);
+  if (!is_applied)
+  {
+    fprintf(stderr, "Cannot apply the patch %s on %s\n", parser.second_name, parser.source_name);
+    fprintf(stderr, "  %s\n", error_message);
+    remove(parser.output_file);
+    return 1;
+  }
+  printf("mainboot sha256 checked\n");
+  return 0;
+}
@@ -0,0 +1,182 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+
+/*
+ * Prints the digest of a file in the format of sha256sum and b3sum: the hexadecimal
+ * digest, two spaces and the name of the file. chariot_addelf_meta_data.py calls it
+ * for the digests of the mainboot, so the native hashers of libchariot_extractelf.a
+ * are used instead of the external tools and of a loop in python: sha256 by default,
+ * the multi-threaded blake3 with --blake3 and the crc32c (8 hexadecimal digits, with
+ * the SSE4.2 instruction when available) with --crc32c. The file is mapped, without
+ * any size limit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "chariot_sha256.h"
+#include "chariot_blake3.h"
+#include "chariot_crc32c.h"
+
+typedef struct _InputParser {
+  const char* file_name;
+  int threads_number;
+  bool requires_help : 1;
+  bool requires_blake3 : 1;
+  bool requires_crc32c : 1;
+} InputParser;
+
+void
+input_parser_usage()
+{
+  printf("usage: chariot_digest_meta_data.exe [-h] [--blake3 | --crc32c] [--threads THREADS] FILE\n"
+         "\n"
+         "prints the sha256 (or with --blake3 the blake3, with --crc32c the crc32c) digest\n"
+         "of FILE as sha256sum does.\n"
+         "THREADS threads hash the blake3 chunks (default one per online processor)\n"
+         "\n");
+}
+
+bool
+fill_input_parser_fields(InputParser* parser, int argc, const char** argv)
+{
+  memset(parser, 0, sizeof(InputParser));
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+      parser->requires_help = true;
+    else if (strcmp(argv[i], "-b3") == 0 || strcmp(argv[i], "--blake3") == 0)
+      parser->requires_blake3 = true;
+    else if (strcmp(argv[i], "-crc") == 0 || strcmp(argv[i], "--crc32c") == 0)
+      parser->requires_crc32c = true;
+    else if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--threads") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      char* end = NULL;
+      long value = strtol(argv[i], &end, 10);
+      if (!end || *end || end == argv[i] || value <= 0 || value > 1024)
+        return false;
+      parser->threads_number = (int) value;
+    }
+    else if (argv[i][0] == '-' || parser->file_name)
+      return false;
+    else
+      parser->file_name = argv[i];
+  }
+  return parser->requires_help
+    || (parser->file_name && !(parser->requires_blake3 && parser->requires_crc32c));
+}
+
+int
+main(int argc, const char** argv)
+{
+  InputParser parser;
+  if (!fill_input_parser_fields(&parser, argc, argv))
+  {
+    input_parser_usage();
+    return 1;
+  }
+  if (parser.requires_help)
+  {
+    input_parser_usage();
+    return 0;
+  }
+
+  // an empty file has no mapping
+  int fd = open(parser.file_name, O_RDONLY);
+  struct stat status;
+  if (fd < 0 || fstat(fd, &status) != 0)
+  {
+    fprintf(stderr, "Cannot open file %s\n", parser.file_name);
+    if (fd >= 0)
+      close(fd);
+    return 1;
+  }
+  size_t buffer_len = status.st_size;
+  const unsigned char* buffer = (const unsigned char*) "";
+  if (buffer_len > 0)
+  {
+    buffer = (const unsigned char*) mmap(NULL, buffer_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (buffer == MAP_FAILED)
+    {
+      fprintf(stderr, "Cannot map file %s\n", parser.file_name);
+      close(fd);
+      return 1;
+    }
+  }
+  close(fd);
+
+  unsigned char digest[32];
+  int digest_len = 32;
+  if (parser.requires_crc32c)
+  {
+    uint32_t crc32c = chariot_crc32c(0, buffer, buffer_len);
+    // printed as the number, big-endian
+    for (int index = 0; index < 4; ++index)
+      digest[index] = (unsigned char) (crc32c >> (8*(3-index)));
+    digest_len = 4;
+  }
+  else if (parser.requires_blake3)
+    chariot_blake3_hash(buffer, buffer_len, digest, parser.threads_number);
+  else
+  {
+    Chariot_Sha256_context context;
+    uint32_t sha256_digest[8];
+    chariot_sha256_init(&context);
+    chariot_sha256_update(&context, buffer, buffer_len);
+    chariot_sha256_final(&context, sha256_digest);
+    // sha256_digest[7] is the first word
+    for (int index = 0; index < 32; ++index)
+      digest[index] = (unsigned char) (sha256_digest[7-index/4] >> (8*(3-index%4)));
+  }
+  if (buffer_len > 0)
+    munmap((void*) buffer, buffer_len);
+  for (int index = 0; index < digest_len; ++index)
+    printf("%02x", digest[index]);
+  printf("  %s\n", parser.file_name);
+  return 0;
+}
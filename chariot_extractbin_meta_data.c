@@ -56,6 +56,7 @@ typedef struct _InputParser {
   bool requires_software_id : 1;
   bool requires_additional : 1;
   bool requires_cut : 1;
+  bool requires_quick_check : 1;
   const char* output_file;
   const char* output_exe_file;
   const char* static_analysis_file;
@@ -89,7 +90,7 @@ input_parser_usage()
          "                                       [--format] [--version]\n"
          "                                       [--blockchain_path] [--license]\n"
          "                                       [--software_ID] [--static-analysis FILE]\n"
-         "                                       [--add] [--output OUTPUT]\n"
+         "                                       [--add] [--quick-check] [--output OUTPUT]\n"
          "                                       [--cut OUTPUT_BIN]\n"
          "                                       exe_name\n"
          "\n");
@@ -129,6 +130,8 @@ fill_input_parser_fields(InputParser* parser, int argc, const char** argv)
       }
       else if (strcmp(argv[i], "-add") == 0 || strcmp(argv[i], "--add") == 0)
         parser->requires_additional = true;
+      else if (strcmp(argv[i], "-qc") == 0 || strcmp(argv[i], "--quick-check") == 0)
+        parser->requires_quick_check = true;
       else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0)
       {
         if (++i >= argc)
@@ -520,6 +523,69 @@ extract_static_analysis_from_field(FILE* hexm_file, FILE* out_file,
   return 0;
 }
 
+/* reads the fields of the meta-data section from the current position of hexm_file */
+int
+extract_fields(FILE* hexm_file, FILE* out_file, InputParser* parser) {
+  int return_code;
+  char buffer[100];
+  if ((return_code = extract_header(hexm_file, out_file, buffer, parser)) != 0)
+    return return_code;
+  /* hexm_file has advanced */
+  if ((return_code = extract_sha(hexm_file, out_file, buffer, parser)) != 0)
+    return return_code;
+  if ((return_code = extract_format(hexm_file, out_file, buffer, parser)) != 0)
+    return return_code;
+
+  int len_field=0;
+  if ((return_code = extract_field_head(hexm_file, out_file, buffer,
+          &len_field, parser)) != 0)
+    return return_code;
+  if ((return_code = extract_additional_from_field(hexm_file, out_file, buffer,
+          &len_field, parser)) != 0)
+    return return_code;
+  if ((return_code = extract_version_from_field(hexm_file, out_file, buffer,
+          &len_field, parser)) != 0)
+    return return_code;
+  if ((return_code = extract_field_head(hexm_file, out_file, buffer,
+          &len_field, parser)) != 0)
+    return return_code;
+  if ((return_code = extract_blockchain_path_from_field(hexm_file, out_file, buffer,
+          &len_field, parser)) != 0)
+    return return_code;
+  if ((return_code = extract_license_from_field(hexm_file, out_file, buffer,
+          &len_field, parser)) != 0)
+    return return_code;
+  if ((return_code = extract_software_id_from_field(hexm_file, out_file, buffer,
+          &len_field, parser)) != 0)
+    return return_code;
+  if ((return_code = extract_static_analysis_from_field(hexm_file, out_file, buffer,
+          &len_field, parser)) != 0)
+    return return_code;
+
+  return 0;
+}
+
+/*
+ * the quick check reads every field without any output, so that a truncated file is
+ * rejected before printing anything. The bin format has no checksum of the firmware:
+ * only --sha and a comparison with the expected digest detect a modified content.
+ */
+int
+quick_check_fields(FILE* hexm_file, FILE* out_file, InputParser* parser) {
+  long position = ftell(hexm_file);
+  InputParser check_parser;
+  memset(&check_parser, 0, sizeof(InputParser));
+  check_parser.exe_name = parser->exe_name;
+  if (parser->requires_verbose)
+    printf("check the meta-data section of %s\n", parser->exe_name);
+  int return_code;
+  if ((return_code = extract_fields(hexm_file, out_file, &check_parser)) != 0)
+    return return_code;
+  fseek(hexm_file, position, SEEK_SET);
+  fprintf(out_file, "meta-data section checked\n");
+  return 0;
+}
+
 int main(int argc, const char** argv) {
   InputParser parser;
   if (!fill_input_parser_fields(&parser, argc, argv))
@@ -550,6 +616,8 @@ int main(int argc, const char** argv) {
            "  --static-analysis, -sa FILE\n"
            "                        print the result of the static analysis in file\n"
            "  --add, -add           print content of the additional section\n"
+           "  --quick-check, -qc    reject a truncated file before any output (the bin\n"
+           "                        format has no checksum of the firmware)\n"
            "  --output OUTPUT, -o OUTPUT\n"
            "                        print into the output file instead of stdout\n"
            "\n");
@@ -598,41 +666,12 @@ int main(int argc, const char** argv) {
     return 0;
   }
 
+  if (parser.requires_quick_check
+      && (return_code = quick_check_fields(hexm_file, out_file, &parser)) != 0)
+    return return_code;
   if (parser.requires_verbose)
     printf("extract meta-data section\n");
-  char buffer[100]; 
-  if ((return_code = extract_header(hexm_file, out_file, buffer, &parser)) != 0)
-    return return_code;
-  /* hexm_file has advanced */
-  if ((return_code = extract_sha(hexm_file, out_file, buffer, &parser)) != 0)
-    return return_code;
-  if ((return_code = extract_format(hexm_file, out_file, buffer, &parser)) != 0)
-    return return_code;
-
-  int len_field=0;
-  if ((return_code = extract_field_head(hexm_file, out_file, buffer,
-          &len_field, &parser)) != 0)
-    return return_code;
-  if ((return_code = extract_additional_from_field(hexm_file, out_file, buffer,
-          &len_field, &parser)) != 0)
-    return return_code;
-  if ((return_code = extract_version_from_field(hexm_file, out_file, buffer,
-          &len_field, &parser)) != 0)
-    return return_code;
-  if ((return_code = extract_field_head(hexm_file, out_file, buffer,
-          &len_field, &parser)) != 0)
-    return return_code;
-  if ((return_code = extract_blockchain_path_from_field(hexm_file, out_file, buffer,
-          &len_field, &parser)) != 0)
-    return return_code;
-  if ((return_code = extract_license_from_field(hexm_file, out_file, buffer,
-          &len_field, &parser)) != 0)
-    return return_code;
-  if ((return_code = extract_software_id_from_field(hexm_file, out_file, buffer,
-          &len_field, &parser)) != 0)
-    return return_code;
-  if ((return_code = extract_static_analysis_from_field(hexm_file, out_file, buffer,
-          &len_field, &parser)) != 0)
+  if ((return_code = extract_fields(hexm_file, out_file, &parser)) != 0)
     return return_code;
 
   if (out_file) fclose(out_file);
@@ -36,15 +36,28 @@
  */
 
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "chariot_extractelf.h"
+#include "chariot_sha256.h"
+#include "chariot_blake3.h"
+#include "chariot_crc32c.h"
 
 const char* Chariot_Section_names[] = { ".chariotmeta.rodata", ".suppldata" };
 
+#define CHARIOT_METADATA_SCHEMA_ENTRY(ID, NAME, SYMBOL, ENCODING, SIZE, PRESENCE, PREFIX) \
+   { #NAME, SYMBOL, ENCODING, SIZE, PRESENCE, PREFIX },
+const Chariot_Metadata_field_schema Chariot_Metadata_schema[CMS_END] = {
+   CHARIOT_METADATA_FIELDS(CHARIOT_METADATA_SCHEMA_ENTRY)
+};
+
 #define EI_DATA         5       /* Data format. */
 #define ELFDATA2MSB     2       /* 2's complement big-endian. */
 #define SHN_UNDEF       0       /* Undefined, missing, irrelevant. */
 #define SHT_SYMTAB      2       /* symbol table section */
+#define PT_LOAD         1       /* loadable segment */
 
 typedef enum
    {  EELS_Ident=EI_NIDENT, EELS_Type=2, EELS_Machine=2, EELS_Version=4, EELS_Entry=4,
@@ -71,6 +84,14 @@ typedef enum
 static const int Elf32_Sym_Size = ESYLS_Name + ESYLS_Value + ESYLS_SSize + ESYLS_Info
    + ESYLS_Other + ESYLS_Shndx;
 
+typedef enum
+   {  EPLS_Type=4, EPLS_Offset=4, EPLS_VAddr=4, EPLS_PAddr=4, EPLS_FileSize=4, EPLS_MemSize=4,
+      EPLS_Flags=4, EPLS_Align=4
+   } Elf32_Phdr_LocalSizes;
+
+static const int Elf32_Phdr_Size = EPLS_Type + EPLS_Offset + EPLS_VAddr + EPLS_PAddr
+   + EPLS_FileSize + EPLS_MemSize + EPLS_Flags + EPLS_Align;
+
 static inline bool
 is_target_little_endian(const Elf32_Ehdr* result)
 {  return (result->e_ident[EI_DATA] != ELFDATA2MSB); }
@@ -158,6 +179,18 @@ reverse_section_header(Elf32_Shdr* section) {
    reverse_word(&section->sh_entsize);
 }
 
+void
+reverse_program_header(Elf32_Phdr* segment) {
+   reverse_word(&segment->p_type);
+   reverse_off(&segment->p_offset);
+   reverse_addr(&segment->p_vaddr);
+   reverse_addr(&segment->p_paddr);
+   reverse_word(&segment->p_filesz);
+   reverse_word(&segment->p_memsz);
+   reverse_word(&segment->p_flags);
+   reverse_word(&segment->p_align);
+}
+
 void
 reverse_symbol_header(Elf32_Sym* symbol) {
    reverse_word(&symbol->st_name);
@@ -166,6 +199,12 @@ reverse_symbol_header(Elf32_Sym* symbol) {
    reverse_half(&symbol->st_shndx);
 }
 
+void fill_section_header(Elf32_Shdr* result, const Elf32_Ehdr* elf_header, const char* buffer) {
+   memcpy(result, buffer, Elf32_Shdr_Size); // [TODO] copy every field if internal error
+   if (is_target_little_endian(elf_header) != is_host_little_endian())
+      reverse_section_header(result);
+}
+
 int retrieve_section_header(Elf32_Shdr* section_header, const Elf32_Ehdr* elf_header,
       const char* buffer_exe, size_t buffer_len, Chariot_Section section, const char** error_message) {
    if (section < 0 || section > CS_Extra) {
@@ -232,37 +271,65 @@ int retrieve_section_header(Elf32_Shdr* section_header, const Elf32_Ehdr* elf_he
    return false;
 }
 
+static bool
+retrieve_symbol_content(const char** result, Chariot_Metadata_Symbols field,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations) {
+   const Elf32_Sym* symbol = &chariot_metadata_localizations->chariot_symbols[field];
+   const Elf32_Ehdr* elf_header = chariot_metadata_localizations->metadata_header;
+   const char* buffer_exe = chariot_metadata_localizations->metadata_buffer_exe;
+   size_t buffer_len = chariot_metadata_localizations->metadata_buffer_len;
+
+   if ((chariot_metadata_localizations->compressed_entries >> field) & 1U)
+      return false; // no content in place, see retrieve_metadata_field_stream
+   if (elf_header->e_shoff + (symbol->st_shndx+1)*Elf32_Shdr_Size > buffer_len)
+      return false;
+   Elf32_Shdr section_container;
+   memcpy(&section_container, buffer_exe + elf_header->e_shoff + symbol->st_shndx*Elf32_Shdr_Size, Elf32_Shdr_Size);
+   if (is_target_little_endian(elf_header) != is_host_little_endian())
+      reverse_section_header(&section_container);
+   if (section_container.sh_offset > buffer_len
+         || symbol->st_value > buffer_len - section_container.sh_offset
+         || symbol->st_size > buffer_len - section_container.sh_offset - symbol->st_value)
+      return false;
+   *result = buffer_exe + section_container.sh_offset + symbol->st_value;
+   return true;
+}
+
+static inline uint32_t
+load_le32(const char* start) {
+   const unsigned char* bytes = (const unsigned char*) start;
+   return (uint32_t) bytes[0] | ((uint32_t) bytes[1] << 8) | ((uint32_t) bytes[2] << 16)
+      | ((uint32_t) bytes[3] << 24);
+}
+
+/* 32 bytes of a digest, with the word convention of fill_sha256 */
+static inline void
+load_digest(uint32_t result[8], const char* start) {
+   const unsigned char* bytes = (const unsigned char*) start;
+   for (int index = 0; index < 8; ++index)
+      result[7-index] = ((uint32_t) bytes[4*index] << 24) | ((uint32_t) bytes[4*index+1] << 16)
+         | ((uint32_t) bytes[4*index+2] << 8) | (uint32_t) bytes[4*index+3];
+}
+
+/*
+ * Perfect hash table of the 2*CMS_END spellings of the symbols, generated at build
+ * time: a lookup hashes the symbol and compares it with a single slot.
+ */
+#include "chariot_symbol_slots.h"
+
+int chariot_metadata_find_field(Chariot_Metadata_Symbols* field, const char* symbol) {
+   uint32_t slot = chariot_hash_symbol(symbol, CHARIOT_SYMBOL_SEED) & (CHARIOT_SYMBOL_SLOTS_NUMBER-1);
+   if (!symbol_slot_names[slot] || strcmp(symbol_slot_names[slot], symbol) != 0)
+      return false;
+   *field = (Chariot_Metadata_Symbols) symbol_slot_fields[slot];
+   return true;
+}
+
 void
 set_metadata_localization(Chariot_Metadata_localizations* chariot_metadata_localizations,
       const char* symbol_name, Elf32_Sym* symbol_header) {
    Chariot_Metadata_Symbols cms_location = CMS_END;
-   if (strcmp(symbol_name, "chariotmeta_mainboot_sha256") == 0)
-      cms_location = CMS_Mainboot_sha256;
-   else if (strcmp(symbol_name, "chariotmeta_format_typeinfo") == 0)
-      cms_location = CMS_Format_typeinfo;
-   else if (strcmp(symbol_name, "chariotmeta_mainboot_offsetnum") == 0)
-      cms_location = CMS_Mainboot_offsetnum;
-   else if (strcmp(symbol_name, "chariotmeta_mainboot_sizesnum") == 0)
-      cms_location = CMS_Mainboot_sizesnum;
-   else if (strcmp(symbol_name, "chariotmeta_extraboot_sha256") == 0)
-      cms_location = CMS_Extraboot_sha256;
-   else if (strcmp(symbol_name, "chariotmeta_extraboot_offsetnum") == 0)
-      cms_location = CMS_Extraboot_offsetnum;
-   else if (strcmp(symbol_name, "chariotmeta_extraboot_sizenum") == 0)
-      cms_location = CMS_Extraboot_sizenum;
-   else if (strcmp(symbol_name, "chariotmeta_extraboot_typeinfo") == 0)
-      cms_location = CMS_Extraboot_typeinfo;
-   else if (strcmp(symbol_name, "chariotmeta_codanalys_typeinfo") == 0)
-      cms_location = CMS_Codanalys_typeinfo;
-   else if (strcmp(symbol_name, "chariotmeta_version_data") == 0)
-      cms_location = CMS_Version_data;
-   else if (strcmp(symbol_name, "chariotmeta_firmware_path") == 0)
-      cms_location = CMS_Firmware_path;
-   else if (strcmp(symbol_name, "chariotmeta_firmware_license") == 0)
-      cms_location = CMS_Firmware_license;
-   else if (strcmp(symbol_name, "chariotmeta_codanalys_data") == 0)
-      cms_location = CMS_Codanalys_data;
-   if (cms_location != CMS_END) {
+   if (chariot_metadata_find_field(&cms_location, symbol_name)) {
       chariot_metadata_localizations->chariot_symbols[cms_location] = *symbol_header;
       chariot_metadata_localizations->valid_entries |= (1U << cms_location);
    };
@@ -340,6 +407,34 @@ int fill_metadata_dict(Chariot_Metadata_localizations* chariot_metadata_localiza
       *error_message = "unable to find a symbol table in the elf buffer";
       return false;
    };
+   // the fields of a SHF_COMPRESSED section are only read by retrieve_metadata_field_stream
+   chariot_metadata_localizations->compressed_entries = 0;
+   for (int field = 0; field < CMS_END; ++field) {
+      Elf32_Half section_index = chariot_metadata_localizations->chariot_symbols[field].st_shndx;
+      Elf32_Shdr section_container;
+      if (!(chariot_metadata_localizations->valid_entries & (1U << field))
+            || elf_header->e_shoff + (section_index+1)*Elf32_Shdr_Size > buffer_len)
+         continue; // reported when the field is read
+      fill_section_header(&section_container, elf_header,
+            buffer_exe + elf_header->e_shoff + section_index*Elf32_Shdr_Size);
+      if (section_container.sh_flags & SHF_COMPRESSED)
+         chariot_metadata_localizations->compressed_entries |= 1U << field;
+   }
+   chariot_metadata_localizations->format_version = 1;
+   if (chariot_metadata_localizations->valid_entries & (1U << CMS_Format_version)) {
+      const char* start = NULL;
+      if (chariot_metadata_localizations->chariot_symbols[CMS_Format_version].st_size != 4
+            || !retrieve_symbol_content(&start, CMS_Format_version, chariot_metadata_localizations)) {
+         *error_message = "invalid field format_version";
+         return false;
+      }
+      chariot_metadata_localizations->format_version = load_le32(start);
+      if (chariot_metadata_localizations->format_version < 1
+            || chariot_metadata_localizations->format_version > 2) {
+         *error_message = "unsupported format version of the metadata";
+         return false;
+      }
+   }
    return true;
 }
 
@@ -370,313 +465,964 @@ fill_sha256(uint32_t result[8], const char* start) {
    return true;
 }
 
-int retrieve_mainboot_sha256(uint32_t result[8],
+static bool
+read_hex_number(const char* start, uint32_t* result) { /* start has at least 8 chars */
+   *result = 0;
+   for (int index = 0; index < 8; ++index) {
+      if (!add_hex_digit(start[index], result))
+         return false;
+   }
+   return true;
+}
+
+#define CHARIOT_METADATA_READ_ERROR(ID, NAME, SYMBOL, ENCODING, SIZE, PRESENCE, PREFIX) \
+   "unable to read " #NAME ": buffer is too small",
+static const char* field_read_errors[CMS_END] = {
+   CHARIOT_METADATA_FIELDS(CHARIOT_METADATA_READ_ERROR)
+};
+
+#define CHARIOT_METADATA_INVALID_ERROR(ID, NAME, SYMBOL, ENCODING, SIZE, PRESENCE, PREFIX) \
+   "invalid field " #NAME,
+static const char* field_invalid_errors[CMS_END] = {
+   CHARIOT_METADATA_FIELDS(CHARIOT_METADATA_INVALID_ERROR)
+};
+
+static inline bool
+is_field_in_place(Chariot_Metadata_Symbols field,
       const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
-   const Elf32_Sym* symbol = &chariot_metadata_localizations->chariot_symbols[CMS_Mainboot_sha256];
-   const Elf32_Ehdr* elf_header = chariot_metadata_localizations->metadata_header;
-   // const Elf32_Shdr* metadata_section = chariot_metadata_localizations->metadata_section;
-   const char* buffer_exe = chariot_metadata_localizations->metadata_buffer_exe;
-   size_t buffer_len = chariot_metadata_localizations->metadata_buffer_len;
+   if (!((chariot_metadata_localizations->compressed_entries >> field) & 1U))
+      return true;
+   *error_message = "compressed metadata field: to be read as a stream";
+   return false;
+}
 
-   if (elf_header->e_shoff + (symbol->st_shndx+1)*Elf32_Shdr_Size > buffer_len
-         || symbol->st_shndx < 0) {
-      *error_message = "unable to find the section having the content of mainboot_sha256: buffer is too small";
+/* content of a field after the prefix of its schema */
+static int
+retrieve_prefixed_content(const char** result, size_t* result_len, Chariot_Metadata_Symbols field,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
+   const char* prefix = Chariot_Metadata_schema[field].prefix;
+   size_t prefix_len = strlen(prefix);
+   size_t size = chariot_metadata_localizations->chariot_symbols[field].st_size;
+   if (!is_field_in_place(field, chariot_metadata_localizations, error_message))
+      return false;
+   if (!retrieve_symbol_content(result, field, chariot_metadata_localizations)) {
+      *error_message = field_read_errors[field];
       return false;
    }
-   Elf32_Shdr section_container;
-   memcpy(&section_container, buffer_exe + elf_header->e_shoff + symbol->st_shndx*Elf32_Shdr_Size, Elf32_Shdr_Size);
-   const char* start = buffer_exe + section_container.sh_offset + symbol->st_value;
-   if (start - buffer_exe + symbol->st_size > buffer_len
-         || symbol->st_value < 0) {
-      *error_message = "unable to read mainboot_sha256: buffer is too small";
+   if (size < prefix_len || strncmp(*result, prefix, prefix_len) != 0) {
+      *error_message = field_invalid_errors[field];
       return false;
    }
-   if (symbol->st_size != strlen("mainboot")+1+64
-         || strncmp(start + 64, " mainboot", strlen(" mainboot")) != 0) {
-      *error_message = "invalid field mainboot_sha256";
+   *result += prefix_len;
+   *result_len = size - prefix_len;
+   return true;
+}
+
+/* 64 hexadecimal digits and " mainboot", or 32 bytes in the format version 2 */
+static bool
+decode_digest(uint32_t result[8], const char* start, size_t len, uint32_t format_version) {
+   if (format_version >= 2) {
+      if (len != 32)
+         return false;
+      load_digest(result, start);
+      return true;
+   }
+   return len == strlen("mainboot")+1+64
+      && strncmp(start + 64, " mainboot", strlen(" mainboot")) == 0
+      && fill_sha256(result, start);
+}
+
+/* 8 hexadecimal digits, or 4 bytes little-endian for a CFE_Word or in the format version 2 */
+static bool
+decode_number(uint32_t* result, const char* start, size_t len, Chariot_Field_encoding encoding,
+      uint32_t format_version) {
+   if (encoding == CFE_Word || format_version >= 2) {
+      if (len != 4)
+         return false;
+      *result = load_le32(start);
+      return true;
+   }
+   return len >= 8 && read_hex_number(start, result);
+}
+
+static int
+retrieve_digest(uint32_t result[8], Chariot_Metadata_Symbols field,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
+   const char* start = NULL;
+   if (!is_field_in_place(field, chariot_metadata_localizations, error_message))
+      return false;
+   if (!retrieve_symbol_content(&start, field, chariot_metadata_localizations)) {
+      *error_message = field_read_errors[field];
       return false;
    }
-   if (!fill_sha256(result, start)) {
-      *error_message = "invalid sha256 for mainboot_sha256";
+   if (!decode_digest(result, start, chariot_metadata_localizations->chariot_symbols[field].st_size,
+         chariot_metadata_localizations->format_version)) {
+      *error_message = field_invalid_errors[field];
       return false;
-   };
+   }
    return true;
 }
 
+int retrieve_mainboot_sha256(uint32_t result[8],
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
+   return retrieve_digest(result, CMS_Mainboot_sha256, chariot_metadata_localizations, error_message);
+}
+
 int retrieve_format_typeinfo(const char** result, size_t* result_len,
       const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
-   const Elf32_Sym* symbol = &chariot_metadata_localizations->chariot_symbols[CMS_Format_typeinfo];
-   const Elf32_Ehdr* elf_header = chariot_metadata_localizations->metadata_header;
-   // const Elf32_Shdr* metadata_section = chariot_metadata_localizations->metadata_section;
-   const char* buffer_exe = chariot_metadata_localizations->metadata_buffer_exe;
-   size_t buffer_len = chariot_metadata_localizations->metadata_buffer_len;
+   return retrieve_prefixed_content(result, result_len, CMS_Format_typeinfo,
+         chariot_metadata_localizations, error_message);
+}
 
-   if (elf_header->e_shoff + (symbol->st_shndx+1)*Elf32_Shdr_Size > buffer_len
-         || symbol->st_shndx < 0) {
-      *error_message = "unable to find the section having the content of format_typeinfo: buffer is too small";
+int retrieve_codanalys_typeinfo(const char** result, size_t* result_len,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
+   return retrieve_prefixed_content(result, result_len, CMS_Codanalys_typeinfo,
+         chariot_metadata_localizations, error_message);
+}
+
+int retrieve_version_data(const char** result, size_t* result_len,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
+   return retrieve_prefixed_content(result, result_len, CMS_Version_data,
+         chariot_metadata_localizations, error_message);
+}
+
+int retrieve_firmware_path(const char** result, size_t* result_len,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
+   return retrieve_prefixed_content(result, result_len, CMS_Firmware_path,
+         chariot_metadata_localizations, error_message);
+}
+
+int retrieve_firmware_license(const char** result, size_t* result_len,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
+   return retrieve_prefixed_content(result, result_len, CMS_Firmware_license,
+         chariot_metadata_localizations, error_message);
+}
+
+int retrieve_codanalys_data(const char** result, size_t* result_len,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
+   if (!retrieve_prefixed_content(result, result_len, CMS_Codanalys_data,
+         chariot_metadata_localizations, error_message))
       return false;
-   }
-   Elf32_Shdr section_container;
-   memcpy(&section_container, buffer_exe + elf_header->e_shoff + symbol->st_shndx*Elf32_Shdr_Size, Elf32_Shdr_Size);
-   const char* start = buffer_exe + section_container.sh_offset + symbol->st_value;
-   if (start - buffer_exe + symbol->st_size > buffer_len
-         || symbol->st_value < 0) {
-      *error_message = "unable to read format_typeinfo: buffer is too small";
+   if (*result_len == 0) {
+      *error_message = field_invalid_errors[CMS_Codanalys_data];
       return false;
    }
-   *result = start;
-   *result_len = symbol->st_size;
+   --*result_len; // the final '\0'
    return true;
 }
 
-int retrieve_codanalys_typeinfo(const char** result, size_t* result_len,
+int retrieve_extraboot(Chariot_Metadata_extraboot* result,
       const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
-   const Elf32_Sym* symbol = &chariot_metadata_localizations->chariot_symbols[CMS_Codanalys_typeinfo];
    const Elf32_Ehdr* elf_header = chariot_metadata_localizations->metadata_header;
+   const Elf32_Sym* symbol_sha256 = &chariot_metadata_localizations->chariot_symbols[CMS_Extraboot_sha256];
+   const Elf32_Sym* symbol_typeinfo = &chariot_metadata_localizations->chariot_symbols[CMS_Extraboot_typeinfo];
    // const Elf32_Shdr* metadata_section = chariot_metadata_localizations->metadata_section;
-   const char* buffer_exe = chariot_metadata_localizations->metadata_buffer_exe;
-   size_t buffer_len = chariot_metadata_localizations->metadata_buffer_len;
+   const char* metadata_buffer_exe = chariot_metadata_localizations->metadata_buffer_exe;
+   size_t metadata_buffer_len = chariot_metadata_localizations->metadata_buffer_len;
+   const char* suppldata_buffer_exe = result->suppldata_buffer_exe;
+   size_t suppldata_buffer_len = result->suppldata_buffer_len;
+   const Elf32_Shdr* suppldata_section = result->suppldata_section;
+   Elf32_Shdr section_container;
+
+   uint32_t start = 0, size = 0;
+   if (!retrieve_metadata_number(&start, CMS_Extraboot_offsetnum, chariot_metadata_localizations,
+            error_message)
+         || !retrieve_metadata_number(&size, CMS_Extraboot_sizenum, chariot_metadata_localizations,
+            error_message))
+      return false;
+
+   if (suppldata_section->sh_offset + start + size > suppldata_buffer_len
+         || start + size > suppldata_section->sh_size) {
+      *error_message = "unable to read extraboot content: buffer is too small";
+      return false;
+   };
+   result->start = suppldata_buffer_exe + suppldata_section->sh_offset + start;
+   result->len = size;
 
-   if (elf_header->e_shoff + (symbol->st_shndx+1)*Elf32_Shdr_Size > buffer_len
-         || symbol->st_shndx < 0) {
-      *error_message = "unable to find the section having the content of codanalys_typeinfo: buffer is too small";
+   if (elf_header->e_shoff + (symbol_sha256->st_shndx+1)*Elf32_Shdr_Size > metadata_buffer_len
+         || symbol_sha256->st_shndx < 0) {
+      *error_message = "unable to find the section having the content of extraboot sha256: buffer is too small";
       return false;
    }
-   Elf32_Shdr section_container;
-   memcpy(&section_container, buffer_exe + elf_header->e_shoff + symbol->st_shndx*Elf32_Shdr_Size, Elf32_Shdr_Size);
-   const char* start = buffer_exe + section_container.sh_offset + symbol->st_value;
-   if (start - buffer_exe + symbol->st_size > buffer_len
-         || symbol->st_value < 0) {
-      *error_message = "unable to read codanalys_typeinfo: buffer is too small";
+   memcpy(&section_container, metadata_buffer_exe + elf_header->e_shoff + symbol_sha256->st_shndx*Elf32_Shdr_Size, Elf32_Shdr_Size);
+   const char* start_sha256 = metadata_buffer_exe + section_container.sh_offset + symbol_sha256->st_value;
+   if (start_sha256 - metadata_buffer_exe + symbol_sha256->st_size > metadata_buffer_len
+         || symbol_sha256->st_value < 0) {
+      *error_message = "unable to read extraboot sha256: buffer is too small";
       return false;
    }
-   *result = start;
-   *result_len = symbol->st_size;
+   if (symbol_sha256->st_size < 64) {
+      *error_message = "sha256 is not long enough for extraboot sha256";
+      return false;
+   };
+   if (!fill_sha256(result->sha256, start_sha256)) {
+      *error_message = "invalid sha256 for extraboot sha256";
+      return false;
+   };
+
+   if (elf_header->e_shoff + (symbol_typeinfo->st_shndx+1)*Elf32_Shdr_Size > metadata_buffer_len
+         || symbol_typeinfo->st_shndx < 0) {
+      *error_message = "unable to find the section having the content of extraboot typeinfo: buffer is too small";
+      return false;
+   }
+   memcpy(&section_container, metadata_buffer_exe + elf_header->e_shoff + symbol_typeinfo->st_shndx*Elf32_Shdr_Size, Elf32_Shdr_Size);
+   const char* start_typeinfo = metadata_buffer_exe + section_container.sh_offset + symbol_typeinfo->st_value;
+   if (start_typeinfo - metadata_buffer_exe + symbol_typeinfo->st_size > metadata_buffer_len
+         || symbol_typeinfo->st_value < 0) {
+      *error_message = "unable to read extraboot typeinfo: buffer is too small";
+      return false;
+   }
+   result->typeinfo = start_typeinfo;
+   result->typeinfo_len = symbol_typeinfo->st_size;
    return true;
 }
 
-int retrieve_version_data(const char** result, size_t* result_len,
-      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
-   const Elf32_Sym* symbol = &chariot_metadata_localizations->chariot_symbols[CMS_Version_data];
-   const Elf32_Ehdr* elf_header = chariot_metadata_localizations->metadata_header;
-   // const Elf32_Shdr* metadata_section = chariot_metadata_localizations->metadata_section;
-   const char* buffer_exe = chariot_metadata_localizations->metadata_buffer_exe;
-   size_t buffer_len = chariot_metadata_localizations->metadata_buffer_len;
 
-   if (elf_header->e_shoff + (symbol->st_shndx+1)*Elf32_Shdr_Size > buffer_len
-         || symbol->st_shndx < 0) {
-      *error_message = "unable to find the section having the content of version_data: buffer is too small";
+int retrieve_metadata_field(const char** result, size_t* result_len, Chariot_Metadata_Symbols field,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
+   if (field < 0 || field >= CMS_END
+         || !(chariot_metadata_localizations->valid_entries & (1U << field))) {
+      *error_message = "metadata field not assigned";
       return false;
    }
-   Elf32_Shdr section_container;
-   memcpy(&section_container, buffer_exe + elf_header->e_shoff + symbol->st_shndx*Elf32_Shdr_Size, Elf32_Shdr_Size);
-   const char* start = buffer_exe + section_container.sh_offset + symbol->st_value;
-   if (start - buffer_exe + symbol->st_size > buffer_len
-         || symbol->st_value < 0) {
-      *error_message = "unable to read version_data: buffer is too small";
+   if (!is_field_in_place(field, chariot_metadata_localizations, error_message))
+      return false;
+   if (!retrieve_symbol_content(result, field, chariot_metadata_localizations)) {
+      *error_message = "unable to read a metadata field: buffer is too small";
       return false;
    }
-   *result = start;
-   *result_len = symbol->st_size;
+   *result_len = chariot_metadata_localizations->chariot_symbols[field].st_size;
    return true;
 }
 
-int retrieve_firmware_path(const char** result, size_t* result_len,
+int retrieve_metadata_number(uint32_t* result, Chariot_Metadata_Symbols field,
       const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
-   const Elf32_Sym* symbol = &chariot_metadata_localizations->chariot_symbols[CMS_Firmware_path];
+   const char* start = NULL;
+   size_t len = 0;
+   if (!retrieve_metadata_field(&start, &len, field, chariot_metadata_localizations, error_message))
+      return false;
+   if ((Chariot_Metadata_schema[field].encoding != CFE_Hex32
+            && Chariot_Metadata_schema[field].encoding != CFE_Word)
+         || !decode_number(result, start, len, Chariot_Metadata_schema[field].encoding,
+            chariot_metadata_localizations->format_version)) {
+      *error_message = field_invalid_errors[field];
+      return false;
+   }
+   return true;
+}
+
+static bool
+read_compression_header(Elf32_Chdr* result, const Elf32_Shdr* section, const Elf32_Ehdr* elf_header,
+      const char* buffer_exe, size_t buffer_len, const char** error_message) {
+   if (section->sh_offset > buffer_len || section->sh_size > buffer_len - section->sh_offset
+         || section->sh_size < sizeof(Elf32_Chdr)) {
+      *error_message = "unable to read a compressed section: buffer is too small";
+      return false;
+   }
+   memcpy(result, buffer_exe + section->sh_offset, sizeof(Elf32_Chdr));
+   if (is_target_little_endian(elf_header) != is_host_little_endian()) {
+      reverse_word(&result->ch_type);
+      reverse_word(&result->ch_size);
+      reverse_word(&result->ch_addralign);
+   }
+   if (result->ch_type != ELFCOMPRESS_ZLIB) {
+      *error_message = result->ch_type == ELFCOMPRESS_ZSTD ? "unsupported zstd compression of a section"
+         : "unknown compression of a section";
+      return false;
+   }
+   return true;
+}
+
+/* the pieces of the inflated section around a field: its prefix, its content and its final '\0' */
+typedef struct {
+   uint64_t position; // inflated bytes already received
+   uint64_t field_start, content_start, content_end, field_end;
+   const char* prefix;
+   bool is_text;
+   bool is_prefix_valid;
+   bool has_final_zero;
+   bool is_output_stopped;
+   Chariot_Zlib_output output;
+   void* context;
+} Field_stream;
+
+static int
+stream_field_piece(void* context, const char* bytes, size_t len) {
+   Field_stream* stream = (Field_stream*) context;
+   uint64_t piece_start = stream->position, piece_end = stream->position + len;
+   stream->position = piece_end;
+   uint64_t start = piece_start > stream->field_start ? piece_start : stream->field_start;
+   uint64_t end = piece_end < stream->content_start ? piece_end : stream->content_start;
+   for (uint64_t position = start; position < end; ++position)
+      if (bytes[position - piece_start] != stream->prefix[position - stream->field_start])
+         stream->is_prefix_valid = false;
+   if (!stream->is_prefix_valid)
+      return false;
+   start = piece_start > stream->content_start ? piece_start : stream->content_start;
+   end = piece_end < stream->content_end ? piece_end : stream->content_end;
+   if (start < end && !stream->output(stream->context, bytes + (start - piece_start), (size_t) (end - start))) {
+      stream->is_output_stopped = true;
+      return false;
+   }
+   if (stream->is_text && stream->content_end >= piece_start && stream->content_end < piece_end)
+      stream->has_final_zero = bytes[stream->content_end - piece_start] == '\0';
+   return piece_end < stream->field_end;
+}
+
+int retrieve_metadata_field_stream(Chariot_Metadata_Symbols field, Chariot_Zlib_output output,
+      void* context, const Chariot_Metadata_localizations* chariot_metadata_localizations,
+      const char** error_message) {
+   if (field < 0 || field >= CMS_END
+         || !(chariot_metadata_localizations->valid_entries & (1U << field))) {
+      *error_message = "metadata field not assigned";
+      return false;
+   }
+   const Elf32_Sym* symbol = &chariot_metadata_localizations->chariot_symbols[field];
    const Elf32_Ehdr* elf_header = chariot_metadata_localizations->metadata_header;
-   // const Elf32_Shdr* metadata_section = chariot_metadata_localizations->metadata_section;
    const char* buffer_exe = chariot_metadata_localizations->metadata_buffer_exe;
    size_t buffer_len = chariot_metadata_localizations->metadata_buffer_len;
+   bool is_text = Chariot_Metadata_schema[field].encoding == CFE_Text;
+   size_t prefix_len = strlen(Chariot_Metadata_schema[field].prefix);
 
-   if (elf_header->e_shoff + (symbol->st_shndx+1)*Elf32_Shdr_Size > buffer_len
-         || symbol->st_shndx < 0) {
-      *error_message = "unable to find the section having the content of firmware_path: buffer is too small";
-      return false;
+   if (!((chariot_metadata_localizations->compressed_entries >> field) & 1U)) {
+      const char* start = NULL;
+      size_t len = 0;
+      if (!retrieve_prefixed_content(&start, &len, field, chariot_metadata_localizations, error_message))
+         return false;
+      if (is_text && (len == 0 || start[len-1] != '\0')) {
+         *error_message = field_invalid_errors[field];
+         return false;
+      }
+      if (is_text)
+         --len;
+      if (len > 0)
+         output(context, start, len);
+      return true;
    }
+
    Elf32_Shdr section_container;
-   memcpy(&section_container, buffer_exe + elf_header->e_shoff + symbol->st_shndx*Elf32_Shdr_Size, Elf32_Shdr_Size);
-   const char* start = buffer_exe + section_container.sh_offset + symbol->st_value;
-   if (start - buffer_exe + symbol->st_size > buffer_len
-         || symbol->st_value < 0) {
-      *error_message = "unable to read firmware_path: buffer is too small";
+   Elf32_Chdr compression;
+   if (symbol->st_size < prefix_len + (is_text ? 1 : 0)) {
+      *error_message = field_invalid_errors[field];
       return false;
    }
-   if (strncmp(start, "CHARIOTMETA_FIRMWARE_PATH=", strlen("CHARIOTMETA_FIRMWARE_PATH=")) != 0) {
-      *error_message = "invalid firmware_path";
+   if (elf_header->e_shoff + (symbol->st_shndx+1)*Elf32_Shdr_Size > buffer_len) {
+      *error_message = field_read_errors[field];
+      return false;
+   }
+   fill_section_header(&section_container, elf_header,
+         buffer_exe + elf_header->e_shoff + symbol->st_shndx*Elf32_Shdr_Size);
+   if (!read_compression_header(&compression, &section_container, elf_header, buffer_exe, buffer_len,
+         error_message))
+      return false;
+   if (symbol->st_value > compression.ch_size || symbol->st_size > compression.ch_size - symbol->st_value) {
+      *error_message = field_read_errors[field];
+      return false;
+   }
+
+   // the inflation stops after the last byte of the field
+   Field_stream stream;
+   memset(&stream, 0, sizeof(Field_stream));
+   stream.field_start = symbol->st_value;
+   stream.content_start = stream.field_start + prefix_len;
+   stream.field_end = stream.field_start + symbol->st_size;
+   stream.content_end = stream.field_end - (is_text ? 1 : 0);
+   stream.prefix = Chariot_Metadata_schema[field].prefix;
+   stream.is_text = is_text;
+   stream.is_prefix_valid = true;
+   stream.output = output;
+   stream.context = context;
+   if (!chariot_zlib_inflate(buffer_exe + section_container.sh_offset + sizeof(Elf32_Chdr),
+         section_container.sh_size - sizeof(Elf32_Chdr), stream_field_piece, &stream, error_message))
+      return false;
+   if (stream.is_output_stopped)
+      return true;
+   if (stream.position < stream.field_end || !stream.is_prefix_valid
+         || (is_text && !stream.has_final_zero)) {
+      *error_message = field_invalid_errors[field];
       return false;
    }
-   *result = start + strlen("CHARIOTMETA_FIRMWARE_PATH=");
-   *result_len = symbol->st_size - strlen("CHARIOTMETA_FIRMWARE_PATH=");
    return true;
 }
 
-int retrieve_firmware_license(const char** result, size_t* result_len,
+typedef struct {
+   char* buffer;
+   size_t len, capacity;
+   bool is_overflowed;
+} Inflated_copy;
+
+static int
+copy_inflated_piece(void* context, const char* bytes, size_t len) {
+   Inflated_copy* copy = (Inflated_copy*) context;
+   if (len > copy->capacity - copy->len) {
+      copy->is_overflowed = true;
+      return false;
+   }
+   memcpy(copy->buffer + copy->len, bytes, len);
+   copy->len += len;
+   return true;
+}
+
+int retrieve_inflated_field(char** result, size_t* result_len, Chariot_Metadata_Symbols field,
       const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
-   const Elf32_Sym* symbol = &chariot_metadata_localizations->chariot_symbols[CMS_Firmware_license];
-   const Elf32_Ehdr* elf_header = chariot_metadata_localizations->metadata_header;
-   // const Elf32_Shdr* metadata_section = chariot_metadata_localizations->metadata_section;
-   const char* buffer_exe = chariot_metadata_localizations->metadata_buffer_exe;
-   size_t buffer_len = chariot_metadata_localizations->metadata_buffer_len;
+   if (field < 0 || field >= CMS_END
+         || !(chariot_metadata_localizations->valid_entries & (1U << field))) {
+      *error_message = "metadata field not assigned";
+      return false;
+   }
+   Inflated_copy copy = { NULL, 0, chariot_metadata_localizations->chariot_symbols[field].st_size, false };
+   if (!(copy.buffer = (char*) malloc(copy.capacity + 1))) {
+      *error_message = "not enough memory";
+      return false;
+   }
+   if (!retrieve_metadata_field_stream(field, copy_inflated_piece, &copy, chariot_metadata_localizations,
+         error_message)) {
+      free(copy.buffer);
+      return false;
+   }
+   copy.buffer[copy.len] = '\0';
+   *result = copy.buffer;
+   *result_len = copy.len;
+   return true;
+}
 
-   if (elf_header->e_shoff + (symbol->st_shndx+1)*Elf32_Shdr_Size > buffer_len
-         || symbol->st_shndx < 0) {
-      *error_message = "unable to find the section having the content of firmware_license: buffer is too small";
+int inflate_section(char** result, size_t* result_len, const Elf32_Shdr* section,
+      const Elf32_Ehdr* elf_header, const char* buffer_exe, size_t buffer_len, const char** error_message) {
+   Elf32_Chdr compression;
+   if (!(section->sh_flags & SHF_COMPRESSED)) {
+      *error_message = "the section is not compressed";
       return false;
    }
-   Elf32_Shdr section_container;
-   memcpy(&section_container, buffer_exe + elf_header->e_shoff + symbol->st_shndx*Elf32_Shdr_Size, Elf32_Shdr_Size);
-   const char* start = buffer_exe + section_container.sh_offset + symbol->st_value;
-   if (start - buffer_exe + symbol->st_size > buffer_len
-         || symbol->st_value < 0) {
-      *error_message = "unable to read firmware_license: buffer is too small";
+   if (!read_compression_header(&compression, section, elf_header, buffer_exe, buffer_len, error_message))
+      return false;
+   Inflated_copy copy = { NULL, 0, compression.ch_size, false };
+   if (!(copy.buffer = (char*) malloc(copy.capacity + 1))) {
+      *error_message = "not enough memory";
+      return false;
+   }
+   if (!chariot_zlib_inflate(buffer_exe + section->sh_offset + sizeof(Elf32_Chdr),
+         section->sh_size - sizeof(Elf32_Chdr), copy_inflated_piece, &copy, error_message)) {
+      free(copy.buffer);
       return false;
    }
-   if (strncmp(start, "CHARIOTMETA_FIRMWARE_LICENSE=", strlen("CHARIOTMETA_FIRMWARE_LICENSE=")) != 0) {
-      *error_message = "invalid firmware_license";
+   if (copy.is_overflowed || copy.len != compression.ch_size) {
+      free(copy.buffer);
+      *error_message = "the inflated section does not have its announced size";
       return false;
    }
-   *result = start + strlen("CHARIOTMETA_FIRMWARE_LICENSE=");
-   *result_len = symbol->st_size - strlen("CHARIOTMETA_FIRMWARE_LICENSE=");
+   *result = copy.buffer;
+   *result_len = copy.len;
    return true;
 }
 
-int retrieve_codanalys_data(const char** result, size_t* result_len,
-      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
-   const Elf32_Sym* symbol = &chariot_metadata_localizations->chariot_symbols[CMS_Codanalys_data];
-   const Elf32_Ehdr* elf_header = chariot_metadata_localizations->metadata_header;
-   // const Elf32_Shdr* metadata_section = chariot_metadata_localizations->metadata_section;
-   const char* buffer_exe = chariot_metadata_localizations->metadata_buffer_exe;
-   size_t buffer_len = chariot_metadata_localizations->metadata_buffer_len;
+static bool
+is_region_in_buffer(const Chariot_Mainboot_region* region, size_t buffer_len)
+{  return region->offset <= buffer_len && region->size <= buffer_len - region->offset; }
 
-   if (elf_header->e_shoff + (symbol->st_shndx+1)*Elf32_Shdr_Size > buffer_len
-         || symbol->st_shndx < 0) {
-      *error_message = "unable to find the section having the content of code analysis data: buffer is too small";
+static int
+retrieve_load_segments(Chariot_Mainboot_region* result, size_t* result_len,
+      size_t result_capacity, const Elf32_Ehdr* elf_header, const char* buffer_exe, size_t buffer_len,
+      const char** error_message) {
+   if (sizeof(Elf32_Phdr) != Elf32_Phdr_Size) {
+      *error_message = "internal error: Elf32_Phdr structure may have padding";
       return false;
    }
-   Elf32_Shdr section_container;
-   memcpy(&section_container, buffer_exe + elf_header->e_shoff + symbol->st_shndx*Elf32_Shdr_Size, Elf32_Shdr_Size);
-   const char* start = buffer_exe + section_container.sh_offset + symbol->st_value;
-   if (start - buffer_exe + symbol->st_size > buffer_len
-         || symbol->st_value < 0) {
-      *error_message = "unable to read code analysis data: buffer is too small";
+   if (elf_header->e_phnum == 0 || Elf32_Phdr_Size != elf_header->e_phentsize) {
+      *error_message = "no program header to find the loadable segments";
       return false;
    }
-   if (strncmp(start, "CHARIOTMETA_CODANALYS_DATA= ", strlen("CHARIOTMETA_CODANALYS_DATA= ")) != 0) {
-      *error_message = "invalid code analysis data";
+   if (elf_header->e_phoff > buffer_len
+         || elf_header->e_phnum*(size_t) Elf32_Phdr_Size > buffer_len - elf_header->e_phoff) {
+      *error_message = "unable to read the program headers: buffer is too small";
+      return false;
+   }
+   *result_len = 0;
+   const char* segment_start = buffer_exe + elf_header->e_phoff;
+   for (int segment_index = 0; segment_index < elf_header->e_phnum; ++segment_index) {
+      Elf32_Phdr segment;
+      memcpy(&segment, segment_start + segment_index*Elf32_Phdr_Size, Elf32_Phdr_Size);
+      if (is_target_little_endian(elf_header) != is_host_little_endian())
+         reverse_program_header(&segment);
+      if (segment.p_type != PT_LOAD || segment.p_filesz == 0)
+         continue;
+      if (*result_len >= result_capacity) {
+         *error_message = "too many loadable segments for mainboot regions";
+         return false;
+      }
+      result[*result_len].offset = segment.p_offset;
+      result[*result_len].size = segment.p_filesz;
+      ++*result_len;
+   }
+   if (*result_len == 0) {
+      *error_message = "no loadable segment for mainboot regions";
       return false;
    }
-   *result = start + strlen("CHARIOTMETA_CODANALYS_DATA= ");
-   *result_len = symbol->st_size - strlen("CHARIOTMETA_CODANALYS_DATA= ") - 1;
    return true;
 }
 
-int retrieve_extraboot(Chariot_Metadata_extraboot* result,
+int retrieve_mainboot_regions(Chariot_Mainboot_region* result, size_t* result_len,
+      size_t result_capacity, const Elf32_Ehdr* elf_header, const char* buffer_exe, size_t buffer_len,
       const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
-   const Elf32_Ehdr* elf_header = chariot_metadata_localizations->metadata_header;
-   const Elf32_Sym* symbol_sha256 = &chariot_metadata_localizations->chariot_symbols[CMS_Extraboot_sha256];
-   const Elf32_Sym* symbol_offsetnum = &chariot_metadata_localizations->chariot_symbols[CMS_Extraboot_offsetnum];
-   const Elf32_Sym* symbol_sizenum = &chariot_metadata_localizations->chariot_symbols[CMS_Extraboot_sizenum];
-   const Elf32_Sym* symbol_typeinfo = &chariot_metadata_localizations->chariot_symbols[CMS_Extraboot_typeinfo];
-   // const Elf32_Shdr* metadata_section = chariot_metadata_localizations->metadata_section;
-   const char* metadata_buffer_exe = chariot_metadata_localizations->metadata_buffer_exe;
-   size_t metadata_buffer_len = chariot_metadata_localizations->metadata_buffer_len;
-   const char* suppldata_buffer_exe = result->suppldata_buffer_exe;
-   size_t suppldata_buffer_len = result->suppldata_buffer_len;
-   const Elf32_Shdr* suppldata_section = result->suppldata_section;
+   *result_len = 0;
+   if (!(chariot_metadata_localizations->valid_entries & (1U << CMS_Mainboot_regions))) {
+      // legacy single region
+      if (result_capacity < 1) {
+         *error_message = "too many mainboot regions";
+         return false;
+      }
+      if (!retrieve_metadata_number(&result[0].offset, CMS_Mainboot_offsetnum,
+               chariot_metadata_localizations, error_message)
+            || !retrieve_metadata_number(&result[0].size, CMS_Mainboot_sizesnum,
+               chariot_metadata_localizations, error_message))
+         return false;
+      *result_len = 1;
+      return true;
+   }
 
-   if (elf_header->e_shoff + (symbol_offsetnum->st_shndx+1)*Elf32_Shdr_Size > metadata_buffer_len
-         || symbol_offsetnum->st_shndx < 0) {
-      *error_message = "unable to find the section having the content of extraboot offsetnum: buffer is too small";
+   const char* start = NULL;
+   if (!retrieve_symbol_content(&start, CMS_Mainboot_regions, chariot_metadata_localizations)) {
+      *error_message = "unable to read mainboot regions: buffer is too small";
       return false;
    }
-   Elf32_Shdr section_container;
-   memcpy(&section_container, metadata_buffer_exe + elf_header->e_shoff + symbol_offsetnum->st_shndx*Elf32_Shdr_Size, Elf32_Shdr_Size);
-   const char* start_offset = metadata_buffer_exe + section_container.sh_offset + symbol_offsetnum->st_value;
-   if (start_offset - metadata_buffer_exe + symbol_offsetnum->st_size > metadata_buffer_len
-         || symbol_offsetnum->st_value < 0) {
-      *error_message = "unable to read extraboot offsetnum: buffer is too small";
+   size_t size = chariot_metadata_localizations->chariot_symbols[CMS_Mainboot_regions].st_size;
+   if (size >= strlen("PT_LOAD") && strncmp(start, "PT_LOAD", strlen("PT_LOAD")) == 0
+         && (size == strlen("PT_LOAD") || start[strlen("PT_LOAD")] == '\0'))
+      return retrieve_load_segments(result, result_len, result_capacity, elf_header, buffer_exe,
+            buffer_len, error_message);
+   if (chariot_metadata_localizations->format_version >= 2) {
+      if (size == 0 || size % 8 != 0) {
+         *error_message = "invalid entry in mainboot regions";
+         return false;
+      }
+      if (size / 8 > result_capacity) {
+         *error_message = "too many mainboot regions";
+         return false;
+      }
+      for (size_t position = 0; position < size; position += 8) {
+         result[*result_len].offset = load_le32(start + position);
+         result[*result_len].size = load_le32(start + position + 4);
+         ++*result_len;
+      }
+      return true;
+   }
+   while (size > 0 && start[size-1] == '\0')
+      --size;
+
+   size_t position = 0;
+   while (position < size) {
+      if (position > 0 && start[position++] != ',') {
+         *error_message = "invalid separator in mainboot regions";
+         return false;
+      }
+      if (size - position < 17 || start[position+8] != ':') {
+         *error_message = "invalid entry in mainboot regions";
+         return false;
+      }
+      if (*result_len >= result_capacity) {
+         *error_message = "too many mainboot regions";
+         return false;
+      }
+      if (!read_hex_number(start + position, &result[*result_len].offset)
+            || !read_hex_number(start + position + 9, &result[*result_len].size)) {
+         *error_message = "invalid value in mainboot regions";
+         return false;
+      }
+      ++*result_len;
+      position += 17;
+   }
+   if (*result_len == 0) {
+      *error_message = "empty mainboot regions";
       return false;
    }
+   return true;
+}
 
-   if (elf_header->e_shoff + (symbol_sizenum->st_shndx+1)*Elf32_Shdr_Size > metadata_buffer_len
-         || symbol_sizenum->st_shndx < 0) {
-      *error_message = "unable to find the section having the content of extraboot sizenum: buffer is too small";
+int verify_mainboot_sha256(const Elf32_Ehdr* elf_header, const char* buffer_exe, size_t buffer_len,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
+   Chariot_Mainboot_region regions[CHARIOT_MAINBOOT_REGIONS_MAX];
+   size_t regions_number = 0;
+   uint32_t expected_sha256[8], sha256[8];
+   if (!retrieve_mainboot_sha256(expected_sha256, chariot_metadata_localizations, error_message))
+      return false;
+   if (!retrieve_mainboot_regions(regions, &regions_number, CHARIOT_MAINBOOT_REGIONS_MAX,
+         elf_header, buffer_exe, buffer_len, chariot_metadata_localizations, error_message))
       return false;
+
+   // one pass over the firmware buffer, the regions are never copied
+   Chariot_Sha256_context context;
+   chariot_sha256_init(&context);
+   for (size_t region_index = 0; region_index < regions_number; ++region_index) {
+      if (!is_region_in_buffer(&regions[region_index], buffer_len)) {
+         *error_message = "unable to read a mainboot region: buffer is too small";
+         return false;
+      }
+      chariot_sha256_update(&context, buffer_exe + regions[region_index].offset,
+            regions[region_index].size);
    }
-   memcpy(&section_container, metadata_buffer_exe + elf_header->e_shoff + symbol_sizenum->st_shndx*Elf32_Shdr_Size, Elf32_Shdr_Size);
-   const char* start_size = metadata_buffer_exe + section_container.sh_offset + symbol_sizenum->st_value;
-   if (start_size - metadata_buffer_exe + symbol_sizenum->st_size > metadata_buffer_len
-         || symbol_sizenum->st_value < 0) {
-      *error_message = "unable to read extraboot sizenum: buffer is too small";
+   chariot_sha256_final(&context, sha256);
+   if (memcmp(sha256, expected_sha256, sizeof(sha256)) != 0) {
+      *error_message = "the mainboot content does not match mainboot_sha256";
       return false;
    }
-   uint32_t start = 0, size = 0;
+   return true;
+}
+
+int retrieve_mainboot_blake3(uint32_t result[8],
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
+   return retrieve_digest(result, CMS_Mainboot_blake3, chariot_metadata_localizations, error_message);
+}
 
-   if (symbol_offsetnum->st_size != 8) {
-      *error_message = "invalid size for extraboot offsetnum";
+int verify_mainboot_blake3(const Elf32_Ehdr* elf_header, const char* buffer_exe, size_t buffer_len,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, int threads_number,
+      const char** error_message) {
+   Chariot_Mainboot_region regions[CHARIOT_MAINBOOT_REGIONS_MAX];
+   Chariot_Blake3_slice slices[CHARIOT_MAINBOOT_REGIONS_MAX];
+   size_t regions_number = 0;
+   uint32_t expected_blake3[8], blake3[8];
+   unsigned char digest[32];
+   if (!retrieve_mainboot_blake3(expected_blake3, chariot_metadata_localizations, error_message))
       return false;
-   }
-   for (int index = 0; index < symbol_offsetnum->st_size; ++index) {
-      if (!add_hex_digit(start_offset[index], &start)) {
-         *error_message = "invalid value for extraboot offsetnum";
+   if (!retrieve_mainboot_regions(regions, &regions_number, CHARIOT_MAINBOOT_REGIONS_MAX,
+         elf_header, buffer_exe, buffer_len, chariot_metadata_localizations, error_message))
+      return false;
+   for (size_t region_index = 0; region_index < regions_number; ++region_index) {
+      if (!is_region_in_buffer(&regions[region_index], buffer_len)) {
+         *error_message = "unable to read a mainboot region: buffer is too small";
          return false;
-      };
+      }
+      slices[region_index].start = buffer_exe + regions[region_index].offset;
+      slices[region_index].len = regions[region_index].size;
+   }
+   if (!chariot_blake3_hash_slices(slices, regions_number, digest, threads_number)) {
+      *error_message = "too many mainboot regions for blake3";
+      return false;
    }
-   if (symbol_sizenum->st_size != 8) {
-      *error_message = "invalid size for extraboot sizenum";
+   // same word convention as fill_sha256: blake3[7] holds the first bytes
+   for (int index = 0; index < 8; ++index)
+      blake3[7-index] = ((uint32_t) digest[4*index] << 24) | ((uint32_t) digest[4*index+1] << 16)
+         | ((uint32_t) digest[4*index+2] << 8) | (uint32_t) digest[4*index+3];
+   if (memcmp(blake3, expected_blake3, sizeof(blake3)) != 0) {
+      *error_message = "the mainboot content does not match mainboot_blake3";
       return false;
    }
-   for (int index = 0; index < symbol_sizenum->st_size; ++index) {
-      if (!add_hex_digit(start_size[index], &size)) {
-         *error_message = "invalid value for extraboot sizenum";
+   return true;
+}
+
+int retrieve_mainboot_crc32c(uint32_t* result,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
+   return retrieve_metadata_number(result, CMS_Mainboot_crc32c, chariot_metadata_localizations, error_message);
+}
+
+int quick_check_mainboot(const Elf32_Ehdr* elf_header, const char* buffer_exe, size_t buffer_len,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
+   Chariot_Mainboot_region regions[CHARIOT_MAINBOOT_REGIONS_MAX];
+   size_t regions_number = 0;
+   if (!retrieve_mainboot_regions(regions, &regions_number, CHARIOT_MAINBOOT_REGIONS_MAX,
+         elf_header, buffer_exe, buffer_len, chariot_metadata_localizations, error_message))
+      return false;
+   for (size_t region_index = 0; region_index < regions_number; ++region_index) {
+      if (!is_region_in_buffer(&regions[region_index], buffer_len)) {
+         *error_message = "the firmware is truncated: a mainboot region is out of the buffer";
          return false;
-      };
+      }
    }
+   if (!(chariot_metadata_localizations->valid_entries & (1U << CMS_Mainboot_crc32c)))
+      return true;
 
-   if (suppldata_section->sh_offset + start + size > suppldata_buffer_len
-         || start < 0 || start + size > suppldata_section->sh_size) {
-      *error_message = "unable to read extraboot content: buffer is too small";
+   uint32_t expected_crc = 0, crc = 0;
+   if (!retrieve_mainboot_crc32c(&expected_crc, chariot_metadata_localizations, error_message))
       return false;
-   };
-   result->start = suppldata_buffer_exe + suppldata_section->sh_offset + start;
-   result->len = size;
+   for (size_t region_index = 0; region_index < regions_number; ++region_index)
+      crc = chariot_crc32c(crc, buffer_exe + regions[region_index].offset, regions[region_index].size);
+   if (crc != expected_crc) {
+      *error_message = "the mainboot content does not match mainboot_crc32c";
+      return false;
+   }
+   return true;
+}
 
-   if (elf_header->e_shoff + (symbol_sha256->st_shndx+1)*Elf32_Shdr_Size > metadata_buffer_len
-         || symbol_sha256->st_shndx < 0) {
-      *error_message = "unable to find the section having the content of extraboot sha256: buffer is too small";
+int retrieve_mainboot_chunks(Chariot_Mainboot_chunks* result,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
+   const Elf32_Sym* symbol = &chariot_metadata_localizations->chariot_symbols[CMS_Mainboot_chunks];
+   const char* start = NULL;
+   if (!(chariot_metadata_localizations->valid_entries & (1U << CMS_Mainboot_chunks))) {
+      *error_message = "metadata field not assigned";
       return false;
    }
-   memcpy(&section_container, metadata_buffer_exe + elf_header->e_shoff + symbol_sha256->st_shndx*Elf32_Shdr_Size, Elf32_Shdr_Size);
-   const char* start_sha256 = metadata_buffer_exe + section_container.sh_offset + symbol_sha256->st_value;
-   if (start_sha256 - metadata_buffer_exe + symbol_sha256->st_size > metadata_buffer_len
-         || symbol_sha256->st_value < 0) {
-      *error_message = "unable to read extraboot sha256: buffer is too small";
+   if (!retrieve_symbol_content(&start, CMS_Mainboot_chunks, chariot_metadata_localizations)) {
+      *error_message = "unable to read mainboot_chunks: buffer is too small";
       return false;
    }
-   if (symbol_sha256->st_size < 64) {
-      *error_message = "sha256 is not long enough for extraboot sha256";
+   size_t len = symbol->st_size;
+   if (chariot_metadata_localizations->format_version >= 2) {
+      if (len < 4+32 || (len - (4+32)) % 32 != 0 || (result->chunk_size = load_le32(start)) == 0) {
+         *error_message = "invalid field mainboot_chunks";
+         return false;
+      }
+      load_digest(result->root, start + 4);
+      result->chunks_number = (len - (4+32)) / 32;
+      result->leaves = start + 4+32;
+      result->leaf_size = 32;
+      return true;
+   }
+   // the assembler may keep the final null character in the size
+   if (len > 0 && start[len-1] == '\0')
+      --len;
+   if (len < 8+1+64+1 || (len - (8+1+64+1)) % 64 != 0 || start[8] != ':' || start[8+1+64] != ':'
+         || !read_hex_number(start, &result->chunk_size) || result->chunk_size == 0
+         || !fill_sha256(result->root, start + 8+1)) {
+      *error_message = "invalid field mainboot_chunks";
       return false;
-   };
-   if (!fill_sha256(result->sha256, start_sha256)) {
-      *error_message = "invalid sha256 for extraboot sha256";
+   }
+   result->chunks_number = (len - (8+1+64+1)) / 64;
+   result->leaves = start + 8+1+64+1;
+   result->leaf_size = 64;
+   return true;
+}
+
+/* bytes of a digest stored with the convention of fill_sha256 */
+static void
+digest_to_bytes(unsigned char result[32], const uint32_t digest[8]) {
+   for (int index = 0; index < 8; ++index) {
+      uint32_t word = digest[7-index];
+      result[4*index] = (unsigned char) (word >> 24);
+      result[4*index+1] = (unsigned char) (word >> 16);
+      result[4*index+2] = (unsigned char) (word >> 8);
+      result[4*index+3] = (unsigned char) word;
+   }
+}
+
+static bool
+load_chunks_leaf(uint32_t result[8], const Chariot_Mainboot_chunks* chunks, size_t chunk_index) {
+   if (chunks->leaf_size == 32) {
+      load_digest(result, chunks->leaves + chunk_index*32);
+      return true;
+   }
+   return fill_sha256(result, chunks->leaves + chunk_index*64);
+}
+
+/* node of the Merkle tree for the leaves [first, first+number) */
+static bool
+compute_chunks_node(uint32_t result[8], const Chariot_Mainboot_chunks* chunks, size_t first, size_t number) {
+   if (number == 1)
+      return load_chunks_leaf(result, chunks, first);
+   size_t left_number = 1;
+   while (left_number*2 < number)
+      left_number *= 2;
+   uint32_t left[8], right[8];
+   if (!compute_chunks_node(left, chunks, first, left_number)
+         || !compute_chunks_node(right, chunks, first + left_number, number - left_number))
       return false;
-   };
+   unsigned char prefix = 1, bytes[32];
+   Chariot_Sha256_context context;
+   chariot_sha256_init(&context);
+   chariot_sha256_update(&context, &prefix, 1);
+   digest_to_bytes(bytes, left);
+   chariot_sha256_update(&context, bytes, 32);
+   digest_to_bytes(bytes, right);
+   chariot_sha256_update(&context, bytes, 32);
+   chariot_sha256_final(&context, result);
+   return true;
+}
 
-   if (elf_header->e_shoff + (symbol_typeinfo->st_shndx+1)*Elf32_Shdr_Size > metadata_buffer_len
-         || symbol_typeinfo->st_shndx < 0) {
-      *error_message = "unable to find the section having the content of extraboot typeinfo: buffer is too small";
+typedef struct {
+   Chariot_Chunk_status* status;
+   const Chariot_Mainboot_chunks* chunks;
+   const Chariot_Mainboot_region* regions;
+   size_t regions_number;
+   uint64_t content_len;
+   const char* buffer_exe;
+   size_t buffer_len;
+   size_t first_chunk, last_chunk;
+} Chunks_verification;
+
+static void*
+verify_chunks_range(void* argument) {
+   const Chunks_verification* task = (const Chunks_verification*) argument;
+   const Chariot_Mainboot_chunks* chunks = task->chunks;
+   size_t region_index = 0;
+   uint64_t region_content_start = 0;
+   for (size_t chunk_index = task->first_chunk; chunk_index < task->last_chunk; ++chunk_index) {
+      if (task->status[chunk_index] == CCS_Valid)
+         continue;
+      uint64_t chunk_start = (uint64_t) chunk_index * chunks->chunk_size;
+      uint64_t chunk_end = chunk_start + chunks->chunk_size;
+      if (chunk_end > task->content_len)
+         chunk_end = task->content_len;
+      while (region_content_start + task->regions[region_index].size <= chunk_start) {
+         region_content_start += task->regions[region_index].size;
+         ++region_index;
+      }
+
+      Chariot_Sha256_context context;
+      unsigned char prefix = 0;
+      chariot_sha256_init(&context);
+      chariot_sha256_update(&context, &prefix, 1);
+      bool is_missing = false;
+      size_t piece_region = region_index;
+      uint64_t piece_content_start = region_content_start;
+      for (uint64_t position = chunk_start; position < chunk_end; ) {
+         const Chariot_Mainboot_region* region = &task->regions[piece_region];
+         uint64_t piece_end = piece_content_start + region->size;
+         if (piece_end > chunk_end)
+            piece_end = chunk_end;
+         uint64_t file_offset = region->offset + (position - piece_content_start);
+         if (file_offset + (piece_end - position) > task->buffer_len) {
+            is_missing = true;
+            break;
+         }
+         chariot_sha256_update(&context, task->buffer_exe + file_offset, piece_end - position);
+         position = piece_end;
+         if (position == piece_content_start + region->size) {
+            piece_content_start += region->size;
+            ++piece_region;
+         }
+      }
+      if (is_missing) {
+         task->status[chunk_index] = CCS_Missing;
+         continue;
+      }
+      uint32_t leaf[8], expected_leaf[8];
+      chariot_sha256_final(&context, leaf);
+      load_chunks_leaf(expected_leaf, chunks, chunk_index);
+      task->status[chunk_index] = memcmp(leaf, expected_leaf, sizeof(leaf)) == 0 ? CCS_Valid : CCS_Bad;
+   }
+   return NULL;
+}
+
+#define CHUNKS_THREADS_MAX 64
+
+int verify_mainboot_chunks(Chariot_Chunk_status* status, size_t status_len,
+      const Elf32_Ehdr* elf_header, const char* buffer_exe, size_t buffer_len,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, int threads_number,
+      const char** error_message) {
+   Chariot_Mainboot_chunks chunks;
+   Chariot_Mainboot_region regions[CHARIOT_MAINBOOT_REGIONS_MAX];
+   size_t regions_number = 0;
+   if (!retrieve_mainboot_chunks(&chunks, chariot_metadata_localizations, error_message))
+      return false;
+   if (status_len != chunks.chunks_number) {
+      *error_message = "the status array does not match the number of mainboot chunks";
       return false;
    }
-   memcpy(&section_container, metadata_buffer_exe + elf_header->e_shoff + symbol_typeinfo->st_shndx*Elf32_Shdr_Size, Elf32_Shdr_Size);
-   const char* start_typeinfo = metadata_buffer_exe + section_container.sh_offset + symbol_typeinfo->st_value;
-   if (start_typeinfo - metadata_buffer_exe + symbol_typeinfo->st_size > metadata_buffer_len
-         || symbol_typeinfo->st_value < 0) {
-      *error_message = "unable to read extraboot typeinfo: buffer is too small";
+   if (!retrieve_mainboot_regions(regions, &regions_number, CHARIOT_MAINBOOT_REGIONS_MAX,
+         elf_header, buffer_exe, buffer_len, chariot_metadata_localizations, error_message))
+      return false;
+   uint64_t content_len = 0;
+   for (size_t region_index = 0; region_index < regions_number; ++region_index)
+      content_len += regions[region_index].size;
+   if ((content_len + chunks.chunk_size - 1) / chunks.chunk_size != chunks.chunks_number
+         || chunks.chunks_number == 0) {
+      *error_message = "the number of mainboot chunks does not match the mainboot size";
       return false;
    }
-   result->typeinfo = start_typeinfo;
-   result->typeinfo_len = symbol_typeinfo->st_size;
+   uint32_t root[8];
+   if (!compute_chunks_node(root, &chunks, 0, chunks.chunks_number)) {
+      *error_message = "invalid digest in mainboot_chunks";
+      return false;
+   }
+   if (memcmp(root, chunks.root, sizeof(root)) != 0) {
+      *error_message = "the chunk table does not match its root";
+      return false;
+   }
+
+   if (threads_number <= 0) {
+      long processors_number = sysconf(_SC_NPROCESSORS_ONLN);
+      threads_number = processors_number > 0 ? (int) processors_number : 1;
+   }
+   if (threads_number > CHUNKS_THREADS_MAX)
+      threads_number = CHUNKS_THREADS_MAX;
+   if ((size_t) threads_number > chunks.chunks_number)
+      threads_number = (int) chunks.chunks_number;
+   Chunks_verification tasks[CHUNKS_THREADS_MAX];
+   pthread_t threads[CHUNKS_THREADS_MAX];
+   bool is_thread_created[CHUNKS_THREADS_MAX];
+   for (int thread_index = 0; thread_index < threads_number; ++thread_index) {
+      Chunks_verification* task = &tasks[thread_index];
+      task->status = status;
+      task->chunks = &chunks;
+      task->regions = regions;
+      task->regions_number = regions_number;
+      task->content_len = content_len;
+      task->buffer_exe = buffer_exe;
+      task->buffer_len = buffer_len;
+      task->first_chunk = chunks.chunks_number * thread_index / threads_number;
+      task->last_chunk = chunks.chunks_number * (thread_index+1) / threads_number;
+      // the calling thread verifies the first range, a failed creation falls back to it
+      is_thread_created[thread_index] = thread_index > 0
+         && pthread_create(&threads[thread_index], NULL, verify_chunks_range, task) == 0;
+   }
+   for (int thread_index = 0; thread_index < threads_number; ++thread_index)
+      if (!is_thread_created[thread_index])
+         verify_chunks_range(&tasks[thread_index]);
+   for (int thread_index = 1; thread_index < threads_number; ++thread_index)
+      if (is_thread_created[thread_index])
+         pthread_join(threads[thread_index], NULL);
+   return true;
+}
+
+int retrieve_codanalys_binary(const char** result, size_t* result_len,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
+   if (!is_field_in_place(CMS_Codanalys_binary, chariot_metadata_localizations, error_message))
+      return false;
+   if (!retrieve_symbol_content(result, CMS_Codanalys_binary, chariot_metadata_localizations)) {
+      *error_message = "unable to read codanalys_binary: buffer is too small";
+      return false;
+   }
+   *result_len = chariot_metadata_localizations->chariot_symbols[CMS_Codanalys_binary].st_size;
    return true;
 }
 
+int chariot_metadata_view_init(Chariot_Metadata_view* result,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
+   memset(result, 0, sizeof(Chariot_Metadata_view));
+   result->format_version = chariot_metadata_localizations->format_version;
+   if ((chariot_metadata_localizations->valid_entries & CHARIOT_METADATA_REQUIRED_ENTRIES)
+         != CHARIOT_METADATA_REQUIRED_ENTRIES) {
+      *error_message = "a required metadata field is missing";
+      return false;
+   }
+   for (int field = 0; field < CMS_END; ++field) {
+      const Chariot_Metadata_field_schema* schema = &Chariot_Metadata_schema[field];
+      const char* start = NULL;
+      size_t len = 0;
+      result->fields[field] = "";
+      if (!(chariot_metadata_localizations->valid_entries & (1U << field)))
+         continue;
+      if ((chariot_metadata_localizations->compressed_entries >> field) & 1U) {
+         // only the optional characters and bytes may be compressed
+         if (schema->presence == CFP_Required || (schema->encoding != CFE_Chars
+               && schema->encoding != CFE_Text && schema->encoding != CFE_Binary)) {
+            *error_message = field_invalid_errors[field];
+            return false;
+         }
+         result->compressed_entries |= 1U << field;
+         continue;
+      }
+      if (!retrieve_prefixed_content(&start, &len, (Chariot_Metadata_Symbols) field,
+            chariot_metadata_localizations, error_message))
+         return false;
+      bool is_valid = true;
+      if (schema->encoding == CFE_Text) {
+         is_valid = len > 0 && start[len-1] == '\0';
+         --len;
+      }
+      else if (schema->encoding == CFE_Digest)
+         is_valid = decode_digest(result->digests[field], start, len, result->format_version);
+      else if (schema->encoding == CFE_Hex32 || schema->encoding == CFE_Word)
+         is_valid = decode_number(&result->numbers[field], start, len, schema->encoding,
+               result->format_version)
+            && (result->format_version >= 2 || schema->size == 0 || len == schema->size);
+      else if (schema->size != 0)
+         is_valid = len == schema->size;
+      if (!is_valid) {
+         *error_message = field_invalid_errors[field];
+         return false;
+      }
+      result->fields[field] = start;
+      result->fields_len[field] = len;
+   }
+   result->valid_entries = chariot_metadata_localizations->valid_entries & ((1U << CMS_END) - 1)
+      & ~result->compressed_entries;
+   return true;
+}
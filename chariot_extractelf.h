@@ -42,23 +42,48 @@
 #pragma once
 
 #include "elf32.h"
+#include "chariot_metadata_schema.h"
+#include "chariot_zlib.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define CHARIOT_METADATA_ENUMERATOR(ID, NAME, SYMBOL, ENCODING, SIZE, PRESENCE, PREFIX) CMS_##ID,
 typedef enum {
-   CMS_Mainboot_sha256, CMS_Format_typeinfo, CMS_Mainboot_offsetnum, CMS_Mainboot_sizesnum,
-   CMS_Extraboot_sha256, CMS_Extraboot_offsetnum, CMS_Extraboot_sizenum, CMS_Extraboot_typeinfo,
-   CMS_Codanalys_typeinfo, CMS_Version_data, CMS_Firmware_path, CMS_Firmware_license,
-   CMS_Codanalys_data, CMS_END
+   CHARIOT_METADATA_FIELDS(CHARIOT_METADATA_ENUMERATOR)
+   CMS_END
 } Chariot_Metadata_Symbols;
 
+typedef struct {
+   const char* name;
+   const char* symbol;
+   Chariot_Field_encoding encoding;
+   uint32_t size;
+   Chariot_Field_presence presence;
+   const char* prefix;
+} Chariot_Metadata_field_schema;
+
+/* CHARIOT_METADATA_FIELDS as a table indexed by Chariot_Metadata_Symbols */
+extern const Chariot_Metadata_field_schema Chariot_Metadata_schema[CMS_END];
+
+#define CHARIOT_METADATA_REQUIRED_BIT(ID, NAME, SYMBOL, ENCODING, SIZE, PRESENCE, PREFIX) \
+   | ((PRESENCE) == CFP_Required ? 1U << CMS_##ID : 0U)
+#define CHARIOT_METADATA_REQUIRED_ENTRIES (0U CHARIOT_METADATA_FIELDS(CHARIOT_METADATA_REQUIRED_BIT))
+
+/*
+ * field of a symbol, given as its SYMBOL or as chariotmeta_NAME, through a perfect
+ * hash of these spellings built at the first call
+ */
+int chariot_metadata_find_field(Chariot_Metadata_Symbols* field, const char* symbol);
+
 typedef enum {
    CS_Meta, CS_Extra
 } Chariot_Section;
 
 int fill_exe_header(Elf32_Ehdr* result, const char* buffer_exe, size_t buffer_len, const char** error_message);
+// decodes the Elf32_Shdr_Size bytes of a section header in the byte order of elf_header
+void fill_section_header(Elf32_Shdr* result, const Elf32_Ehdr* elf_header, const char* buffer);
 int retrieve_section_header(Elf32_Shdr* section_header, const Elf32_Ehdr* elf_header,
       const char* buffer_exe, size_t buffer_len, Chariot_Section section, const char** error_message);
 
@@ -69,6 +94,8 @@ typedef struct {
    Elf32_Shdr* metadata_section;
    const char* metadata_buffer_exe;
    size_t metadata_buffer_len;
+   uint32_t format_version; // set by fill_metadata_dict, see chariot_metadata_schema.h
+   uint32_t compressed_entries; // set by fill_metadata_dict, see retrieve_metadata_field_stream
 } Chariot_Metadata_localizations;
 
 int fill_metadata_dict(Chariot_Metadata_localizations* chariot_metadata_localizations,
@@ -89,6 +116,38 @@ int retrieve_firmware_license(const char** result, size_t* result_len,
 int retrieve_codanalys_data(const char** result, size_t* result_len,
       const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message);
 
+/*
+ * Raw content of any field of valid_entries (st_size bytes with its final '\0' if any),
+ * for the generic readers like chariot_index.h
+ */
+int retrieve_metadata_field(const char** result, size_t* result_len, Chariot_Metadata_Symbols field,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message);
+/* value of a CFE_Hex32 or CFE_Word field in any format version */
+int retrieve_metadata_number(uint32_t* result, Chariot_Metadata_Symbols field,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message);
+
+/*
+ * The inserters may move the large optional fields, like codanalys_data, into a second
+ * SHF_COMPRESSED section of the metadata object, whose symbols give the offsets in its
+ * inflated content. These fields have their bit in compressed_entries: the accessors
+ * above refuse them and the view leaves them out. retrieve_metadata_field_stream gives
+ * the content of any field as the view does (after the prefix, without the final '\0'
+ * of a text) to output, by pieces for a compressed field, whose section is only inflated
+ * up to the end of the field. retrieve_inflated_field copies it into a malloc'd buffer.
+ */
+int retrieve_metadata_field_stream(Chariot_Metadata_Symbols field, Chariot_Zlib_output output,
+      void* context, const Chariot_Metadata_localizations* chariot_metadata_localizations,
+      const char** error_message);
+int retrieve_inflated_field(char** result, size_t* result_len, Chariot_Metadata_Symbols field,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message);
+
+/*
+ * Inflated content, malloc'd, of a SHF_COMPRESSED section of the elf buffer, like the
+ * .suppldata section compressed by the inserters. Only ELFCOMPRESS_ZLIB is supported.
+ */
+int inflate_section(char** result, size_t* result_len, const Elf32_Shdr* section,
+      const Elf32_Ehdr* elf_header, const char* buffer_exe, size_t buffer_len, const char** error_message);
+
 typedef struct {
    uint32_t sha256[8];
    const char* typeinfo;
@@ -104,6 +163,145 @@ typedef struct {
 int retrieve_extraboot(Chariot_Metadata_extraboot* result,
       const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message);
 
+/*
+ * The mainboot content is a list of (file offset, size) regions of the firmware.
+ * chariotmeta_mainboot_regions is either "PT_LOAD" (every loadable segment)
+ * or a comma separated list of "oooooooo:ssssssss" hexadecimal entries.
+ * Without this symbol, the region is given by chariotmeta_mainboot_offsetnum
+ * and chariotmeta_mainboot_sizesnum.
+ */
+typedef struct {
+   Elf32_Off offset;
+   Elf32_Word size;
+} Chariot_Mainboot_region;
+
+#define CHARIOT_MAINBOOT_REGIONS_MAX 64
+
+int retrieve_mainboot_regions(Chariot_Mainboot_region* result, size_t* result_len,
+      size_t result_capacity, const Elf32_Ehdr* elf_header, const char* buffer_exe, size_t buffer_len,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message);
+
+// hashes the regions in place in the firmware buffer and compares with mainboot_sha256
+int verify_mainboot_sha256(const Elf32_Ehdr* elf_header, const char* buffer_exe, size_t buffer_len,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message);
+
+/*
+ * Optional BLAKE3 digest of the mainboot regions, same layout as mainboot_sha256.
+ * Its verification uses threads_number threads (0 = one per online processor).
+ */
+int retrieve_mainboot_blake3(uint32_t result[8],
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message);
+int verify_mainboot_blake3(const Elf32_Ehdr* elf_header, const char* buffer_exe, size_t buffer_len,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, int threads_number,
+      const char** error_message);
+
+/*
+ * Optional CRC32C of the mainboot regions as 8 hexadecimal characters.
+ * quick_check_mainboot rejects the truncated firmwares and, if this field exists,
+ * the corrupted ones at memory speed before the cryptographic verifications.
+ */
+int retrieve_mainboot_crc32c(uint32_t* result,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message);
+int quick_check_mainboot(const Elf32_Ehdr* elf_header, const char* buffer_exe, size_t buffer_len,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message);
+
+/*
+ * Optional Merkle table of the mainboot content (the concatenation of its regions)
+ * cut into chunks of chunk_size bytes. chariotmeta_mainboot_chunks is
+ * "ssssssss:" (chunk size in hexadecimal), the 64 hexadecimal digits of the root,
+ * ":" and then 64 hexadecimal digits per chunk. In the format version 2, it is the
+ * chunk size on 4 bytes little-endian, the 32 bytes of the root and 32 bytes per chunk.
+ * A leaf is sha256(0x00 || chunk) and a node is sha256(0x01 || left || right)
+ * where left covers the largest power of two of chunks smaller than the node's.
+ */
+typedef struct {
+   Elf32_Word chunk_size;
+   size_t chunks_number;
+   uint32_t root[8];
+   const char* leaves; // leaf_size bytes per chunk
+   size_t leaf_size; // 64 hexadecimal digits or 32 bytes in the format version 2
+} Chariot_Mainboot_chunks;
+
+typedef enum {
+   CCS_Unknown, CCS_Valid, CCS_Bad, CCS_Missing
+} Chariot_Chunk_status;
+
+int retrieve_mainboot_chunks(Chariot_Mainboot_chunks* result,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message);
+
+/*
+ * Checks the chunk table against its root and then every chunk on threads_number
+ * threads (0 = one per online processor). buffer_exe may only contain the beginning
+ * of a partially received firmware: the chunks out of buffer_len become CCS_Missing.
+ * The chunks already CCS_Valid in status are not hashed again, so that a call can
+ * resume the verification of a previous one after the reception of new data.
+ * status has chunks_number entries.
+ */
+int verify_mainboot_chunks(Chariot_Chunk_status* status, size_t status_len,
+      const Elf32_Ehdr* elf_header, const char* buffer_exe, size_t buffer_len,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, int threads_number,
+      const char** error_message);
+
+/*
+ * Optional code analysis results in the binary encoding of chariot_codanalys.h.
+ * result points into the metadata buffer, to be given to chariot_codanalys_open.
+ */
+int retrieve_codanalys_binary(const char** result, size_t* result_len,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message);
+
+/*
+ * Decode-once view of the metadata, built after fill_metadata_dict for the readers
+ * of many fields. Every field of valid_entries is located and checked once against
+ * Chariot_Metadata_schema: its bounds, its size, its prefix and its digits, decoded
+ * there. The required fields must be present. The contents point into the metadata
+ * buffer, without the prefix and the final '\0' of the texts, in the encoding of
+ * the format version.
+ */
+typedef struct {
+   const char* fields[CMS_END]; // "" for the fields out of valid_entries
+   size_t fields_len[CMS_END];
+   uint32_t valid_entries;
+   uint32_t compressed_entries; // optional fields to read by retrieve_metadata_field_stream
+   uint32_t format_version;
+   uint32_t numbers[CMS_END]; // value of the CFE_Hex32 and CFE_Word fields
+   uint32_t digests[CMS_END][8]; // value of the CFE_Digest fields
+} Chariot_Metadata_view;
+
+int chariot_metadata_view_init(Chariot_Metadata_view* result,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message);
+
+/* O(1) access to a field once the view is built: returns false if it is not assigned */
+static inline int chariot_metadata_view_field(const char** result, size_t* result_len,
+      const Chariot_Metadata_view* view, Chariot_Metadata_Symbols field) {
+   *result = view->fields[field];
+   *result_len = view->fields_len[field];
+   return (view->valid_entries >> field) & 1U;
+}
+
+/*
+ * Typed accessors chariot_metadata_view_NAME generated from the schema: a CFE_Digest
+ * field gives its 8 words, a CFE_Hex32 or CFE_Word field its number and the others
+ * their content
+ */
+#define CHARIOT_METADATA_VIEW_ACCESSOR_CFE_Digest(ID, NAME) \
+   static inline int chariot_metadata_view_##NAME(const uint32_t** result, const Chariot_Metadata_view* view) \
+   {  *result = view->digests[CMS_##ID]; return (view->valid_entries >> CMS_##ID) & 1U; }
+#define CHARIOT_METADATA_VIEW_ACCESSOR_CFE_Hex32(ID, NAME) \
+   static inline int chariot_metadata_view_##NAME(uint32_t* result, const Chariot_Metadata_view* view) \
+   {  *result = view->numbers[CMS_##ID]; return (view->valid_entries >> CMS_##ID) & 1U; }
+#define CHARIOT_METADATA_VIEW_ACCESSOR_CFE_Chars(ID, NAME) \
+   static inline int chariot_metadata_view_##NAME(const char** result, size_t* result_len, \
+         const Chariot_Metadata_view* view) \
+   {  return chariot_metadata_view_field(result, result_len, view, CMS_##ID); }
+#define CHARIOT_METADATA_VIEW_ACCESSOR_CFE_Word CHARIOT_METADATA_VIEW_ACCESSOR_CFE_Hex32
+#define CHARIOT_METADATA_VIEW_ACCESSOR_CFE_Text CHARIOT_METADATA_VIEW_ACCESSOR_CFE_Chars
+#define CHARIOT_METADATA_VIEW_ACCESSOR_CFE_Regions CHARIOT_METADATA_VIEW_ACCESSOR_CFE_Chars
+#define CHARIOT_METADATA_VIEW_ACCESSOR_CFE_Chunks CHARIOT_METADATA_VIEW_ACCESSOR_CFE_Chars
+#define CHARIOT_METADATA_VIEW_ACCESSOR_CFE_Binary CHARIOT_METADATA_VIEW_ACCESSOR_CFE_Chars
+#define CHARIOT_METADATA_VIEW_ACCESSOR(ID, NAME, SYMBOL, ENCODING, SIZE, PRESENCE, PREFIX) \
+   CHARIOT_METADATA_VIEW_ACCESSOR_##ENCODING(ID, NAME)
+CHARIOT_METADATA_FIELDS(CHARIOT_METADATA_VIEW_ACCESSOR)
+
 #ifdef __cplusplus
 }
 #endif
@@ -40,8 +40,13 @@
 #include <memory.h>
 #include <string.h>
 #include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "chariot_extractelf.h"
+#include "chariot_codanalys.h"
 
 typedef struct _InputParser {
   const char* exe_name;
@@ -53,7 +58,13 @@ typedef struct _InputParser {
   bool requires_license : 1;
   bool requires_static_analysis : 1;
   bool requires_additional : 1;
+  bool requires_check : 1;
+  bool requires_quick_check : 1;
+  bool requires_chunks : 1;
   const char* output_file;
+  const char* metadata_file;
+  const char* function_name;
+  int threads_number;
 } InputParser;
 
 void
@@ -61,8 +72,10 @@ input_parser_usage()
 {
   printf("usage: chariot_extractelf_meta_data.py [-h] [--all] [--verbose] [--sha]\n"
          "                                       [--blockchain_path] [--license]\n"
-         "                                       [--static-analysis] [--add]\n"
-         "                                       [--output OUTPUT]\n"
+         "                                       [--static-analysis] [--add] [--check]\n"
+         "                                       [--quick-check] [--chunks]\n"
+         "                                       [--threads THREADS] [--function NAME]\n"
+         "                                       [--metadata METADATA] [--output OUTPUT]\n"
          "                                       exe_name\n"
          "\n");
 }
@@ -89,12 +102,38 @@ fill_input_parser_fields(InputParser* parser, int argc, const char** argv)
         parser->requires_license = true;
       else if (strcmp(argv[i], "-sa") == 0 || strcmp(argv[i], "--static-analysis") == 0)
         parser->requires_static_analysis = true;
+      else if (strcmp(argv[i], "-chk") == 0 || strcmp(argv[i], "--check") == 0)
+        parser->requires_check = true;
+      else if (strcmp(argv[i], "-qc") == 0 || strcmp(argv[i], "--quick-check") == 0)
+        parser->requires_quick_check = true;
+      else if (strcmp(argv[i], "-chunks") == 0 || strcmp(argv[i], "--chunks") == 0)
+        parser->requires_chunks = true;
       else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0)
       {
         if (++i >= argc)
           return false;
         parser->output_file = argv[i];
       }
+      else if (strcmp(argv[i], "-md") == 0 || strcmp(argv[i], "--metadata") == 0)
+      {
+        if (++i >= argc)
+          return false;
+        parser->metadata_file = argv[i];
+      }
+      else if (strcmp(argv[i], "-fn") == 0 || strcmp(argv[i], "--function") == 0)
+      {
+        if (++i >= argc)
+          return false;
+        parser->function_name = argv[i];
+      }
+      else if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--threads") == 0)
+      {
+        if (++i >= argc)
+          return false;
+        parser->threads_number = atoi(argv[i]);
+        if (parser->threads_number < 0)
+          return false;
+      }
       else
         return false;
     }
@@ -106,6 +145,45 @@ fill_input_parser_fields(InputParser* parser, int argc, const char** argv)
   return true;
 }
 
+/* output of retrieve_metadata_field_stream for a compressed field */
+int
+write_piece(void* context, const char* bytes, size_t len)
+{
+  return fwrite(bytes, 1, len, (FILE*) context) == len;
+}
+
+/* read-only mapping of a whole file */
+char*
+map_file(const char* file_name, size_t* buffer_size)
+{
+  int fd = open(file_name, O_RDONLY);
+  struct stat status;
+  if (fd < 0 || fstat(fd, &status) != 0 || status.st_size <= 0)
+  {
+    fprintf(stderr, "Cannot open file %s\n", file_name);
+    if (fd >= 0)
+      close(fd);
+    return NULL;
+  }
+  *buffer_size = status.st_size;
+  char* buffer = (char*) mmap(NULL, *buffer_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (buffer == MAP_FAILED)
+  {
+    fprintf(stderr, "Cannot map file %s\n", file_name);
+    return NULL;
+  }
+  return buffer;
+}
+
+void
+unmap_files(char* buffer, size_t buffer_size, char* metadata_file, size_t metadata_file_size)
+{
+  munmap(buffer, buffer_size);
+  if (metadata_file)
+    munmap(metadata_file, metadata_file_size);
+}
+
 int main(int argc, const char** argv) {
   InputParser parser;
   if (!fill_input_parser_fields(&parser, argc, argv))
@@ -134,37 +212,37 @@ int main(int argc, const char** argv) {
            "  --static-analysis, -sa\n"
            "                        print the result of the static analysis as file/format\n"
            "  --add, -add           print content of the additional section\n"
+           "  --check, -chk         check the mainboot regions against their blake3\n"
+           "                        (when present) or their sha256\n"
+           "  --quick-check, -qc    reject a truncated firmware or a mainboot that does\n"
+           "                        not match its crc32c (also done before --check)\n"
+           "  --chunks, -chunks     check every chunk of the mainboot and print the bad ones\n"
+           "  --function NAME, -fn NAME\n"
+           "                        print the stack usage, the code size and the callees\n"
+           "                        of the function NAME from the code analysis binary data\n"
+           "  --threads THREADS, -j THREADS\n"
+           "                        number of threads for the blake3 and chunks checks\n"
+           "                        (default: one per processor)\n"
+           "  --metadata METADATA, -md METADATA\n"
+           "                        read the metadata in the file METADATA, the content of\n"
+           "                        the .chariotmeta.rodata section received apart, to check\n"
+           "                        the chunks of a partially received firmware\n"
            "  --output OUTPUT, -o OUTPUT\n"
            "                        print into the output file instead of stdout\n"
            "\n");
     return 0;
   }
 
-  char* buffer = (char*) NULL;
-  long int buffer_size = 0;
+  // the firmware is mapped, without any size limit, for the threaded checks of large images
+  size_t buffer_size = 0, metadata_file_size = 0;
+  char* buffer = map_file(parser.exe_name, &buffer_size);
+  if (!buffer)
+    return 1;
+  char* metadata_file = NULL;
+  if (parser.metadata_file && !(metadata_file = map_file(parser.metadata_file, &metadata_file_size)))
   {
-    FILE* file = fopen(parser.exe_name, "rb");
-    if (!file)
-    {
-      fprintf(stderr, "Cannot open file %s\n", parser.exe_name);
-      return 1;
-    }
-    fseek(file, 0, SEEK_END);
-    long int len = ftell(file);
-    if (len <= 0 || len >= 20000000L)
-    {
-      fprintf(stderr, "file %s is too large to be allocated in memory\n", parser.exe_name);
-      return 1;
-    }
-    buffer = malloc(len);
-    if (!buffer)
-    {
-      fprintf(stderr, "buffer not allocated\n");
-      return 1;
-    }
-    fseek(file, 0, SEEK_SET);
-    buffer_size = fread(buffer, 1, len, file);
-    fclose(file);
+    munmap(buffer, buffer_size);
+    return 1;
   }
 
   FILE* out_file = NULL;
@@ -185,33 +263,37 @@ int main(int argc, const char** argv) {
     fprintf(stderr, "Cannot read elf header of %s\n", parser.exe_name);
     fprintf(stderr, "  %s\n", error_message);
     if (out_file) fclose(out_file);
-    free(buffer);
+    unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
     return 1;
   }
 
+  // with --metadata, the metadata section is the whole file received apart
   Elf32_Shdr metadata_section;
-  if (parser.requires_verbose)
+  const char* metadata_buffer = metadata_file ? metadata_file : &buffer[0];
+  memset(&metadata_section, 0, sizeof(Elf32_Shdr));
+  metadata_section.sh_size = metadata_file_size;
+  if (parser.requires_verbose && !metadata_file)
     printf("call retrieve_section_header -> metadata_section\n");
-  if (!retrieve_section_header(&metadata_section, &elf_header, &buffer[0], buffer_size,
-      CS_Meta, &error_message))
+  if (!metadata_file && !retrieve_section_header(&metadata_section, &elf_header, &buffer[0],
+      buffer_size, CS_Meta, &error_message))
   {
     fprintf(stderr, "Cannot find CHARIOT metadata inside %s\n", parser.exe_name);
     fprintf(stderr, "  %s\n", error_message);
     if (out_file) fclose(out_file);
-    free(buffer);
+    unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
     return 1;
   }
 
   Elf32_Ehdr metadata_elf_header;
   if (parser.requires_verbose)
     printf("call fill_exe_header -> metadata_elf_header\n");
-  if (!fill_exe_header(&metadata_elf_header, &buffer[0] + metadata_section.sh_offset,
+  if (!fill_exe_header(&metadata_elf_header, metadata_buffer + metadata_section.sh_offset,
       metadata_section.sh_size, &error_message))
   {
     fprintf(stderr, "section .chariotmeta.rodata should also follow the elf format %s\n", parser.exe_name);
     fprintf(stderr, "  %s\n", error_message);
     if (out_file) fclose(out_file);
-    free(buffer);
+    unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
     return 1;
   }
 
@@ -219,7 +301,7 @@ int main(int argc, const char** argv) {
   metadata_dict.valid_entries = 0;
   metadata_dict.metadata_header = &metadata_elf_header;
   metadata_dict.metadata_section = &metadata_section;
-  metadata_dict.metadata_buffer_exe = &buffer[0] + metadata_section.sh_offset;
+  metadata_dict.metadata_buffer_exe = metadata_buffer + metadata_section.sh_offset;
   metadata_dict.metadata_buffer_len = metadata_section.sh_size;
 
   if (parser.requires_verbose)
@@ -229,7 +311,7 @@ int main(int argc, const char** argv) {
     fprintf(stderr, "Cannot find CHARIOT symbols inside %s\n", parser.exe_name);
     fprintf(stderr, "  %s\n", error_message);
     if (out_file) fclose(out_file);
-    free(buffer);
+    unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
     return 1;
   }
 
@@ -247,7 +329,7 @@ int main(int argc, const char** argv) {
         fprintf(stderr, "Cannot find mainboot_sha256 inside %s\n", parser.exe_name);
         fprintf(stderr, "  %s\n", error_message);
         if (out_file) fclose(out_file);
-        free(buffer);
+        unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
         return 1;
       }
       for (int i = 8; --i >= 0; )
@@ -256,6 +338,105 @@ int main(int argc, const char** argv) {
     }
   }
 
+  if (parser.requires_check || parser.requires_quick_check)
+  {
+    if (parser.requires_verbose)
+      printf("call quick_check_mainboot -> mainboot regions\n");
+    if (!quick_check_mainboot(&elf_header, &buffer[0], buffer_size, &metadata_dict, &error_message))
+    {
+      fprintf(stderr, "Cannot check mainboot of %s\n", parser.exe_name);
+      fprintf(stderr, "  %s\n", error_message);
+      if (out_file) fclose(out_file);
+      unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
+      return 1;
+    }
+    if (!parser.requires_check)
+      fprintf(out, (metadata_dict.valid_entries & (1U << CMS_Mainboot_crc32c))
+          ? "mainboot crc32c checked\n" : "mainboot regions checked\n");
+  }
+
+  if (parser.requires_check)
+  {
+    bool has_blake3 = metadata_dict.valid_entries & (1U << CMS_Mainboot_blake3);
+    bool is_checked;
+    if (has_blake3)
+    {
+      if (parser.requires_verbose)
+        printf("call verify_mainboot_blake3 -> mainboot regions\n");
+      is_checked = verify_mainboot_blake3(&elf_header, &buffer[0], buffer_size, &metadata_dict,
+          parser.threads_number, &error_message);
+    }
+    else
+    {
+      if (parser.requires_verbose)
+        printf("call verify_mainboot_sha256 -> mainboot regions\n");
+      is_checked = verify_mainboot_sha256(&elf_header, &buffer[0], buffer_size, &metadata_dict,
+          &error_message);
+    }
+    if (!is_checked)
+    {
+      fprintf(stderr, "Cannot check mainboot of %s\n", parser.exe_name);
+      fprintf(stderr, "  %s\n", error_message);
+      if (out_file) fclose(out_file);
+      unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
+      return 1;
+    }
+    fprintf(out, has_blake3 ? "mainboot blake3 checked\n" : "mainboot sha256 checked\n");
+  }
+
+  if (parser.requires_chunks)
+  {
+    if (parser.requires_verbose)
+      printf("call verify_mainboot_chunks -> mainboot chunks\n");
+    Chariot_Mainboot_chunks chunks;
+    Chariot_Chunk_status* status = NULL;
+    bool is_checked = retrieve_mainboot_chunks(&chunks, &metadata_dict, &error_message);
+    if (is_checked)
+    {
+      status = (Chariot_Chunk_status*) calloc(chunks.chunks_number, sizeof(Chariot_Chunk_status));
+      is_checked = status && verify_mainboot_chunks(status, chunks.chunks_number, &elf_header,
+          &buffer[0], buffer_size, &metadata_dict, parser.threads_number, &error_message);
+      if (!status)
+        error_message = "not enough memory for the chunks status";
+    }
+    if (!is_checked)
+    {
+      fprintf(stderr, "Cannot check mainboot chunks of %s\n", parser.exe_name);
+      fprintf(stderr, "  %s\n", error_message);
+      free(status);
+      if (out_file) fclose(out_file);
+      unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
+      return 1;
+    }
+    size_t valid_number = 0, bad_number = 0, missing_number = 0;
+    for (size_t chunk_index = 0; chunk_index < chunks.chunks_number; ++chunk_index)
+    {
+      if (status[chunk_index] == CCS_Valid)
+        ++valid_number;
+      else if (status[chunk_index] == CCS_Bad)
+      {
+        ++bad_number;
+        fprintf(out, "bad chunk %zu at mainboot offset %08zx\n", chunk_index,
+            chunk_index * (size_t) chunks.chunk_size);
+      }
+      else
+      {
+        ++missing_number;
+        fprintf(out, "missing chunk %zu at mainboot offset %08zx\n", chunk_index,
+            chunk_index * (size_t) chunks.chunk_size);
+      }
+    }
+    free(status);
+    fprintf(out, "mainboot chunks: %zu valid, %zu bad, %zu missing\n", valid_number, bad_number,
+        missing_number);
+    if (valid_number != chunks.chunks_number)
+    {
+      if (out_file) fclose(out_file);
+      unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
+      return 1;
+    }
+  }
+
   if (parser.requires_all || parser.requires_blockchain_path)
   {
     if (!(metadata_dict.valid_entries & (1U << CMS_Firmware_path)))
@@ -270,7 +451,7 @@ int main(int argc, const char** argv) {
         fprintf(stderr, "Cannot find firmware path inside %s\n", parser.exe_name);
         fprintf(stderr, "  %s\n", error_message);
         if (out_file) fclose(out_file);
-        free(buffer);
+        unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
         return 1;
       }
       fprintf(out, "CHARIOTMETA_FIRMWARE_PATH=");
@@ -293,7 +474,7 @@ int main(int argc, const char** argv) {
         fprintf(stderr, "Cannot find firmware license inside %s\n", parser.exe_name);
         fprintf(stderr, "  %s\n", error_message);
         if (out_file) fclose(out_file);
-        free(buffer);
+        unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
         return 1;
       }
       fprintf(out, "CHARIOTMETA_FIRMWARE_LICENSE=");
@@ -307,24 +488,87 @@ int main(int argc, const char** argv) {
     if (!(metadata_dict.valid_entries & (1U << CMS_Codanalys_data)))
       fprintf(out, "code analysis data symbol not assigned\n");
     else {
+      bool is_compressed = (metadata_dict.compressed_entries >> CMS_Codanalys_data) & 1U;
       if (parser.requires_verbose)
-        printf("call retrieve_codanalys_data -> static analysis data\n");
+        printf(is_compressed ? "call retrieve_metadata_field_stream -> static analysis data\n"
+            : "call retrieve_codanalys_data -> static analysis data\n");
       const char* codanalys_data = NULL;
       size_t codanalys_data_len = 0;
-      if (!retrieve_codanalys_data(&codanalys_data, &codanalys_data_len, &metadata_dict, &error_message))
+      if (is_compressed)
+        fprintf(out, "CHARIOTMETA_CODANALYS_DATA=");
+      if (is_compressed
+          ? !retrieve_metadata_field_stream(CMS_Codanalys_data, write_piece, out, &metadata_dict,
+              &error_message)
+          : !retrieve_codanalys_data(&codanalys_data, &codanalys_data_len, &metadata_dict, &error_message))
       {
         fprintf(stderr, "Cannot find static code analysis data inside %s\n", parser.exe_name);
         fprintf(stderr, "  %s\n", error_message);
         if (out_file) fclose(out_file);
-        free(buffer);
+        unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
         return 1;
       }
-      fprintf(out, "CHARIOTMETA_CODANALYS_DATA=");
-      fwrite(codanalys_data, 1, codanalys_data_len, out);
+      if (!is_compressed)
+      {
+        fprintf(out, "CHARIOTMETA_CODANALYS_DATA=");
+        fwrite(codanalys_data, 1, codanalys_data_len, out);
+      }
       fprintf(out, "\n");
     }
   };
 
+  if ((parser.requires_all || parser.requires_static_analysis || parser.function_name)
+      && (metadata_dict.valid_entries & (1U << CMS_Codanalys_binary)))
+  {
+    if (parser.requires_verbose)
+      printf("call retrieve_codanalys_binary -> static analysis binary data\n");
+    const char* codanalys_binary = NULL;
+    size_t codanalys_binary_len = 0;
+    Chariot_Codanalys_binary codanalys;
+    if (!retrieve_codanalys_binary(&codanalys_binary, &codanalys_binary_len, &metadata_dict, &error_message)
+        || !chariot_codanalys_open(&codanalys, codanalys_binary, codanalys_binary_len, &error_message))
+    {
+      fprintf(stderr, "Cannot find static code analysis binary data inside %s\n", parser.exe_name);
+      fprintf(stderr, "  %s\n", error_message);
+      if (out_file) fclose(out_file);
+      unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
+      return 1;
+    }
+    fprintf(out, "CHARIOTMETA_CODANALYS_BINARY= %u functions, %u calls in %lu bytes\n",
+        codanalys.functions_number, codanalys.calls_number, (unsigned long) codanalys_binary_len);
+    if (parser.function_name)
+    {
+      static const char* flag_names[] = { "recursion", "indirect", "unknown", "unbounded", "noframe" };
+      uint32_t index = 0, callee_index = 0;
+      Chariot_Codanalys_function function, callee;
+      if (!chariot_codanalys_find(&index, &codanalys, parser.function_name))
+      {
+        fprintf(stderr, "Cannot find function %s in the code analysis binary data\n", parser.function_name);
+        if (out_file) fclose(out_file);
+        unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
+        return 1;
+      }
+      if (!chariot_codanalys_function(&function, &codanalys, index, &error_message))
+      {
+        fprintf(stderr, "Cannot read function %s in the code analysis binary data\n", parser.function_name);
+        fprintf(stderr, "  %s\n", error_message);
+        if (out_file) fclose(out_file);
+        unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
+        return 1;
+      }
+      fprintf(out, "function %s: frame %u, stack depth %u, code size %u",
+          function.name, function.frame, function.depth, function.code_size);
+      for (int flag = 0; flag < 5; ++flag)
+        if (function.flags & (1U << flag))
+          fprintf(out, ", %s", flag_names[flag]);
+      fprintf(out, "\n");
+      while (chariot_codanalys_next_callee(&callee_index, &function))
+        if (chariot_codanalys_function(&callee, &codanalys, callee_index, &error_message))
+          fprintf(out, "  calls %s (stack depth %u)\n", callee.name, callee.depth);
+    }
+  }
+  else if (parser.function_name)
+    fprintf(out, "code analysis binary symbol not assigned\n");
+
   if (parser.requires_all || parser.requires_additional)
   {
     if (!(metadata_dict.valid_entries & (1U << CMS_Extraboot_offsetnum))
@@ -341,20 +585,40 @@ int main(int argc, const char** argv) {
         fprintf(stderr, "Cannot find CHARIOT metadata inside %s\n", parser.exe_name);
         fprintf(stderr, "  %s\n", error_message);
         if (out_file) fclose(out_file);
-        free(buffer);
+        unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
         return 1;
       }
 
+      // a SHF_COMPRESSED .suppldata section is inflated in memory
+      char* suppldata_content = NULL;
+      const char* suppldata_buffer = &buffer[0] + suppldata_section.sh_offset;
+      size_t suppldata_len = suppldata_section.sh_size;
+      if (suppldata_section.sh_flags & SHF_COMPRESSED)
+      {
+        if (parser.requires_verbose)
+          printf("call inflate_section -> suppldata content\n");
+        if (!inflate_section(&suppldata_content, &suppldata_len, &suppldata_section, &elf_header,
+              &buffer[0], buffer_size, &error_message))
+        {
+          fprintf(stderr, "Cannot inflate the section .suppldata of %s\n", parser.exe_name);
+          fprintf(stderr, "  %s\n", error_message);
+          if (out_file) fclose(out_file);
+          unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
+          return 1;
+        }
+        suppldata_buffer = suppldata_content;
+      }
+
       Elf32_Ehdr suppldata_elf_header;
       if (parser.requires_verbose)
         printf("call fill_exe_header -> suppldata_elf_header\n");
-      if (!fill_exe_header(&suppldata_elf_header, &buffer[0] + suppldata_section.sh_offset,
-            suppldata_section.sh_size, &error_message))
+      if (!fill_exe_header(&suppldata_elf_header, suppldata_buffer, suppldata_len, &error_message))
       {
         fprintf(stderr, "section .suppldata of %s should also follow the elf format\n", parser.exe_name);
         fprintf(stderr, "  %s\n", error_message);
+        free(suppldata_content);
         if (out_file) fclose(out_file);
-        free(buffer);
+        unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
         return 1;
       }
 
@@ -362,38 +626,40 @@ int main(int argc, const char** argv) {
       if (parser.requires_verbose)
         printf("call retrieve_section_header -> suppldata_inside_section\n");
       if (!retrieve_section_header(&suppldata_inside_section, &suppldata_elf_header,
-            &buffer[0] + suppldata_section.sh_offset, suppldata_section.sh_size,
-            CS_Extra, &error_message))
+            suppldata_buffer, suppldata_len, CS_Extra, &error_message))
       {
         fprintf(stderr, "Cannot find CHARIOT suppldata inside suppldata inside %s\n", parser.exe_name);
         fprintf(stderr, "  %s\n", error_message);
+        free(suppldata_content);
         if (out_file) fclose(out_file);
-        free(buffer);
+        unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
         return 1;
       }
 
       Chariot_Metadata_extraboot extractboot_info;
       extractboot_info.suppldata_header = &suppldata_elf_header;
       extractboot_info.suppldata_section = &suppldata_inside_section;
-      extractboot_info.suppldata_buffer_exe = &buffer[0] + suppldata_section.sh_offset;
-      extractboot_info.suppldata_buffer_len = suppldata_section.sh_size;
+      extractboot_info.suppldata_buffer_exe = suppldata_buffer;
+      extractboot_info.suppldata_buffer_len = suppldata_len;
       if (parser.requires_verbose)
         printf("call retrieve_extraboot -> extra boot section\n");
       if (!retrieve_extraboot(&extractboot_info, &metadata_dict, &error_message))
       {
         fprintf(stderr, "Cannot find CHARIOT extra data inside %s\n", parser.exe_name);
         fprintf(stderr, "  %s\n", error_message);
+        free(suppldata_content);
         if (out_file) fclose(out_file);
-        free(buffer);
+        unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
         return 1;
       };
       fwrite(extractboot_info.start, 1, extractboot_info.len, out);
       fprintf(out, "\n");
+      free(suppldata_content);
     }
   };
 
   if (out_file) fclose(out_file);
-  free(buffer);
+  unmap_files(buffer, buffer_size, metadata_file, metadata_file_size);
   return 0;
 }
 
@@ -4,6 +4,8 @@ import sys
 import argparse
 import subprocess
 import tempfile
+import struct
+import zlib
 
 __author__ = "Franck Vedrine"
 __copyright__ = "Copyright (c) 2019-2020, Commissariat a l'Energie Atomique CEA. All rights reserved."
@@ -68,8 +70,31 @@ def extract_section(exe_name, section_name, out_filename, verbose):
             raise OSError(returncode)
         print (command)
 
+def query_compressed_sections(elf_filename):
+    # (name, inflated content) of the SHF_COMPRESSED sections of an elf32 file by section index
+    with open(elf_filename, 'rb') as elf_file:
+        content = elf_file.read()
+    result = {}
+    if len(content) < 52 or content[0:4] != b'\x7fELF':
+        return result
+    endian = '>' if content[5] == 2 else '<'
+    (shoff,) = struct.unpack(endian + 'I', content[32:36])
+    (shentsize, shnum, shstrndx) = struct.unpack(endian + 'HHH', content[46:52])
+    headers = [struct.unpack(endian + 'I4xI4xII', content[shoff+index*shentsize:shoff+index*shentsize+24])
+            for index in range(shnum)]
+    names_offset = headers[shstrndx][2] if shstrndx < shnum else 0
+    for (index, (name, flags, offset, size)) in enumerate(headers):
+        if flags & 0x800 and size >= 12:
+            # Elf32_Chdr then the zlib stream, zstd is not supported
+            (kind, inflated_size) = struct.unpack(endian + 'II', content[offset:offset+8])
+            if kind == 1:
+                name_end = content.find(b'\0', names_offset+name)
+                result[index] = (content[names_offset+name:name_end].decode(),
+                        zlib.decompress(content[offset+12:offset+size])[0:inflated_size])
+    return result
+
 def query_start_size(metadata_filename, verbose):
-    readelf_proc = subprocess.Popen(['readelf', '-s', metadata_filename], stdout=subprocess.PIPE)
+    readelf_proc = subprocess.Popen(['readelf', '-s', '-W', metadata_filename], stdout=subprocess.PIPE)
     result = {}
     while True:
         line = readelf_proc.stdout.readline()
@@ -82,12 +107,13 @@ def query_start_size(metadata_filename, verbose):
                 key = partition[7]
                 if len(key) >= 25:
                     key = key[0:25]
-                result[key] = (int(partition[1], 16), int(partition[2]))
+                ndx = int(partition[6]) if partition[6].isdigit() else 0
+                result[key] = (int(partition[1], 16), int(partition[2], 0), ndx)
             except:
                 continue
     returncode = readelf_proc.wait()
     if verbose or returncode:
-        command = "readelf -s " + metadata_filename
+        command = "readelf -s -W " + metadata_filename
         if returncode:
             print ("[error] the command " + command + " has failed with return code " + str(returncode))
             raise OSError(returncode)
@@ -100,13 +126,20 @@ def print_meta_data_result(condition, field, metadata_file, start_size_dict, out
         if len(key) >= 25:
             key = key[0:25]
         try:
-            (start, size) = start_size_dict[key]
+            (start, size, ndx) = start_size_dict[key]
             if size > 0:
-                metadata_file.seek(start+elf_offset_section)
+                if ndx in compressed_sections:
+                    content = compressed_sections[ndx][1][start:start+size]
+                else:
+                    metadata_file.seek(start+elf_offset_section)
+                    content = metadata_file.read(size)
+                if field == b"chariotmeta_mainboot_sha256" and size == 32:
+                    # raw digest of the format version 2
+                    content = (content.hex() + " mainboot").encode()
                 if output_file is not None:
-                    output_file.write(metadata_file.read(size))
+                    output_file.write(content)
                 else:
-                    print(str(metadata_file.read(size), "utf-8"))
+                    print(str(content, "utf-8"))
             else:
                 print("no output for metadata ", key, file=sys.stderr)
         except:
@@ -117,15 +150,19 @@ def get_meta_data_result(field, metadata_file, start_size_dict):
     if len(key) >= 25:
         key = key[0:25]
     try:
-        (start, size) = start_size_dict[key]
+        (start, size, ndx) = start_size_dict[key]
         result = 0
         if size > 0:
             metadata_file.seek(start+elf_offset_section)
             content = metadata_file.read(size)
-            if size != 8:
+            if size == 4:
+                # little-endian number of the format version 2
+                (result,) = struct.unpack('<I', content)
+            elif size != 8:
                 print ("[error] corrupted int for " + field + " in metadata section of exe file")
                 raise OSError(0)
-            result = int(content, 16)
+            else:
+                result = int(content, 16)
         else:
             print ("no output for metadata ", key, file=sys.stderr)
             raise OSError(0)
@@ -178,6 +215,7 @@ except OSError as err:
 
 try:
     start_size_dict = query_start_size(metadata_filename, args.verbose)
+    compressed_sections = query_compressed_sections(metadata_filename)
 except OSError as err:
     close_fd_and_file(fd_metadata, metadata_filename)
     sys.exit(err.errno)
@@ -191,6 +229,10 @@ if args.add or args.all:
     fd_additions, additions_filename = tempfile.mkstemp()
     try:
         extract_section(args.exe_name, "suppldata", additions_filename, args.verbose)
+        for (name, inflated) in query_compressed_sections(args.exe_name).values():
+            if name == ".suppldata":
+                with open(additions_filename, 'wb') as additions_file:
+                    additions_file.write(inflated)
         start = get_meta_data_result(b"chariotmeta_extraboot_offsetnum", metadata_file, start_size_dict)
         size = get_meta_data_result(b"chariotmeta_extraboot_sizenum", metadata_file, start_size_dict)
         additions_file = open(additions_filename, 'rb')
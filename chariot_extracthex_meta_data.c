@@ -55,6 +55,7 @@ typedef struct _InputParser {
   bool requires_software_id : 1;
   bool requires_additional : 1;
   bool requires_cut : 1;
+  bool requires_quick_check : 1;
   const char* output_file;
   const char* output_exe_file;
   const char* static_analysis_file;
@@ -342,13 +343,61 @@ convert_hex_line(FILE* hexm_file, FILE* out_file, size_t* bytes_number,
   return 0;
 }
 
+static int
+hex_digit(int ch) {
+  if (ch >= '0' && ch <= '9')
+    return ch - '0';
+  if (ch >= 'a' && ch <= 'f')
+    return ch - 'a' + 10;
+  if (ch >= 'A' && ch <= 'F')
+    return ch - 'A' + 10;
+  return -1;
+}
+
+/* the quick check: the length and the checksum of every record of the file, without any digest */
+int
+quick_check_records(FILE* hexm_file, FILE* out_file, InputParser* parser) {
+  long position = ftell(hexm_file);
+  char line[600]; /* 255 bytes in a record */
+  size_t line_number = 0;
+  if (parser->requires_verbose)
+    printf("check the records of %s\n", parser->exe_name);
+  fseek(hexm_file, 0, SEEK_SET);
+  while (fgets(line, sizeof(line), hexm_file)) {
+    ++line_number;
+    size_t len = strlen(line);
+    while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'
+          || line[len-1] == ' ' || line[len-1] == '\t'))
+      line[--len] = '\0';
+    int checksum = 0, bytes_number = 0;
+    bool is_valid = len >= 11 && len % 2 == 1 && line[0] == ':';
+    for (size_t i = 1; is_valid && i < len; i += 2) {
+      int high = hex_digit(line[i]), low = hex_digit(line[i+1]);
+      is_valid = high >= 0 && low >= 0;
+      if (i == 1)
+        bytes_number = (high << 4) | low;
+      checksum += (high << 4) | low;
+    }
+    if (!is_valid || (size_t) bytes_number != (len-11)/2 || (checksum & 0xff) != 0) {
+      fprintf(stderr, "Cannot check the records of %s\n", parser->exe_name);
+      fprintf(stderr, "  bad record at line %u\n", (unsigned) line_number);
+      if (out_file) fclose(out_file);
+      fclose(hexm_file);
+      return 1;
+    }
+  }
+  fseek(hexm_file, position, SEEK_SET);
+  fprintf(out_file, "%u records checked\n", (unsigned) line_number);
+  return 0;
+}
+
 void
 input_parser_usage()
 {
   printf("usage: chariot_extracthex_meta_data [-h] [--all] [--verbose] [--sha]\n"
          "                                    [--blockchain_path] [--license]\n"
          "                                    [--static-analysis FILE] [--add]\n"
-         "                                    [--format] [--output OUTPUT]\n"
+         "                                    [--format] [--quick-check] [--output OUTPUT]\n"
          "                                    [--cut OUTPUT_HEX]\n"
          "                                    hex_name\n"
          "\n");
@@ -390,6 +439,8 @@ fill_input_parser_fields(InputParser* parser, int argc, const char** argv)
       }
       else if (strcmp(argv[i], "-add") == 0 || strcmp(argv[i], "--add") == 0)
         parser->requires_additional = true;
+      else if (strcmp(argv[i], "-qc") == 0 || strcmp(argv[i], "--quick-check") == 0)
+        parser->requires_quick_check = true;
       else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0)
       {
         if (++i >= argc)
@@ -927,6 +978,8 @@ int main(int argc, const char** argv) {
            "  --static-analysis, -sa FILE\n"
            "                        print the result of the static analysis in file\n"
            "  --add, -add           print content of the additional section\n"
+           "  --quick-check, -qc    reject a truncated file or a record that does not\n"
+           "                        match its checksum\n"
            "  --output OUTPUT, -o OUTPUT\n"
            "                        print into the output file instead of stdout\n"
            "\n");
@@ -952,6 +1005,9 @@ int main(int argc, const char** argv) {
   int error_code;
   if ((error_code = locate_line_from_end(hexm_file, &parser)) != 0)
     return standard_error(out_file, hexm_file, &parser);
+  if (parser.requires_quick_check
+      && (error_code = quick_check_records(hexm_file, out_file, &parser)) != 0)
+    return error_code;
 
   if ((error_code = extract_firmware(hexm_file, out_file, &parser)) != 0)
     return error_code;
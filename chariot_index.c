@@ -0,0 +1,705 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chariot_index.h"
+
+static const char index_magic[4] = { 'C', 'H', 'I', 'X' };
+
+#define CHARIOT_INDEX_COLUMN_NAME(ID, NAME, SYMBOL, ENCODING, SIZE, PRESENCE, PREFIX) #NAME,
+static const char* index_column_names[CHARIOT_INDEX_COLUMNS] = {
+   CHARIOT_METADATA_FIELDS(CHARIOT_INDEX_COLUMN_NAME) "image"
+};
+
+static void
+store_u32(unsigned char* target, uint32_t value) {
+   for (int index = 0; index < 4; ++index)
+      target[index] = (unsigned char) (value >> (8*index));
+}
+
+static void
+store_u64(unsigned char* target, uint64_t value) {
+   for (int index = 0; index < 8; ++index)
+      target[index] = (unsigned char) (value >> (8*index));
+}
+
+static uint32_t
+load_u32(const unsigned char* source) {
+   return (uint32_t) source[0] | ((uint32_t) source[1] << 8)
+      | ((uint32_t) source[2] << 16) | ((uint32_t) source[3] << 24);
+}
+
+static uint64_t
+load_u64(const unsigned char* source) {
+   return (uint64_t) load_u32(source) | ((uint64_t) load_u32(source + 4) << 32);
+}
+
+/* dictionary order: bytes, then the shorter value first */
+static int
+compare_values(const unsigned char* first, size_t first_len, const unsigned char* second,
+      size_t second_len) {
+   int result = memcmp(first, second, first_len < second_len ? first_len : second_len);
+   if (result != 0)
+      return result;
+   return first_len < second_len ? -1 : (first_len > second_len ? 1 : 0);
+}
+
+int chariot_index_find_column(unsigned* column, const char* name) {
+   if (strcmp(name, index_column_names[CHARIOT_INDEX_IMAGE]) == 0) {
+      *column = CHARIOT_INDEX_IMAGE;
+      return true;
+   }
+   // a field is found by its symbol, the spellings of the inserters included
+   char symbol[128];
+   Chariot_Metadata_Symbols field;
+   if (strncmp(name, "chariotmeta_", strlen("chariotmeta_")) != 0) {
+      if (strlen("chariotmeta_") + strlen(name) >= sizeof(symbol))
+         return false;
+      strcpy(symbol, "chariotmeta_");
+      strcat(symbol, name);
+      name = symbol;
+   }
+   if (!chariot_metadata_find_field(&field, name))
+      return false;
+   *column = field;
+   return true;
+}
+
+const char* chariot_index_column_name(unsigned column) {
+   return column < CHARIOT_INDEX_COLUMNS ? index_column_names[column] : NULL;
+}
+
+void chariot_index_builder_init(Chariot_Index_builder* builder) {
+   memset(builder, 0, sizeof(Chariot_Index_builder));
+}
+
+void chariot_index_builder_free(Chariot_Index_builder* builder) {
+   for (unsigned column = 0; column < CHARIOT_INDEX_COLUMNS; ++column) {
+      free(builder->columns[column].strings);
+      free(builder->columns[column].offsets);
+      free(builder->columns[column].slots);
+      free(builder->columns[column].codes);
+   }
+   free(builder->digests);
+   memset(builder, 0, sizeof(Chariot_Index_builder));
+}
+
+/* FNV-1a of the value for the hash table of its column */
+static uint32_t
+hash_value(const unsigned char* value, size_t value_len) {
+   uint32_t result = 2166136261U;
+   for (size_t index = 0; index < value_len; ++index)
+      result = (result ^ value[index]) * 16777619U;
+   return result;
+}
+
+static bool
+resize_slots(Chariot_Index_column* column, uint32_t slots_number) {
+   uint32_t* slots = (uint32_t*) malloc(slots_number*sizeof(uint32_t));
+   if (!slots)
+      return false;
+   memset(slots, 0xff, slots_number*sizeof(uint32_t));
+   for (uint32_t value = 0; value < column->values_number; ++value) {
+      uint32_t slot = hash_value(column->strings + column->offsets[value],
+            column->offsets[value+1] - column->offsets[value]) & (slots_number - 1);
+      while (slots[slot] != CHARIOT_INDEX_NONE)
+         slot = (slot + 1) & (slots_number - 1);
+      slots[slot] = value;
+   }
+   free(column->slots);
+   column->slots = slots;
+   column->slots_number = slots_number;
+   return true;
+}
+
+/* code in the order of insertion of the value, which is added if it is new */
+static bool
+add_value(uint32_t* code, Chariot_Index_column* column, const unsigned char* value, size_t value_len) {
+   if (2*((uint64_t) column->values_number + 1) > column->slots_number
+         && !resize_slots(column, column->slots_number ? 2*column->slots_number : 1024))
+      return false;
+   uint32_t slot = hash_value(value, value_len) & (column->slots_number - 1);
+   while (column->slots[slot] != CHARIOT_INDEX_NONE) {
+      uint32_t other = column->slots[slot];
+      if (compare_values(value, value_len, column->strings + column->offsets[other],
+            column->offsets[other+1] - column->offsets[other]) == 0) {
+         *code = other;
+         return true;
+      }
+      slot = (slot + 1) & (column->slots_number - 1);
+   }
+
+   if (column->values_number + 2 > column->values_capacity) {
+      uint32_t new_capacity = column->values_capacity ? 2*column->values_capacity : 1024;
+      uint64_t* new_offsets = (uint64_t*) realloc(column->offsets, new_capacity*sizeof(uint64_t));
+      if (!new_offsets)
+         return false;
+      if (!column->offsets)
+         new_offsets[0] = 0;
+      column->offsets = new_offsets;
+      column->values_capacity = new_capacity;
+   }
+   if (column->strings_size + value_len > column->strings_capacity) {
+      size_t new_capacity = column->strings_capacity ? 2*column->strings_capacity : 65536;
+      while (new_capacity < column->strings_size + value_len)
+         new_capacity *= 2;
+      unsigned char* new_strings = (unsigned char*) realloc(column->strings, new_capacity);
+      if (!new_strings)
+         return false;
+      column->strings = new_strings;
+      column->strings_capacity = new_capacity;
+   }
+   memcpy(column->strings + column->strings_size, value, value_len);
+   column->strings_size += value_len;
+   *code = column->values_number;
+   column->slots[slot] = column->values_number;
+   column->offsets[++column->values_number] = column->strings_size;
+   return true;
+}
+
+static bool
+reserve_images(Chariot_Index_builder* builder) {
+   if (builder->images_number < builder->images_capacity)
+      return true;
+   if (builder->images_capacity >= CHARIOT_INDEX_NONE/2)
+      return false;
+   uint32_t new_capacity = builder->images_capacity ? 2*builder->images_capacity : 1024;
+   for (unsigned column = 0; column < CHARIOT_INDEX_COLUMNS; ++column) {
+      uint32_t* new_codes = (uint32_t*) realloc(builder->columns[column].codes,
+            new_capacity*sizeof(uint32_t));
+      if (!new_codes)
+         return false;
+      builder->columns[column].codes = new_codes;
+   }
+   unsigned char* new_digests = (unsigned char*) realloc(builder->digests,
+         (size_t) new_capacity*CHARIOT_INDEX_DIGEST_SIZE);
+   if (!new_digests)
+      return false;
+   builder->digests = new_digests;
+   builder->images_capacity = new_capacity;
+   return true;
+}
+
+static void
+hex_bytes(char* target, const char* source, size_t len) {
+   for (size_t index = 0; index < len; ++index)
+      sprintf(target + 2*index, "%02x", (unsigned char) source[index]);
+}
+
+/* the text of the format version 1 for a raw value of the format version 2 */
+static bool
+format_v2_value(char** text, size_t* text_len, const Chariot_Metadata_view* view,
+      Chariot_Metadata_Symbols field, const char* value, size_t value_len) {
+   Chariot_Field_encoding encoding = Chariot_Metadata_schema[field].encoding;
+   size_t capacity = 0;
+   if (encoding == CFE_Digest)
+      capacity = 64+strlen(" mainboot")+1;
+   else if (encoding == CFE_Hex32 || encoding == CFE_Word)
+      capacity = 8+1;
+   else if (encoding == CFE_Regions)
+      capacity = value_len/8*18+1;
+   else if (encoding == CFE_Chunks)
+      capacity = 2*value_len+3;
+   else
+      return true;
+   if (encoding == CFE_Regions && value_len == strlen("PT_LOAD")
+         && strncmp(value, "PT_LOAD", value_len) == 0)
+      return true;
+   if (!(*text = (char*) malloc(capacity)))
+      return false;
+   if (encoding == CFE_Digest) {
+      hex_bytes(*text, value, 32);
+      strcpy(*text + 64, " mainboot");
+   }
+   else if (encoding == CFE_Hex32)
+      sprintf(*text, "%08x", (unsigned) view->numbers[field]);
+   else if (encoding == CFE_Word)
+      sprintf(*text, "%u", (unsigned) view->numbers[field]);
+   else if (encoding == CFE_Regions) {
+      size_t text_position = 0;
+      **text = '\0';
+      for (size_t position = 0; position + 8 <= value_len; position += 8)
+         text_position += sprintf(*text + text_position, "%s%08x:%08x", position > 0 ? "," : "",
+               (unsigned) load_u32((const unsigned char*) value + position),
+               (unsigned) load_u32((const unsigned char*) value + position + 4));
+   }
+   else if (value_len >= 4+32) {
+      sprintf(*text, "%08x:", (unsigned) load_u32((const unsigned char*) value));
+      hex_bytes(*text + 9, value + 4, 32);
+      (*text)[9+64] = ':';
+      hex_bytes(*text + 9+64+1, value + 4+32, value_len - (4+32));
+   }
+   else
+      **text = '\0';
+   *text_len = strlen(*text);
+   return true;
+}
+
+int chariot_index_read_entry(Chariot_Index_entry* entry, const char* image_name,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
+   // the values are copied, chariot_metadata_localizations may be released before the entry is added
+   Chariot_Metadata_view view;
+   const char* values[CHARIOT_INDEX_COLUMNS];
+   size_t values_len[CHARIOT_INDEX_COLUMNS];
+   char* texts[CMS_END] = { NULL };
+   int result = false;
+   memset(entry, 0, sizeof(Chariot_Index_entry));
+   if (!chariot_metadata_view_init(&view, chariot_metadata_localizations, error_message))
+      return false;
+   for (unsigned field = 0; field < CMS_END; ++field) {
+      if ((view.compressed_entries >> field) & 1U) {
+         // a compressed field is inflated into its text
+         if (!retrieve_inflated_field(&texts[field], &values_len[field], (Chariot_Metadata_Symbols) field,
+               chariot_metadata_localizations, error_message))
+            goto end;
+         values[field] = texts[field];
+      }
+      else if (!chariot_metadata_view_field(&values[field], &values_len[field], &view,
+            (Chariot_Metadata_Symbols) field)) {
+         values[field] = NULL;
+         continue;
+      }
+      // the values of the format version 2 are indexed as those of the version 1
+      if (view.format_version >= 2) {
+         if (!format_v2_value(&texts[field], &values_len[field], &view, (Chariot_Metadata_Symbols) field,
+               values[field], values_len[field])) {
+            *error_message = "not enough memory";
+            goto end;
+         }
+         if (texts[field])
+            values[field] = texts[field];
+      }
+      if (field != CMS_Codanalys_binary)
+         while (values_len[field] > 0 && values[field][values_len[field]-1] == '\0')
+            --values_len[field];
+   }
+   const uint32_t* sha256 = NULL;
+   if (chariot_metadata_view_mainboot_sha256(&sha256, &view)) {
+      // the digest bytes, sha256[7] is the first word
+      for (int index = 0; index < 8; ++index) {
+         entry->sha256[4*index] = (unsigned char) (sha256[7-index] >> 24);
+         entry->sha256[4*index+1] = (unsigned char) (sha256[7-index] >> 16);
+         entry->sha256[4*index+2] = (unsigned char) (sha256[7-index] >> 8);
+         entry->sha256[4*index+3] = (unsigned char) sha256[7-index];
+      }
+      entry->has_sha256 = true;
+   }
+   values[CHARIOT_INDEX_IMAGE] = image_name;
+   values_len[CHARIOT_INDEX_IMAGE] = strlen(image_name);
+
+   size_t strings_size = 0;
+   for (unsigned column = 0; column < CHARIOT_INDEX_COLUMNS; ++column)
+      if (values[column])
+         strings_size += values_len[column];
+   entry->strings = (char*) malloc(strings_size + 1);
+   if (!entry->strings) {
+      *error_message = "not enough memory";
+      goto end;
+   }
+   strings_size = 0;
+   for (unsigned column = 0; column < CHARIOT_INDEX_COLUMNS; ++column) {
+      entry->has_values[column] = values[column] != NULL;
+      entry->values_len[column] = values[column] ? values_len[column] : 0;
+      memcpy(entry->strings + strings_size, values[column] ? values[column] : "", entry->values_len[column]);
+      strings_size += entry->values_len[column];
+   }
+   result = true;
+
+end:
+   for (unsigned field = 0; field < CMS_END; ++field)
+      free(texts[field]);
+   return result;
+}
+
+void chariot_index_entry_free(Chariot_Index_entry* entry) {
+   free(entry->strings);
+   entry->strings = NULL;
+}
+
+int chariot_index_add_entry(Chariot_Index_builder* builder, const Chariot_Index_entry* entry,
+      const char** error_message) {
+   if (!reserve_images(builder)) {
+      *error_message = "not enough memory";
+      return false;
+   }
+   const unsigned char* value = (const unsigned char*) entry->strings;
+   for (unsigned column = 0; column < CHARIOT_INDEX_COLUMNS; ++column) {
+      uint32_t code = CHARIOT_INDEX_NONE;
+      if (entry->has_values[column] && !add_value(&code, &builder->columns[column], value,
+            entry->values_len[column])) {
+         *error_message = "not enough memory";
+         return false;
+      }
+      builder->columns[column].codes[builder->images_number] = code;
+      value += entry->values_len[column];
+   }
+   if (entry->has_sha256) {
+      unsigned char* digest = builder->digests + (size_t) builder->digests_number*CHARIOT_INDEX_DIGEST_SIZE;
+      memcpy(digest, entry->sha256, 32);
+      store_u32(digest + 32, builder->images_number);
+      ++builder->digests_number;
+   }
+   ++builder->images_number;
+   return true;
+}
+
+int chariot_index_add_metadata(Chariot_Index_builder* builder, const char* image_name,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message) {
+   Chariot_Index_entry entry;
+   if (!chariot_index_read_entry(&entry, image_name, chariot_metadata_localizations, error_message))
+      return false;
+   int result = chariot_index_add_entry(builder, &entry, error_message);
+   chariot_index_entry_free(&entry);
+   return result;
+}
+
+int chariot_index_add_firmware(Chariot_Index_builder* builder, const char* image_name,
+      const char* buffer_exe, size_t buffer_len, const char** error_message) {
+   Elf32_Ehdr elf_header, metadata_elf_header;
+   Elf32_Shdr metadata_section;
+   if (!fill_exe_header(&elf_header, buffer_exe, buffer_len, error_message)
+         || !retrieve_section_header(&metadata_section, &elf_header, buffer_exe, buffer_len, CS_Meta,
+            error_message))
+      return false;
+   if (metadata_section.sh_offset > buffer_len
+         || metadata_section.sh_size > buffer_len - metadata_section.sh_offset) {
+      *error_message = "unable to read the metadata section: buffer is too small";
+      return false;
+   }
+   if (!fill_exe_header(&metadata_elf_header, buffer_exe + metadata_section.sh_offset,
+         metadata_section.sh_size, error_message))
+      return false;
+   Chariot_Metadata_localizations metadata_dict;
+   metadata_dict.valid_entries = 0;
+   metadata_dict.metadata_header = &metadata_elf_header;
+   metadata_dict.metadata_section = &metadata_section;
+   metadata_dict.metadata_buffer_exe = buffer_exe + metadata_section.sh_offset;
+   metadata_dict.metadata_buffer_len = metadata_section.sh_size;
+   return fill_metadata_dict(&metadata_dict, error_message)
+      && chariot_index_add_metadata(builder, image_name, &metadata_dict, error_message);
+}
+
+typedef struct {
+   const unsigned char* value;
+   size_t len;
+   uint32_t code;
+} Sorted_value;
+
+static int
+compare_sorted_values(const void* first, const void* second) {
+   const Sorted_value* first_value = (const Sorted_value*) first;
+   const Sorted_value* second_value = (const Sorted_value*) second;
+   return compare_values(first_value->value, first_value->len, second_value->value, second_value->len);
+}
+
+static int
+compare_digests(const void* first, const void* second) {
+   int result = memcmp(first, second, 32);
+   if (result != 0)
+      return result;
+   uint32_t first_image = load_u32((const unsigned char*) first + 32),
+      second_image = load_u32((const unsigned char*) second + 32);
+   return first_image < second_image ? -1 : (first_image > second_image ? 1 : 0);
+}
+
+static inline uint64_t
+align_up(uint64_t value)
+{  return (value + 7) & ~(uint64_t) 7; }
+
+static bool
+write_padding(FILE* file, uint64_t position) {
+   static const unsigned char zeros[8] = { 0 };
+   size_t len = (size_t) (align_up(position) - position);
+   return fwrite(zeros, 1, len, file) == len;
+}
+
+int chariot_index_write(FILE* file, const Chariot_Index_builder* builder, const char** error_message) {
+   unsigned char header[CHARIOT_INDEX_HEADER_SIZE + CHARIOT_INDEX_COLUMNS*CHARIOT_INDEX_COLUMN_SIZE];
+   uint64_t code_offsets[CHARIOT_INDEX_COLUMNS], value_offsets[CHARIOT_INDEX_COLUMNS],
+      string_offsets[CHARIOT_INDEX_COLUMNS];
+   uint64_t position = sizeof(header);
+   for (unsigned column = 0; column < CHARIOT_INDEX_COLUMNS; ++column) {
+      const Chariot_Index_column* index_column = &builder->columns[column];
+      code_offsets[column] = position;
+      value_offsets[column] = align_up(position + 4*(uint64_t) builder->images_number);
+      string_offsets[column] = value_offsets[column] + 8*((uint64_t) index_column->values_number + 1);
+      position = align_up(string_offsets[column] + index_column->strings_size);
+   }
+   memset(header, 0, sizeof(header));
+   memcpy(header, index_magic, 4);
+   header[4] = CHARIOT_INDEX_VERSION; header[5] = 0;
+   header[6] = CHARIOT_INDEX_HEADER_SIZE; header[7] = 0;
+   store_u32(header + 8, builder->images_number);
+   store_u32(header + 12, CHARIOT_INDEX_COLUMNS);
+   store_u32(header + 16, builder->digests_number);
+   store_u64(header + 24, position);
+   for (unsigned column = 0; column < CHARIOT_INDEX_COLUMNS; ++column) {
+      unsigned char* entry = header + CHARIOT_INDEX_HEADER_SIZE + column*CHARIOT_INDEX_COLUMN_SIZE;
+      store_u32(entry, builder->columns[column].values_number);
+      store_u64(entry + 8, code_offsets[column]);
+      store_u64(entry + 16, value_offsets[column]);
+      store_u64(entry + 24, string_offsets[column]);
+   }
+
+   bool result = false;
+   Sorted_value* sorted = NULL;
+   uint32_t* ranks = NULL;
+   unsigned char* codes = (unsigned char*) malloc(4*(size_t) builder->images_number + 1);
+   unsigned char* digests = (unsigned char*) malloc((size_t) builder->digests_number*CHARIOT_INDEX_DIGEST_SIZE + 1);
+   *error_message = "not enough memory";
+   if (!codes || !digests)
+      goto end;
+   *error_message = "unable to write the index";
+   if (fwrite(header, 1, sizeof(header), file) != sizeof(header))
+      goto end;
+   position = sizeof(header);
+   for (unsigned column = 0; column < CHARIOT_INDEX_COLUMNS; ++column) {
+      const Chariot_Index_column* index_column = &builder->columns[column];
+      uint32_t values_number = index_column->values_number;
+      free(sorted);
+      free(ranks);
+      sorted = (Sorted_value*) malloc((values_number+1)*sizeof(Sorted_value));
+      ranks = (uint32_t*) malloc((values_number+1)*sizeof(uint32_t));
+      if (!sorted || !ranks) {
+         *error_message = "not enough memory";
+         goto end;
+      }
+      for (uint32_t code = 0; code < values_number; ++code) {
+         sorted[code].value = index_column->strings + index_column->offsets[code];
+         sorted[code].len = index_column->offsets[code+1] - index_column->offsets[code];
+         sorted[code].code = code;
+      }
+      qsort(sorted, values_number, sizeof(Sorted_value), compare_sorted_values);
+      for (uint32_t rank = 0; rank < values_number; ++rank)
+         ranks[sorted[rank].code] = rank;
+
+      // the codes of the images are the ranks of their values in the dictionary
+      for (uint32_t image = 0; image < builder->images_number; ++image) {
+         uint32_t code = index_column->codes[image];
+         store_u32(codes + 4*(size_t) image, code == CHARIOT_INDEX_NONE ? code : ranks[code]);
+      }
+      position += 4*(uint64_t) builder->images_number;
+      if (fwrite(codes, 4, builder->images_number, file) != builder->images_number
+            || !write_padding(file, position))
+         goto end;
+      position = align_up(position);
+      uint64_t string_offset = 0;
+      unsigned char offset[8];
+      for (uint32_t rank = 0; rank <= values_number; ++rank) {
+         store_u64(offset, string_offset);
+         if (fwrite(offset, 1, 8, file) != 8)
+            goto end;
+         if (rank < values_number)
+            string_offset += sorted[rank].len;
+      }
+      for (uint32_t rank = 0; rank < values_number; ++rank)
+         if (fwrite(sorted[rank].value, 1, sorted[rank].len, file) != sorted[rank].len)
+            goto end;
+      position += 8*((uint64_t) values_number + 1) + string_offset;
+      if (!write_padding(file, position))
+         goto end;
+      position = align_up(position);
+   }
+
+   memcpy(digests, builder->digests, (size_t) builder->digests_number*CHARIOT_INDEX_DIGEST_SIZE);
+   qsort(digests, builder->digests_number, CHARIOT_INDEX_DIGEST_SIZE, compare_digests);
+   if (fwrite(digests, CHARIOT_INDEX_DIGEST_SIZE, builder->digests_number, file) != builder->digests_number)
+      goto end;
+   result = true;
+
+end:
+   free(sorted);
+   free(ranks);
+   free(codes);
+   free(digests);
+   return result;
+}
+
+static inline const unsigned char*
+column_entry(const Chariot_Index* index, unsigned column) {
+   return index->columns + column*CHARIOT_INDEX_COLUMN_SIZE;
+}
+
+int chariot_index_open(Chariot_Index* result, const char* buffer, size_t len,
+      const char** error_message) {
+   const unsigned char* start = (const unsigned char*) buffer;
+   if (len < CHARIOT_INDEX_HEADER_SIZE || memcmp(start, index_magic, 4) != 0) {
+      *error_message = "invalid metadata index";
+      return false;
+   }
+   uint32_t version = start[4] | (start[5] << 8), header_size = start[6] | (start[7] << 8);
+   if (version != CHARIOT_INDEX_VERSION) {
+      *error_message = "unsupported version of metadata index";
+      return false;
+   }
+   result->start = start;
+   result->len = len;
+   result->images_number = load_u32(start + 8);
+   result->columns_number = load_u32(start + 12);
+   result->digests_number = load_u32(start + 16);
+   uint64_t digests_offset = load_u64(start + 24);
+   if (header_size < CHARIOT_INDEX_HEADER_SIZE || result->columns_number < CHARIOT_INDEX_COLUMNS
+         || header_size + CHARIOT_INDEX_COLUMN_SIZE*(uint64_t) result->columns_number > len
+         || digests_offset > len
+         || CHARIOT_INDEX_DIGEST_SIZE*(uint64_t) result->digests_number > len - digests_offset) {
+      *error_message = "metadata index is truncated";
+      return false;
+   }
+   result->columns = start + header_size;
+   result->digests = start + digests_offset;
+
+   // the value offsets are checked once there, so that the accesses only check the codes
+   for (unsigned column = 0; column < result->columns_number; ++column) {
+      const unsigned char* entry = column_entry(result, column);
+      uint32_t values_number = load_u32(entry);
+      uint64_t codes_offset = load_u64(entry + 8), values_offset = load_u64(entry + 16),
+         strings_offset = load_u64(entry + 24);
+      if (codes_offset > len || 4*(uint64_t) result->images_number > len - codes_offset
+            || values_offset > len || 8*((uint64_t) values_number + 1) > len - values_offset
+            || strings_offset > len) {
+         *error_message = "metadata index is truncated";
+         return false;
+      }
+      uint64_t previous = 0;
+      for (uint32_t rank = 0; rank <= values_number; ++rank) {
+         uint64_t offset = load_u64(start + values_offset + 8*(uint64_t) rank);
+         if (offset < previous || offset > len - strings_offset) {
+            *error_message = "metadata index has an invalid dictionary";
+            return false;
+         }
+         previous = offset;
+      }
+   }
+   return true;
+}
+
+uint32_t chariot_index_values_number(const Chariot_Index* index, unsigned column) {
+   return column < index->columns_number ? load_u32(column_entry(index, column)) : 0;
+}
+
+int chariot_index_value(const char** value, size_t* value_len, const Chariot_Index* index,
+      unsigned column, uint32_t code) {
+   if (code >= chariot_index_values_number(index, column))
+      return false;
+   const unsigned char* entry = column_entry(index, column);
+   const unsigned char* offsets = index->start + load_u64(entry + 16) + 8*(uint64_t) code;
+   uint64_t offset = load_u64(offsets);
+   *value = (const char*) index->start + load_u64(entry + 24) + offset;
+   *value_len = (size_t) (load_u64(offsets + 8) - offset);
+   return true;
+}
+
+uint32_t chariot_index_code(const Chariot_Index* index, unsigned column, uint32_t image) {
+   if (column >= index->columns_number || image >= index->images_number)
+      return CHARIOT_INDEX_NONE;
+   uint32_t code = load_u32(index->start + load_u64(column_entry(index, column) + 8) + 4*(uint64_t) image);
+   return code < chariot_index_values_number(index, column) ? code : CHARIOT_INDEX_NONE;
+}
+
+int chariot_index_find_value(uint32_t* code, const Chariot_Index* index, unsigned column,
+      const char* value, size_t value_len) {
+   uint32_t low = 0, high = chariot_index_values_number(index, column);
+   while (low < high) {
+      uint32_t middle = low + (high - low)/2;
+      const char* middle_value;
+      size_t middle_len;
+      chariot_index_value(&middle_value, &middle_len, index, column, middle);
+      int comparison = compare_values((const unsigned char*) middle_value, middle_len,
+            (const unsigned char*) value, value_len);
+      if (comparison == 0) {
+         *code = middle;
+         return true;
+      }
+      if (comparison < 0)
+         low = middle + 1;
+      else
+         high = middle;
+   }
+   return false;
+}
+
+uint32_t chariot_index_select(uint32_t* images, uint32_t capacity, const Chariot_Index* index,
+      unsigned column, uint32_t code) {
+   if (column >= index->columns_number)
+      return 0;
+   // a sequential scan of the code column
+   const unsigned char* codes = index->start + load_u64(column_entry(index, column) + 8);
+   uint32_t result = 0;
+   for (uint32_t image = 0; image < index->images_number; ++image)
+      if (load_u32(codes + 4*(size_t) image) == code) {
+         if (result < capacity)
+            images[result] = image;
+         ++result;
+      }
+   return result;
+}
+
+void chariot_index_find_digest(uint32_t* first, uint32_t* number, const Chariot_Index* index,
+      const uint32_t sha256[8]) {
+   unsigned char digest[32];
+   for (int word = 0; word < 8; ++word)
+      for (int byte = 0; byte < 4; ++byte)
+         digest[4*word + byte] = (unsigned char) (sha256[7-word] >> (24 - 8*byte));
+   // lower bound, then upper bound of the digest
+   uint32_t low = 0, high = index->digests_number;
+   while (low < high) {
+      uint32_t middle = low + (high - low)/2;
+      if (memcmp(index->digests + (size_t) middle*CHARIOT_INDEX_DIGEST_SIZE, digest, 32) < 0)
+         low = middle + 1;
+      else
+         high = middle;
+   }
+   *first = low;
+   high = index->digests_number;
+   while (low < high) {
+      uint32_t middle = low + (high - low)/2;
+      if (memcmp(index->digests + (size_t) middle*CHARIOT_INDEX_DIGEST_SIZE, digest, 32) <= 0)
+         low = middle + 1;
+      else
+         high = middle;
+   }
+   *number = low - *first;
+}
+
+uint32_t chariot_index_digest_image(const Chariot_Index* index, uint32_t position) {
+   return position < index->digests_number
+      ? load_u32(index->digests + (size_t) position*CHARIOT_INDEX_DIGEST_SIZE + 32) : CHARIOT_INDEX_NONE;
+}
@@ -0,0 +1,170 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+/*
+ * Fleet index of the CHARIOT metadata of many firmwares: a columnar file, read in
+ * place on a mapped file, with one column per Chariot_Metadata_Symbols field plus
+ * the image names and a sorted column of the mainboot sha256 digests. The values
+ * of a column are dictionary-encoded: every distinct value is stored once, the
+ * values are sorted to be found by binary search and every image has the code (the
+ * rank) of its value in each column.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "chariot_extractelf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Format, every fixed size number is a little endian integer:
+ *   "CHIX" version:16 header_size:16 images_number:32 columns_number:32
+ *   digests_number:32 reserved:32 digests_offset:64 reserved:64
+ *   columns: columns_number entries of 32 bytes
+ *      values_number:32 reserved:32 codes_offset:64 values_offset:64 strings_offset:64
+ *   for each column:
+ *      codes: images_number codes of 32 bits, CHARIOT_INDEX_NONE for an absent field
+ *      values: values_number+1 offsets of 64 bits in the strings, sorted by value
+ *      strings: the values, without separator
+ *   digests: digests_number entries of 36 bytes, the 32 bytes of a mainboot sha256
+ *      then the image of 32 bits, sorted by digest and by image
+ * Offsets are relative to the start of the index. The values of the firmware path,
+ * of the license and of the code analysis data are stored without their
+ * CHARIOTMETA_... prefix and the texts without their final '\0'. The raw values of
+ * the metadata format version 2 are stored as the texts of the version 1, the format
+ * version itself in decimal.
+ */
+#define CHARIOT_INDEX_VERSION 2
+#define CHARIOT_INDEX_HEADER_SIZE 40
+#define CHARIOT_INDEX_COLUMN_SIZE 32
+#define CHARIOT_INDEX_DIGEST_SIZE 36
+#define CHARIOT_INDEX_NONE 0xffffffffU
+
+// the columns are the Chariot_Metadata_Symbols then the image names
+#define CHARIOT_INDEX_IMAGE CMS_END
+#define CHARIOT_INDEX_COLUMNS (CMS_END+1)
+
+typedef struct {
+   unsigned char* strings;
+   size_t strings_size, strings_capacity;
+   uint64_t* offsets; // values_number+1 offsets in strings, in the order of insertion
+   uint32_t values_number, values_capacity;
+   uint32_t* slots; // hash table of the values, CHARIOT_INDEX_NONE for an empty slot
+   uint32_t slots_number;
+   uint32_t* codes; // value of every image in the order of insertion
+} Chariot_Index_column;
+
+typedef struct {
+   Chariot_Index_column columns[CHARIOT_INDEX_COLUMNS];
+   uint32_t images_number, images_capacity;
+   unsigned char* digests;
+   uint32_t digests_number;
+} Chariot_Index_builder;
+
+void chariot_index_builder_init(Chariot_Index_builder* builder);
+void chariot_index_builder_free(Chariot_Index_builder* builder);
+
+/* the values of an image in the columns, copied to be added after the release of its metadata */
+typedef struct {
+   char* strings; // the values of the columns one after the other
+   size_t values_len[CHARIOT_INDEX_COLUMNS];
+   bool has_values[CHARIOT_INDEX_COLUMNS];
+   unsigned char sha256[32];
+   bool has_sha256;
+} Chariot_Index_entry;
+
+/* adds the fields of the metadata found by fill_metadata_dict under the name image_name */
+int chariot_index_add_metadata(Chariot_Index_builder* builder, const char* image_name,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message);
+/* chariot_index_add_metadata in two steps, the entries being read in any order and in parallel */
+int chariot_index_read_entry(Chariot_Index_entry* entry, const char* image_name,
+      const Chariot_Metadata_localizations* chariot_metadata_localizations, const char** error_message);
+int chariot_index_add_entry(Chariot_Index_builder* builder, const Chariot_Index_entry* entry,
+      const char** error_message);
+void chariot_index_entry_free(Chariot_Index_entry* entry);
+/* finds the metadata of the elf firmware in buffer_exe and adds them */
+int chariot_index_add_firmware(Chariot_Index_builder* builder, const char* image_name,
+      const char* buffer_exe, size_t buffer_len, const char** error_message);
+/* sorts the dictionaries and the digests and writes the index */
+int chariot_index_write(FILE* file, const Chariot_Index_builder* builder, const char** error_message);
+
+typedef struct {
+   const unsigned char* start;
+   size_t len;
+   uint32_t images_number;
+   uint32_t columns_number;
+   const unsigned char* columns;
+   uint32_t digests_number;
+   const unsigned char* digests;
+} Chariot_Index;
+
+/* checks the header and the bounds of every column of the len bytes at buffer */
+int chariot_index_open(Chariot_Index* result, const char* buffer, size_t len,
+      const char** error_message);
+/* column of a field name like "firmware_license" or "chariotmeta_firmware_license", or "image" */
+int chariot_index_find_column(unsigned* column, const char* name);
+const char* chariot_index_column_name(unsigned column);
+
+uint32_t chariot_index_values_number(const Chariot_Index* index, unsigned column);
+/* value of rank code in the column, it points into the index */
+int chariot_index_value(const char** value, size_t* value_len, const Chariot_Index* index,
+      unsigned column, uint32_t code);
+/* code of the value of image in the column, CHARIOT_INDEX_NONE if the field is absent */
+uint32_t chariot_index_code(const Chariot_Index* index, unsigned column, uint32_t image);
+/* binary search of a value in the dictionary of the column, returns false if it is absent */
+int chariot_index_find_value(uint32_t* code, const Chariot_Index* index, unsigned column,
+      const char* value, size_t value_len);
+/*
+ * stores in images (at most capacity of them) the images whose column has the value code
+ * and returns their number, which may be larger than capacity
+ */
+uint32_t chariot_index_select(uint32_t* images, uint32_t capacity, const Chariot_Index* index,
+      unsigned column, uint32_t code);
+/* range [*first, *first + *number) of the digest column with the mainboot sha256 */
+void chariot_index_find_digest(uint32_t* first, uint32_t* number, const Chariot_Index* index,
+      const uint32_t sha256[8]);
+uint32_t chariot_index_digest_image(const Chariot_Index* index, uint32_t position);
+
+#ifdef __cplusplus
+}
+#endif
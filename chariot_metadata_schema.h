@@ -0,0 +1,117 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+/*
+ * Schema of the fields of the .chariotmeta.rodata section: the only list of these
+ * fields, expanded by chariot_extractelf.h into the Chariot_Metadata_Symbols enum,
+ * the lookup of the symbols, the checks and the typed accessors of the metadata view
+ * and by the inserters into the symbols, the encodings and the prefixes they write.
+ *
+ * CHARIOT_METADATA_FIELDS(FIELD) calls FIELD(ID, NAME, SYMBOL, ENCODING, SIZE, PRESENCE, PREFIX)
+ * once per field in the order of the enum, which is also the order of the columns
+ * of chariot_index.h, so that a new field is appended.
+ *  - CMS_ID is the enumerator of the field,
+ *  - NAME is the field name, also accepted as the symbol chariotmeta_NAME,
+ *  - SYMBOL is the symbol written by the inserters,
+ *  - SIZE is the size in bytes of the content in the format version 1, 0 for a
+ *    variable size,
+ *  - PREFIX is written before a text and removed by the readers ("" if none).
+ *
+ * The format version 2, marked by chariotmeta_format_version, stores the numbers
+ * and the digests as raw little-endian words and bytes instead of hexadecimal digits,
+ * to be read by plain loads in half of the size. A firmware without this symbol
+ * has the format version 1.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef enum {
+   CFE_Digest, // 64 hexadecimal digits and " mainboot", 32 bytes in the format version 2
+   CFE_Hex32, // 8 hexadecimal digits, 4 bytes little-endian in the format version 2
+   CFE_Word, // 4 bytes little-endian in every format version
+   CFE_Chars, // characters without a final '\0'
+   CFE_Text, // characters with their final '\0' in the size of the symbol
+   CFE_Binary, // raw bytes aligned on 4 bytes
+   CFE_Regions, // "PT_LOAD" or "oooooooo:ssssssss,...",
+                // 8 bytes (offset, size) per region in the format version 2
+   CFE_Chunks // see Chariot_Mainboot_chunks
+} Chariot_Field_encoding;
+
+typedef enum { CFP_Required, CFP_Optional } Chariot_Field_presence;
+
+#define CHARIOT_METADATA_FIELDS(FIELD) \
+   FIELD(Mainboot_sha256, mainboot_sha256, "chariotmeta_mainboot_sha256", CFE_Digest, 73, CFP_Required, "") \
+   FIELD(Format_typeinfo, format_typeinfo, "chariotmeta_format_typeinfo", CFE_Chars, 0, CFP_Required, "") \
+   FIELD(Mainboot_offsetnum, mainboot_offsetnum, "chariotmeta_mainboot_offsetnum", CFE_Hex32, 8, CFP_Required, "") \
+   FIELD(Mainboot_sizesnum, mainboot_sizesnum, "chariotmeta_mainboot_sizenum", CFE_Hex32, 8, CFP_Required, "") \
+   FIELD(Extraboot_sha256, extraboot_sha256, "chariotmeta_extraboot_sha256", CFE_Text, 0, CFP_Optional, "") \
+   FIELD(Extraboot_offsetnum, extraboot_offsetnum, "chariotmeta_extraboot_offsetnum", CFE_Hex32, 8, CFP_Optional, "") \
+   FIELD(Extraboot_sizenum, extraboot_sizenum, "chariotmeta_extraboot_sizenum", CFE_Hex32, 8, CFP_Optional, "") \
+   FIELD(Extraboot_typeinfo, extraboot_typeinfo, "chariotmeta_extraboot_typeinfo", CFE_Chars, 0, CFP_Optional, "") \
+   FIELD(Codanalys_typeinfo, codanalys_typeinfo, "chariotmeta_codanalys_typeinfo", CFE_Chars, 0, CFP_Optional, "") \
+   FIELD(Version_data, version_data, "chariotmeta_version_data", CFE_Text, 0, CFP_Required, "") \
+   FIELD(Firmware_path, firmware_path, "chariotmeta_firmware_path", CFE_Text, 0, CFP_Optional, \
+         "CHARIOTMETA_FIRMWARE_PATH=") \
+   FIELD(Firmware_license, firmware_license, "chariotmeta_firmware_license", CFE_Text, 0, CFP_Optional, \
+         "CHARIOTMETA_FIRMWARE_LICENSE=") \
+   FIELD(Codanalys_data, codanalys_data, "chariotmeta_codanalys_data", CFE_Text, 0, CFP_Optional, \
+         "CHARIOTMETA_CODANALYS_DATA= ") \
+   FIELD(Mainboot_regions, mainboot_regions, "chariotmeta_mainboot_regions", CFE_Regions, 0, CFP_Optional, "") \
+   FIELD(Mainboot_blake3, mainboot_blake3, "chariotmeta_mainboot_blake3", CFE_Digest, 73, CFP_Optional, "") \
+   FIELD(Mainboot_crc32c, mainboot_crc32c, "chariotmeta_mainboot_crc32c", CFE_Hex32, 8, CFP_Optional, "") \
+   FIELD(Mainboot_chunks, mainboot_chunks, "chariotmeta_mainboot_chunks", CFE_Chunks, 0, CFP_Optional, "") \
+   FIELD(Codanalys_binary, codanalys_binary, "chariotmeta_codanalys_binary", CFE_Binary, 0, CFP_Optional, "") \
+   FIELD(Format_version, format_version, "chariotmeta_format_version", CFE_Word, 4, CFP_Optional, "")
+
+/*
+ * Hash of the symbols for chariot_metadata_find_field. chariot_symbolslots_gen.c writes
+ * at build time the table of the slots of the 2*CMS_END spellings (chariotmeta_NAME and
+ * SYMBOL) with CHARIOT_SYMBOL_SEED into chariot_symbol_slots.h, and fails if two
+ * different spellings share a slot, with a seed to use instead.
+ */
+#define CHARIOT_SYMBOL_SLOTS_NUMBER 256
+#define CHARIOT_SYMBOL_SEED 0
+
+static inline uint32_t
+chariot_hash_symbol(const char* symbol, uint32_t seed) { // FNV-1a
+   uint32_t result = 2166136261U ^ (seed * 0x9e3779b9U);
+   for (; *symbol; ++symbol)
+      result = (result ^ (unsigned char) *symbol) * 16777619U;
+   return result ^ (result >> 15);
+}
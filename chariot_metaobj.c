@@ -0,0 +1,410 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "chariot_metaobj.h"
+#include "chariot_zlib.h"
+
+#define METAOBJ_EHDR_SIZE 52
+#define METAOBJ_SHDR_SIZE 40
+#define METAOBJ_SYM_SIZE 16
+#define METAOBJ_CHDR_SIZE 12
+#define METAOBJ_SECTION_ALIGN 16
+#define METAOBJ_COPY_SIZE 65536
+
+// defined in chariot_extractelf.c
+extern const char* Chariot_Section_names[];
+
+// sections of the object: null, the CHARIOT section, .symtab, .strtab, .shstrtab
+// and, with is_compressed fields, the SHF_COMPRESSED CHARIOT section
+enum { MOS_Null, MOS_Data, MOS_Symtab, MOS_Strtab, MOS_Shstrtab, MOS_Compressed, MOS_END };
+
+static const char metaobj_table_names[] = ".symtab\0.strtab\0.shstrtab";
+
+typedef struct {
+   Elf32_Word data_size, compressed_size, strtab_size, shstrtab_size;
+   Elf32_Word section_name_offsets[MOS_END];
+   Elf32_Off data_offset, compressed_offset, symtab_offset, strtab_offset, shstrtab_offset, shdr_offset;
+   Elf32_Half sections_number;
+   size_t total_size;
+} Metaobj_layout;
+
+static inline Elf32_Word
+align_up(Elf32_Word value, Elf32_Word align)
+{  return align > 1 ? (value + align - 1) & ~(align - 1) : value; }
+
+static bool
+compute_layout(Metaobj_layout* layout, const Chariot_Metaobj_description* description) {
+   Elf32_Word data_size = 0, strtab_size = 1;
+   bool has_compressed_fields = false;
+   if ((description->section != CS_Meta && description->section != CS_Extra)
+         || description->fields_number > (0xffffffffU - METAOBJ_EHDR_SIZE)/METAOBJ_SYM_SIZE - 2
+         || description->compressed_section_len > 0x7fffffff)
+      return false;
+   for (size_t field_index = 0; field_index < description->fields_number; ++field_index) {
+      const Chariot_Metaobj_field* field = &description->fields[field_index];
+      if (!field->name || !field->name[0] || field->size > field->content_len
+            || (field->content_len && !field->content && !field->content_file)
+            || (field->is_compressed && field->content_len && !field->content)
+            || (field->align & (field->align - 1)) || field->align > METAOBJ_SECTION_ALIGN)
+         return false;
+      size_t name_len = strlen(field->name) + 1;
+      if (data_size + (uint64_t) field->align + field->content_len > 0x7fffffff
+            || strtab_size + (uint64_t) name_len > 0x7fffffff)
+         return false;
+      if (field->is_compressed)
+         has_compressed_fields = true;
+      else
+         data_size = align_up(data_size, field->align) + field->content_len;
+      strtab_size += name_len;
+   }
+   if (has_compressed_fields != (description->compressed_section != NULL))
+      return false;
+   // .shstrtab is "\0" then the name of the CHARIOT section then metaobj_table_names
+   Elf32_Word section_name_len = strlen(Chariot_Section_names[description->section]) + 1;
+   layout->section_name_offsets[MOS_Null] = 0;
+   layout->section_name_offsets[MOS_Data] = 1;
+   layout->section_name_offsets[MOS_Symtab] = 1 + section_name_len;
+   layout->section_name_offsets[MOS_Strtab] = layout->section_name_offsets[MOS_Symtab] + 8;
+   layout->section_name_offsets[MOS_Shstrtab] = layout->section_name_offsets[MOS_Strtab] + 8;
+   layout->shstrtab_size = 1 + section_name_len + sizeof(metaobj_table_names);
+
+   layout->data_size = data_size;
+   layout->compressed_size = (Elf32_Word) description->compressed_section_len;
+   layout->strtab_size = strtab_size;
+   layout->sections_number = has_compressed_fields ? MOS_END : MOS_Compressed;
+   layout->data_offset = align_up(METAOBJ_EHDR_SIZE, METAOBJ_SECTION_ALIGN);
+   layout->compressed_offset = align_up(layout->data_offset + data_size, 4);
+   if ((uint64_t) layout->compressed_offset + layout->compressed_size > 0x7fffffff)
+      return false;
+   layout->symtab_offset = align_up(layout->compressed_offset + layout->compressed_size, 4);
+   layout->strtab_offset = layout->symtab_offset
+      + (Elf32_Word) (description->fields_number + 2)*METAOBJ_SYM_SIZE;
+   layout->shstrtab_offset = layout->strtab_offset + strtab_size;
+   layout->shdr_offset = align_up(layout->shstrtab_offset + layout->shstrtab_size, 4);
+   layout->total_size = (size_t) layout->shdr_offset + layout->sections_number*METAOBJ_SHDR_SIZE;
+   return layout->total_size <= 0x7fffffff;
+}
+
+size_t chariot_metaobj_size(const Chariot_Metaobj_description* description) {
+   Metaobj_layout layout;
+   return compute_layout(&layout, description) ? layout.total_size : 0;
+}
+
+static void
+store_half(char* target, Elf32_Half value, bool is_big_endian) {
+   unsigned char* bytes = (unsigned char*) target;
+   bytes[is_big_endian ? 1 : 0] = (unsigned char) value;
+   bytes[is_big_endian ? 0 : 1] = (unsigned char) (value >> 8);
+}
+
+static void
+store_word(char* target, Elf32_Word value, bool is_big_endian) {
+   unsigned char* bytes = (unsigned char*) target;
+   for (int index = 0; index < 4; ++index)
+      bytes[is_big_endian ? 3-index : index] = (unsigned char) (value >> (8*index));
+}
+
+static void
+store_section_header(char* target, Elf32_Word name, Elf32_Word type, Elf32_Word flags,
+      Elf32_Off offset, Elf32_Word size, Elf32_Word link, Elf32_Word info,
+      Elf32_Word addralign, Elf32_Word entsize, bool is_big_endian) {
+   store_word(target, name, is_big_endian);
+   store_word(target + 4, type, is_big_endian);
+   store_word(target + 8, flags, is_big_endian);
+   store_word(target + 12, 0 /* sh_addr */, is_big_endian);
+   store_word(target + 16, offset, is_big_endian);
+   store_word(target + 20, size, is_big_endian);
+   store_word(target + 24, link, is_big_endian);
+   store_word(target + 28, info, is_big_endian);
+   store_word(target + 32, addralign, is_big_endian);
+   store_word(target + 36, entsize, is_big_endian);
+}
+
+static void
+store_symbol(char* target, Elf32_Word name, Elf32_Addr value, Elf32_Word size,
+      unsigned char info, Elf32_Half shndx, bool is_big_endian) {
+   store_word(target, name, is_big_endian);
+   store_word(target + 4, value, is_big_endian);
+   store_word(target + 8, size, is_big_endian);
+   target[12] = (char) info;
+   target[13] = 0;
+   store_half(target + 14, shndx, is_big_endian);
+}
+
+/*
+ * Stores the elf header in head (data_offset bytes) and the symbols, the string
+ * tables and the section headers in tail (total_size - symtab_offset bytes).
+ */
+static void
+store_object_tables(char* head, char* tail, const Metaobj_layout* layout,
+      const Chariot_Metaobj_description* description) {
+   bool is_big_endian = description->is_big_endian;
+   memset(head, 0, layout->data_offset);
+   memset(tail, 0, layout->total_size - layout->symtab_offset);
+
+   // elf header of a relocatable object
+   memcpy(head, "\177ELF", 4);
+   head[4] = 1; // ELFCLASS32
+   head[5] = is_big_endian ? 2 : 1; // ELFDATA2MSB : ELFDATA2LSB
+   head[6] = 1; // EV_CURRENT
+   store_half(head + 16, 1 /* ET_REL */, is_big_endian);
+   store_half(head + 18, description->machine, is_big_endian);
+   store_word(head + 20, 1 /* EV_CURRENT */, is_big_endian);
+   store_word(head + 32, layout->shdr_offset, is_big_endian);
+   store_word(head + 36, description->flags, is_big_endian);
+   store_half(head + 40, METAOBJ_EHDR_SIZE, is_big_endian);
+   store_half(head + 46, METAOBJ_SHDR_SIZE, is_big_endian);
+   store_half(head + 48, layout->sections_number, is_big_endian);
+   store_half(head + 50, MOS_Shstrtab, is_big_endian);
+
+   // the symbols of the fields and their names; symbol 1 is the local section symbol
+   char* symbols = tail;
+   char* strings = tail + (layout->strtab_offset - layout->symtab_offset);
+   store_symbol(symbols + METAOBJ_SYM_SIZE, 0, 0, 0, 3 /* STB_LOCAL, STT_SECTION */, MOS_Data,
+         is_big_endian);
+   // the offsets of the compressed fields are those in the inflated content
+   Elf32_Word field_offset = 0, inflated_offset = 0, name_offset = 1;
+   for (size_t field_index = 0; field_index < description->fields_number; ++field_index) {
+      const Chariot_Metaobj_field* field = &description->fields[field_index];
+      size_t name_len = strlen(field->name) + 1;
+      Elf32_Word* offset = field->is_compressed ? &inflated_offset : &field_offset;
+      *offset = align_up(*offset, field->align);
+      memcpy(strings + name_offset, field->name, name_len);
+      store_symbol(symbols + (field_index+2)*METAOBJ_SYM_SIZE, name_offset, *offset,
+            field->size, 0x11 /* STB_GLOBAL, STT_OBJECT */,
+            field->is_compressed ? MOS_Compressed : MOS_Data, is_big_endian);
+      *offset += field->content_len;
+      name_offset += name_len;
+   }
+   char* section_names = tail + (layout->shstrtab_offset - layout->symtab_offset);
+   strcpy(section_names + layout->section_name_offsets[MOS_Data],
+         Chariot_Section_names[description->section]);
+   memcpy(section_names + layout->section_name_offsets[MOS_Symtab], metaobj_table_names,
+         sizeof(metaobj_table_names));
+
+   char* section_headers = tail + (layout->shdr_offset - layout->symtab_offset);
+   store_section_header(section_headers + MOS_Data*METAOBJ_SHDR_SIZE,
+         layout->section_name_offsets[MOS_Data], 1 /* SHT_PROGBITS */, 2 /* SHF_ALLOC */,
+         layout->data_offset, layout->data_size, 0, 0, METAOBJ_SECTION_ALIGN, 0, is_big_endian);
+   store_section_header(section_headers + MOS_Symtab*METAOBJ_SHDR_SIZE,
+         layout->section_name_offsets[MOS_Symtab], 2 /* SHT_SYMTAB */, 0,
+         layout->symtab_offset, layout->strtab_offset - layout->symtab_offset, MOS_Strtab,
+         2 /* first global symbol */, 4, METAOBJ_SYM_SIZE, is_big_endian);
+   store_section_header(section_headers + MOS_Strtab*METAOBJ_SHDR_SIZE,
+         layout->section_name_offsets[MOS_Strtab], 3 /* SHT_STRTAB */, 0,
+         layout->strtab_offset, layout->strtab_size, 0, 0, 1, 0, is_big_endian);
+   store_section_header(section_headers + MOS_Shstrtab*METAOBJ_SHDR_SIZE,
+         layout->section_name_offsets[MOS_Shstrtab], 3 /* SHT_STRTAB */, 0,
+         layout->shstrtab_offset, layout->shstrtab_size, 0, 0, 1, 0, is_big_endian);
+   if (layout->sections_number > MOS_Compressed)
+      store_section_header(section_headers + MOS_Compressed*METAOBJ_SHDR_SIZE,
+            layout->section_name_offsets[MOS_Data], 1 /* SHT_PROGBITS */, 0x800 /* SHF_COMPRESSED */,
+            layout->compressed_offset, layout->compressed_size, 0, 0, 4, 0, is_big_endian);
+}
+
+int chariot_metaobj_write(char* buffer, size_t buffer_len,
+      const Chariot_Metaobj_description* description, const char** error_message) {
+   Metaobj_layout layout;
+   if (!compute_layout(&layout, description)) {
+      *error_message = "invalid description of the metadata object";
+      return false;
+   }
+   if (buffer_len < layout.total_size) {
+      *error_message = "unable to write the metadata object: buffer is too small";
+      return false;
+   }
+   store_object_tables(buffer, buffer + layout.symtab_offset, &layout, description);
+   char* data = buffer + layout.data_offset;
+   memset(data, 0, layout.symtab_offset - layout.data_offset);
+   Elf32_Word field_offset = 0;
+   for (size_t field_index = 0; field_index < description->fields_number; ++field_index) {
+      const Chariot_Metaobj_field* field = &description->fields[field_index];
+      if (field->is_compressed)
+         continue;
+      field_offset = align_up(field_offset, field->align);
+      if (field->content)
+         memcpy(data + field_offset, field->content, field->content_len);
+      else if (field->content_len
+            && fread(data + field_offset, 1, field->content_len, field->content_file)
+               != field->content_len) {
+         *error_message = "unable to read the content of a field";
+         return false;
+      }
+      field_offset += field->content_len;
+   }
+   if (description->compressed_section)
+      memcpy(buffer + layout.compressed_offset, description->compressed_section, layout.compressed_size);
+   return true;
+}
+
+static bool
+write_zeros(FILE* file, size_t len) {
+   static const char zeros[METAOBJ_SECTION_ALIGN] = { 0 };
+   return fwrite(zeros, 1, len, file) == len;
+}
+
+int chariot_metaobj_write_file(FILE* file, const Chariot_Metaobj_description* description,
+      const char** error_message) {
+   Metaobj_layout layout;
+   if (!compute_layout(&layout, description)) {
+      *error_message = "invalid description of the metadata object";
+      return false;
+   }
+   char* head = (char*) malloc(layout.data_offset + layout.total_size - layout.symtab_offset);
+   char* copy_buffer = (char*) malloc(METAOBJ_COPY_SIZE);
+   if (!head || !copy_buffer) {
+      free(head);
+      free(copy_buffer);
+      *error_message = "unable to allocate the tables of the metadata object";
+      return false;
+   }
+   char* tail = head + layout.data_offset;
+   store_object_tables(head, tail, &layout, description);
+
+   bool result = fwrite(head, 1, layout.data_offset, file) == layout.data_offset;
+   *error_message = "unable to write the metadata object";
+   Elf32_Word field_offset = 0;
+   for (size_t field_index = 0; result && field_index < description->fields_number; ++field_index) {
+      const Chariot_Metaobj_field* field = &description->fields[field_index];
+      if (field->is_compressed)
+         continue;
+      Elf32_Word aligned_offset = align_up(field_offset, field->align);
+      result = write_zeros(file, aligned_offset - field_offset);
+      field_offset = aligned_offset;
+      if (field->content)
+         result = result && fwrite(field->content, 1, field->content_len, file) == field->content_len;
+      else {
+         // the payload is copied by blocks, as is
+         Elf32_Word left = field->content_len;
+         while (result && left > 0) {
+            size_t block_len = left < METAOBJ_COPY_SIZE ? left : METAOBJ_COPY_SIZE;
+            if (fread(copy_buffer, 1, block_len, field->content_file) != block_len) {
+               *error_message = "unable to read the content of a field";
+               result = false;
+            }
+            else
+               result = fwrite(copy_buffer, 1, block_len, file) == block_len;
+            left -= block_len;
+         }
+      }
+      field_offset += field->content_len;
+   }
+   result = result && write_zeros(file, layout.compressed_offset - layout.data_offset - field_offset)
+      && (!description->compressed_section
+         || fwrite(description->compressed_section, 1, layout.compressed_size, file) == layout.compressed_size)
+      && write_zeros(file, layout.symtab_offset - layout.compressed_offset - layout.compressed_size)
+      && fwrite(tail, 1, layout.total_size - layout.symtab_offset, file)
+         == layout.total_size - layout.symtab_offset;
+   free(head);
+   free(copy_buffer);
+   return result;
+}
+
+
+int chariot_metaobj_compress_section(char** result, size_t* result_len, const char* content,
+      size_t content_len, Elf32_Word addralign, bool is_big_endian, const char** error_message) {
+   if (content_len > 0x7fffffff) {
+      *error_message = "too large content to compress";
+      return false;
+   }
+   size_t stream_len = chariot_zlib_deflate_bound(content_len);
+   *result = (char*) malloc(METAOBJ_CHDR_SIZE + stream_len);
+   if (!*result) {
+      *error_message = "unable to allocate the compressed section";
+      return false;
+   }
+   store_word(*result, 1 /* ELFCOMPRESS_ZLIB */, is_big_endian);
+   store_word(*result + 4, (Elf32_Word) content_len, is_big_endian);
+   store_word(*result + 8, addralign, is_big_endian);
+   if (!chariot_zlib_deflate(*result + METAOBJ_CHDR_SIZE, &stream_len, content, content_len,
+         error_message)) {
+      free(*result);
+      *result = NULL;
+      return false;
+   }
+   *result_len = METAOBJ_CHDR_SIZE + stream_len;
+   return true;
+}
+
+int chariot_metaobj_compress(char** result, size_t* result_len,
+      const Chariot_Metaobj_description* description, const char** error_message) {
+   // the is_compressed fields are laid out as in the data section before their deflation
+   size_t inflated_len = 0;
+   bool has_compressed_fields = false;
+   *result = NULL;
+   *result_len = 0;
+   for (size_t field_index = 0; field_index < description->fields_number; ++field_index) {
+      const Chariot_Metaobj_field* field = &description->fields[field_index];
+      if (!field->is_compressed)
+         continue;
+      if (field->content_len && !field->content) {
+         *error_message = "a compressed field needs its content in memory";
+         return false;
+      }
+      has_compressed_fields = true;
+      inflated_len = align_up((Elf32_Word) inflated_len, field->align) + (size_t) field->content_len;
+      if (inflated_len > 0x7fffffff) {
+         *error_message = "too large content to compress";
+         return false;
+      }
+   }
+   if (!has_compressed_fields)
+      return true;
+   char* inflated = (char*) calloc(inflated_len + 1, 1);
+   if (!inflated) {
+      *error_message = "unable to allocate the compressed section";
+      return false;
+   }
+   Elf32_Word field_offset = 0;
+   for (size_t field_index = 0; field_index < description->fields_number; ++field_index) {
+      const Chariot_Metaobj_field* field = &description->fields[field_index];
+      if (!field->is_compressed)
+         continue;
+      field_offset = align_up(field_offset, field->align);
+      if (field->content_len)
+         memcpy(inflated + field_offset, field->content, field->content_len);
+      field_offset += field->content_len;
+   }
+   int is_compressed = chariot_metaobj_compress_section(result, result_len, inflated, inflated_len,
+         METAOBJ_SECTION_ALIGN, description->is_big_endian, error_message);
+   free(inflated);
+   return is_compressed;
+}
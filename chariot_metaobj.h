@@ -0,0 +1,118 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+
+/*
+ * Direct emission of the relocatable elf objects holding the CHARIOT metadata
+ * and the supplementary data, as the assembly of a generated .s file or the
+ * compilation of a generated C array would produce them: a .chariotmeta.rodata
+ * (or .suppldata) section with a global object symbol per field, then .symtab,
+ * .strtab and .shstrtab. chariot_addelf_meta_data.py inserts these objects as
+ * the content of the sections of the same name in the firmware.
+ * The is_compressed fields go into a last SHF_COMPRESSED section of the same name,
+ * whose symbols give the offsets in its inflated content.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "chariot_extractelf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A field stores content_len bytes of content at the next multiple of align
+ * (0 or 1 for no alignment) and its symbol has st_size = size <= content_len.
+ * A string field as ".string" stores its final '\0' in content_len and excludes
+ * it from size for the fixed-size fields (".size sym, 8") or includes it for the
+ * variable-size ones (".size sym, . - sym").
+ * Without content, the content_len bytes come from content_file, which
+ * chariot_metaobj_write_file copies by blocks without loading it in memory.
+ * An is_compressed field needs its content.
+ */
+typedef struct {
+   const char* name;
+   const char* content;
+   FILE* content_file;
+   Elf32_Word content_len;
+   Elf32_Word size;
+   Elf32_Word align;
+   bool is_compressed;
+} Chariot_Metaobj_field;
+
+typedef struct {
+   Chariot_Section section; // CS_Meta for .chariotmeta.rodata, CS_Extra for .suppldata
+   Elf32_Half machine; // e_machine of the firmware, 3 for EM_386
+   Elf32_Word flags;   // e_flags of the firmware, for the linkers that check it
+   bool is_big_endian;
+   const Chariot_Metaobj_field* fields;
+   size_t fields_number;
+   // content of the SHF_COMPRESSED section, from chariot_metaobj_compress, or NULL
+   const char* compressed_section;
+   size_t compressed_section_len;
+} Chariot_Metaobj_description;
+
+#define CHARIOT_METAOBJ_EM_386 3
+
+/* size in bytes of the object described by description, 0 if it is invalid */
+size_t chariot_metaobj_size(const Chariot_Metaobj_description* description);
+
+/* writes the object into buffer, whose buffer_len should be at least chariot_metaobj_size */
+int chariot_metaobj_write(char* buffer, size_t buffer_len,
+      const Chariot_Metaobj_description* description, const char** error_message);
+/* streams the object into file, with a bounded memory whatever the size of the contents */
+int chariot_metaobj_write_file(FILE* file, const Chariot_Metaobj_description* description,
+      const char** error_message);
+
+/*
+ * malloc'd content of a SHF_COMPRESSED section for content: its Elf32_Chdr
+ * (ELFCOMPRESS_ZLIB) and then the zlib stream, see chariot_zlib.h
+ */
+int chariot_metaobj_compress_section(char** result, size_t* result_len, const char* content,
+      size_t content_len, Elf32_Word addralign, bool is_big_endian, const char** error_message);
+/* compressed section of the is_compressed fields of description, for its compressed_section */
+int chariot_metaobj_compress(char** result, size_t* result_len,
+      const Chariot_Metaobj_description* description, const char** error_message);
+
+#ifdef __cplusplus
+}
+#endif
+
@@ -0,0 +1,522 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+
+/*
+ * Post-link patch of the CHARIOT metadata of a linked elf firmware. The firmware
+ * is linked once with fixed-size placeholders ("00000000" strings) in its
+ * .chariotmeta.rodata section. This tool maps the firmware, finds the placeholders
+ * through its symbol table and overwrites them in place with the offset, the size
+ * and the digests of the mainboot region (between __mainboot_start and
+ * __mainboot_end), and with the offset, the size and the digest of the extraboot
+ * data in the .suppldata section. The numbers are written as 8 hexadecimal digits
+ * and the digests as 64 ones, as read by libchariot_extractelf.a. A firmware whose
+ * chariotmeta_format_version is 2 has raw placeholders: the numbers are then written
+ * on 4 bytes little-endian and the mainboot digests on 32 bytes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "chariot_extractelf.h"
+#include "chariot_sha256.h"
+#include "chariot_blake3.h"
+#include "chariot_crc32c.h"
+
+typedef struct _InputParser {
+  const char* firmware_name;
+  const char* output_file;
+  const char* mainboot_start;
+  const char* mainboot_end;
+  const char* extraboot_symbol;
+  bool requires_help : 1;
+  bool requires_verbose : 1;
+} InputParser;
+
+void
+input_parser_usage()
+{
+  printf("usage: chariot_patchelf_meta_data.exe [-h] [--verbose] [--mainboot START END]\n"
+         "                                      [--extraboot SYMBOL] [--output OUTPUT]\n"
+         "                                      firmware\n"
+         "\n"
+         "patches in place (or into OUTPUT) the metadata placeholders of a linked firmware;\n"
+         "the mainboot region is between the symbols START and END (default __mainboot_start\n"
+         "and __mainboot_end), the extraboot data is SYMBOL (default boot_supplementary_data)\n"
+         "\n");
+}
+
+bool
+fill_input_parser_fields(InputParser* parser, int argc, const char** argv)
+{
+  memset(parser, 0, sizeof(InputParser));
+  parser->mainboot_start = "__mainboot_start";
+  parser->mainboot_end = "__mainboot_end";
+  parser->extraboot_symbol = "boot_supplementary_data";
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+      parser->requires_help = true;
+    else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0)
+      parser->requires_verbose = true;
+    else if (strcmp(argv[i], "-mb") == 0 || strcmp(argv[i], "--mainboot") == 0)
+    {
+      if (i+2 >= argc)
+        return false;
+      parser->mainboot_start = argv[++i];
+      parser->mainboot_end = argv[++i];
+    }
+    else if (strcmp(argv[i], "-eb") == 0 || strcmp(argv[i], "--extraboot") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      parser->extraboot_symbol = argv[i];
+    }
+    else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      parser->output_file = argv[i];
+    }
+    else if (argv[i][0] == '-' || parser->firmware_name)
+      return false;
+    else
+      parser->firmware_name = argv[i];
+  }
+  return parser->requires_help || parser->firmware_name;
+}
+
+typedef struct {
+  unsigned char* buffer;
+  size_t buffer_len;
+  Elf32_Ehdr header;
+  bool is_little_endian;
+  const unsigned char* symbols;
+  uint32_t symbols_size;
+  const char* strings;
+  uint32_t strings_size;
+  // the hashed region, which no placeholder may overlap
+  Elf32_Off mainboot_offset;
+  Elf32_Word mainboot_size;
+} Firmware;
+
+static uint32_t
+read_elf_word(const unsigned char* source, bool is_little_endian)
+{
+  return is_little_endian
+    ? (uint32_t) source[0] | ((uint32_t) source[1] << 8) | ((uint32_t) source[2] << 16) | ((uint32_t) source[3] << 24)
+    : (uint32_t) source[3] | ((uint32_t) source[2] << 8) | ((uint32_t) source[1] << 16) | ((uint32_t) source[0] << 24);
+}
+
+static uint16_t
+read_elf_half(const unsigned char* source, bool is_little_endian)
+{
+  return is_little_endian
+    ? (uint16_t) (source[0] | (source[1] << 8))
+    : (uint16_t) (source[1] | (source[0] << 8));
+}
+
+static bool
+read_section_header(Elf32_Shdr* result, const Firmware* firmware, unsigned section_index)
+{
+  if (section_index >= firmware->header.e_shnum)
+    return false;
+  const unsigned char* section = firmware->buffer + firmware->header.e_shoff + section_index*40;
+  result->sh_type = read_elf_word(section + 4, firmware->is_little_endian);
+  result->sh_addr = read_elf_word(section + 12, firmware->is_little_endian);
+  result->sh_offset = read_elf_word(section + 16, firmware->is_little_endian);
+  result->sh_size = read_elf_word(section + 20, firmware->is_little_endian);
+  result->sh_link = read_elf_word(section + 24, firmware->is_little_endian);
+  return result->sh_type == 8 /* SHT_NOBITS */
+    || result->sh_offset + (uint64_t) result->sh_size <= firmware->buffer_len;
+}
+
+int
+open_firmware(Firmware* firmware, const char** error_message)
+{
+  if (!fill_exe_header(&firmware->header, (const char*) firmware->buffer, firmware->buffer_len,
+        error_message))
+    return false;
+  if (memcmp(firmware->header.e_ident, "\177ELF", 4) != 0
+      || firmware->header.e_ident[4] != 1 /* ELFCLASS32 */) {
+    *error_message = "not an elf32 file";
+    return false;
+  }
+  firmware->is_little_endian = firmware->header.e_ident[5] == 1 /* ELFDATA2LSB */;
+  if (firmware->header.e_shentsize != 40
+      || firmware->header.e_shoff + (uint64_t) firmware->header.e_shnum*40 > firmware->buffer_len) {
+    *error_message = "unable to read the section headers: buffer is too small";
+    return false;
+  }
+  for (unsigned section_index = 0; section_index < firmware->header.e_shnum; ++section_index) {
+    Elf32_Shdr section, strings_section;
+    if (!read_section_header(&section, firmware, section_index)
+        || section.sh_type != 2 /* SHT_SYMTAB */)
+      continue;
+    if (!read_section_header(&strings_section, firmware, section.sh_link)
+        || strings_section.sh_size == 0
+        || firmware->buffer[strings_section.sh_offset + strings_section.sh_size - 1] != '\0') {
+      *error_message = "unable to read the strings of the symbol table";
+      return false;
+    }
+    firmware->symbols = firmware->buffer + section.sh_offset;
+    firmware->symbols_size = section.sh_size;
+    firmware->strings = (const char*) firmware->buffer + strings_section.sh_offset;
+    firmware->strings_size = strings_section.sh_size;
+    return true;
+  }
+  *error_message = "no symbol table: the firmware should not be stripped before the patch";
+  return false;
+}
+
+static bool
+find_symbol(Elf32_Sym* result, const Firmware* firmware, const char* name)
+{
+  for (uint32_t symbol_offset = 0; symbol_offset + 16 <= firmware->symbols_size; symbol_offset += 16) {
+    const unsigned char* symbol = firmware->symbols + symbol_offset;
+    uint32_t name_offset = read_elf_word(symbol, firmware->is_little_endian);
+    if (name_offset >= firmware->strings_size || strcmp(firmware->strings + name_offset, name) != 0)
+      continue;
+    result->st_name = name_offset;
+    result->st_value = read_elf_word(symbol + 4, firmware->is_little_endian);
+    result->st_size = read_elf_word(symbol + 8, firmware->is_little_endian);
+    result->st_info = symbol[12];
+    result->st_other = symbol[13];
+    result->st_shndx = read_elf_half(symbol + 14, firmware->is_little_endian);
+    return true;
+  }
+  return false;
+}
+
+// file offset of an address in the file content of a PT_LOAD segment
+static bool
+address_offset(Elf32_Off* result, const Firmware* firmware, Elf32_Addr address)
+{
+  if (firmware->header.e_phentsize != 32
+      || firmware->header.e_phoff + (uint64_t) firmware->header.e_phnum*32 > firmware->buffer_len)
+    return false;
+  for (unsigned segment_index = 0; segment_index < firmware->header.e_phnum; ++segment_index) {
+    const unsigned char* segment = firmware->buffer + firmware->header.e_phoff + segment_index*32;
+    Elf32_Off offset = read_elf_word(segment + 4, firmware->is_little_endian);
+    Elf32_Addr start = read_elf_word(segment + 8, firmware->is_little_endian);
+    Elf32_Word file_size = read_elf_word(segment + 16, firmware->is_little_endian);
+    if (read_elf_word(segment, firmware->is_little_endian) == 1 /* PT_LOAD */
+        && address >= start && address - start <= file_size) {
+      *result = offset + (address - start);
+      return true;
+    }
+  }
+  return false;
+}
+
+// file offset of the content of a symbol, through the section which contains it
+static bool
+symbol_offset(Elf32_Off* result, const Firmware* firmware, const Elf32_Sym* symbol)
+{
+  Elf32_Shdr section;
+  if (symbol->st_shndx == 0 /* SHN_UNDEF */ || symbol->st_shndx >= 0xff00 /* SHN_LORESERVE */
+      || !read_section_header(&section, firmware, symbol->st_shndx)
+      || section.sh_type == 8 /* SHT_NOBITS */)
+    return false;
+  // st_value is an address in a linked firmware, an offset in a relocatable one
+  Elf32_Word position = firmware->header.e_type == 1 /* ET_REL */
+    ? symbol->st_value : symbol->st_value - section.sh_addr;
+  if (position > section.sh_size || symbol->st_size > section.sh_size - position)
+    return false;
+  *result = section.sh_offset + position;
+  return true;
+}
+
+static const char*
+hex_digits(char* result, const unsigned char* bytes, size_t len)
+{
+  for (size_t index = 0; index < len; ++index)
+    sprintf(result + 2*index, "%02x", bytes[index]);
+  return result;
+}
+
+static const char*
+sha256_digits(char result[65], const void* start, size_t len)
+{
+  Chariot_Sha256_context context;
+  uint32_t digest[8];
+  chariot_sha256_init(&context);
+  chariot_sha256_update(&context, start, len);
+  chariot_sha256_final(&context, digest);
+  // digest[7] is the first word
+  for (int index = 0; index < 8; ++index)
+    sprintf(result + 8*index, "%08x", digest[7-index]);
+  return result;
+}
+
+/*
+ * overwrites the beginning of the content of the symbol name with the len bytes
+ * of content, shown as digits; an absent optional symbol is left as is
+ */
+int
+patch_field(Firmware* firmware, const char* name, const char* content, size_t len, const char* digits,
+      bool is_optional, bool is_verbose, const char** error_message)
+{
+  Elf32_Sym symbol;
+  Elf32_Off offset;
+  if (!find_symbol(&symbol, firmware, name)) {
+    if (is_optional)
+      return true;
+    *error_message = "a metadata placeholder is missing in the symbol table";
+    return false;
+  }
+  if (!symbol_offset(&offset, firmware, &symbol)) {
+    *error_message = "the content of a metadata placeholder is not in the firmware";
+    return false;
+  }
+  if (symbol.st_size < len) {
+    *error_message = "a metadata placeholder is too small";
+    return false;
+  }
+  if (offset < firmware->mainboot_offset + firmware->mainboot_size
+      && firmware->mainboot_offset < offset + len) {
+    *error_message = "a metadata placeholder is inside the mainboot region";
+    return false;
+  }
+  memcpy(firmware->buffer + offset, content, len);
+  if (is_verbose)
+    printf("%s= %s at offset %#x\n", name, digits, (unsigned) offset);
+  return true;
+}
+
+/* 8 hexadecimal digits or, in the format version 2, 4 bytes little-endian */
+static int
+patch_number(Firmware* firmware, const char* name, uint32_t value, bool is_raw, bool is_optional,
+      bool is_verbose, const char** error_message)
+{
+  char digits[9], content[4];
+  sprintf(digits, "%08x", (unsigned) value);
+  if (!is_raw)
+    return patch_field(firmware, name, digits, 8, digits, is_optional, is_verbose, error_message);
+  for (int index = 0; index < 4; ++index)
+    content[index] = (char) (value >> (8*index));
+  return patch_field(firmware, name, content, 4, digits, is_optional, is_verbose, error_message);
+}
+
+/* 64 hexadecimal digits and " mainboot" or, in the format version 2, 32 bytes */
+static int
+patch_digest(Firmware* firmware, const char* name, const unsigned char bytes[32], bool is_raw,
+      bool is_optional, bool is_verbose, const char** error_message)
+{
+  char digits[64+sizeof(" mainboot")];
+  Elf32_Sym symbol;
+  strcat((char*) hex_digits(digits, bytes, 32), is_raw ? "" : " mainboot");
+  // the extractor only accepts a text digest filling its whole placeholder
+  if (!is_raw && find_symbol(&symbol, firmware, name) && symbol.st_size != strlen(digits)) {
+    *error_message = "a metadata digest placeholder is not 73 characters long";
+    return false;
+  }
+  return patch_field(firmware, name, is_raw ? (const char*) bytes : digits, is_raw ? 32 : strlen(digits),
+        digits, is_optional, is_verbose, error_message);
+}
+
+/* the format version of the placeholders, 1 without chariotmeta_format_version */
+static bool
+retrieve_format_version(uint32_t* result, const Firmware* firmware)
+{
+  Elf32_Sym symbol;
+  Elf32_Off offset;
+  *result = 1;
+  if (!find_symbol(&symbol, firmware, "chariotmeta_format_version"))
+    return true;
+  if (symbol.st_size != 4 || !symbol_offset(&offset, firmware, &symbol))
+    return false;
+  *result = read_elf_word(firmware->buffer + offset, true);
+  return *result == 1 || *result == 2;
+}
+
+int
+patch_firmware(Firmware* firmware, const InputParser* parser, const char** error_message)
+{
+  char digits[65];
+  uint32_t format_version;
+  Elf32_Sym start_symbol, end_symbol;
+  Elf32_Off start_offset, end_offset;
+  if (!find_symbol(&start_symbol, firmware, parser->mainboot_start)
+      || !find_symbol(&end_symbol, firmware, parser->mainboot_end)) {
+    *error_message = "the symbols of the mainboot region are missing";
+    return false;
+  }
+  if (!address_offset(&start_offset, firmware, start_symbol.st_value)
+      || !address_offset(&end_offset, firmware, end_symbol.st_value)
+      || end_offset < start_offset) {
+    *error_message = "the mainboot region is not in the file content of the firmware";
+    return false;
+  }
+  if (!retrieve_format_version(&format_version, firmware)) {
+    *error_message = "unsupported format version of the metadata";
+    return false;
+  }
+  bool is_raw = format_version == 2;
+  firmware->mainboot_offset = start_offset;
+  firmware->mainboot_size = end_offset - start_offset;
+  const unsigned char* mainboot = firmware->buffer + start_offset;
+
+  // every digest is computed before any patch, the placeholders being out of the region
+  Chariot_Sha256_context context;
+  uint32_t sha256_digest[8], crc32c;
+  unsigned char sha256[32], blake3[32];
+  chariot_sha256_init(&context);
+  chariot_sha256_update(&context, mainboot, firmware->mainboot_size);
+  chariot_sha256_final(&context, sha256_digest);
+  // sha256_digest[7] is the first word
+  for (int index = 0; index < 32; ++index)
+    sha256[index] = (unsigned char) (sha256_digest[7-index/4] >> (8*(3-index%4)));
+  chariot_blake3_hash(mainboot, firmware->mainboot_size, blake3, 0);
+  crc32c = chariot_crc32c(0, mainboot, firmware->mainboot_size);
+
+  if (!patch_number(firmware, "chariotmeta_mainboot_offsetnum", firmware->mainboot_offset, is_raw,
+        false, parser->requires_verbose, error_message)
+      || !patch_number(firmware, "chariotmeta_mainboot_sizenum", firmware->mainboot_size, is_raw,
+        true, parser->requires_verbose, error_message)
+      || !patch_number(firmware, "chariotmeta_mainboot_sizesnum", firmware->mainboot_size, is_raw,
+        true, parser->requires_verbose, error_message)
+      || !patch_digest(firmware, "chariotmeta_mainboot_sha256", sha256, is_raw,
+        false, parser->requires_verbose, error_message)
+      || !patch_digest(firmware, "chariotmeta_mainboot_blake3", blake3, is_raw,
+        true, parser->requires_verbose, error_message)
+      || !patch_number(firmware, "chariotmeta_mainboot_crc32c", crc32c, is_raw,
+        true, parser->requires_verbose, error_message))
+    return false;
+
+  // the extraboot offset is relative to the .suppldata section
+  Elf32_Sym extra_symbol, extra_offsetnum;
+  if (!find_symbol(&extra_offsetnum, firmware, "chariotmeta_extraboot_offsetnum"))
+    return true;
+  Elf32_Shdr suppldata_section;
+  Elf32_Off extra_offset;
+  if (!retrieve_section_header(&suppldata_section, &firmware->header, (const char*) firmware->buffer,
+        firmware->buffer_len, CS_Extra, error_message))
+    return false;
+  if (!find_symbol(&extra_symbol, firmware, parser->extraboot_symbol)
+      || !symbol_offset(&extra_offset, firmware, &extra_symbol)
+      || extra_offset < suppldata_section.sh_offset
+      || extra_offset - suppldata_section.sh_offset + extra_symbol.st_size > suppldata_section.sh_size) {
+    *error_message = "the extraboot data is not in the .suppldata section";
+    return false;
+  }
+  if (!patch_number(firmware, "chariotmeta_extraboot_offsetnum",
+        extra_offset - suppldata_section.sh_offset, is_raw, false, parser->requires_verbose, error_message)
+      || !patch_number(firmware, "chariotmeta_extraboot_sizenum", extra_symbol.st_size, is_raw,
+        false, parser->requires_verbose, error_message))
+    return false;
+  // the extraboot sha256 stays 64 hexadecimal digits in the format version 2
+  sha256_digits(digits, firmware->buffer + extra_offset, extra_symbol.st_size);
+  return patch_field(firmware, "chariotmeta_extraboot_sha256", digits, 64, digits, true,
+        parser->requires_verbose, error_message);
+}
+
+int
+main(int argc, const char** argv)
+{
+  InputParser parser;
+  if (!fill_input_parser_fields(&parser, argc, argv))
+  {
+    input_parser_usage();
+    return 1;
+  }
+  if (parser.requires_help)
+  {
+    input_parser_usage();
+    return 0;
+  }
+
+  // the firmware is patched in place, or in a private mapping copied to the output
+  int fd = open(parser.firmware_name, parser.output_file ? O_RDONLY : O_RDWR);
+  struct stat status;
+  if (fd < 0 || fstat(fd, &status) != 0 || status.st_size <= 0)
+  {
+    fprintf(stderr, "Cannot open file %s\n", parser.firmware_name);
+    if (fd >= 0)
+      close(fd);
+    return 1;
+  }
+  Firmware firmware;
+  memset(&firmware, 0, sizeof(Firmware));
+  firmware.buffer_len = status.st_size;
+  firmware.buffer = (unsigned char*) mmap(NULL, firmware.buffer_len, PROT_READ | PROT_WRITE,
+      parser.output_file ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+  close(fd);
+  if (firmware.buffer == MAP_FAILED)
+  {
+    fprintf(stderr, "Cannot map file %s\n", parser.firmware_name);
+    return 1;
+  }
+
+  const char* error_message = NULL;
+  if (!open_firmware(&firmware, &error_message)
+      || !patch_firmware(&firmware, &parser, &error_message))
+  {
+    fprintf(stderr, "Cannot patch the metadata of %s\n", parser.firmware_name);
+    fprintf(stderr, "  %s\n", error_message);
+    munmap(firmware.buffer, firmware.buffer_len);
+    return 1;
+  }
+
+  int result = 0;
+  if (parser.output_file)
+  {
+    FILE* output = fopen(parser.output_file, "wb");
+    if (!output || fwrite(firmware.buffer, 1, firmware.buffer_len, output) != firmware.buffer_len
+        || fclose(output) != 0)
+    {
+      fprintf(stderr, "Cannot write file %s\n", parser.output_file);
+      result = 1;
+    }
+  }
+  else if (msync(firmware.buffer, firmware.buffer_len, MS_SYNC) != 0)
+  {
+    fprintf(stderr, "Cannot write file %s\n", parser.firmware_name);
+    result = 1;
+  }
+  munmap(firmware.buffer, firmware.buffer_len);
+  return result;
+}
+
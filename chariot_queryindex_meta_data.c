@@ -0,0 +1,348 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+
+/*
+ * Answers the fleet queries on an index built by chariot_buildindex_meta_data.exe,
+ * the index is mapped and read in place:
+ *   --field NAME VALUE   images whose field NAME is VALUE, the conditions are combined
+ *   --digest SHA256      images whose mainboot_sha256 is SHA256
+ *   --distinct NAME      distinct values of the field NAME with their number of images
+ *   --image NAME         every field of the image NAME
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "chariot_index.h"
+
+typedef struct _InputParser {
+  const char* index_file;
+  const char** field_names; // with their values in field_values
+  const char** field_values;
+  size_t fields_number;
+  const char* digest;
+  const char* distinct_name;
+  const char* image_name;
+  bool requires_help : 1;
+  bool requires_count : 1;
+} InputParser;
+
+void
+input_parser_usage()
+{
+  printf("usage: chariot_queryindex_meta_data.exe [-h] [--count] INDEX\n"
+         "                                        ((--field NAME VALUE)* [--digest SHA256]\n"
+         "                                        | --distinct NAME | --image NAME)\n"
+         "\n"
+         "queries the index of CHARIOT metadata INDEX, NAME is a field like firmware_license\n"
+         "or version_data, or image for the image names\n"
+         "\n");
+}
+
+bool
+fill_input_parser_fields(InputParser* parser, int argc, const char** argv)
+{
+  memset(parser, 0, sizeof(InputParser));
+  parser->field_names = (const char**) calloc(argc/2+1, sizeof(const char*));
+  parser->field_values = (const char**) calloc(argc/2+1, sizeof(const char*));
+  if (!parser->field_names || !parser->field_values)
+    return false;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+      parser->requires_help = true;
+    else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--count") == 0)
+      parser->requires_count = true;
+    else if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--field") == 0)
+    {
+      if (i+2 >= argc)
+        return false;
+      parser->field_names[parser->fields_number] = argv[++i];
+      parser->field_values[parser->fields_number++] = argv[++i];
+    }
+    else if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--digest") == 0)
+    {
+      if (++i >= argc || strlen(argv[i]) < 64)
+        return false;
+      parser->digest = argv[i];
+    }
+    else if (strcmp(argv[i], "--distinct") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      parser->distinct_name = argv[i];
+    }
+    else if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--image") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      parser->image_name = argv[i];
+    }
+    else if (argv[i][0] == '-' || parser->index_file)
+      return false;
+    else
+      parser->index_file = argv[i];
+  }
+  if (parser->requires_help)
+    return true;
+  int queries_number = (parser->fields_number > 0 || parser->digest)
+    + (parser->distinct_name != NULL) + (parser->image_name != NULL);
+  return parser->index_file && queries_number == 1;
+}
+
+void
+free_input_parser(InputParser* parser)
+{
+  free(parser->field_names);
+  free(parser->field_values);
+}
+
+bool
+read_sha256(uint32_t result[8], const char* text) {
+  memset(result, 0, 8*sizeof(uint32_t));
+  for (int index = 0; index < 64; ++index)
+  {
+    char digit = text[index];
+    uint32_t value;
+    if (digit >= '0' && digit <= '9')
+      value = digit - '0';
+    else if (digit >= 'a' && digit <= 'f')
+      value = digit - 'a' + 10;
+    else if (digit >= 'A' && digit <= 'F')
+      value = digit - 'A' + 10;
+    else
+      return false;
+    // the first hexadecimal digits are in result[7], like retrieve_mainboot_sha256
+    result[7 - index/8] = (result[7 - index/8] << 4) | value;
+  }
+  return true;
+}
+
+void
+print_value(const Chariot_Index* index, unsigned column, uint32_t code) {
+  const char* value;
+  size_t value_len;
+  if (!chariot_index_value(&value, &value_len, index, column, code))
+    printf("<absent>");
+  else if (column == CMS_Codanalys_binary)
+    printf("<%u bytes>", (unsigned) value_len);
+  else
+    fwrite(value, 1, value_len, stdout);
+}
+
+/* images matching every --field condition and the --digest, in the order of the index */
+int
+select_images(const Chariot_Index* index, const InputParser* parser)
+{
+  unsigned columns[parser->fields_number+1];
+  uint32_t codes[parser->fields_number+1];
+  for (size_t field = 0; field < parser->fields_number; ++field)
+  {
+    if (!chariot_index_find_column(&columns[field], parser->field_names[field]))
+    {
+      fprintf(stderr, "Cannot find the field %s\n", parser->field_names[field]);
+      return 1;
+    }
+    if (!chariot_index_find_value(&codes[field], index, columns[field], parser->field_values[field],
+          strlen(parser->field_values[field])))
+    {
+      if (parser->requires_count)
+        printf("0\n");
+      return 0;
+    }
+  }
+
+  uint32_t first = 0, number = index->images_number;
+  if (parser->digest)
+  {
+    uint32_t sha256[8];
+    if (!read_sha256(sha256, parser->digest))
+    {
+      fprintf(stderr, "Cannot read the sha256 %s\n", parser->digest);
+      return 1;
+    }
+    chariot_index_find_digest(&first, &number, index, sha256);
+  }
+  uint32_t count = 0;
+  for (uint32_t position = first; position < first + number; ++position)
+  {
+    uint32_t image = parser->digest ? chariot_index_digest_image(index, position) : position;
+    bool is_selected = true;
+    for (size_t field = 0; is_selected && field < parser->fields_number; ++field)
+      is_selected = chariot_index_code(index, columns[field], image) == codes[field];
+    if (!is_selected)
+      continue;
+    ++count;
+    if (!parser->requires_count)
+    {
+      print_value(index, CHARIOT_INDEX_IMAGE, chariot_index_code(index, CHARIOT_INDEX_IMAGE, image));
+      printf("\n");
+    }
+  }
+  if (parser->requires_count)
+    printf("%u\n", (unsigned) count);
+  return 0;
+}
+
+int
+print_distinct(const Chariot_Index* index, const InputParser* parser)
+{
+  unsigned column;
+  if (!chariot_index_find_column(&column, parser->distinct_name))
+  {
+    fprintf(stderr, "Cannot find the field %s\n", parser->distinct_name);
+    return 1;
+  }
+  uint32_t values_number = chariot_index_values_number(index, column);
+  if (parser->requires_count)
+  {
+    printf("%u\n", (unsigned) values_number);
+    return 0;
+  }
+  uint32_t* counts = (uint32_t*) calloc(values_number+1, sizeof(uint32_t));
+  if (!counts)
+  {
+    fprintf(stderr, "buffer not allocated\n");
+    return 1;
+  }
+  // the last count is the number of images without the field
+  for (uint32_t image = 0; image < index->images_number; ++image)
+  {
+    uint32_t code = chariot_index_code(index, column, image);
+    ++counts[code == CHARIOT_INDEX_NONE ? values_number : code];
+  }
+  for (uint32_t code = 0; code <= values_number; ++code)
+    if (counts[code] > 0)
+    {
+      printf("%u ", (unsigned) counts[code]);
+      print_value(index, column, code);
+      printf("\n");
+    }
+  free(counts);
+  return 0;
+}
+
+int
+print_image(const Chariot_Index* index, const InputParser* parser)
+{
+  uint32_t code;
+  if (!chariot_index_find_value(&code, index, CHARIOT_INDEX_IMAGE, parser->image_name,
+        strlen(parser->image_name)))
+  {
+    fprintf(stderr, "Cannot find the image %s\n", parser->image_name);
+    return 1;
+  }
+  // the image names are unique unless a firmware was given twice
+  uint32_t image;
+  chariot_index_select(&image, 1, index, CHARIOT_INDEX_IMAGE, code);
+  for (unsigned column = 0; column < CHARIOT_INDEX_IMAGE; ++column)
+  {
+    uint32_t value_code = chariot_index_code(index, column, image);
+    if (value_code == CHARIOT_INDEX_NONE)
+      continue;
+    printf("%s: ", chariot_index_column_name(column));
+    print_value(index, column, value_code);
+    printf("\n");
+  }
+  return 0;
+}
+
+int
+main(int argc, const char** argv)
+{
+  InputParser parser;
+  if (!fill_input_parser_fields(&parser, argc, argv))
+  {
+    input_parser_usage();
+    free_input_parser(&parser);
+    return 1;
+  }
+  if (parser.requires_help)
+  {
+    input_parser_usage();
+    free_input_parser(&parser);
+    return 0;
+  }
+
+  int fd = open(parser.index_file, O_RDONLY);
+  struct stat status;
+  if (fd < 0 || fstat(fd, &status) != 0 || status.st_size <= 0)
+  {
+    fprintf(stderr, "Cannot open file %s\n", parser.index_file);
+    if (fd >= 0)
+      close(fd);
+    free_input_parser(&parser);
+    return 1;
+  }
+  size_t buffer_len = status.st_size;
+  const char* buffer = (const char*) mmap(NULL, buffer_len, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (buffer == MAP_FAILED)
+  {
+    fprintf(stderr, "Cannot map file %s\n", parser.index_file);
+    free_input_parser(&parser);
+    return 1;
+  }
+
+  Chariot_Index index;
+  const char* error_message = NULL;
+  int result;
+  if (!chariot_index_open(&index, buffer, buffer_len, &error_message))
+  {
+    fprintf(stderr, "Cannot read the index %s\n", parser.index_file);
+    fprintf(stderr, "  %s\n", error_message);
+    result = 1;
+  }
+  else if (parser.distinct_name)
+    result = print_distinct(&index, &parser);
+  else if (parser.image_name)
+    result = print_image(&index, &parser);
+  else
+    result = select_images(&index, &parser);
+  munmap((void*) buffer, buffer_len);
+  free_input_parser(&parser);
+  return result;
+}
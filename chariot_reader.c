@@ -0,0 +1,333 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "chariot_reader.h"
+#include "chariot_sha256.h"
+
+#define READER_EHDR_SIZE 52
+#define READER_SHDR_SIZE 40
+// the program headers are kept in the head when they end before this offset
+#define READER_HEAD_MAX 65536
+#define READER_BLOCK_SIZE 65536
+
+extern const char* Chariot_Section_names[];
+
+long chariot_read_at_file(void* context, char* target, uint64_t offset, size_t len) {
+   FILE* file = (FILE*) context;
+   if (fseeko(file, (off_t) offset, SEEK_SET) != 0)
+      return -1;
+   size_t result = fread(target, 1, len, file);
+   if (result < len && ferror(file))
+      return -1;
+   return (long) result;
+}
+
+int chariot_reader_init(Chariot_Reader* reader, Chariot_Read_at read_at, void* context,
+      const char** error_message) {
+   memset(reader, 0, sizeof(Chariot_Reader));
+   reader->read_at = read_at;
+   reader->context = context;
+   reader->pages = (char*) malloc(CHARIOT_READER_PAGES_NUMBER*CHARIOT_READER_PAGE_SIZE);
+   if (!reader->pages) {
+      *error_message = "not enough memory";
+      return false;
+   }
+   return true;
+}
+
+void chariot_reader_free(Chariot_Reader* reader) {
+   free(reader->pages);
+   reader->pages = NULL;
+}
+
+static bool
+fetch(Chariot_Reader* reader, char* target, uint64_t offset, size_t len, size_t* result) {
+   long read_len = reader->read_at(reader->context, target, offset, len);
+   ++reader->fetches_number;
+   if (read_len < 0 || (size_t) read_len > len)
+      return false;
+   reader->fetched_bytes += read_len;
+   *result = read_len;
+   return true;
+}
+
+int chariot_reader_read(Chariot_Reader* reader, char* target, uint64_t offset, size_t len,
+      const char** error_message) {
+   if (len >= CHARIOT_READER_PAGES_NUMBER*CHARIOT_READER_PAGE_SIZE/4) {
+      // a large read would evict every cached page for bytes read only once
+      while (len > 0) {
+         size_t read_len = 0;
+         if (!fetch(reader, target, offset, len, &read_len)) {
+            *error_message = "unable to read the image";
+            return false;
+         }
+         if (read_len == 0) {
+            *error_message = "unable to read the image: out of its content";
+            return false;
+         }
+         target += read_len;
+         offset += read_len;
+         len -= read_len;
+      }
+      return true;
+   }
+
+   while (len > 0) {
+      uint64_t page_offset = offset - offset % CHARIOT_READER_PAGE_SIZE;
+      int page = -1, replaced_page = 0;
+      for (int index = 0; index < CHARIOT_READER_PAGES_NUMBER; ++index) {
+         if (reader->page_uses[index] != 0 && reader->page_offsets[index] == page_offset) {
+            page = index;
+            break;
+         }
+         if (reader->page_uses[index] < reader->page_uses[replaced_page])
+            replaced_page = index;
+      }
+      if (page < 0) {
+         page = replaced_page;
+         reader->page_uses[page] = 0;
+         if (!fetch(reader, reader->pages + page*CHARIOT_READER_PAGE_SIZE, page_offset,
+               CHARIOT_READER_PAGE_SIZE, &reader->page_lens[page])) {
+            *error_message = "unable to read the image";
+            return false;
+         }
+         reader->page_offsets[page] = page_offset;
+      }
+      reader->page_uses[page] = ++reader->uses_number;
+      size_t page_position = offset - page_offset;
+      if (page_position >= reader->page_lens[page]) {
+         *error_message = "unable to read the image: out of its content";
+         return false;
+      }
+      size_t copied_len = reader->page_lens[page] - page_position;
+      if (copied_len > len)
+         copied_len = len;
+      memcpy(target, reader->pages + page*CHARIOT_READER_PAGE_SIZE + page_position, copied_len);
+      target += copied_len;
+      offset += copied_len;
+      len -= copied_len;
+   }
+   return true;
+}
+
+int chariot_reader_find_section(Elf32_Shdr* result, const Elf32_Ehdr* elf_header, uint64_t elf_offset,
+      Chariot_Reader* reader, Chariot_Section section, const char** error_message) {
+   if (section < 0 || section > CS_Extra) {
+      *error_message = "bad CHARIOT section description";
+      return false;
+   }
+   if (elf_header->e_shentsize != READER_SHDR_SIZE) {
+      *error_message = "size of section header is not as expected";
+      return false;
+   }
+   if (elf_header->e_shstrndx == 0 || elf_header->e_shstrndx >= elf_header->e_shnum) {
+      *error_message = "no string table to find CHARIOT sections";
+      return false;
+   }
+   const char* section_name = Chariot_Section_names[section];
+   size_t name_len = strlen(section_name) + 1;
+   char buffer[READER_SHDR_SIZE];
+   Elf32_Shdr section_string_table;
+   uint64_t headers_offset = elf_offset + elf_header->e_shoff;
+   if (!chariot_reader_read(reader, buffer, headers_offset + elf_header->e_shstrndx*READER_SHDR_SIZE,
+         READER_SHDR_SIZE, error_message))
+      return false;
+   fill_section_header(&section_string_table, elf_header, buffer);
+
+   // the names are compared on name_len bytes, the section headers come from the same pages
+   for (int section_index = 0; section_index < elf_header->e_shnum; ++section_index) {
+      Elf32_Shdr section_header;
+      char name[64];
+      if (!chariot_reader_read(reader, buffer, headers_offset + section_index*READER_SHDR_SIZE,
+            READER_SHDR_SIZE, error_message))
+         return false;
+      fill_section_header(&section_header, elf_header, buffer);
+      if (section_header.sh_name >= section_string_table.sh_size
+            || name_len > section_string_table.sh_size - section_header.sh_name)
+         continue;
+      if (!chariot_reader_read(reader, name, elf_offset + section_string_table.sh_offset
+            + section_header.sh_name, name_len, error_message))
+         return false;
+      if (memcmp(name, section_name, name_len) == 0) {
+         *result = section_header;
+         return true;
+      }
+   }
+
+   if (section == CS_Meta)
+      *error_message = "unable to find CHARIOT metadata section in elf buffer";
+   else
+      *error_message = "unable to find CHARIOT extra section in elf buffer";
+   return false;
+}
+
+void chariot_reader_metadata_free(Chariot_Reader_metadata* metadata) {
+   free(metadata->head);
+   free(metadata->metadata_buffer);
+   metadata->head = NULL;
+   metadata->metadata_buffer = NULL;
+}
+
+int chariot_reader_load_metadata(Chariot_Reader_metadata* result, Chariot_Reader* reader,
+      const char** error_message) {
+   char header[READER_EHDR_SIZE];
+   memset(result, 0, sizeof(Chariot_Reader_metadata));
+   if (!chariot_reader_read(reader, header, 0, READER_EHDR_SIZE, error_message)
+         || !fill_exe_header(&result->elf_header, header, READER_EHDR_SIZE, error_message))
+      return false;
+   result->head_len = READER_EHDR_SIZE;
+   uint64_t program_headers_end = result->elf_header.e_phoff
+      + (uint64_t) result->elf_header.e_phnum*result->elf_header.e_phentsize;
+   if (result->elf_header.e_phnum > 0 && program_headers_end <= READER_HEAD_MAX
+         && program_headers_end > READER_EHDR_SIZE)
+      result->head_len = (size_t) program_headers_end;
+   result->head = (char*) malloc(result->head_len);
+   if (!result->head) {
+      *error_message = "not enough memory";
+      return false;
+   }
+   if (!chariot_reader_read(reader, result->head, 0, result->head_len, error_message)
+         || !chariot_reader_find_section(&result->metadata_section, &result->elf_header, 0, reader,
+            CS_Meta, error_message))
+      goto error;
+
+   result->metadata_buffer = (char*) malloc(result->metadata_section.sh_size + 1);
+   if (!result->metadata_buffer) {
+      *error_message = "not enough memory";
+      goto error;
+   }
+   if (!chariot_reader_read(reader, result->metadata_buffer, result->metadata_section.sh_offset,
+            result->metadata_section.sh_size, error_message)
+         || !fill_exe_header(&result->metadata_header, result->metadata_buffer,
+            result->metadata_section.sh_size, error_message))
+      goto error;
+   result->metadata_dict.valid_entries = 0;
+   result->metadata_dict.metadata_header = &result->metadata_header;
+   result->metadata_dict.metadata_section = &result->metadata_section;
+   result->metadata_dict.metadata_buffer_exe = result->metadata_buffer;
+   result->metadata_dict.metadata_buffer_len = result->metadata_section.sh_size;
+   if (!fill_metadata_dict(&result->metadata_dict, error_message))
+      goto error;
+   return true;
+
+error:
+   chariot_reader_metadata_free(result);
+   return false;
+}
+
+int chariot_reader_locate_extraboot(uint64_t* offset, size_t* len, const Chariot_Reader_metadata* metadata,
+      Chariot_Reader* reader, const char** error_message) {
+   uint32_t start = 0, size = 0;
+   if (!retrieve_metadata_number(&start, CMS_Extraboot_offsetnum, &metadata->metadata_dict, error_message)
+         || !retrieve_metadata_number(&size, CMS_Extraboot_sizenum, &metadata->metadata_dict, error_message))
+      return false;
+
+   // the .suppldata section contains an elf object with its own .suppldata section
+   Elf32_Shdr suppldata_section, suppldata_inside_section;
+   Elf32_Ehdr suppldata_elf_header;
+   char header[READER_EHDR_SIZE];
+   if (!chariot_reader_find_section(&suppldata_section, &metadata->elf_header, 0, reader, CS_Extra,
+         error_message))
+      return false;
+   if (suppldata_section.sh_flags & SHF_COMPRESSED) {
+      *error_message = "the extraboot content of a compressed .suppldata section is not in place";
+      return false;
+   }
+   if (suppldata_section.sh_size < READER_EHDR_SIZE) {
+      *error_message = "not enough bytes to be a valid elf content";
+      return false;
+   }
+   if (!chariot_reader_read(reader, header, suppldata_section.sh_offset, READER_EHDR_SIZE, error_message)
+         || !fill_exe_header(&suppldata_elf_header, header, READER_EHDR_SIZE, error_message)
+         || !chariot_reader_find_section(&suppldata_inside_section, &suppldata_elf_header,
+            suppldata_section.sh_offset, reader, CS_Extra, error_message))
+      return false;
+   if (suppldata_inside_section.sh_offset > suppldata_section.sh_size
+         || suppldata_inside_section.sh_size > suppldata_section.sh_size - suppldata_inside_section.sh_offset
+         || start > suppldata_inside_section.sh_size || size > suppldata_inside_section.sh_size - start) {
+      *error_message = "unable to read extraboot content: buffer is too small";
+      return false;
+   }
+   *offset = (uint64_t) suppldata_section.sh_offset + suppldata_inside_section.sh_offset + start;
+   *len = size;
+   return true;
+}
+
+int chariot_reader_verify_mainboot_sha256(const Chariot_Reader_metadata* metadata, Chariot_Reader* reader,
+      const char** error_message) {
+   Chariot_Mainboot_region regions[CHARIOT_MAINBOOT_REGIONS_MAX];
+   size_t regions_number = 0;
+   uint32_t expected_sha256[8], sha256[8];
+   if (!retrieve_mainboot_sha256(expected_sha256, &metadata->metadata_dict, error_message)
+         || !retrieve_mainboot_regions(regions, &regions_number, CHARIOT_MAINBOOT_REGIONS_MAX,
+            &metadata->elf_header, metadata->head, metadata->head_len, &metadata->metadata_dict,
+            error_message))
+      return false;
+   char* buffer = (char*) malloc(READER_BLOCK_SIZE);
+   if (!buffer) {
+      *error_message = "not enough memory";
+      return false;
+   }
+   Chariot_Sha256_context context;
+   chariot_sha256_init(&context);
+   for (size_t region_index = 0; region_index < regions_number; ++region_index) {
+      uint64_t offset = regions[region_index].offset;
+      size_t size = regions[region_index].size;
+      while (size > 0) {
+         size_t len = size < READER_BLOCK_SIZE ? size : READER_BLOCK_SIZE;
+         if (!chariot_reader_read(reader, buffer, offset, len, error_message)) {
+            free(buffer);
+            return false;
+         }
+         chariot_sha256_update(&context, buffer, len);
+         offset += len;
+         size -= len;
+      }
+   }
+   free(buffer);
+   chariot_sha256_final(&context, sha256);
+   if (memcmp(sha256, expected_sha256, sizeof(sha256)) != 0) {
+      *error_message = "the mainboot content does not match mainboot_sha256";
+      return false;
+   }
+   return true;
+}
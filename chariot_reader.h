@@ -0,0 +1,128 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+/*
+ * Random-access reader of a firmware that is not loaded in memory: flash partition,
+ * block device or ranged download. The library only fetches through read_at the
+ * bytes it needs (elf header, section headers and names, .chariotmeta.rodata, ...),
+ * by pages kept in a small cache, and then gives the metadata to the usual
+ * retrieve_... functions of chariot_extractelf.h.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "chariot_extractelf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Copies at most len bytes of the image at offset into target and returns their
+ * number, smaller than len only at the end of the image, or -1 on a read error.
+ */
+typedef long (*Chariot_Read_at)(void* context, char* target, uint64_t offset, size_t len);
+
+// read_at for a FILE* context opened in binary mode
+long chariot_read_at_file(void* context, char* target, uint64_t offset, size_t len);
+
+#define CHARIOT_READER_PAGE_SIZE 4096
+#define CHARIOT_READER_PAGES_NUMBER 16
+
+typedef struct {
+   Chariot_Read_at read_at;
+   void* context;
+   char* pages; // CHARIOT_READER_PAGES_NUMBER pages of CHARIOT_READER_PAGE_SIZE bytes
+   uint64_t page_offsets[CHARIOT_READER_PAGES_NUMBER];
+   size_t page_lens[CHARIOT_READER_PAGES_NUMBER];
+   uint32_t page_uses[CHARIOT_READER_PAGES_NUMBER]; // 0 for a free page, the least recent is replaced
+   uint32_t uses_number;
+   size_t fetches_number; // calls to read_at
+   uint64_t fetched_bytes;
+} Chariot_Reader;
+
+int chariot_reader_init(Chariot_Reader* reader, Chariot_Read_at read_at, void* context,
+      const char** error_message);
+void chariot_reader_free(Chariot_Reader* reader);
+/*
+ * Copies exactly len bytes at offset into target. The small reads go through the
+ * page cache, the large ones (like a mainboot region) directly to read_at.
+ */
+int chariot_reader_read(Chariot_Reader* reader, char* target, uint64_t offset, size_t len,
+      const char** error_message);
+
+/* header of the section of an elf file starting at elf_offset in the image */
+int chariot_reader_find_section(Elf32_Shdr* result, const Elf32_Ehdr* elf_header, uint64_t elf_offset,
+      Chariot_Reader* reader, Chariot_Section section, const char** error_message);
+
+/*
+ * Metadata of an image read through a reader. metadata_dict points into this
+ * structure, which should not move once loaded. head has the elf header and, when
+ * they are in the first 64 KiB, the program headers, so that retrieve_mainboot_regions
+ * can be given (&elf_header, head, head_len, &metadata_dict).
+ */
+typedef struct {
+   Elf32_Ehdr elf_header;
+   char* head;
+   size_t head_len;
+   Elf32_Shdr metadata_section;
+   Elf32_Ehdr metadata_header;
+   char* metadata_buffer; // content of .chariotmeta.rodata
+   Chariot_Metadata_localizations metadata_dict;
+} Chariot_Reader_metadata;
+
+int chariot_reader_load_metadata(Chariot_Reader_metadata* result, Chariot_Reader* reader,
+      const char** error_message);
+void chariot_reader_metadata_free(Chariot_Reader_metadata* metadata);
+
+/*
+ * offset in the image and size of the extraboot content, to be read through the reader;
+ * a SHF_COMPRESSED .suppldata section is refused, see inflate_section
+ */
+int chariot_reader_locate_extraboot(uint64_t* offset, size_t* len, const Chariot_Reader_metadata* metadata,
+      Chariot_Reader* reader, const char** error_message);
+
+/* streams the mainboot regions from read_at and compares them with mainboot_sha256 */
+int chariot_reader_verify_mainboot_sha256(const Chariot_Reader_metadata* metadata, Chariot_Reader* reader,
+      const char** error_message);
+
+#ifdef __cplusplus
+}
+#endif
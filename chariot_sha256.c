@@ -0,0 +1,139 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+#include <string.h>
+#include "chariot_sha256.h"
+
+static const uint32_t sha256_constants[64] = {
+   0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+   0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+   0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+   0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+   0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+   0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+   0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+   0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t
+rotate_right(uint32_t word, int shift)
+{  return (word >> shift) | (word << (32-shift)); }
+
+static void
+sha256_compress(uint32_t state[8], const unsigned char* block) {
+   uint32_t schedule[64];
+   for (int index = 0; index < 16; ++index)
+      schedule[index] = ((uint32_t) block[4*index] << 24) | ((uint32_t) block[4*index+1] << 16)
+         | ((uint32_t) block[4*index+2] << 8) | (uint32_t) block[4*index+3];
+   for (int index = 16; index < 64; ++index) {
+      uint32_t s0 = rotate_right(schedule[index-15], 7) ^ rotate_right(schedule[index-15], 18)
+         ^ (schedule[index-15] >> 3);
+      uint32_t s1 = rotate_right(schedule[index-2], 17) ^ rotate_right(schedule[index-2], 19)
+         ^ (schedule[index-2] >> 10);
+      schedule[index] = schedule[index-16] + s0 + schedule[index-7] + s1;
+   }
+
+   uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+            e = state[4], f = state[5], g = state[6], h = state[7];
+   for (int index = 0; index < 64; ++index) {
+      uint32_t t1 = h + (rotate_right(e, 6) ^ rotate_right(e, 11) ^ rotate_right(e, 25))
+         + ((e & f) ^ (~e & g)) + sha256_constants[index] + schedule[index];
+      uint32_t t2 = (rotate_right(a, 2) ^ rotate_right(a, 13) ^ rotate_right(a, 22))
+         + ((a & b) ^ (a & c) ^ (b & c));
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+   }
+   state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+   state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void
+chariot_sha256_init(Chariot_Sha256_context* context) {
+   static const uint32_t initial_state[8] = {
+      0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+   };
+   memcpy(context->state, initial_state, sizeof(initial_state));
+   context->length = 0;
+   context->block_len = 0;
+}
+
+void
+chariot_sha256_update(Chariot_Sha256_context* context, const void* data, size_t len) {
+   const unsigned char* source = (const unsigned char*) data;
+   context->length += len;
+   if (context->block_len > 0) {
+      size_t missing = 64 - context->block_len;
+      if (len < missing) {
+         memcpy(context->block + context->block_len, source, len);
+         context->block_len += len;
+         return;
+      }
+      memcpy(context->block + context->block_len, source, missing);
+      sha256_compress(context->state, context->block);
+      context->block_len = 0;
+      source += missing;
+      len -= missing;
+   }
+   // the firmware content is directly compressed without being copied
+   while (len >= 64) {
+      sha256_compress(context->state, source);
+      source += 64;
+      len -= 64;
+   }
+   if (len > 0) {
+      memcpy(context->block, source, len);
+      context->block_len = len;
+   }
+}
+
+void
+chariot_sha256_final(Chariot_Sha256_context* context, uint32_t result[8]) {
+   uint64_t bit_length = context->length * 8;
+   context->block[context->block_len++] = 0x80;
+   if (context->block_len > 56) {
+      memset(context->block + context->block_len, 0, 64 - context->block_len);
+      sha256_compress(context->state, context->block);
+      context->block_len = 0;
+   }
+   memset(context->block + context->block_len, 0, 56 - context->block_len);
+   for (int index = 0; index < 8; ++index)
+      context->block[56+index] = (unsigned char) (bit_length >> (56 - 8*index));
+   sha256_compress(context->state, context->block);
+   for (int index = 0; index < 8; ++index)
+      result[7-index] = context->state[index];
+}
@@ -0,0 +1,821 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+/*
+ * Link-time merge of the call graph summaries written by the CHARIOT gcc plugin
+ * (one <translationunit>.chariotcg per translation unit) into the worst-case
+ * stack depth of every entry point. The strongly connected components are
+ * computed with an iterative Tarjan algorithm and visited callees first, so that
+ * the analysis is linear in the size of the call graph. A recursion counts its
+ * cycle once and is reported, like the indirect calls and the unknown callees.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chariot_extractelf.h"
+#include "chariot_codanalys.h"
+
+typedef struct _InputParser {
+  const char** summary_files;
+  int summary_files_number;
+  const char** entries;
+  int entries_number;
+  bool requires_help : 1;
+  bool requires_verbose : 1;
+  bool requires_all : 1;
+  const char* output_file;
+  const char* binary_file;
+  const char* elf_file;
+} InputParser;
+
+typedef struct {
+  char* name;
+  long frame;
+  uint32_t code_size; // from the symbol table of the firmware
+  unsigned own_flags; // from the summary
+  unsigned flags; // of the whole call tree
+  bool is_defined;
+  bool is_called;
+  unsigned first_edge; // into Call_graph.edges after build_edges
+  unsigned edges_number;
+  // Tarjan
+  int index, low_link;
+  bool is_on_stack;
+  unsigned component;
+  long depth;
+} Function;
+
+typedef struct {
+  unsigned caller, callee;
+} Call;
+
+typedef struct {
+  Function* functions;
+  unsigned functions_number, functions_capacity;
+  unsigned* name_table; // function index + 1, 0 for an empty slot
+  size_t name_table_size;
+  Call* calls;
+  size_t calls_number, calls_capacity;
+  unsigned* edges; // callees sorted by caller
+  unsigned components_number;
+} Call_graph;
+
+void
+input_parser_usage()
+{
+  printf("usage: chariot_stackdepth.exe [-h] [--verbose] [--all] [--entry NAME]*\n"
+         "                              [--output OUTPUT] [--binary BINARY]\n"
+         "                              [--elf FIRMWARE] summary.chariotcg...\n"
+         "\n");
+}
+
+bool
+fill_input_parser_fields(InputParser* parser, int argc, const char** argv)
+{
+  memset(parser, 0, sizeof(InputParser));
+  parser->summary_files = (const char**) malloc(argc*sizeof(const char*));
+  parser->entries = (const char**) malloc(argc*sizeof(const char*));
+  if (!parser->summary_files || !parser->entries)
+    return false;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (argv[i][0] == '-')
+    {
+      if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+        parser->requires_help = true;
+      else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0)
+        parser->requires_verbose = true;
+      else if (strcmp(argv[i], "-a") == 0 || strcmp(argv[i], "--all") == 0)
+        parser->requires_all = true;
+      else if (strcmp(argv[i], "-e") == 0 || strcmp(argv[i], "--entry") == 0)
+      {
+        if (++i >= argc)
+          return false;
+        parser->entries[parser->entries_number++] = argv[i];
+      }
+      else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0)
+      {
+        if (++i >= argc)
+          return false;
+        parser->output_file = argv[i];
+      }
+      else if (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--binary") == 0)
+      {
+        if (++i >= argc)
+          return false;
+        parser->binary_file = argv[i];
+      }
+      else if (strcmp(argv[i], "--elf") == 0)
+      {
+        if (++i >= argc)
+          return false;
+        parser->elf_file = argv[i];
+      }
+      else
+        return false;
+    }
+    else
+      parser->summary_files[parser->summary_files_number++] = argv[i];
+  }
+  return parser->requires_help || parser->summary_files_number > 0;
+}
+
+static size_t
+hash_name(const char* name)
+{
+  size_t result = 5381;
+  while (*name)
+    result = result*33 ^ (unsigned char) *name++;
+  return result;
+}
+
+static bool
+grow_name_table(Call_graph* graph)
+{
+  size_t new_size = graph->name_table_size ? 2*graph->name_table_size : 1024;
+  unsigned* new_table = (unsigned*) calloc(new_size, sizeof(unsigned));
+  if (!new_table)
+    return false;
+  for (unsigned index = 0; index < graph->functions_number; ++index)
+  {
+    size_t slot = hash_name(graph->functions[index].name) & (new_size-1);
+    while (new_table[slot] != 0)
+      slot = (slot+1) & (new_size-1);
+    new_table[slot] = index+1;
+  }
+  free(graph->name_table);
+  graph->name_table = new_table;
+  graph->name_table_size = new_size;
+  return true;
+}
+
+/* index of the function of this name, -1 if it is absent */
+static long
+find_function(const Call_graph* graph, const char* name)
+{
+  if (graph->name_table_size == 0)
+    return -1;
+  size_t slot = hash_name(name) & (graph->name_table_size-1);
+  for (; graph->name_table[slot] != 0; slot = (slot+1) & (graph->name_table_size-1))
+    if (strcmp(graph->functions[graph->name_table[slot]-1].name, name) == 0)
+      return graph->name_table[slot]-1;
+  return -1;
+}
+
+/* index of the function of this name, created if needed; -1 if out of memory */
+static long
+intern_function(Call_graph* graph, const char* name)
+{
+  if (2*(graph->functions_number+1) > graph->name_table_size && !grow_name_table(graph))
+    return -1;
+  size_t slot = hash_name(name) & (graph->name_table_size-1);
+  for (; graph->name_table[slot] != 0; slot = (slot+1) & (graph->name_table_size-1))
+    if (strcmp(graph->functions[graph->name_table[slot]-1].name, name) == 0)
+      return graph->name_table[slot]-1;
+  if (graph->functions_number == graph->functions_capacity)
+  {
+    unsigned new_capacity = graph->functions_capacity ? 2*graph->functions_capacity : 256;
+    Function* new_functions = (Function*) realloc(graph->functions, new_capacity*sizeof(Function));
+    if (!new_functions)
+      return -1;
+    graph->functions = new_functions;
+    graph->functions_capacity = new_capacity;
+  }
+  Function* function = &graph->functions[graph->functions_number];
+  memset(function, 0, sizeof(Function));
+  function->name = strdup(name);
+  if (!function->name)
+    return -1;
+  function->index = -1;
+  graph->name_table[slot] = graph->functions_number+1;
+  return graph->functions_number++;
+}
+
+static bool
+add_call(Call_graph* graph, unsigned caller, unsigned callee)
+{
+  if (graph->calls_number == graph->calls_capacity)
+  {
+    size_t new_capacity = graph->calls_capacity ? 2*graph->calls_capacity : 1024;
+    Call* new_calls = (Call*) realloc(graph->calls, new_capacity*sizeof(Call));
+    if (!new_calls)
+      return false;
+    graph->calls = new_calls;
+    graph->calls_capacity = new_capacity;
+  }
+  graph->calls[graph->calls_number].caller = caller;
+  graph->calls[graph->calls_number].callee = callee;
+  graph->calls_number++;
+  return true;
+}
+
+int
+read_summary(Call_graph* graph, const char* file_name)
+{
+  FILE* file = fopen(file_name, "r");
+  if (!file)
+  {
+    fprintf(stderr, "Cannot open file %s\n", file_name);
+    return 1;
+  }
+  char line[4096], name[4096];
+  long caller = -1;
+  int line_number = 0;
+  while (fgets(line, sizeof(line), file))
+  {
+    ++line_number;
+    long static_size = 0, dynamic_size = 0;
+    int is_unbounded = 0;
+    unsigned indirect_calls = 0;
+    if (line[0] == '#' || line[0] == '\n')
+      continue;
+    if (line[0] == 'F' && sscanf(line, "F %4095s %ld %ld %d %u", name, &static_size,
+          &dynamic_size, &is_unbounded, &indirect_calls) == 5)
+    {
+      if ((caller = intern_function(graph, name)) < 0)
+        break;
+      Function* function = &graph->functions[caller];
+      long frame = static_size < 0 ? 0 : static_size + dynamic_size;
+      unsigned flags = (static_size < 0 ? CCA_No_frame : 0) | (is_unbounded ? CCA_Unbounded : 0)
+        | (indirect_calls ? CCA_Indirect : 0);
+      // a public function defined twice (e.g. an inline copy) keeps its worst frame
+      if (!function->is_defined || frame > function->frame)
+        function->frame = frame;
+      function->own_flags = function->is_defined ? (function->own_flags | flags) : flags;
+      function->is_defined = true;
+    }
+    else if (line[0] == 'C' && caller >= 0 && sscanf(line, "C %4095s", name) == 1)
+    {
+      long callee = intern_function(graph, name);
+      if (callee < 0 || !add_call(graph, (unsigned) caller, (unsigned) callee))
+        break;
+    }
+    else
+    {
+      fprintf(stderr, "Cannot read the callgraph summary %s\n", file_name);
+      fprintf(stderr, "  invalid line %d\n", line_number);
+      fclose(file);
+      return 1;
+    }
+  }
+  bool has_failed = !feof(file);
+  fclose(file);
+  if (has_failed)
+  {
+    fprintf(stderr, "Cannot read the callgraph summary %s\n", file_name);
+    fprintf(stderr, "  not enough memory or read error\n");
+    return 1;
+  }
+  return 0;
+}
+
+/* counting sort of the calls by caller into the edges array */
+static bool
+build_edges(Call_graph* graph)
+{
+  graph->edges = (unsigned*) malloc((graph->calls_number ? graph->calls_number : 1)*sizeof(unsigned));
+  if (!graph->edges)
+    return false;
+  for (size_t call_index = 0; call_index < graph->calls_number; ++call_index)
+  {
+    graph->functions[graph->calls[call_index].caller].edges_number++;
+    graph->functions[graph->calls[call_index].callee].is_called = true;
+  }
+  unsigned first_edge = 0;
+  for (unsigned index = 0; index < graph->functions_number; ++index)
+  {
+    graph->functions[index].first_edge = first_edge;
+    first_edge += graph->functions[index].edges_number;
+    graph->functions[index].edges_number = 0;
+  }
+  for (size_t call_index = 0; call_index < graph->calls_number; ++call_index)
+  {
+    Function* caller = &graph->functions[graph->calls[call_index].caller];
+    graph->edges[caller->first_edge + caller->edges_number++] = graph->calls[call_index].callee;
+  }
+  return true;
+}
+
+/*
+ * Iterative Tarjan algorithm. The components are numbered in the order they are
+ * completed, which is a topological order of the callees before their callers,
+ * and the depth of each component is computed at its completion.
+ */
+static bool
+compute_depths(Call_graph* graph)
+{
+  unsigned functions_number = graph->functions_number;
+  unsigned* stack = (unsigned*) malloc((functions_number+1)*sizeof(unsigned));
+  unsigned* call_stack = (unsigned*) malloc((functions_number+1)*sizeof(unsigned));
+  unsigned* next_edge = (unsigned*) calloc(functions_number+1, sizeof(unsigned));
+  if (!stack || !call_stack || !next_edge)
+  {
+    free(stack);
+    free(call_stack);
+    free(next_edge);
+    return false;
+  }
+  int current_index = 0;
+  unsigned stack_top = 0;
+  for (unsigned root = 0; root < functions_number; ++root)
+  {
+    if (graph->functions[root].index >= 0)
+      continue;
+    unsigned call_top = 0;
+    call_stack[call_top++] = root;
+    graph->functions[root].index = graph->functions[root].low_link = current_index++;
+    graph->functions[root].is_on_stack = true;
+    stack[stack_top++] = root;
+    while (call_top > 0)
+    {
+      unsigned caller_index = call_stack[call_top-1];
+      Function* caller = &graph->functions[caller_index];
+      if (next_edge[caller_index] < caller->edges_number)
+      {
+        unsigned callee_index = graph->edges[caller->first_edge + next_edge[caller_index]++];
+        Function* callee = &graph->functions[callee_index];
+        if (callee->index < 0)
+        {
+          callee->index = callee->low_link = current_index++;
+          callee->is_on_stack = true;
+          stack[stack_top++] = callee_index;
+          call_stack[call_top++] = callee_index;
+        }
+        else if (callee->is_on_stack && callee->index < caller->low_link)
+          caller->low_link = callee->index;
+        continue;
+      }
+      --call_top;
+      if (call_top > 0)
+      {
+        Function* parent = &graph->functions[call_stack[call_top-1]];
+        if (caller->low_link < parent->low_link)
+          parent->low_link = caller->low_link;
+      }
+      if (caller->low_link != caller->index)
+        continue;
+
+      // caller is the root of a component: stack[component_start..stack_top)
+      unsigned component_start = stack_top;
+      do
+        --component_start;
+      while (stack[component_start] != caller_index);
+      unsigned component = graph->components_number++;
+      bool is_recursive = stack_top - component_start > 1;
+      long frames = 0, callees_depth = 0;
+      unsigned flags = 0;
+      for (unsigned member = component_start; member < stack_top; ++member)
+        graph->functions[stack[member]].component = component;
+      // the callees out of the component are completed components
+      for (unsigned member = component_start; member < stack_top; ++member)
+      {
+        Function* function = &graph->functions[stack[member]];
+        function->is_on_stack = false;
+        frames += function->frame;
+        flags |= function->own_flags | (function->is_defined ? 0 : CCA_Unknown);
+        for (unsigned edge = 0; edge < function->edges_number; ++edge)
+        {
+          Function* callee = &graph->functions[graph->edges[function->first_edge + edge]];
+          if (callee->component == component)
+          {
+            is_recursive = is_recursive || callee == function;
+            continue;
+          }
+          if (callee->depth > callees_depth)
+            callees_depth = callee->depth;
+          flags |= callee->flags;
+        }
+      }
+      if (is_recursive)
+        flags |= CCA_Recursion;
+      for (unsigned member = component_start; member < stack_top; ++member)
+      {
+        Function* function = &graph->functions[stack[member]];
+        function->depth = frames + callees_depth;
+        function->flags = flags;
+      }
+      stack_top = component_start;
+    }
+  }
+  free(stack);
+  free(call_stack);
+  free(next_edge);
+  return true;
+}
+
+static void
+print_json_string(FILE* file, const char* text)
+{
+  fputc('"', file);
+  for (; *text; ++text)
+  {
+    if (*text == '"' || *text == '\\')
+      fputc('\\', file);
+    fputc(*text, file);
+  }
+  fputc('"', file);
+}
+
+static void
+print_function(FILE* file, const Function* function, bool is_first)
+{
+  static const char* flag_names[] = { "recursion", "indirect", "unknown", "unbounded", "noframe" };
+  fprintf(file, "%s\n    { \"name\": ", is_first ? "" : ",");
+  print_json_string(file, function->name);
+  fprintf(file, ", \"frame\": %ld, \"depth\": %ld, \"size\": %lu, \"flags\": [",
+      function->frame, function->depth, (unsigned long) function->code_size);
+  bool is_first_flag = true;
+  for (int flag = 0; flag < 5; ++flag)
+    if (function->flags & (1U << flag))
+    {
+      fprintf(file, "%s\"%s\"", is_first_flag ? "" : ", ", flag_names[flag]);
+      is_first_flag = false;
+    }
+  fprintf(file, "] }");
+}
+
+/*
+ * {"chariotstackdepth": 1, "functions": [{name, frame, depth, size, flags}...],
+ *  "recursions": [[names of a component]...], "indirect": [...], "unknown": [...]}
+ * where frame, depth and code size are in bytes and depth is a bound only without flags.
+ */
+int
+write_depths(FILE* file, const Call_graph* graph, const InputParser* parser)
+{
+  fprintf(file, "{\n  \"chariotstackdepth\": 1,\n  \"functions\": [");
+  bool is_first = true;
+  if (parser->entries_number > 0)
+  {
+    for (int entry = 0; entry < parser->entries_number; ++entry)
+    {
+      unsigned index = 0;
+      while (index < graph->functions_number && strcmp(graph->functions[index].name, parser->entries[entry]) != 0)
+        ++index;
+      if (index == graph->functions_number)
+      {
+        fprintf(stderr, "Cannot find the entry point %s\n", parser->entries[entry]);
+        return 1;
+      }
+      print_function(file, &graph->functions[index], is_first);
+      is_first = false;
+    }
+  }
+  else
+  {
+    for (unsigned index = 0; index < graph->functions_number; ++index)
+      if (graph->functions[index].is_defined && (parser->requires_all || !graph->functions[index].is_called))
+      {
+        print_function(file, &graph->functions[index], is_first);
+        is_first = false;
+      }
+  }
+
+  // the functions bucketed by component (counting sort), to print each cycle in one pass
+  unsigned* component_starts = (unsigned*) calloc(graph->components_number+1, sizeof(unsigned));
+  unsigned* members = (unsigned*) malloc((graph->functions_number+1)*sizeof(unsigned));
+  if (!component_starts || !members)
+  {
+    fprintf(stderr, "Cannot write the stack depths\n");
+    fprintf(stderr, "  not enough memory\n");
+    free(component_starts);
+    free(members);
+    return 1;
+  }
+  for (unsigned index = 0; index < graph->functions_number; ++index)
+    ++component_starts[graph->functions[index].component+1];
+  for (unsigned component = 0; component < graph->components_number; ++component)
+    component_starts[component+1] += component_starts[component];
+  for (unsigned index = 0; index < graph->functions_number; ++index)
+    members[component_starts[graph->functions[index].component]++] = index;
+  // component_starts[component] is now the end of the bucket of component
+  fprintf(file, "\n  ],\n  \"recursions\": [");
+  is_first = true;
+  for (unsigned component = 0; component < graph->components_number; ++component)
+  {
+    bool is_first_member = true;
+    unsigned member = component > 0 ? component_starts[component-1] : 0;
+    for (; member < component_starts[component]; ++member)
+    {
+      const Function* function = &graph->functions[members[member]];
+      if (!(function->flags & CCA_Recursion))
+        continue;
+      // the recursion flag may come from a callee: keep the members of a cycle
+      bool is_cycle = false;
+      for (unsigned edge = 0; edge < function->edges_number && !is_cycle; ++edge)
+        is_cycle = graph->functions[graph->edges[function->first_edge + edge]].component == component;
+      if (!is_cycle)
+        continue;
+      fprintf(file, "%s", is_first_member ? (is_first ? "\n    [" : ",\n    [") : ", ");
+      print_json_string(file, function->name);
+      is_first_member = is_first = false;
+    }
+    if (!is_first_member)
+      fprintf(file, "]");
+  }
+  free(component_starts);
+  free(members);
+
+  fprintf(file, "\n  ],\n  \"indirect\": [");
+  is_first = true;
+  for (unsigned index = 0; index < graph->functions_number; ++index)
+    if (graph->functions[index].own_flags & CCA_Indirect)
+    {
+      fprintf(file, "%s", is_first ? "" : ", ");
+      print_json_string(file, graph->functions[index].name);
+      is_first = false;
+    }
+  fprintf(file, "],\n  \"unknown\": [");
+  is_first = true;
+  for (unsigned index = 0; index < graph->functions_number; ++index)
+    if (!graph->functions[index].is_defined)
+    {
+      fprintf(file, "%s", is_first ? "" : ", ");
+      print_json_string(file, graph->functions[index].name);
+      is_first = false;
+    }
+  fprintf(file, "]\n}\n");
+  return 0;
+}
+
+static uint32_t
+read_elf_word(const unsigned char* source, bool is_little_endian)
+{
+  return is_little_endian
+    ? (uint32_t) source[0] | ((uint32_t) source[1] << 8) | ((uint32_t) source[2] << 16) | ((uint32_t) source[3] << 24)
+    : (uint32_t) source[3] | ((uint32_t) source[2] << 8) | ((uint32_t) source[1] << 16) | ((uint32_t) source[0] << 24);
+}
+
+/*
+ * code size of the functions from the STT_FUNC symbols of the firmware.
+ * A local symbol follows the STT_FILE symbol of its source file and its summary
+ * name is prefixed by the basename of this file, as done by the plugin.
+ */
+int
+read_code_sizes(Call_graph* graph, const char* file_name)
+{
+  FILE* file = fopen(file_name, "rb");
+  if (!file)
+  {
+    fprintf(stderr, "Cannot open file %s\n", file_name);
+    return 1;
+  }
+  fseek(file, 0, SEEK_END);
+  long buffer_len = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  unsigned char* buffer = buffer_len > 0 ? (unsigned char*) malloc(buffer_len) : NULL;
+  if (!buffer || fread(buffer, 1, buffer_len, file) != (size_t) buffer_len)
+  {
+    fprintf(stderr, "Cannot read file %s\n", file_name);
+    fclose(file);
+    free(buffer);
+    return 1;
+  }
+  fclose(file);
+
+  Elf32_Ehdr elf_header;
+  const char* error_message = NULL;
+  if (!fill_exe_header(&elf_header, (const char*) buffer, buffer_len, &error_message)
+      || elf_header.e_ident[4] != 1 /* ELFCLASS32 */)
+  {
+    fprintf(stderr, "Cannot read the elf header of %s\n", file_name);
+    fprintf(stderr, "  %s\n", error_message ? error_message : "not an elf32 file");
+    free(buffer);
+    return 1;
+  }
+  bool is_little_endian = elf_header.e_ident[5] == 1 /* ELFDATA2LSB */;
+  if (elf_header.e_shoff + (uint64_t) elf_header.e_shnum*40 > (uint64_t) buffer_len)
+  {
+    fprintf(stderr, "Cannot read the sections of %s\n", file_name);
+    free(buffer);
+    return 1;
+  }
+  char name[4096];
+  unsigned sizes_number = 0;
+  for (int section_index = 0; section_index < elf_header.e_shnum; ++section_index)
+  {
+    const unsigned char* section = buffer + elf_header.e_shoff + section_index*40;
+    uint32_t symbols_offset = read_elf_word(section + 16, is_little_endian);
+    uint32_t symbols_size = read_elf_word(section + 20, is_little_endian);
+    uint32_t strings_index = read_elf_word(section + 24, is_little_endian);
+    if (read_elf_word(section + 4, is_little_endian) != 2 /* SHT_SYMTAB */
+        || strings_index >= elf_header.e_shnum
+        || symbols_offset + (uint64_t) symbols_size > (uint64_t) buffer_len)
+      continue;
+    const unsigned char* strings_section = buffer + elf_header.e_shoff + strings_index*40;
+    uint32_t strings_offset = read_elf_word(strings_section + 16, is_little_endian);
+    uint32_t strings_size = read_elf_word(strings_section + 20, is_little_endian);
+    if (strings_offset + (uint64_t) strings_size > (uint64_t) buffer_len || strings_size == 0
+        || buffer[strings_offset + strings_size - 1] != '\0')
+      continue;
+    const char* strings = (const char*) buffer + strings_offset;
+    const char* translation_unit = NULL;
+    size_t translation_unit_len = 0;
+    for (uint32_t symbol_offset = 0; symbol_offset + 16 <= symbols_size; symbol_offset += 16)
+    {
+      const unsigned char* symbol = buffer + symbols_offset + symbol_offset;
+      uint32_t name_offset = read_elf_word(symbol, is_little_endian);
+      unsigned char type = symbol[12] & 0xf, binding = symbol[12] >> 4;
+      if (name_offset >= strings_size)
+        continue;
+      const char* symbol_name = strings + name_offset;
+      if (type == 4 /* STT_FILE */)
+      {
+        const char* base_name = strrchr(symbol_name, '/');
+        translation_unit = base_name ? base_name+1 : symbol_name;
+        const char* suffix = strchr(translation_unit, '.');
+        translation_unit_len = suffix ? (size_t) (suffix - translation_unit) : strlen(translation_unit);
+        continue;
+      }
+      if (type != 2 /* STT_FUNC */)
+        continue;
+      long index = -1;
+      if (binding == 0 /* STB_LOCAL */ && translation_unit
+          && translation_unit_len + 1 + strlen(symbol_name) < sizeof(name))
+      {
+        memcpy(name, translation_unit, translation_unit_len);
+        name[translation_unit_len] = ':';
+        strcpy(name + translation_unit_len + 1, symbol_name);
+        index = find_function(graph, name);
+      }
+      if (index < 0)
+        index = find_function(graph, symbol_name);
+      if (index >= 0)
+      {
+        graph->functions[index].code_size = read_elf_word(symbol + 8, is_little_endian);
+        ++sizes_number;
+      }
+    }
+  }
+  free(buffer);
+  if (sizes_number == 0)
+    fprintf(stderr, "no function of the summaries in the symbol table of %s\n", file_name);
+  return 0;
+}
+
+int
+write_binary(const Call_graph* graph, const char* file_name)
+{
+  Chariot_Codanalys_entry* entries = (Chariot_Codanalys_entry*)
+    malloc((graph->functions_number+1)*sizeof(Chariot_Codanalys_entry));
+  if (!entries)
+  {
+    fprintf(stderr, "Cannot write file %s\n", file_name);
+    fprintf(stderr, "  not enough memory\n");
+    return 1;
+  }
+  for (unsigned index = 0; index < graph->functions_number; ++index)
+  {
+    const Function* function = &graph->functions[index];
+    entries[index].name = function->name;
+    entries[index].frame = (uint32_t) function->frame;
+    entries[index].depth = (uint32_t) function->depth;
+    entries[index].flags = function->flags;
+    entries[index].code_size = function->code_size;
+    entries[index].callees = graph->edges + function->first_edge;
+    entries[index].callees_number = function->edges_number;
+  }
+  FILE* file = fopen(file_name, "wb");
+  const char* error_message = NULL;
+  int result = 0;
+  if (!file)
+  {
+    fprintf(stderr, "Cannot open file %s\n", file_name);
+    result = 1;
+  }
+  else
+  {
+    bool is_written = chariot_codanalys_write(file, entries, graph->functions_number, &error_message);
+    if (fclose(file) != 0 && is_written)
+    {
+      is_written = false;
+      error_message = "unable to write the file";
+    }
+    if (!is_written)
+    {
+      fprintf(stderr, "Cannot write file %s\n", file_name);
+      fprintf(stderr, "  %s\n", error_message);
+      result = 1;
+    }
+  }
+  free(entries);
+  return result;
+}
+
+int
+main(int argc, const char** argv)
+{
+  InputParser parser;
+  if (!fill_input_parser_fields(&parser, argc, argv))
+  {
+    input_parser_usage();
+    return 1;
+  }
+  if (parser.requires_help)
+  {
+    input_parser_usage();
+    printf("merge the callgraph summaries of the CHARIOT gcc plugin\n"
+           "and compute the worst-case stack depth of the entry points\n"
+           "\n"
+           "positional arguments:\n"
+           "  summary.chariotcg     summary of a translation unit\n"
+           "\n"
+           "optional arguments:\n"
+           "  -h, --help            show this help message and exit\n"
+           "  -v, --verbose         print the size of the merged call graph\n"
+           "  -a, --all             report every function and not only the uncalled ones\n"
+           "  -e NAME, --entry NAME\n"
+           "                        report the entry point NAME\n"
+           "  -o OUTPUT, --output OUTPUT\n"
+           "                        json output file (default: standard output)\n"
+           "  -b BINARY, --binary BINARY\n"
+           "                        also write the compact encoding of chariot_codanalys.h\n"
+           "                        to be inserted as chariotmeta_codanalys_binary\n"
+           "  --elf FIRMWARE        take the code size of the functions in the symbol\n"
+           "                        table of the linked FIRMWARE\n");
+    return 0;
+  }
+
+  Call_graph graph;
+  memset(&graph, 0, sizeof(Call_graph));
+  int result = 0;
+  for (int file_index = 0; result == 0 && file_index < parser.summary_files_number; ++file_index)
+    result = read_summary(&graph, parser.summary_files[file_index]);
+  if (result == 0 && parser.elf_file)
+    result = read_code_sizes(&graph, parser.elf_file);
+  if (result == 0 && (!build_edges(&graph) || !compute_depths(&graph)))
+  {
+    fprintf(stderr, "Cannot compute the stack depths\n");
+    fprintf(stderr, "  not enough memory\n");
+    result = 1;
+  }
+  if (result == 0)
+  {
+    if (parser.requires_verbose)
+      printf("%u functions, %lu calls, %u strongly connected components\n",
+          graph.functions_number, (unsigned long) graph.calls_number, graph.components_number);
+    FILE* output = parser.output_file ? fopen(parser.output_file, "w") : stdout;
+    if (!output)
+    {
+      fprintf(stderr, "Cannot open file %s\n", parser.output_file);
+      result = 1;
+    }
+    else
+    {
+      result = write_depths(output, &graph, &parser);
+      if (output != stdout)
+        fclose(output);
+    }
+  }
+  if (result == 0 && parser.binary_file)
+    result = write_binary(&graph, parser.binary_file);
+
+  for (unsigned index = 0; index < graph.functions_number; ++index)
+    free(graph.functions[index].name);
+  free(graph.functions);
+  free(graph.name_table);
+  free(graph.calls);
+  free(graph.edges);
+  free(parser.summary_files);
+  free(parser.entries);
+  return result;
+}
@@ -0,0 +1,103 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+
+/*
+ * Build time generator of chariot_symbol_slots.h, the perfect hash table of the
+ * symbols of chariot_metadata_schema.h used by chariot_metadata_find_field. It
+ * fails when CHARIOT_SYMBOL_SEED puts two different spellings in the same slot,
+ * after the search of a seed without collision.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "chariot_metadata_schema.h"
+
+#define CHARIOT_METADATA_SPELLINGS(ID, NAME, SYMBOL, ENCODING, SIZE, PRESENCE, PREFIX) \
+   "chariotmeta_" #NAME, SYMBOL,
+static const char* spellings[] = {
+   CHARIOT_METADATA_FIELDS(CHARIOT_METADATA_SPELLINGS)
+};
+#define SPELLINGS_NUMBER (sizeof(spellings)/sizeof(spellings[0]))
+#define SEEDS_MAX 65536
+
+static const char* slot_names[CHARIOT_SYMBOL_SLOTS_NUMBER];
+static unsigned slot_fields[CHARIOT_SYMBOL_SLOTS_NUMBER];
+
+/* the index of the first spelling in collision, SPELLINGS_NUMBER if none */
+static unsigned
+fill_slots(uint32_t seed) {
+   memset(slot_names, 0, sizeof(slot_names));
+   for (unsigned spelling = 0; spelling < SPELLINGS_NUMBER; ++spelling) {
+      uint32_t slot = chariot_hash_symbol(spellings[spelling], seed) & (CHARIOT_SYMBOL_SLOTS_NUMBER-1);
+      if (slot_names[slot] && strcmp(slot_names[slot], spellings[spelling]) != 0)
+         return spelling;
+      slot_names[slot] = spellings[spelling];
+      slot_fields[slot] = spelling/2;
+   }
+   return SPELLINGS_NUMBER;
+}
+
+int
+main(void) {
+   unsigned collision = fill_slots(CHARIOT_SYMBOL_SEED);
+   if (collision < SPELLINGS_NUMBER) {
+      fprintf(stderr, "Cannot generate chariot_symbol_slots.h\n");
+      fprintf(stderr, "  %s collides with CHARIOT_SYMBOL_SEED %u\n", spellings[collision],
+            (unsigned) CHARIOT_SYMBOL_SEED);
+      for (uint32_t seed = 0; seed < SEEDS_MAX; ++seed)
+         if (fill_slots(seed) == SPELLINGS_NUMBER) {
+            fprintf(stderr, "  the seed %u has no collision\n", (unsigned) seed);
+            return 1;
+         }
+      fprintf(stderr, "  no seed below %u without collision, increase CHARIOT_SYMBOL_SLOTS_NUMBER\n",
+            (unsigned) SEEDS_MAX);
+      return 1;
+   }
+   printf("/* generated by chariot_symbolslots_gen.exe from chariot_metadata_schema.h */\n\n");
+   printf("static const char* const symbol_slot_names[CHARIOT_SYMBOL_SLOTS_NUMBER] = {\n");
+   for (unsigned slot = 0; slot < CHARIOT_SYMBOL_SLOTS_NUMBER; ++slot)
+      if (slot_names[slot])
+         printf("   [%u] = \"%s\",\n", slot, slot_names[slot]);
+   printf("};\n\nstatic const unsigned char symbol_slot_fields[CHARIOT_SYMBOL_SLOTS_NUMBER] = {\n");
+   for (unsigned slot = 0; slot < CHARIOT_SYMBOL_SLOTS_NUMBER; ++slot)
+      if (slot_names[slot])
+         printf("   [%u] = %u,\n", slot, slot_fields[slot]);
+   printf("};\n");
+   return 0;
+}
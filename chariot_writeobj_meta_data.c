@@ -0,0 +1,341 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+
+/*
+ * Writes the relocatable elf object of the CHARIOT metadata (or with --suppldata of
+ * the supplementary data) without any assembler nor compiler.
+ * Every field is given on the command line, in the order of the section:
+ *   --field NAME VALUE       fixed-size string, st_size excludes the final '\0'
+ *   --text NAME VALUE        variable-size string, st_size includes the final '\0'
+ *   --text-file NAME FILE    same as --text with the content of FILE
+ *   --binary-file NAME FILE  raw content of FILE aligned on 4 bytes, copied by blocks
+ * and --compress NAME moves the field NAME (a --text or --text-file one) into the
+ * SHF_COMPRESSED section of the object, see chariot_metaobj.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "chariot_metaobj.h"
+
+typedef struct _InputParser {
+  Chariot_Metaobj_field* fields;
+  size_t fields_number;
+  char** loaded_contents; // one per field, NULL when the content is in argv
+  FILE** opened_files; // one per field, for the streamed --binary-file contents
+  const char** compressed_names;
+  size_t compressed_names_number;
+  Elf32_Half machine;
+  Elf32_Word flags;
+  bool requires_help : 1;
+  bool requires_verbose : 1;
+  bool is_big_endian : 1;
+  bool requires_suppldata : 1;
+  const char* output_file;
+} InputParser;
+
+void
+input_parser_usage()
+{
+  printf("usage: chariot_writeobj_meta_data.exe [-h] [--verbose] [--machine MACHINE] [--flags FLAGS]\n"
+         "                                      [--big-endian] [--suppldata]\n"
+         "                                      (--field NAME VALUE | --text NAME VALUE\n"
+         "                                      | --text-file NAME FILE | --binary-file NAME FILE)*\n"
+         "                                      [--compress NAME]* --output OUTPUT\n"
+         "\n"
+         "writes the relocatable object of the .chariotmeta.rodata section (or of the .suppldata\n"
+         "section) for the target e_machine MACHINE (default 3, EM_386) and e_flags FLAGS (default 0)\n"
+         "the fields NAME of --compress go into a zlib SHF_COMPRESSED section of the same name\n"
+         "\n");
+}
+
+char*
+load_file(const char* file_name, size_t* buffer_size)
+{
+  FILE* file = fopen(file_name, "rb");
+  if (!file)
+  {
+    fprintf(stderr, "Cannot open file %s\n", file_name);
+    return NULL;
+  }
+  fseek(file, 0, SEEK_END);
+  long int len = ftell(file);
+  if (len < 0 || len >= 20000000L)
+  {
+    fprintf(stderr, "file %s is too large to be allocated in memory\n", file_name);
+    fclose(file);
+    return NULL;
+  }
+  // one more byte for the final '\0' of --text-file
+  char* buffer = malloc(len+1);
+  if (!buffer)
+  {
+    fprintf(stderr, "buffer not allocated\n");
+    fclose(file);
+    return NULL;
+  }
+  fseek(file, 0, SEEK_SET);
+  *buffer_size = fread(buffer, 1, len, file);
+  buffer[*buffer_size] = '\0';
+  fclose(file);
+  return buffer;
+}
+
+bool
+fill_input_parser_fields(InputParser* parser, int argc, const char** argv)
+{
+  memset(parser, 0, sizeof(InputParser));
+  parser->machine = CHARIOT_METAOBJ_EM_386;
+  // at most one field for every two arguments
+  parser->fields = (Chariot_Metaobj_field*) calloc(argc/2+1, sizeof(Chariot_Metaobj_field));
+  parser->loaded_contents = (char**) calloc(argc/2+1, sizeof(char*));
+  parser->opened_files = (FILE**) calloc(argc/2+1, sizeof(FILE*));
+  parser->compressed_names = (const char**) calloc(argc/2+1, sizeof(const char*));
+  if (!parser->fields || !parser->loaded_contents || !parser->opened_files || !parser->compressed_names)
+    return false;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+      parser->requires_help = true;
+    else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0)
+      parser->requires_verbose = true;
+    else if (strcmp(argv[i], "-be") == 0 || strcmp(argv[i], "--big-endian") == 0)
+      parser->is_big_endian = true;
+    else if (strcmp(argv[i], "-sd") == 0 || strcmp(argv[i], "--suppldata") == 0)
+      parser->requires_suppldata = true;
+    else if (strcmp(argv[i], "-m") == 0 || strcmp(argv[i], "--machine") == 0
+        || strcmp(argv[i], "-fl") == 0 || strcmp(argv[i], "--flags") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      char* end = NULL;
+      unsigned long value = strtoul(argv[i], &end, 0);
+      if (!end || *end || end == argv[i])
+        return false;
+      if (argv[i-1][1] == 'm' || argv[i-1][2] == 'm')
+      {
+        if (value > 0xffff)
+          return false;
+        parser->machine = (Elf32_Half) value;
+      }
+      else
+        parser->flags = (Elf32_Word) value;
+    }
+    else if (strcmp(argv[i], "--field") == 0 || strcmp(argv[i], "--text") == 0
+        || strcmp(argv[i], "--text-file") == 0 || strcmp(argv[i], "--binary-file") == 0)
+    {
+      if (i+2 >= argc)
+        return false;
+      const char* option = argv[i];
+      Chariot_Metaobj_field* field = &parser->fields[parser->fields_number];
+      field->name = argv[++i];
+      const char* value = argv[++i];
+      if (strcmp(option, "--field") == 0 || strcmp(option, "--text") == 0)
+      {
+        field->content = value;
+        field->content_len = strlen(value)+1;
+        field->size = option[2] == 'f' ? field->content_len-1 : field->content_len;
+      }
+      else if (option[2] == 't')
+      {
+        size_t len = 0;
+        char* content = load_file(value, &len);
+        if (!content)
+          return false;
+        parser->loaded_contents[parser->fields_number] = content;
+        field->content = content;
+        field->content_len = field->size = strlen(content)+1;
+      }
+      else
+      {
+        // the payload is only measured here, chariot_metaobj_write_file copies it
+        FILE* file = fopen(value, "rb");
+        if (!file)
+        {
+          fprintf(stderr, "Cannot open file %s\n", value);
+          return false;
+        }
+        parser->opened_files[parser->fields_number] = file;
+        fseek(file, 0, SEEK_END);
+        long int len = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        if (len < 0 || len > 0x7fffffffL)
+        {
+          fprintf(stderr, "file %s is too large for an elf32 object\n", value);
+          return false;
+        }
+        field->content_file = file;
+        field->content_len = field->size = (Elf32_Word) len;
+        field->align = 4;
+      }
+      ++parser->fields_number;
+    }
+    else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--compress") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      parser->compressed_names[parser->compressed_names_number++] = argv[i];
+    }
+    else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0)
+    {
+      if (++i >= argc)
+        return false;
+      parser->output_file = argv[i];
+    }
+    else
+      return false;
+  }
+  if (parser->requires_help)
+    return true;
+  for (size_t name_index = 0; name_index < parser->compressed_names_number; ++name_index)
+  {
+    bool is_found = false;
+    for (size_t index = 0; index < parser->fields_number; ++index)
+      if (strcmp(parser->fields[index].name, parser->compressed_names[name_index]) == 0)
+      {
+        parser->fields[index].is_compressed = true;
+        is_found = true;
+      }
+    if (!is_found)
+    {
+      fprintf(stderr, "no field %s to compress\n", parser->compressed_names[name_index]);
+      return false;
+    }
+  }
+  return parser->output_file && strlen(parser->output_file) > 0;
+}
+
+void
+free_input_parser(InputParser* parser)
+{
+  if (parser->loaded_contents)
+  {
+    for (size_t index = 0; index < parser->fields_number; ++index)
+      free(parser->loaded_contents[index]);
+    free(parser->loaded_contents);
+  }
+  if (parser->opened_files)
+  {
+    for (size_t index = 0; index <= parser->fields_number; ++index)
+      if (parser->opened_files[index])
+        fclose(parser->opened_files[index]);
+    free(parser->opened_files);
+  }
+  free(parser->compressed_names);
+  free(parser->fields);
+}
+
+int
+main(int argc, const char** argv)
+{
+  InputParser parser;
+  if (!fill_input_parser_fields(&parser, argc, argv))
+  {
+    input_parser_usage();
+    free_input_parser(&parser);
+    return 1;
+  }
+  if (parser.requires_help)
+  {
+    input_parser_usage();
+    free_input_parser(&parser);
+    return 0;
+  }
+
+  Chariot_Metaobj_description description;
+  description.section = parser.requires_suppldata ? CS_Extra : CS_Meta;
+  description.machine = parser.machine;
+  description.flags = parser.flags;
+  description.is_big_endian = parser.is_big_endian;
+  description.fields = parser.fields;
+  description.fields_number = parser.fields_number;
+  description.compressed_section = NULL;
+  description.compressed_section_len = 0;
+
+  const char* error_message = NULL;
+  char* compressed_section = NULL;
+  if (!chariot_metaobj_compress(&compressed_section, &description.compressed_section_len,
+        &description, &error_message))
+  {
+    fprintf(stderr, "Cannot write the metadata object %s\n", parser.output_file);
+    fprintf(stderr, "  %s\n", error_message);
+    free_input_parser(&parser);
+    return 1;
+  }
+  description.compressed_section = compressed_section;
+  size_t size = chariot_metaobj_size(&description);
+  if (size == 0)
+  {
+    fprintf(stderr, "Cannot write the metadata object %s\n", parser.output_file);
+    fprintf(stderr, "  invalid description of the metadata object\n");
+    free(compressed_section);
+    free_input_parser(&parser);
+    return 1;
+  }
+
+  int result = 0;
+  FILE* output = fopen(parser.output_file, "wb");
+  if (!output)
+  {
+    fprintf(stderr, "Cannot write file %s\n", parser.output_file);
+    result = 1;
+  }
+  else if (!chariot_metaobj_write_file(output, &description, &error_message))
+  {
+    fprintf(stderr, "Cannot write the metadata object %s\n", parser.output_file);
+    fprintf(stderr, "  %s\n", error_message);
+    fclose(output);
+    result = 1;
+  }
+  else if (fclose(output) != 0)
+  {
+    fprintf(stderr, "Cannot write file %s\n", parser.output_file);
+    result = 1;
+  }
+  else if (parser.requires_verbose)
+    printf("%s: %u fields in %u bytes\n", parser.output_file, (unsigned) parser.fields_number,
+        (unsigned) size);
+  free(compressed_section);
+  free_input_parser(&parser);
+  return result;
+}
+
@@ -0,0 +1,505 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "chariot_zlib.h"
+
+#define ZLIB_WINDOW_SIZE 32768
+// the ring of the inflation keeps the window while the half after it is filled
+#define ZLIB_RING_SIZE (2*ZLIB_WINDOW_SIZE)
+#define ZLIB_MAX_BITS 15
+#define ZLIB_MIN_MATCH 3
+#define ZLIB_MAX_MATCH 258
+#define ZLIB_HASH_BITS 15
+#define ZLIB_CHAIN_MAX 64
+
+/* base and extra bits of the lengths 257..285 and of the distances 0..29 */
+static const uint16_t length_bases[29] = {
+   3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115,
+   131, 163, 195, 227, 258
+};
+static const uint8_t length_extras[29] = {
+   0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t distance_bases[30] = {
+   1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537,
+   2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t distance_extras[30] = {
+   0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static uint32_t
+adler32(uint32_t adler, const unsigned char* bytes, size_t len) {
+   uint32_t low = adler & 0xffff, high = adler >> 16;
+   while (len > 0) {
+      size_t block_len = len < 5552 ? len : 5552; // no overflow of high before the modulo
+      len -= block_len;
+      while (block_len-- > 0) {
+         low += *bytes++;
+         high += low;
+      }
+      low %= 65521;
+      high %= 65521;
+   }
+   return (high << 16) | low;
+}
+
+typedef struct {
+   const unsigned char* source;
+   size_t source_len, position;
+   uint32_t bit_buffer;
+   int bits_number;
+   unsigned char* ring;
+   uint64_t total, flushed; // inflated bytes, bytes given to output
+   uint32_t adler;
+   Chariot_Zlib_output output;
+   void* context;
+   bool is_stopped;
+} Inflate_state;
+
+/* canonical Huffman code: number of codes of each length and symbols by code */
+typedef struct {
+   uint16_t counts[ZLIB_MAX_BITS+1];
+   uint16_t symbols[288];
+} Huffman_code;
+
+static bool
+read_bits(uint32_t* result, Inflate_state* state, int number) {
+   while (state->bits_number < number) {
+      if (state->position >= state->source_len)
+         return false;
+      state->bit_buffer |= (uint32_t) state->source[state->position++] << state->bits_number;
+      state->bits_number += 8;
+   }
+   *result = state->bit_buffer & ((1U << number) - 1);
+   state->bit_buffer >>= number;
+   state->bits_number -= number;
+   return true;
+}
+
+static void
+flush_ring(Inflate_state* state) {
+   size_t len = (size_t) (state->total - state->flushed);
+   if (len == 0 || state->is_stopped)
+      return;
+   const unsigned char* start = state->ring + (state->flushed & (ZLIB_RING_SIZE-1));
+   state->adler = adler32(state->adler, start, len);
+   state->flushed = state->total;
+   if (!state->output(state->context, (const char*) start, len))
+      state->is_stopped = true;
+}
+
+/* false once the output has stopped the inflation */
+static inline bool
+put_byte(Inflate_state* state, unsigned char byte) {
+   state->ring[state->total++ & (ZLIB_RING_SIZE-1)] = byte;
+   if (state->total - state->flushed == ZLIB_WINDOW_SIZE)
+      flush_ring(state);
+   return !state->is_stopped;
+}
+
+static bool
+build_code(Huffman_code* code, const uint8_t* lengths, int symbols_number) {
+   uint16_t offsets[ZLIB_MAX_BITS+1];
+   memset(code->counts, 0, sizeof(code->counts));
+   for (int symbol = 0; symbol < symbols_number; ++symbol)
+      ++code->counts[lengths[symbol]];
+   int left = 1;
+   for (int len = 1; len <= ZLIB_MAX_BITS; ++len) {
+      left = 2*left - code->counts[len];
+      if (left < 0)
+         return false; // over-subscribed, an incomplete code fails at its unused codes
+   }
+   offsets[1] = 0;
+   for (int len = 1; len < ZLIB_MAX_BITS; ++len)
+      offsets[len+1] = offsets[len] + code->counts[len];
+   for (int symbol = 0; symbol < symbols_number; ++symbol)
+      if (lengths[symbol] != 0)
+         code->symbols[offsets[lengths[symbol]]++] = (uint16_t) symbol;
+   return true;
+}
+
+static bool
+decode_symbol(int* result, Inflate_state* state, const Huffman_code* code) {
+   int code_value = 0, first = 0, index = 0;
+   for (int len = 1; len <= ZLIB_MAX_BITS; ++len) {
+      uint32_t bit;
+      if (!read_bits(&bit, state, 1))
+         return false;
+      code_value |= (int) bit;
+      int count = code->counts[len];
+      if (code_value - first < count) {
+         *result = code->symbols[index + code_value - first];
+         return true;
+      }
+      index += count;
+      first = (first + count) << 1;
+      code_value <<= 1;
+   }
+   return false;
+}
+
+static bool
+inflate_codes(Inflate_state* state, const Huffman_code* lengths_code, const Huffman_code* distances_code) {
+   for (;;) {
+      int symbol;
+      if (!decode_symbol(&symbol, state, lengths_code))
+         return false;
+      if (symbol < 256) {
+         if (!put_byte(state, (unsigned char) symbol))
+            return true;
+      }
+      else if (symbol == 256)
+         return true;
+      else {
+         uint32_t extra, distance;
+         int distance_symbol;
+         symbol -= 257;
+         if (symbol >= 29 || !read_bits(&extra, state, length_extras[symbol]))
+            return false;
+         uint32_t len = length_bases[symbol] + extra;
+         if (!decode_symbol(&distance_symbol, state, distances_code) || distance_symbol >= 30
+               || !read_bits(&extra, state, distance_extras[distance_symbol]))
+            return false;
+         distance = distance_bases[distance_symbol] + extra;
+         if (distance > state->total)
+            return false;
+         while (len-- > 0)
+            if (!put_byte(state, state->ring[(state->total - distance) & (ZLIB_RING_SIZE-1)]))
+               return true;
+      }
+   }
+}
+
+static bool
+inflate_stored(Inflate_state* state) {
+   // the block starts at the next byte
+   state->bit_buffer = 0;
+   state->bits_number = 0;
+   if (state->source_len - state->position < 4)
+      return false;
+   const unsigned char* header = state->source + state->position;
+   uint32_t len = header[0] | (header[1] << 8);
+   if ((len ^ 0xffff) != (uint32_t) (header[2] | (header[3] << 8)))
+      return false;
+   state->position += 4;
+   if (state->source_len - state->position < len)
+      return false;
+   while (len-- > 0)
+      if (!put_byte(state, state->source[state->position++]))
+         return true;
+   return true;
+}
+
+static bool
+inflate_fixed(Inflate_state* state) {
+   uint8_t lengths[288];
+   Huffman_code lengths_code, distances_code;
+   memset(lengths, 8, 144);
+   memset(lengths + 144, 9, 256-144);
+   memset(lengths + 256, 7, 280-256);
+   memset(lengths + 280, 8, 288-280);
+   build_code(&lengths_code, lengths, 288);
+   memset(lengths, 5, 30);
+   build_code(&distances_code, lengths, 30);
+   return inflate_codes(state, &lengths_code, &distances_code);
+}
+
+static bool
+inflate_dynamic(Inflate_state* state) {
+   static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+   uint8_t lengths[286+30];
+   Huffman_code lengths_code, distances_code;
+   uint32_t lengths_number, distances_number, code_lengths_number;
+   if (!read_bits(&lengths_number, state, 5) || !read_bits(&distances_number, state, 5)
+         || !read_bits(&code_lengths_number, state, 4))
+      return false;
+   lengths_number += 257;
+   distances_number += 1;
+   code_lengths_number += 4;
+   if (lengths_number > 286 || distances_number > 30)
+      return false;
+   memset(lengths, 0, 19);
+   for (uint32_t index = 0; index < code_lengths_number; ++index) {
+      uint32_t len;
+      if (!read_bits(&len, state, 3))
+         return false;
+      lengths[order[index]] = (uint8_t) len;
+   }
+   if (!build_code(&lengths_code, lengths, 19))
+      return false;
+   uint32_t index = 0;
+   while (index < lengths_number + distances_number) {
+      int symbol;
+      uint32_t repeat;
+      uint8_t len = 0;
+      if (!decode_symbol(&symbol, state, &lengths_code))
+         return false;
+      if (symbol < 16) {
+         lengths[index++] = (uint8_t) symbol;
+         continue;
+      }
+      if (symbol == 16) {
+         if (index == 0 || !read_bits(&repeat, state, 2))
+            return false;
+         len = lengths[index-1];
+         repeat += 3;
+      }
+      else if (symbol == 17) {
+         if (!read_bits(&repeat, state, 3))
+            return false;
+         repeat += 3;
+      }
+      else {
+         if (!read_bits(&repeat, state, 7))
+            return false;
+         repeat += 11;
+      }
+      if (index + repeat > lengths_number + distances_number)
+         return false;
+      while (repeat-- > 0)
+         lengths[index++] = len;
+   }
+   // the end of block must have a code
+   return lengths[256] != 0
+      && build_code(&lengths_code, lengths, (int) lengths_number)
+      && build_code(&distances_code, lengths + lengths_number, (int) distances_number)
+      && inflate_codes(state, &lengths_code, &distances_code);
+}
+
+int chariot_zlib_inflate(const char* source, size_t source_len, Chariot_Zlib_output output,
+      void* context, const char** error_message) {
+   const unsigned char* bytes = (const unsigned char*) source;
+   // deflate with a window of at most 32 KiB and without preset dictionary
+   if (source_len < 2+4 || (bytes[0] & 0x0f) != 8 || (bytes[0] >> 4) > 7
+         || ((bytes[0] << 8) | bytes[1]) % 31 != 0 || (bytes[1] & 0x20)) {
+      *error_message = "invalid header of a zlib stream";
+      return false;
+   }
+   Inflate_state state;
+   memset(&state, 0, sizeof(Inflate_state));
+   state.source = bytes;
+   state.source_len = source_len;
+   state.position = 2;
+   state.adler = 1;
+   state.output = output;
+   state.context = context;
+   if (!(state.ring = (unsigned char*) malloc(ZLIB_RING_SIZE))) {
+      *error_message = "unable to allocate the window of the inflation";
+      return false;
+   }
+   bool result = true, is_last = false;
+   while (result && !is_last && !state.is_stopped) {
+      uint32_t header;
+      if (!(result = read_bits(&header, &state, 3)))
+         break;
+      is_last = header & 1;
+      if ((header >> 1) == 0)
+         result = inflate_stored(&state);
+      else if ((header >> 1) == 1)
+         result = inflate_fixed(&state);
+      else if ((header >> 1) == 2)
+         result = inflate_dynamic(&state);
+      else
+         result = false;
+   }
+   if (result && !state.is_stopped)
+      flush_ring(&state);
+   if (result && !state.is_stopped) {
+      // adler32 of the inflated bytes, big-endian, at the next byte
+      const unsigned char* trailer = bytes + state.position;
+      result = source_len - state.position >= 4
+         && state.adler == (((uint32_t) trailer[0] << 24) | ((uint32_t) trailer[1] << 16)
+               | ((uint32_t) trailer[2] << 8) | trailer[3]);
+   }
+   free(state.ring);
+   if (!result)
+      *error_message = "invalid zlib stream";
+   return result;
+}
+
+size_t chariot_zlib_deflate_bound(size_t len) {
+   // at most 9 bits per byte with the fixed code, the header, the end of block and adler32
+   // (more than the stored blocks)
+   return len + len/8 + 16;
+}
+
+typedef struct {
+   unsigned char* target;
+   size_t position;
+   uint32_t bit_buffer;
+   int bits_number;
+} Deflate_state;
+
+static void
+write_bits(Deflate_state* state, uint32_t value, int number) {
+   state->bit_buffer |= value << state->bits_number;
+   state->bits_number += number;
+   while (state->bits_number >= 8) {
+      state->target[state->position++] = (unsigned char) state->bit_buffer;
+      state->bit_buffer >>= 8;
+      state->bits_number -= 8;
+   }
+}
+
+/* the Huffman codes are stored from their most significant bit */
+static void
+write_code(Deflate_state* state, uint32_t code, int len) {
+   uint32_t reversed = 0;
+   for (int index = 0; index < len; ++index)
+      reversed |= ((code >> index) & 1) << (len - 1 - index);
+   write_bits(state, reversed, len);
+}
+
+static void
+write_fixed_symbol(Deflate_state* state, int symbol) {
+   if (symbol < 144)
+      write_code(state, 0x30 + symbol, 8);
+   else if (symbol < 256)
+      write_code(state, 0x190 + symbol - 144, 9);
+   else if (symbol < 280)
+      write_code(state, symbol - 256, 7);
+   else
+      write_code(state, 0xc0 + symbol - 280, 8);
+}
+
+static void
+write_match(Deflate_state* state, uint32_t len, uint32_t distance) {
+   int symbol = 28;
+   while (length_bases[symbol] > len)
+      --symbol;
+   write_fixed_symbol(state, 257 + symbol);
+   write_bits(state, len - length_bases[symbol], length_extras[symbol]);
+   symbol = 29;
+   while (distance_bases[symbol] > distance)
+      --symbol;
+   write_code(state, symbol, 5);
+   write_bits(state, distance - distance_bases[symbol], distance_extras[symbol]);
+}
+
+static inline uint32_t
+hash_prefix(const unsigned char* bytes) {
+   uint32_t prefix = bytes[0] | ((uint32_t) bytes[1] << 8) | ((uint32_t) bytes[2] << 16);
+   return (prefix * 2654435761U) >> (32 - ZLIB_HASH_BITS);
+}
+
+int chariot_zlib_deflate(char* target, size_t* target_len, const char* source, size_t len,
+      const char** error_message) {
+   const unsigned char* bytes = (const unsigned char*) source;
+   // the last position of each hash of 3 bytes and the previous one of each position
+   int32_t* heads = (int32_t*) malloc((1U << ZLIB_HASH_BITS)*sizeof(int32_t));
+   int32_t* previous = (int32_t*) malloc(ZLIB_WINDOW_SIZE*sizeof(int32_t));
+   if (!heads || !previous || len > 0x7fffffff) {
+      free(heads);
+      free(previous);
+      *error_message = len > 0x7fffffff ? "too large content to deflate" : "unable to allocate the deflation tables";
+      return false;
+   }
+   memset(heads, 0xff, (1U << ZLIB_HASH_BITS)*sizeof(int32_t));
+
+   Deflate_state state;
+   memset(&state, 0, sizeof(Deflate_state));
+   state.target = (unsigned char*) target;
+   state.target[state.position++] = 0x78; // deflate, 32 KiB window
+   state.target[state.position++] = 0x01; // fastest compression, (0x78 << 8 | 0x01) % 31 == 0
+   write_bits(&state, 1 /* final block */ | (1 << 1) /* fixed code */, 3);
+   size_t position = 0;
+   while (position < len) {
+      size_t best_len = 0, best_distance = 0;
+      if (len - position >= ZLIB_MIN_MATCH) {
+         size_t max_len = len - position < ZLIB_MAX_MATCH ? len - position : ZLIB_MAX_MATCH;
+         int32_t candidate = heads[hash_prefix(bytes + position)];
+         for (int chain = 0; candidate >= 0 && position - candidate <= ZLIB_WINDOW_SIZE
+               && chain < ZLIB_CHAIN_MAX; ++chain) {
+            size_t match_len = 0;
+            while (match_len < max_len && bytes[candidate + match_len] == bytes[position + match_len])
+               ++match_len;
+            if (match_len > best_len) {
+               best_len = match_len;
+               best_distance = position - candidate;
+               if (match_len == max_len)
+                  break;
+            }
+            candidate = previous[candidate & (ZLIB_WINDOW_SIZE-1)];
+         }
+      }
+      if (best_len < ZLIB_MIN_MATCH) {
+         write_fixed_symbol(&state, bytes[position]);
+         best_len = 1;
+      }
+      else
+         write_match(&state, (uint32_t) best_len, (uint32_t) best_distance);
+      for (size_t end = position + best_len; position < end; ++position)
+         if (len - position >= ZLIB_MIN_MATCH) {
+            uint32_t hash = hash_prefix(bytes + position);
+            previous[position & (ZLIB_WINDOW_SIZE-1)] = heads[hash];
+            heads[hash] = (int32_t) position;
+         }
+   }
+   write_fixed_symbol(&state, 256);
+   if (state.bits_number > 0)
+      write_bits(&state, 0, 8 - state.bits_number);
+   // the incompressible contents, like the random ones, are stored instead
+   size_t stored_blocks = len > 0 ? (len + 0xfffe)/0xffff : 1;
+   if (state.position > 2 + len + 5*stored_blocks) {
+      state.position = 2;
+      for (size_t block = 0, position = 0; block < stored_blocks; ++block) {
+         size_t block_len = len - position < 0xffff ? len - position : 0xffff;
+         state.target[state.position++] = block == stored_blocks-1; // final block, stored
+         state.target[state.position++] = (unsigned char) block_len;
+         state.target[state.position++] = (unsigned char) (block_len >> 8);
+         state.target[state.position++] = (unsigned char) ~block_len;
+         state.target[state.position++] = (unsigned char) (~block_len >> 8);
+         memcpy(state.target + state.position, bytes + position, block_len);
+         state.position += block_len;
+         position += block_len;
+      }
+   }
+   uint32_t adler = adler32(1, bytes, len);
+   for (int index = 0; index < 4; ++index)
+      state.target[state.position++] = (unsigned char) (adler >> (24 - 8*index));
+   *target_len = state.position;
+   free(heads);
+   free(previous);
+   return true;
+}
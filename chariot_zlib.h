@@ -0,0 +1,77 @@
+/*
+ *  Copyright (c) 2019-2020,
+ *  Commissariat a l'Energie Atomique (CEA)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   - Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *
+ *   - Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *   - Neither the name of CEA nor the names of its contributors may be used to
+ *     endorse or promote products derived from this software without specific 
+ *     prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ *  ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY 
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF 
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  Authors: Franck Vedrine (franck.vedrine@cea.fr)
+ *  Funding: European Union’s Horizon 2020 RIA programme
+ *     under grant agreement No 780075
+ *     CHARIOT - Cognitive Heterogeneous Architecture for Industrial IoT
+ */
+
+
+
+/*
+ * zlib streams (RFC 1950 around RFC 1951 deflate) of the SHF_COMPRESSED sections,
+ * without any external library. The inflation streams its output by pieces with a
+ * bounded memory, so that a reader can stop once it has the bytes it needs.
+ * The deflation is greedy with a fixed Huffman code, enough for the texts of the
+ * static analyses and the supplementary data.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* receives the next len inflated bytes, returns false to stop the inflation */
+typedef int (*Chariot_Zlib_output)(void* context, const char* bytes, size_t len);
+
+/*
+ * inflates the zlib stream of source_len bytes into output, by pieces of at most 32 KiB;
+ * a stop of output is a success without checking the end of the stream
+ */
+int chariot_zlib_inflate(const char* source, size_t source_len, Chariot_Zlib_output output,
+      void* context, const char** error_message);
+
+/* upper bound of the size of the zlib stream of len bytes */
+size_t chariot_zlib_deflate_bound(size_t len);
+
+/* writes into target (chariot_zlib_deflate_bound(len) bytes) the zlib stream of source */
+int chariot_zlib_deflate(char* target, size_t* target_len, const char* source, size_t len,
+      const char** error_message);
+
+#ifdef __cplusplus
+}
+#endif
+
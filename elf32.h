@@ -98,6 +98,37 @@ typedef struct {
         Elf32_Word      sh_entsize;     /* Size of each entry in section. */
 } Elf32_Shdr;
 
+/* Flag of sh_flags. */
+#define SHF_COMPRESSED  0x800   /* Section content is compressed. */
+
+/*
+ * Compression header at the beginning of a SHF_COMPRESSED section.
+ */
+
+typedef struct {
+        Elf32_Word      ch_type;        /* Compression algorithm. */
+        Elf32_Word      ch_size;        /* Size of the uncompressed content. */
+        Elf32_Word      ch_addralign;   /* Alignment of the uncompressed content. */
+} Elf32_Chdr;
+
+#define ELFCOMPRESS_ZLIB        1       /* zlib stream. */
+#define ELFCOMPRESS_ZSTD        2       /* Zstandard frame. */
+
+/*
+ * Program header.
+ */
+
+typedef struct {
+        Elf32_Word      p_type;         /* Entry type. */
+        Elf32_Off       p_offset;       /* File offset of contents. */
+        Elf32_Addr      p_vaddr;        /* Virtual address in memory image. */
+        Elf32_Addr      p_paddr;        /* Physical address (not used). */
+        Elf32_Word      p_filesz;       /* Size of contents in file. */
+        Elf32_Word      p_memsz;        /* Size of contents in memory. */
+        Elf32_Word      p_flags;        /* Access permission flags. */
+        Elf32_Word      p_align;        /* Alignment in memory and file. */
+} Elf32_Phdr;
+
 /*
  * Symbol table entries.
  */